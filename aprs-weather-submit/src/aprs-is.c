@@ -161,9 +161,10 @@ exitGracefully:
  * @param username The username with which to authenticate to the server.
  * @param password The password with which to authenticate to the server.
  * @param toSend   The APRS-IS packet, as a string.
+ * @param connectMicros If not NULL, how long the lookup and connect took, in microseconds.
  * @since 0.3
  */
-int sendPacket (const char* const restrict server, const unsigned short port, const char* const restrict username, const char* const restrict password, const char* const restrict toSend)
+int sendPacket (const char* const restrict server, const unsigned short port, const char* const restrict username, const char* const restrict password, const char* const restrict toSend, long* const connectMicros)
 {
 	int              error = 0;
 	ssize_t          bytesRead = 0;
@@ -174,7 +175,9 @@ int sendPacket (const char* const restrict server, const unsigned short port, co
 	char             verificationMessage[BUFSIZE];
 	char             buffer[BUFSIZE];
 	int              socket_desc = -1;
+	struct timespec  start;
 
+	clock_gettime( CLOCK_MONOTONIC, &start );
 	error = getaddrinfo(server, NULL, NULL, &results);
 	if (error != 0)
 	{
@@ -254,6 +257,12 @@ int sendPacket (const char* const restrict server, const unsigned short port, co
 		}
 	}
 	freeaddrinfo(results);
+	if( connectMicros )
+	{
+		struct timespec now;
+		clock_gettime( CLOCK_MONOTONIC, &now );
+		*connectMicros = (now.tv_sec - start.tv_sec) * 1000000L + (now.tv_nsec - start.tv_nsec) / 1000;
+	}
 	if( foundValidServerIP == 0 )
 	{
 		log_error( "sendPacket: could not connect to the server.  %s\n", toSend );
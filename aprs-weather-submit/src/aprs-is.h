@@ -33,13 +33,14 @@ with this program.  If not, see <https://www.gnu.org/licenses/agpl-3.0.html>.
  * @param username The username with which to authenticate to the server.
  * @param password The password with which to authenticate to the server.
  * @param toSend   The APRS-IS packet, as a string.
+ * @param connectMicros If not NULL, how long the lookup and connect took, in microseconds.
  * @since 0.3
  */
 int
 sendPacket (const char* const restrict server, const unsigned short port,
             const char* const restrict username,
             const char* const restrict password,
-            const char* const restrict toSend);
+            const char* const restrict toSend, long* const connectMicros);
 
 /* This should be defined by the operating system, but just in case... */
 #ifndef NI_MAXHOST
@@ -0,0 +1,412 @@
+//
+//  aprs_format.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Single pass replacement for the APRSPacket + printAPRSPacket() combo.  The uncompressed output is byte for byte what printAPRSPacket()
+//  produces (including the snprintf truncation quirks of its fixed size fields) but we write straight into the caller's buffer.
+//  `wxbench -v 2000000` runs both over random reports and shows any packet that differs.
+//  The compressed and positionless formats are the shorter ones from chapter 12 of the APRS 1.01 spec, mostly for the radio.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "aprs_format.h"
+#include "aprs-wx.h"
+
+
+#define kMaxPrefixLen   64
+#define kMaxWxBodyLen   80      // timestamp + position + every field we know how to write (it's about 70)
+
+// airtime estimate for 1200 baud AFSK through Direwolf, see aprs_estimate_airtime_ms()
+#define kBaudRate       1200
+#define kTxDelayMs      300     // Direwolf's default TXDELAY
+#define kTxTailMs       10
+#define kBitStuffing    1.05    // HDLC bit stuffing adds a few percent on ASCII text
+#define kMphToKnots     0.868976
+
+
+static char   s_prefix[kMaxPrefixLen]   = {0};      // "CALL>APNFOL,TCPIP*:"
+static size_t s_prefix_len              = 0;
+static char   s_position[24]            = {0};      // "DDMM.mmN/DDDMM.mmW"
+static size_t s_position_len            = 0;
+static char   s_compressed_position[12] = {0};      // "/YYYYXXXX"
+
+static time_t s_stamp_minute            = -1;       // the minute the cached timestamp below is good for
+static char   s_stamp[8]                = {0};      // "DDHHMMz"
+static time_t s_mdhm_minute             = -1;
+static char   s_mdhm[9]                 = {0};      // "MMDDHHMM" for positionless reports
+
+static const char* s_format_names[kWxFormat_count] = { "uncompressed", "compressed", "positionless" };
+
+
+static inline char* put_two( char* out, int value )
+{
+    out[0] = '0' + value / 10;
+    out[1] = '0' + value % 10;
+    return out + 2;
+}
+
+
+// lays down value the same way snprintf( out, maxChars + 1, "%.<digits>d", value ) would, truncation and all.
+// %0Nd is the same thing with one less digit when the value is negative (the width includes the sign).
+static char* put_fixed( char* out, int value, int digits, int maxChars )
+{
+    // fast path, this is nearly every field in every packet we ever send
+    if( value >= 0 && digits == maxChars && digits == 3 && value < 1000 )
+    {
+        out[0] = '0' + value / 100;
+        out[1] = '0' + (value / 10) % 10;
+        out[2] = '0' + value % 10;
+        return out + 3;
+    }
+
+    char         tmp[16];
+    char*        p = tmp + sizeof( tmp );
+    unsigned int v = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    do
+    {
+        *--p = '0' + v % 10;
+        v /= 10;
+    } while( v );
+
+    while( (tmp + sizeof( tmp )) - p < digits )
+        *--p = '0';
+
+    if( value < 0 )
+        *--p = '-';
+
+    size_t len = (tmp + sizeof( tmp )) - p;
+    if( len > maxChars )
+        len = maxChars;
+
+    memcpy( out, p, len );
+    return out + len;
+}
+
+
+// the "%03d" fields
+static inline char* put_three( char* out, int value )
+{
+    return put_fixed( out, value, value < 0 ? 2 : 3, 3 );
+}
+
+
+static char* put_timestamp( char* out, time_t when )
+{
+    time_t minute = when / 60;
+    if( minute != s_stamp_minute )
+    {
+        struct tm now;
+        gmtime_r( &when, &now ); // APRS uses GMT
+
+        char* p = put_two( s_stamp, now.tm_mday );
+        p = put_two( p, now.tm_hour );
+        p = put_two( p, now.tm_min );
+        *p = 'z';
+        s_stamp_minute = minute;
+    }
+
+    memcpy( out, s_stamp, 7 );
+    return out + 7;
+}
+
+
+static char* put_mdhm( char* out, time_t when )
+{
+    time_t minute = when / 60;
+    if( minute != s_mdhm_minute )
+    {
+        struct tm now;
+        gmtime_r( &when, &now );
+
+        char* p = put_two( s_mdhm, now.tm_mon + 1 );
+        p = put_two( p, now.tm_mday );
+        p = put_two( p, now.tm_hour );
+        p = put_two( p, now.tm_min );
+        s_mdhm_minute = minute;
+    }
+
+    memcpy( out, s_mdhm, 8 );
+    return out + 8;
+}
+
+
+static char* put_unknown( char* out, int len )
+{
+    memset( out, '.', len );
+    return out + len;
+}
+
+
+void aprs_format_init( const char* callsign, const char* destination, const char* path, double latitude, double longitude )
+{
+    int len = snprintf( s_prefix, sizeof( s_prefix ), "%s>%s,%s:", callsign, destination, path );
+    s_prefix_len = (len > 0 && len < sizeof( s_prefix )) ? len : 0;
+
+    // use the original code to do the position so it matches exactly, we only ever need to do it once
+    char lat[9];
+    char lon[10];
+    uncompressedPosition( lat, latitude,  IS_LATITUDE );
+    uncompressedPosition( lon, longitude, IS_LONGITUDE );
+
+    len = snprintf( s_position, sizeof( s_position ), "%s/%s", lat, lon );
+    s_position_len = (len > 0 && len < sizeof( s_position )) ? len : 0;
+
+    char clat[5];
+    char clon[5];
+    compressedPosition( clat, latitude,  IS_LATITUDE );
+    compressedPosition( clon, longitude, IS_LONGITUDE );
+    snprintf( s_compressed_position, sizeof( s_compressed_position ), "/%s%s", clat, clon );
+
+    s_stamp_minute = -1;
+    s_mdhm_minute  = -1;
+}
+
+
+const char* aprs_format_name( wx_format format )
+{
+    if( format < 0 || format >= kWxFormat_count )
+        return "unknown";
+    return s_format_names[format];
+}
+
+
+bool aprs_format_from_name( const char* name, wx_format* format )
+{
+    if( !name || !format )
+        return false;
+
+    for( int i = 0; i < kWxFormat_count; i++ )
+    {
+        if( strcmp( name, s_format_names[i] ) == 0 )
+        {
+            *format = (wx_format)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// returns the length of the packet or zero if it didn't fit
+size_t aprs_format_wx( char* buffer, size_t bufferSize, wx_format format, const wx_report* wx, time_t when, const char* comment )
+{
+    size_t commentLen = comment ? strlen( comment ) : 0;
+    if( !buffer || !wx || !s_prefix_len || bufferSize < s_prefix_len + kMaxWxBodyLen + commentLen + 1 )
+        return 0;
+
+    char* p = buffer;
+    memcpy( p, s_prefix, s_prefix_len );
+    p += s_prefix_len;
+
+    switch( format )
+    {
+        case kWxFormat_compressed:
+        {
+            *p++ = '@';
+            p = put_timestamp( p, when );
+            memcpy( p, s_compressed_position, 9 );
+            p += 9;
+            *p++ = '_';
+
+            // compressed course/speed is in knots, the T byte says: current fix, other source, software origin (same 'C' the old code used)
+            int direction = wx->windDirection < 0 ? 0 : wx->windDirection;
+            int speed     = wx->windSpeed < 0 ? 0 : wx->windSpeed;
+            *p++ = compressedWindDirection( direction );
+            *p++ = compressedWindSpeed( (unsigned short)(speed * kMphToKnots + 0.5) );
+            *p++ = 'C';
+            break;
+        }
+
+        case kWxFormat_positionless:
+        {
+            *p++ = '_';
+            p = put_mdhm( p, when );
+
+            *p++ = 'c';
+            p = put_three( p, wx->windDirection );
+            *p++ = 's';
+            p = put_three( p, wx->windSpeed );
+            break;
+        }
+
+        case kWxFormat_uncompressed:
+        default:
+        {
+            *p++ = '@';
+            p = put_timestamp( p, when );
+
+            memcpy( p, s_position, s_position_len );
+            p += s_position_len;
+            *p++ = '_';
+
+            // wind direction and speed are always there, gust and temp are in the fixed part of the packet but can be blank
+            p = put_three( p, wx->windDirection );
+            *p++ = '/';
+            p = put_three( p, wx->windSpeed );
+            break;
+        }
+    }
+
+    *p++ = 'g';
+    if( wx->gust != kWxFieldUnknown )
+        p = put_three( p, wx->gust );
+    else if( format == kWxFormat_uncompressed )
+    {
+        memcpy( p, "000", 3 );
+        p += 3;
+    }
+    else
+        p = put_unknown( p, 3 );
+
+    *p++ = 't';
+    if( wx->temperature != kWxFieldUnknown )
+        p = put_three( p, wx->temperature );
+    else
+        p = put_unknown( p, 3 );
+
+    if( wx->rainLastHour != kWxFieldUnknown )
+    {
+        *p++ = 'r';
+        p = put_three( p, wx->rainLastHour );
+    }
+
+    if( wx->rainLast24Hours != kWxFieldUnknown )
+    {
+        *p++ = 'p';
+        p = put_three( p, wx->rainLast24Hours );
+    }
+
+    if( wx->rainSinceMidnight != kWxFieldUnknown )
+    {
+        *p++ = 'P';
+        p = put_three( p, wx->rainSinceMidnight );
+    }
+
+    if( wx->humidity != kWxFieldUnknown )
+    {
+        *p++ = 'h';
+        p = put_fixed( p, wx->humidity, 2, 2 );
+    }
+
+    if( wx->pressure != kWxFieldUnknown )
+    {
+        *p++ = 'b';
+        p = put_fixed( p, wx->pressure, 5, 5 );
+    }
+
+    if( commentLen )
+    {
+        memcpy( p, comment, commentLen );
+        p += commentLen;
+    }
+
+    *p = '\0';
+    return p - buffer;
+}
+
+
+// swaps the CALL in front of the '>' for another one, for packets we send on behalf of the other stations we hear
+size_t aprs_format_set_source( char* packet, size_t packetSize, const char* callsign )
+{
+    char* gt = packet ? strchr( packet, '>' ) : NULL;
+    if( !gt || !callsign )
+        return 0;
+
+    size_t newLen  = strlen( callsign );
+    size_t restLen = strlen( gt ) + 1;
+    if( !newLen || newLen + restLen > packetSize )
+        return 0;
+
+    memmove( packet + newLen, gt, restLen );
+    memcpy( packet, callsign, newLen );
+    return newLen + restLen - 1;
+}
+
+
+// position report with the wx symbol, this is what lets positionless wx reports show up on a map
+size_t aprs_format_position( char* buffer, size_t bufferSize, const char* comment )
+{
+    size_t commentLen = comment ? strlen( comment ) : 0;
+    if( !buffer || !s_prefix_len || bufferSize < s_prefix_len + s_position_len + commentLen + 3 )
+        return 0;
+
+    char* p = buffer;
+    memcpy( p, s_prefix, s_prefix_len );
+    p += s_prefix_len;
+
+    *p++ = '!';
+    memcpy( p, s_position, s_position_len );
+    p += s_position_len;
+    *p++ = '_';
+
+    if( commentLen )
+    {
+        memcpy( p, comment, commentLen );
+        p += commentLen;
+    }
+
+    *p = '\0';
+    return p - buffer;
+}
+
+
+static inline char* put_base91_pair( char* out, int value )
+{
+    if( value < 0 )
+        value = 0;
+    else if( value > kTelemetryMaxValue )
+        value = kTelemetryMaxValue;
+
+    out[0] = '!' + value / 91;
+    out[1] = '!' + value % 91;
+    return out + 2;
+}
+
+
+// writes the |ss1122334455| block that goes on the end of a comment, values are clamped to 0-8280 so scale them first
+size_t aprs_format_telemetry( char* buffer, size_t bufferSize, int sequence, const int* values, int count )
+{
+    if( !buffer || !values || count < 1 || count > kTelemetryChannels || bufferSize < (count + 1) * 2 + 3 )
+        return 0;
+
+    char* p = buffer;
+    *p++ = '|';
+    p = put_base91_pair( p, sequence % (kTelemetryMaxValue + 1) );
+
+    for( int i = 0; i < count; i++ )
+        p = put_base91_pair( p, values[i] );
+
+    *p++ = '|';
+    *p = '\0';
+    return p - buffer;
+}
+
+
+// rough time on air for a TNC2 style packet going out as AX.25 at 1200 baud: 7 bytes per address, control + PID, info, FCS, flags.
+int aprs_estimate_airtime_ms( const char* packet )
+{
+    if( !packet )
+        return 0;
+
+    const char* info = strchr( packet, ':' );
+    if( !info )
+        return 0;
+
+    // source and destination plus one for every digipeater in the path
+    int addresses = 2;
+    for( const char* c = packet; c < info; c++ )
+        if( *c == ',' )
+            ++addresses;
+
+    size_t frameBytes = addresses * 7 + 2 + strlen( info + 1 ) + 2;
+    double bits       = frameBytes * 8 * kBitStuffing + 16;  // plus opening and closing flag
+
+    return kTxDelayMs + (int)(bits * 1000.0 / kBaudRate + 0.5) + kTxTailMs;
+}
@@ -0,0 +1,56 @@
+//
+//  aprs_format.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_aprs_format
+#define _H_aprs_format
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+// the wire formats we can send wx out in, each destination gets to pick one
+typedef enum
+{
+    kWxFormat_uncompressed = 0,     // @DDHHMMzDDMM.mmN/DDDMM.mmW_ddd/sssgggttt...  (what we've always sent)
+    kWxFormat_compressed,           // @DDHHMMz/YYYYXXXX_csTgggttt...  base-91 position, direction and speed
+    kWxFormat_positionless,         // _MMDDHHMMcdddsssgggttt...  needs a position beacon every once in a while
+    kWxFormat_count
+} wx_format;
+
+// base-91 comment telemetry: |ss1122334455| -- sequence plus up to five analog channels, two base-91 digits each
+#define kTelemetryChannels  5
+#define kTelemetryMaxValue  (91 * 91 - 1)
+
+// use this for any field we don't have a measurement for, it gets left out of the packet (same as the dots in APRSPacket)
+#define kWxFieldUnknown  INT32_MIN
+
+// everything in here is already in APRS units, the formatter just lays the digits down
+typedef struct
+{
+    int windDirection;      // degrees
+    int windSpeed;          // mph
+    int gust;               // mph
+    int temperature;        // °F
+    int rainLastHour;       // hundredths of an inch
+    int rainLast24Hours;    // hundredths of an inch
+    int rainSinceMidnight;  // hundredths of an inch
+    int humidity;           // APRS style: 1-99, 0 means 100%
+    int pressure;           // tenths of millibars
+} wx_report;
+
+void        aprs_format_init( const char* callsign, const char* destination, const char* path, double latitude, double longitude );
+size_t      aprs_format_wx( char* buffer, size_t bufferSize, wx_format format, const wx_report* wx, time_t when, const char* comment );
+size_t      aprs_format_position( char* buffer, size_t bufferSize, const char* comment );
+size_t      aprs_format_set_source( char* packet, size_t packetSize, const char* callsign );
+size_t      aprs_format_telemetry( char* buffer, size_t bufferSize, int sequence, const int* values, int count );
+int         aprs_estimate_airtime_ms( const char* packet );
+const char* aprs_format_name( wx_format format );
+bool        aprs_format_from_name( const char* name, wx_format* format );
+
+#endif // !_H_aprs_format
@@ -0,0 +1,664 @@
+//
+//  bench.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Microbenchmarks for the relay's hot paths.  This links main.c built with WXRELAY_NO_MAIN and the wiringPiI2C stub in stubs/,
+//  so it runs anywhere- the Pi, a laptop, a build box.  The wxlog functions are measured against a realistic history (a day of
+//  frames every 5 seconds) and the worst case (the log full to kMaxNumberOfRecords).  It's built with the same flags as wxrelay
+//  so the numbers are for the code the Pi actually runs.
+//
+//  Every result is one line of JSON on stdout so runs from different machines can be kept, diffed and graphed:
+//    {"bench":"wxlog_get_wx_averages","history":"day","records":17280,"machine":"armv7l","samples":7,"iterations":64,"ns_per_op":...}
+//  ns_per_op is the median of the samples, min and max are there to tell a noisy run from a real regression.
+//
+//  The rain totals are measured with a day of tips (one a minute) in the accumulator.
+//
+//  The ingest server is measured over loopback with the bench playing every node: how long taking a connection takes, and what
+//  a frame costs from write() to coming out of the merge with 1, 64 and 1000 nodes connected ("history" is the node count).
+//
+//  -v checks aprs_format_wx() against the APRSPacket + printAPRSPacket() it replaced instead: that many random reports (out of range
+//  values and missing rain included) go through both and any packet that isn't byte for byte the same is printed.  It exits non-zero
+//  if there were any.
+//
+//  usage: wxbench [-t millis per sample] [-n samples] [-v reports to check [-s seed]] [name filter]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+
+#include "main.h"
+#include "ingest.h"
+#include "rain_accum.h"
+#include "receivers.h"
+#include "aprs-wx.h"
+#include "aprs_format.h"
+#include "ax25_pad.h"
+#include "kiss_frame.h"
+
+
+#define kDefaultSampleMillis    100
+#define kDefaultSamples         7
+#define kMaxSamples             64
+#define kDaySecs                (60 * 60 * 24)
+#define kFrameIntervalSecs      5               // how often the TX31U sends
+#define kIngestMaxNodes         1000            // under kIngestMaxConnections
+#define kIngestBatch            32              // frames written before reading them back out of the merge
+#define kIngestAcceptNs         5000000000ull   // a connection the server hasn't taken by now isn't going to be
+#define kVerifyMaxMismatches    10              // printed before we stop bothering
+#define kLatitude               34.108
+#define kLongitude              -118.3349371
+
+
+typedef void (*bench_fn)( void* context, size_t iterations );
+
+typedef struct
+{
+    const char* name;
+    size_t      records;       // frames asked for, SIZE_MAX means as many as the wxlog will hold
+    time_t      spanSecs;
+} history_size;
+
+typedef struct
+{
+    int*     fds;
+    int      count;
+    uint32_t sent;
+} ingest_nodes;
+
+typedef struct
+{
+    uint32_t count;
+    time_t   now;
+} rain_gauge;
+
+static rain_gauge s_gauge;
+
+static const int s_ingest_nodes[] = { 1, 64, kIngestMaxNodes };     // one ESP32 up to more than we'll ever have
+
+static const history_size s_history_sizes[] =
+{
+    { "day", kDaySecs / kFrameIntervalSecs, kDaySecs },     // steady state, the log stops growing once it spans a day
+    { "max", SIZE_MAX,                      kDaySecs },     // a faster transmitter fills the whole thing
+};
+
+static int          s_sample_millis = kDefaultSampleMillis;
+static int          s_samples       = kDefaultSamples;
+static const char*  s_filter        = NULL;
+static char         s_machine[sizeof( ((struct utsname*)0)->machine )] = "unknown";
+static Frame        s_frame;
+static volatile int s_sink          = 0;       // keeps the compiler from throwing the work away
+
+static const char*  s_tnc2_packet   = "K6LOT-13>APNFOL,WIDE2-1:@181200z3406.48N/11820.10W_270/005g012t072r001p010P008h45b10132folabs-wx-relay120";
+
+
+
+static uint64_t now_ns( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static int compare_doubles( const void* a, const void* b )
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return da < db ? -1 : da > db ? 1 : 0;
+}
+
+
+// reset is run before every sample (outside the timing) for benchmarks that wear out their own setup
+static void run( const char* name, const char* history, size_t records, bench_fn fn, bench_fn reset, void* context, size_t maxIterations )
+{
+    if( s_filter && !strstr( name, s_filter ) )
+        return;
+
+    // find how many iterations fill a sample
+    uint64_t target     = (uint64_t)s_sample_millis * 1000000ull;
+    size_t   iterations = 1;
+    for( ;; )
+    {
+        if( reset )
+            reset( context, 0 );
+        uint64_t start   = now_ns();
+        fn( context, iterations );
+        uint64_t elapsed = now_ns() - start;
+        if( elapsed >= target / 4 || iterations >= maxIterations )
+        {
+            if( elapsed && elapsed < target )
+                iterations = (size_t)(iterations * ((double)target / elapsed));
+            break;
+        }
+        iterations *= 2;
+    }
+    if( !iterations )
+        iterations = 1;
+    if( iterations > maxIterations )
+        iterations = maxIterations;
+
+    double ns_per_op[kMaxSamples];
+    for( int i = 0; i < s_samples; i++ )
+    {
+        if( reset )
+            reset( context, 0 );
+        uint64_t start = now_ns();
+        fn( context, iterations );
+        ns_per_op[i] = (double)(now_ns() - start) / iterations;
+    }
+    qsort( ns_per_op, s_samples, sizeof( double ), compare_doubles );
+
+    printf( "{\"bench\":\"%s\",\"history\":\"%s\",\"records\":%zu,\"machine\":\"%s\",\"samples\":%d,\"iterations\":%zu,\"ns_per_op\":%.1f,\"min_ns_per_op\":%.1f,\"max_ns_per_op\":%.1f}\n",
+            name, history, records, s_machine, s_samples, iterations, ns_per_op[s_samples / 2], ns_per_op[0], ns_per_op[s_samples - 1] );
+    fflush( stdout );
+}
+
+
+
+#pragma mark -
+
+static void bench_crc( void* context, size_t iterations )
+{
+    for( size_t i = 0; i < iterations; i++ )
+        s_sink += calculate_crc( (uint8_t*)&s_frame, sizeof( Frame ) );
+}
+
+
+static void bench_update_stats( void* context, size_t iterations )
+{
+    Frame min = s_frame;
+    Frame max = s_frame;
+    Frame ave = s_frame;
+    for( size_t i = 0; i < iterations; i++ )
+    {
+        Frame frame = s_frame;     // updateStats clears flags on anything it throws out
+        updateStats( &frame, &min, &max, &ave );
+        s_sink += frame.flags;
+    }
+}
+
+
+static void bench_wxlog_frame( void* context, size_t iterations )
+{
+    for( size_t i = 0; i < iterations; i++ )
+        s_sink += wxlog_frame( &s_frame );
+}
+
+
+static void bench_wxlog_averages( void* context, size_t iterations )
+{
+    Frame wx;
+    for( size_t i = 0; i < iterations; i++ )
+        s_sink += wxlog_get_wx_averages( &wx );
+}
+
+
+// a tip a minute for a whole day, the gauge's clock keeps going from there
+static size_t seed_rain( void )
+{
+    s_gauge.now = time( NULL ) - kDaySecs;
+    for( int i = 0; i <= kDaySecs / 60; i++, s_gauge.now += 60 )
+        rain_accum_count( ++s_gauge.count, s_gauge.now );
+
+    rain_accum_stats stats;
+    rain_accum_get_stats( &stats );
+    return stats.buffered;
+}
+
+
+// steady state: one tip comes in, one falls out of each window
+static void bench_rain_count( void* context, size_t iterations )
+{
+    for( size_t i = 0; i < iterations; i++ )
+    {
+        s_gauge.now += 60;
+        rain_accum_count( ++s_gauge.count, s_gauge.now );
+    }
+}
+
+
+static void bench_rain_totals( void* context, size_t iterations )
+{
+    rain_totals totals;
+    for( size_t i = 0; i < iterations; i++ )
+    {
+        rain_accum_get_totals( s_gauge.now, &totals );
+        s_sink += totals.last24Hours;
+    }
+}
+
+
+static void reseed_history( void* context, size_t iterations )
+{
+    const history_size* size = (const history_size*)context;
+    wxlog_seed( &s_frame, size->records, size->spanSecs );
+}
+
+
+// the wxlog only keeps its size while the oldest frame is a day old, inserts push frames out the back without time moving
+// so this one gets a two day history and stops well before it has pushed out half of it
+static void reseed_history_for_inserts( void* context, size_t iterations )
+{
+    const history_size* size = (const history_size*)context;
+    wxlog_seed( &s_frame, size->records, size->spanSecs * 2 );
+}
+
+
+static void bench_aprs_format( void* context, size_t iterations )
+{
+    wx_report report = { .windDirection = 270, .windSpeed = 5, .gust = 12, .temperature = 72, .rainLastHour = 1, .rainLast24Hours = 10,
+                         .rainSinceMidnight = 8, .humidity = 45, .pressure = 10132 };
+    char      packet[BUFSIZE];
+    time_t    now = time( NULL );
+    for( size_t i = 0; i < iterations; i++ )
+        s_sink += aprs_format_wx( packet, sizeof( packet ), kWxFormat_uncompressed, &report, now, PROGRAM_NAME VERSION );
+}
+
+
+static void bench_print_aprs_packet( void* context, size_t iterations )
+{
+    APRSPacket wx;
+    char       packet[BUFSIZE];
+
+    packetConstructor( &wx );
+    uncompressedPosition( wx.latitude,  kLatitude,  IS_LATITUDE );
+    uncompressedPosition( wx.longitude, kLongitude, IS_LONGITUDE );
+    snprintf( wx.callsign,              10, "K6LOT-13" );
+    snprintf( wx.windDirection,          4, "%03d", 270 );
+    snprintf( wx.windSpeed,              4, "%03d", 5 );
+    snprintf( wx.gust,                   4, "%03d", 12 );
+    snprintf( wx.temperature,            4, "%03d", 72 );
+    snprintf( wx.humidity,               3, "%.2d", 45 );
+    snprintf( wx.pressure,               6, "%.5d", 10132 );
+    snprintf( wx.rainfallLastHour,       4, "%03d", 1 );
+    snprintf( wx.rainfallLast24Hours,    4, "%03d", 10 );
+    snprintf( wx.rainfallSinceMidnight,  4, "%03d", 8 );
+
+    for( size_t i = 0; i < iterations; i++ )
+    {
+        printAPRSPacket( &wx, packet, UNCOMPRESSED_PACKET, 0, false );
+        s_sink += packet[0];
+    }
+}
+
+
+static void bench_ax25( void* context, size_t iterations )
+{
+    char          text[BUFSIZE];
+    unsigned char frame[AX25_MAX_PACKET_LEN];
+    for( size_t i = 0; i < iterations; i++ )
+    {
+        strcpy( text, s_tnc2_packet );     // ax25_from_text scribbles on its input
+        packet_t pp = ax25_from_text( text, 1 );
+        if( pp )
+        {
+            s_sink += ax25_pack( pp, frame );
+            ax25_delete( pp );
+        }
+    }
+}
+
+
+static void bench_kiss( void* context, size_t iterations )
+{
+    unsigned char frame[AX25_MAX_PACKET_LEN + 1];
+    unsigned char kissed[2 * sizeof( frame ) + 2];
+    char          text[BUFSIZE];
+
+    strcpy( text, s_tnc2_packet );
+    packet_t pp = ax25_from_text( text, 1 );
+    if( !pp )
+        return;
+    frame[0] = 0;   // channel 0, data frame
+    int len = ax25_pack( pp, frame + 1 ) + 1;
+    ax25_delete( pp );
+
+    for( size_t i = 0; i < iterations; i++ )
+        s_sink += kiss_encapsulate( frame, len, kissed );
+}
+
+
+
+#pragma mark -
+
+static void wait_for_connections( uint32_t count )
+{
+    ingest_stats stats;
+    for( int i = 0; i < 5000; i++ )
+    {
+        ingest_get_stats( &stats );
+        if( stats.connections == count )
+            return;
+        usleep( 1000 );
+    }
+}
+
+
+static int connect_to_ingest( void )
+{
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_port = htons( ingest_port( 0 ) ), .sin_addr.s_addr = htonl( INADDR_LOOPBACK ) };
+    int                fd      = socket( AF_INET, SOCK_STREAM, 0 );
+    if( fd >= 0 && connect( fd, (struct sockaddr*)&address, sizeof( address ) ) < 0 )
+    {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+
+// connect, have the ingest thread accept it, hang up
+static void bench_ingest_connect( void* context, size_t iterations )
+{
+    ingest_stats stats;
+    ingest_get_stats( &stats );
+    uint64_t accepted = stats.accepted;
+    uint64_t rejected = stats.rejected;
+
+    for( size_t i = 0; i < iterations; i++ )
+    {
+        int fd = connect_to_ingest();
+        if( fd < 0 )
+            return;
+
+        // turned away (the pool is full) or never picked up, either way there's nothing left to time
+        uint64_t deadline = now_ns() + kIngestAcceptNs;
+        do
+        {
+            sched_yield();
+            ingest_get_stats( &stats );
+        } while( stats.accepted == accepted && stats.rejected == rejected && now_ns() < deadline );
+        close( fd );
+
+        if( stats.accepted == accepted )
+        {
+            fprintf( stderr, "the ingest server %s a connection, ingest_connect is off\n", stats.rejected != rejected ? "turned away" : "never accepted" );
+            return;
+        }
+        accepted = stats.accepted;
+    }
+}
+
+
+// a frame from each node in turn, through the epoll loop, the framer and the merge, in batches so the ring never fills
+static void bench_ingest_frames( void* context, size_t iterations )
+{
+    ingest_nodes* nodes = (ingest_nodes*)context;
+    Frame         frame = s_frame;
+    Frame         merged;
+
+    for( size_t done = 0; done < iterations; )
+    {
+        size_t batch = iterations - done < kIngestBatch ? iterations - done : kIngestBatch;
+        for( size_t i = 0; i < batch; i++ )
+        {
+            // every one has to be different or the merge throws it out as a copy
+            frame.tempC = (float)(++nodes->sent % 100000) / 1000;
+            frame.CRC   = 0;
+            frame.CRC   = calculate_crc( (uint8_t*)&frame, sizeof( Frame ) );
+            if( write( nodes->fds[nodes->sent % nodes->count], &frame, sizeof( Frame ) ) != sizeof( Frame ) )
+                return;
+        }
+        for( size_t i = 0; i < batch; i++ )
+            if( receivers_next( &merged, NULL, 1000 ) )
+                s_sink += merged.station_id;
+        done += batch;
+    }
+}
+
+
+static void run_ingest( void )
+{
+    if( s_filter && !strstr( "ingest_connect ingest_frames", s_filter ) )
+        return;
+
+    // the bench is both ends of every connection
+    struct rlimit limit;
+    if( getrlimit( RLIMIT_NOFILE, &limit ) == 0 )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit( RLIMIT_NOFILE, &limit );
+    }
+
+    if( !ingest_parse_option( "wx:127.0.0.1:0" ) || !receivers_start() || !ingest_start() )
+    {
+        fprintf( stderr, "couldn't start the ingest server\n" );
+        return;
+    }
+    run( "ingest_connect", "none", 0, bench_ingest_connect, NULL, NULL, SIZE_MAX );
+
+    static int   fds[kIngestMaxNodes];
+    ingest_nodes nodes = { .fds = fds };
+    for( size_t i = 0; i < sizeof( s_ingest_nodes ) / sizeof( s_ingest_nodes[0] ); i++ )
+    {
+        while( nodes.count < s_ingest_nodes[i] )
+        {
+            fds[nodes.count] = connect_to_ingest();
+            if( fds[nodes.count] < 0 )
+            {
+                fprintf( stderr, "couldn't connect %d nodes to the ingest server\n", s_ingest_nodes[i] );
+                return;
+            }
+            ++nodes.count;
+        }
+        wait_for_connections( nodes.count );
+
+        char label[32];
+        snprintf( label, sizeof( label ), "%d nodes", nodes.count );
+        run( "ingest_frames", label, nodes.count, bench_ingest_frames, NULL, &nodes, SIZE_MAX );
+    }
+
+    for( int i = 0; i < nodes.count; i++ )
+        close( fds[i] );
+    ingest_shutdown();
+    receivers_shutdown();
+}
+
+
+#pragma mark -
+
+// mostly what a real station sends, every so often something the formatter has to truncate the same way snprintf would
+static int random_field( int low, int high )
+{
+    switch( random() % 16 )
+    {
+        case 0:  return -(int)(random() % 100000);
+        case 1:  return (int)(random() % 10000000);
+        case 2:  return random() & 1 ? INT32_MAX : INT32_MIN + 1;     // INT32_MIN is kWxFieldUnknown
+        default: return low + (int)(random() % (high - low + 1));
+    }
+}
+
+
+static void random_report( wx_report* report )
+{
+    report->windDirection = random_field( 0, 360 );
+    report->windSpeed     = random_field( 0, 60 );
+    report->gust          = random_field( 0, 90 );
+    report->temperature   = random_field( -20, 120 );
+    report->humidity      = random_field( 0, 99 );
+    report->pressure      = random_field( 9500, 10500 );
+    if( random() % 4 )
+    {
+        report->rainLastHour      = random_field( 0, 200 );
+        report->rainLast24Hours   = random_field( 0, 500 );
+        report->rainSinceMidnight = random_field( 0, 500 );
+    }
+    else
+        report->rainLastHour = report->rainLast24Hours = report->rainSinceMidnight = kWxFieldUnknown;
+}
+
+
+// what transmit_wx_frame() did before aprs_format.c
+// random_field() hands out values too big for the field on purpose, this cuts them off at 3 characters just like snprintf( field, 4 )
+// did without -O2 warning that "%03d" might not fit
+static void put_three_chars( char* field, int value )
+{
+    char digits[16];
+    snprintf( digits, sizeof( digits ), "%03d", value );
+    snprintf( field, 4, "%.3s", digits );
+}
+
+
+static void print_aprs_report( const wx_report* report, char* packet )
+{
+    APRSPacket wx;
+    packetConstructor( &wx );
+
+    uncompressedPosition( wx.latitude,  kLatitude,  IS_LATITUDE );
+    uncompressedPosition( wx.longitude, kLongitude, IS_LONGITUDE );
+
+    snprintf( wx.callsign,      10, "K6LOT-13" );
+    snprintf( wx.windDirection,  4, "%03d", report->windDirection );
+    snprintf( wx.windSpeed,      4, "%03d", report->windSpeed );
+    snprintf( wx.gust,           4, "%03d", report->gust );
+    snprintf( wx.temperature,    4, "%03d", report->temperature );
+    snprintf( wx.humidity,       3, "%.2d", report->humidity );
+    snprintf( wx.pressure,       6, "%.5d", report->pressure );
+
+    if( report->rainLastHour != kWxFieldUnknown )
+    {
+        put_three_chars( wx.rainfallLastHour,      report->rainLastHour );
+        put_three_chars( wx.rainfallLast24Hours,   report->rainLast24Hours );
+        put_three_chars( wx.rainfallSinceMidnight, report->rainSinceMidnight );
+    }
+
+    memset( packet, 0, BUFSIZE );
+    printAPRSPacket( &wx, packet, UNCOMPRESSED_PACKET, 0, false );
+    strcat( packet, PROGRAM_NAME );
+    strcat( packet, VERSION );
+}
+
+
+static int verify_aprs_format( long count, unsigned seed )
+{
+    char   old[BUFSIZE];
+    char   packet[BUFSIZE];
+    long   mismatches = 0;
+    long   retries    = 0;
+
+    srandom( seed );
+    for( long i = 0; i < count; i++ )
+    {
+        wx_report report;
+        random_report( &report );
+
+        // printAPRSPacket() reads the clock itself, go again if the minute turned over in between
+        time_t now;
+        do
+        {
+            now = time( NULL );
+            aprs_format_wx( packet, sizeof( packet ), kWxFormat_uncompressed, &report, now, PROGRAM_NAME VERSION );
+            print_aprs_report( &report, old );
+        } while( time( NULL ) / 60 != now / 60 && ++retries );
+
+        if( strcmp( old, packet ) != 0 && ++mismatches <= kVerifyMaxMismatches )
+            printf( "mismatch:\n  old: %s\n  new: %s\n", old, packet );
+    }
+
+    printf( "{\"verify\":\"aprs_format_wx\",\"reports\":%ld,\"seed\":%u,\"mismatches\":%ld,\"retries\":%ld}\n", count, seed, mismatches, retries );
+    return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+
+#pragma mark -
+
+int main( int argc, const char* argv[] )
+{
+    long     verify = 0;
+    unsigned seed   = 1;
+    int      opt;
+    while( (opt = getopt( argc, (char* const*)argv, "t:n:v:s:h" )) != -1 )
+    {
+        switch( opt )
+        {
+            case 't':
+                s_sample_millis = atoi( optarg );
+                break;
+            case 'n':
+                s_samples = atoi( optarg );
+                break;
+            case 'v':
+                verify = atol( optarg );
+                break;
+            case 's':
+                seed = (unsigned)strtoul( optarg, NULL, 0 );
+                break;
+            default:
+                fprintf( stderr, "usage: %s [-t millis per sample (%d)] [-n samples (%d)] [-v reports to check [-s seed]] [name filter]\n", argv[0], kDefaultSampleMillis, kDefaultSamples );
+                return EXIT_FAILURE;
+        }
+    }
+    if( optind < argc )
+        s_filter = argv[optind];
+    if( s_sample_millis <= 0 )
+        s_sample_millis = kDefaultSampleMillis;
+    if( s_samples <= 0 || s_samples > kMaxSamples )
+        s_samples = kDefaultSamples;
+
+    struct utsname name;
+    if( uname( &name ) == 0 )
+        snprintf( s_machine, sizeof( s_machine ), "%s", name.machine );
+
+    // a plausible frame with every field present, it has to get through updateStats without being thrown out
+    memset( &s_frame, 0, sizeof( Frame ) );
+    s_frame.flags         = kDataFlag_temp | kDataFlag_humidity | kDataFlag_wind | kDataFlag_gust | kDataFlag_rain | kDataFlag_intTemp | kDataFlag_pressure | kDataFlag_airQuality;
+    s_frame.tempC         = 22.5f;
+    s_frame.humidity      = 45;
+    s_frame.windSpeedMs   = 2.2f;
+    s_frame.windDirection = 270;
+    s_frame.windGustMs    = 5.4f;
+    s_frame.rain          = 12.3f;
+    s_frame.intTempC      = 24.0f;
+    s_frame.pressure      = 1013.2f;
+    s_frame.pm25_standard = 12;
+    s_frame.CRC           = 0;     // same as process_wx_frame() checks it
+    s_frame.CRC           = calculate_crc( (uint8_t*)&s_frame, sizeof( Frame ) );
+
+    aprs_format_init( "K6LOT-13", "APNFOL", "TCPIP*", kLatitude, kLongitude );
+    if( verify > 0 )
+        return verify_aprs_format( verify, seed );
+
+    run( "calculate_crc",    "none", 0, bench_crc,               NULL, NULL, SIZE_MAX );
+    run( "updateStats",      "none", 0, bench_update_stats,      NULL, NULL, SIZE_MAX );
+    run( "aprs_format_wx",   "none", 0, bench_aprs_format,       NULL, NULL, SIZE_MAX );
+    run( "printAPRSPacket",  "none", 0, bench_print_aprs_packet, NULL, NULL, SIZE_MAX );
+    run( "ax25_from_text+ax25_pack", "none", 0, bench_ax25,      NULL, NULL, SIZE_MAX );
+    run( "kiss_encapsulate", "none", 0, bench_kiss,              NULL, NULL, SIZE_MAX );
+
+    for( size_t i = 0; i < sizeof( s_history_sizes ) / sizeof( s_history_sizes[0] ); i++ )
+    {
+        history_size size = s_history_sizes[i];
+        size.records = wxlog_seed( &s_frame, size.records, size.spanSecs );
+        if( !size.records )
+        {
+            fprintf( stderr, "couldn't set up a %s sized wx history\n", size.name );
+            return EXIT_FAILURE;
+        }
+
+        run( "wxlog_frame",           size.name, size.records, bench_wxlog_frame,    reseed_history_for_inserts, &size, size.records / 4 );
+        run( "wxlog_get_wx_averages", size.name, size.records, bench_wxlog_averages, reseed_history,             &size, SIZE_MAX );
+    }
+
+    size_t tips = seed_rain();
+    run( "rain_accum_count",      "day", tips, bench_rain_count,  NULL, NULL, SIZE_MAX );
+    run( "rain_accum_get_totals", "day", tips, bench_rain_totals, NULL, NULL, SIZE_MAX );
+
+    run_ingest();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,423 @@
+//
+//  capture.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Records the raw bytes from the receivers so when something odd shows up (a 700 MPH gust...) we can see exactly what came in and
+//  when.  The serial readers hand every chunk to capture_chunk(), which stamps it and copies it into a slot of a lock-free ring, the
+//  same bounded multi-producer, single consumer ring logging.c uses.  A writer thread drains the ring through a big stdio buffer and
+//  rotates the file to path.1, path.2... when it gets too big.  The buffer is only flushed once the oldest thing in it has waited
+//  kCaptureFlushSecs (or the buffer fills, or we rotate or shut down) so the SD card sees a few big writes rather than one per frame.
+//  If the ring is full the chunk is dropped and counted, the readers never wait on the SD card.
+//
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "capture.h"
+#include "metrics.h"
+#include "wx_thread.h"
+
+
+#define kCaptureSlots       1024        // must be a power of two, ~150k
+#define kCaptureSlotMask    (kCaptureSlots - 1)
+#define kCaptureFileBuffer  (64 * 1024)
+#define kCaptureMaxBytes    (16 * 1024 * 1024)
+#define kCaptureKeep        4           // the current file plus path.1 to path.3
+#define kCaptureFlushSecs   10          // longest a chunk sits in the stdio buffer, what a crash can cost us
+
+
+typedef struct
+{
+    atomic_size_t  sequence;
+    capture_record record;
+    uint8_t        data[kCaptureChunkMax];
+} capture_slot;
+
+
+static capture_slot  s_ring[kCaptureSlots];
+static atomic_size_t s_head      = 0;       // next slot to claim
+static size_t        s_tail      = 0;       // next slot to write, only the writer touches this
+static atomic_bool   s_enabled   = false;
+static sem_t         s_ready;
+
+static atomic_uint_fast64_t s_chunks  = 0;
+static atomic_uint_fast64_t s_bytes   = 0;
+static atomic_uint_fast64_t s_dropped = 0;
+static atomic_bool          s_shutdown = false;
+static atomic_bool          s_done     = false;
+
+// only the writer thread touches these
+static char          s_path[256]     = {0};
+static size_t        s_max_bytes     = kCaptureMaxBytes;
+static FILE*         s_file          = NULL;
+static char*         s_file_buffer   = NULL;
+static size_t        s_file_bytes    = 0;
+static uint64_t      s_dirty_us      = 0;       // when the oldest unflushed chunk went into the buffer, zero if there isn't one
+static capture_stats s_stats;
+
+
+
+static uint64_t monotonic_ns( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static uint64_t monotonic_us( void )
+{
+    return monotonic_ns() / 1000;
+}
+
+
+// one record per slot, so a big read takes several
+static void capture_piece( capture_source source, int channel, const uint8_t* data, size_t length, uint64_t now_ns, int64_t wall_us )
+{
+    size_t        pos  = atomic_load_explicit( &s_head, memory_order_relaxed );
+    capture_slot* slot = NULL;
+    while( 1 )
+    {
+        slot = &s_ring[pos & kCaptureSlotMask];
+        size_t   sequence = atomic_load_explicit( &slot->sequence, memory_order_acquire );
+        intptr_t diff     = (intptr_t)sequence - (intptr_t)pos;
+        if( diff == 0 )
+        {
+            if( atomic_compare_exchange_weak_explicit( &s_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed ) )
+                break;
+        }
+        else if( diff < 0 )
+        {
+            // the writer is a whole ring behind, don't wait on it
+            atomic_fetch_add_explicit( &s_dropped, 1, memory_order_relaxed );
+            return;
+        }
+        else
+            pos = atomic_load_explicit( &s_head, memory_order_relaxed );
+    }
+
+    slot->record.monotonic_ns = now_ns;
+    slot->record.wall_us      = wall_us;
+    slot->record.source       = (uint8_t)source;
+    slot->record.length       = (uint16_t)length;
+    slot->record.channel      = (uint8_t)channel;
+    memcpy( slot->data, data, length );
+
+    atomic_store_explicit( &slot->sequence, pos + 1, memory_order_release );
+    atomic_fetch_add_explicit( &s_chunks, 1, memory_order_relaxed );
+    atomic_fetch_add_explicit( &s_bytes, length, memory_order_relaxed );
+}
+
+
+void capture_chunk( capture_source source, int channel, const void* data, size_t length )
+{
+    if( !atomic_load_explicit( &s_enabled, memory_order_relaxed ) || !data || !length )
+        return;
+
+    struct timespec wall;
+    clock_gettime( CLOCK_REALTIME, &wall );
+    uint64_t now_ns  = monotonic_ns();
+    int64_t  wall_us = (int64_t)wall.tv_sec * 1000000 + wall.tv_nsec / 1000;
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    while( length )
+    {
+        size_t piece = length < kCaptureChunkMax ? length : kCaptureChunkMax;
+        capture_piece( source, channel, bytes, piece, now_ns, wall_us );
+        bytes  += piece;
+        length -= piece;
+    }
+    sem_post( &s_ready );
+}
+
+
+bool capture_enabled( void )
+{
+    return atomic_load_explicit( &s_enabled, memory_order_relaxed );
+}
+
+
+
+#pragma mark -
+
+static void rotate_capture( void );
+
+
+// a file from a different version can't be appended to, its records are a different size
+static bool header_matches( FILE* file )
+{
+    capture_header header;
+    rewind( file );
+    return fread( &header, sizeof( header ), 1, file ) == 1 && !memcmp( header.magic, kCaptureMagic, sizeof( header.magic ) ) &&
+           header.version == kCaptureVersion && header.record_size == sizeof( capture_record );
+}
+
+
+static void open_capture( void )
+{
+    s_file = fopen( s_path, "a+b" );
+    if( !s_file )
+    {
+        log_error( "capture: failed to open %s: %d\n", s_path, errno );
+        return;
+    }
+
+    if( !s_file_buffer )
+        s_file_buffer = malloc( kCaptureFileBuffer );
+    if( s_file_buffer )
+        setvbuf( s_file, s_file_buffer, _IOFBF, kCaptureFileBuffer );
+
+    // picking up where the last run left off, otherwise it needs a header
+    fseek( s_file, 0, SEEK_END );
+    s_file_bytes = ftell( s_file );
+    if( s_file_bytes && !header_matches( s_file ) )
+    {
+        log_error( "capture: %s was written by a different version, moving it out of the way\n", s_path );
+        rotate_capture();
+        return;
+    }
+    fseek( s_file, 0, SEEK_END );
+    if( !s_file_bytes )
+    {
+        capture_header header = { .version = kCaptureVersion, .record_size = sizeof( capture_record ) };
+        memcpy( header.magic, kCaptureMagic, sizeof( header.magic ) );
+        s_file_bytes = fwrite( &header, sizeof( header ), 1, s_file ) * sizeof( header );
+    }
+}
+
+
+static void rotate_capture( void )
+{
+    if( s_file )
+        fclose( s_file );
+    s_file     = NULL;
+    s_dirty_us = 0;
+
+    size_t len = strlen( s_path ) + 4;
+    char   from[len];
+    char   to[len];
+    for( int i = kCaptureKeep - 1; i > 0; i-- )
+    {
+        snprintf( to, len, "%s.%d", s_path, i );
+        if( i > 1 )
+            snprintf( from, len, "%s.%d", s_path, i - 1 );
+        else
+            snprintf( from, len, "%s", s_path );
+        rename( from, to );     // the older ones might not be there yet
+    }
+
+    ++s_stats.rotations;
+    open_capture();
+}
+
+
+// writes out everything in the ring, it stays in the stdio buffer until flush_capture()
+static void drain( void )
+{
+    while( 1 )
+    {
+        capture_slot* slot     = &s_ring[s_tail & kCaptureSlotMask];
+        size_t        sequence = atomic_load_explicit( &slot->sequence, memory_order_acquire );
+        if( sequence != s_tail + 1 )
+            break;  // nothing there yet (or a reader is still filling it in)
+
+        if( s_file && s_file_bytes >= s_max_bytes )
+            rotate_capture();
+
+        size_t length = slot->record.length;
+        if( s_file && fwrite( &slot->record, sizeof( capture_record ), 1, s_file ) == 1 && fwrite( slot->data, 1, length, s_file ) == length )
+        {
+            s_file_bytes += sizeof( capture_record ) + length;
+            ++s_stats.written;
+            if( !s_dirty_us )
+                s_dirty_us = monotonic_us();
+        }
+        else
+            atomic_fetch_add_explicit( &s_dropped, 1, memory_order_relaxed );
+
+        atomic_store_explicit( &slot->sequence, s_tail + kCaptureSlots, memory_order_release );
+        ++s_tail;
+    }
+}
+
+
+static void flush_capture( void )
+{
+    if( !s_dirty_us || !s_file )
+        return;
+
+    uint64_t start = monotonic_us();
+    fflush( s_file );
+    s_dirty_us = 0;
+
+    uint32_t elapsed = (uint32_t)(monotonic_us() - start);
+    if( elapsed > s_stats.max_write_us )
+        s_stats.max_write_us = elapsed;
+}
+
+
+static wx_thread_return_t capture_writer_thread( void* args )
+{
+    while( !atomic_load( &s_shutdown ) )
+    {
+        // sleep until there's more or it's time to flush what we have
+        if( s_dirty_us )
+        {
+            uint64_t due = s_dirty_us + kCaptureFlushSecs * 1000000ull;
+            uint64_t now = monotonic_us();
+            if( now >= due )
+            {
+                flush_capture();
+                continue;
+            }
+
+            struct timespec deadline;
+            clock_gettime( CLOCK_REALTIME, &deadline );
+            uint64_t wait_ns  = (due - now) * 1000 + deadline.tv_nsec;
+            deadline.tv_sec  += wait_ns / 1000000000ull;
+            deadline.tv_nsec  = wait_ns % 1000000000ull;
+            if( sem_timedwait( &s_ready, &deadline ) == -1 )
+                continue;   // timed out (or a signal), the top of the loop flushes if it's due
+        }
+        else
+        {
+            while( sem_wait( &s_ready ) == -1 && errno == EINTR )
+                ;
+        }
+
+        // one wakeup for everything that piled up
+        while( sem_trywait( &s_ready ) == 0 )
+            ;
+        drain();
+    }
+
+    drain();
+    if( s_file )
+        fclose( s_file );
+    s_file = NULL;
+    atomic_store( &s_done, true );
+    wx_thread_return();
+}
+
+
+// "path" or "path:megabytes"
+bool capture_parse_option( const char* arg, char* path, size_t pathSize, size_t* maxBytes )
+{
+    if( !arg || !*arg || !path || !pathSize || !maxBytes )
+        return false;
+
+    *maxBytes = kCaptureMaxBytes;
+
+    const char* colon = strrchr( arg, ':' );
+    size_t      len   = colon ? (size_t)(colon - arg) : strlen( arg );
+    if( colon )
+    {
+        char*         end = NULL;
+        unsigned long mb  = strtoul( colon + 1, &end, 10 );
+        if( end == colon + 1 || *end || !mb )
+            return false;
+        *maxBytes = mb * 1024 * 1024;
+    }
+
+    if( !len || len >= pathSize )
+        return false;
+    memcpy( path, arg, len );
+    path[len] = '\0';
+    return true;
+}
+
+
+bool capture_start( const char* path, size_t maxBytes )
+{
+    if( !path || atomic_load( &s_enabled ) )
+        return false;
+
+    snprintf( s_path, sizeof( s_path ), "%s", path );
+    s_max_bytes = maxBytes ? maxBytes : kCaptureMaxBytes;
+
+    for( size_t i = 0; i < kCaptureSlots; i++ )
+        atomic_init( &s_ring[i].sequence, i );
+    sem_init( &s_ready, 0, 0 );
+
+    open_capture();
+    if( !s_file )
+        return false;
+
+    wx_create_thread_detached( capture_writer_thread, NULL );
+    atomic_store( &s_enabled, true );
+    log_error( "capture: recording raw receiver data to %s, rotating at %zu MB\n", s_path, s_max_bytes / (1024 * 1024) );
+    return true;
+}
+
+
+// get whatever is still in the ring out before we exit
+void capture_shutdown( void )
+{
+    if( !atomic_exchange( &s_enabled, false ) )
+        return;
+
+    atomic_store( &s_shutdown, true );
+    sem_post( &s_ready );
+
+    for( int i = 0; i < 100 && !atomic_load( &s_done ); i++ )
+        usleep( 10000 );
+}
+
+
+
+#pragma mark -
+
+void capture_get_stats( capture_stats* stats )
+{
+    if( !stats )
+        return;
+
+    *stats = s_stats;   // written by the writer thread, a slightly torn read is fine for stats
+    stats->chunks  = atomic_load_explicit( &s_chunks, memory_order_relaxed );
+    stats->bytes   = atomic_load_explicit( &s_bytes, memory_order_relaxed );
+    stats->dropped = atomic_load_explicit( &s_dropped, memory_order_relaxed );
+}
+
+
+void capture_log_stats( void )
+{
+    if( !capture_enabled() )
+        return;
+
+    capture_stats stats;
+    capture_get_stats( &stats );
+    log_error( "capture: chunks: %llu, bytes: %llu, written: %llu, dropped: %llu, rotations: %u, slowest write: %uus\n", (unsigned long long)stats.chunks,
+               (unsigned long long)stats.bytes, (unsigned long long)stats.written, (unsigned long long)stats.dropped, stats.rotations, stats.max_write_us );
+}
+
+
+static double bytes_value( void* context )
+{
+    return atomic_load_explicit( &s_bytes, memory_order_relaxed );
+}
+
+
+static double dropped_value( void* context )
+{
+    return atomic_load_explicit( &s_dropped, memory_order_relaxed );
+}
+
+
+void capture_add_metrics( void )
+{
+    if( !capture_enabled() )
+        return;
+
+    metrics_add_value( "wxrelay_capture_bytes_total",   "counter", "Raw receiver bytes captured", bytes_value, NULL );
+    metrics_add_value( "wxrelay_capture_dropped_total", "counter", "Captured chunks that never made it to the file", dropped_value, NULL );
+}
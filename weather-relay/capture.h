@@ -0,0 +1,76 @@
+//
+//  capture.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_capture
+#define _H_capture
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define kCaptureMagic       "WXCP"
+#define kCaptureVersion     2           // 2 added the channel
+#define kCaptureChunkMax    128         // bigger reads get split across records
+
+// where the bytes came from
+typedef enum
+{
+    kCapture_wx = 0,        // the TX31U receiver
+    kCapture_rain,          // the rain gauge radio
+    kCapture_count
+} capture_source;
+
+// a capture file is one of these followed by records, all little endian
+typedef struct
+{
+    char     magic[4];
+    uint16_t version;
+    uint16_t record_size;       // sizeof( capture_record ) when it was written
+} __attribute__ ((__packed__)) capture_header;
+
+// each record is followed by length bytes exactly as read() returned them
+typedef struct
+{
+    uint64_t monotonic_ns;      // CLOCK_MONOTONIC, for the gaps between reads
+    int64_t  wall_us;           // CLOCK_REALTIME, to line things up with the log
+    uint8_t  source;            // capture_source
+    uint16_t length;
+    uint8_t  channel;           // which receiver of that source (the --device index), reads from different ones can't be glued together
+} __attribute__ ((__packed__)) capture_record;
+
+typedef struct
+{
+    uint64_t chunks;            // made it into the ring
+    uint64_t bytes;
+    uint64_t written;           // chunks that made it to the file
+    uint64_t dropped;           // ring was full or the file couldn't be written
+    uint32_t rotations;
+    uint32_t max_write_us;      // slowest flush, this is the SD card
+} capture_stats;
+
+// recording, path[:megabytes] rotates to path.1, path.2... once the file gets that big
+bool capture_parse_option( const char* arg, char* path, size_t pathSize, size_t* maxBytes );
+bool capture_start( const char* path, size_t maxBytes );
+void capture_chunk( capture_source source, int channel, const void* data, size_t length );
+void capture_shutdown( void );
+bool capture_enabled( void );
+
+void capture_get_stats( capture_stats* stats );
+void capture_log_stats( void );
+void capture_add_metrics( void );
+
+// reading them back
+typedef struct capture_reader capture_reader;
+
+capture_reader* capture_open( const char* path );
+int             capture_next( capture_reader* reader, capture_record* record, uint8_t* data, size_t dataSize );   // length, 0 at the end, -1 if it's bad
+void            capture_close( capture_reader* reader );
+const char*     capture_source_name( capture_source source );
+
+#endif // !_H_capture
@@ -0,0 +1,87 @@
+//
+//  capture_reader.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Reads back what capture.c records.  This is kept apart from the recorder so tools like wxcapture can read captures without
+//  dragging in the logging and metrics threads.
+//
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+
+
+struct capture_reader
+{
+    FILE*          file;
+    capture_header header;
+};
+
+
+static const char* s_source_names[kCapture_count] = { "wx", "rain" };
+
+
+capture_reader* capture_open( const char* path )
+{
+    FILE* file = fopen( path, "rb" );
+    if( !file )
+        return NULL;
+
+    capture_reader* reader = (capture_reader*)calloc( 1, sizeof( capture_reader ) );
+    if( !reader )
+    {
+        fclose( file );
+        return NULL;
+    }
+    reader->file = file;
+
+    if( fread( &reader->header, sizeof( capture_header ), 1, file ) != 1 || memcmp( reader->header.magic, kCaptureMagic, sizeof( reader->header.magic ) ) != 0 ||
+        reader->header.record_size < offsetof( capture_record, channel ) )
+    {
+        capture_close( reader );
+        return NULL;
+    }
+    return reader;
+}
+
+
+int capture_next( capture_reader* reader, capture_record* record, uint8_t* data, size_t dataSize )
+{
+    if( !reader || !record || !data )
+        return -1;
+
+    // older writers had less in the record (version 1 had no channel, everything was channel 0), newer ones might have more
+    size_t size = reader->header.record_size < sizeof( capture_record ) ? reader->header.record_size : sizeof( capture_record );
+    memset( record, 0, sizeof( capture_record ) );
+    if( fread( record, size, 1, reader->file ) != 1 )
+        return feof( reader->file ) ? 0 : -1;
+    if( reader->header.record_size > size )
+        fseek( reader->file, reader->header.record_size - size, SEEK_CUR );
+
+    if( record->length > dataSize || fread( data, 1, record->length, reader->file ) != record->length )
+        return -1;
+    return record->length;
+}
+
+
+void capture_close( capture_reader* reader )
+{
+    if( !reader )
+        return;
+
+    if( reader->file )
+        fclose( reader->file );
+    free( reader );
+}
+
+
+const char* capture_source_name( capture_source source )
+{
+    return source < kCapture_count ? s_source_names[source] : "unknown";
+}
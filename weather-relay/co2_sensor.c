@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include "main.h"
+#include "logging.h"
 #include "co2_sensor.h"
 
 
@@ -84,7 +85,7 @@ float co2_read_sensor( float* tempPtr, float* humidityPtr )
         
         if( timeout > kCO2SensorReadyTimeout )
         {
-            log_error( "co2 sensor read timed out waiting for data ready\n" );
+            log_error_throttled( "co2 sensor read timed out waiting for data ready\n" );
             return 0.0f;
         }
 
@@ -99,7 +100,7 @@ float co2_read_sensor( float* tempPtr, float* humidityPtr )
     
     if( result != 18 )
     {
-        log_error( "co2 sensor read failed\n" );
+        log_error_throttled( "co2 sensor read failed\n" );
         return 0.0f;
     }
     
@@ -109,7 +110,7 @@ float co2_read_sensor( float* tempPtr, float* humidityPtr )
         if( crc8( buffer + i, 2 ) != buffer[i + 2] )
         {
             // we got a bad CRC, fail out
-            log_error( "co2 sensor bad CRC\n" );
+            log_error_throttled( "co2 sensor bad CRC\n" );
             return 0.0f;
         }
     }
@@ -0,0 +1,378 @@
+//
+//  control.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Signals and the control socket.  SIGINT, SIGTERM and SIGHUP are blocked in every thread and picked up through a signalfd on
+//  the control thread instead, so nothing ever runs in signal context.  The same thread listens on a UNIX domain socket for one
+//  line commands ("dump", "export /tmp/wx.txt", ...).  Every command runs on its own worker thread and streams its reply back
+//  over the connection, so a slow client or a 20k line dump never holds up the control thread, let alone ingestion.
+//
+//      echo dump | nc -U /run/wxrelay.sock
+//
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "control.h"
+#include "wx_thread.h"
+
+
+#define kMaxCommands        16
+#define kMaxSignalCommands  4
+#define kMaxWorkers         4           // commands running at once, anyone past that gets told we're busy
+#define kMaxCommandLength   256
+#define kClientTimeoutSecs  5
+
+
+typedef struct
+{
+    const char*     name;
+    const char*     help;
+    control_handler handler;
+    void*           context;
+} control_command;
+
+typedef struct
+{
+    int  sig;
+    char name[32];
+} signal_command;
+
+typedef struct
+{
+    int                    fd;          // client connection, -1 for a signal
+    const control_command* command;     // already known for a signal, read off the connection otherwise
+} control_request;
+
+
+static control_command s_commands[kMaxCommands];
+static int             s_command_count = 0;
+static signal_command  s_signal_commands[kMaxSignalCommands];
+static int             s_signal_count  = 0;
+static const char*     s_socket_path   = NULL;
+static int             s_listen_fd     = -1;
+static int             s_signal_fd     = -1;
+static atomic_bool     s_quit          = false;
+static atomic_int      s_workers       = 0;
+
+
+
+static sigset_t control_signals( void )
+{
+    sigset_t set;
+    sigemptyset( &set );
+    sigaddset( &set, SIGINT );
+    sigaddset( &set, SIGTERM );
+    sigaddset( &set, SIGHUP );
+    return set;
+}
+
+
+static const control_command* find_command( const char* name )
+{
+    for( int i = 0; i < s_command_count; i++ )
+        if( strcmp( s_commands[i].name, name ) == 0 )
+            return &s_commands[i];
+    return NULL;
+}
+
+
+static void help_command( FILE* out, const char* args, void* context )
+{
+    if( !out )
+        return;
+
+    fprintf( out, "commands:\n" );
+    for( int i = 0; i < s_command_count; i++ )
+        fprintf( out, "  %-12s %s\n", s_commands[i].name, s_commands[i].help );
+}
+
+
+
+#pragma mark -
+
+// reads up to the newline, commands are short so a byte at a time is fine
+static bool read_line( int fd, char* line, size_t size )
+{
+    size_t len = 0;
+    while( len < size - 1 )
+    {
+        char c;
+        ssize_t got = read( fd, &c, 1 );
+        if( got < 0 && errno == EINTR )
+            continue;
+        if( got <= 0 )
+            break;
+        if( c == '\n' )
+            break;
+        if( c != '\r' )
+            line[len++] = c;
+    }
+    line[len] = '\0';
+    return len > 0;
+}
+
+
+static wx_thread_return_t control_worker( void* args )
+{
+    control_request request = *(control_request*)args;
+    free( args );
+
+    FILE* out  = NULL;
+    char  line[kMaxCommandLength] = "";
+    char* rest = line;
+
+    if( request.fd >= 0 )
+    {
+        read_line( request.fd, line, sizeof( line ) );
+        out = fdopen( request.fd, "w" );
+        if( !out )
+        {
+            close( request.fd );
+            atomic_fetch_sub( &s_workers, 1 );
+            wx_thread_return();
+        }
+
+        // first word is the command, the rest is handed to it as is
+        char* name = line + strspn( line, " \t" );
+        rest = name + strcspn( name, " \t" );
+        if( *rest )
+            *rest++ = '\0';
+        rest += strspn( rest, " \t" );
+
+        request.command = find_command( name );
+        if( !request.command )
+            fprintf( out, "unknown command: %s (try help)\n", name );
+    }
+
+    if( request.command )
+        request.command->handler( out, rest, request.command->context );
+
+    if( out )
+        fclose( out );
+
+    atomic_fetch_sub( &s_workers, 1 );
+    wx_thread_return();
+}
+
+
+static void start_worker( int fd, const control_command* command )
+{
+    if( atomic_fetch_add( &s_workers, 1 ) >= kMaxWorkers )
+    {
+        atomic_fetch_sub( &s_workers, 1 );
+        if( fd >= 0 )
+        {
+            static const char busy[] = "busy, try again\n";
+            write( fd, busy, sizeof( busy ) - 1 );
+            close( fd );
+        }
+        else
+            log_error( "control: too many commands running, dropped %s\n", command->name );
+        return;
+    }
+
+    control_request* request = (control_request*)malloc( sizeof( control_request ) );
+    if( !request )
+    {
+        atomic_fetch_sub( &s_workers, 1 );
+        if( fd >= 0 )
+            close( fd );
+        return;
+    }
+    request->fd      = fd;
+    request->command = command;
+    wx_create_thread_detached( control_worker, request );
+}
+
+
+static void handle_signal( int sig )
+{
+    if( sig == SIGINT || sig == SIGTERM )
+    {
+        // main loop notices this and shuts down on its own thread, a second one means it's stuck so just go
+        if( atomic_exchange( &s_quit, true ) )
+            _exit( EXIT_FAILURE );
+        return;
+    }
+
+    for( int i = 0; i < s_signal_count; i++ )
+    {
+        if( s_signal_commands[i].sig != sig )
+            continue;
+
+        const control_command* command = find_command( s_signal_commands[i].name );
+        if( command )
+            start_worker( -1, command );
+    }
+}
+
+
+static wx_thread_return_t control_thread( void* args )
+{
+    struct pollfd fds[2] = {
+        { .fd = s_signal_fd, .events = POLLIN },
+        { .fd = s_listen_fd, .events = POLLIN },
+    };
+    int count = s_listen_fd >= 0 ? 2 : 1;
+
+    while( 1 )
+    {
+        if( poll( fds, count, -1 ) < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            log_error( "control: poll failed (%d)\n", errno );
+            break;
+        }
+
+        if( fds[0].revents & POLLIN )
+        {
+            struct signalfd_siginfo info;
+            while( read( s_signal_fd, &info, sizeof( info ) ) == sizeof( info ) )
+                handle_signal( (int)info.ssi_signo );
+        }
+
+        if( count > 1 && (fds[1].revents & POLLIN) )
+        {
+            int client = accept( s_listen_fd, NULL, NULL );
+            if( client >= 0 )
+            {
+                struct timeval timeout = { kClientTimeoutSecs, 0 };
+                setsockopt( client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout ) );
+                setsockopt( client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+                start_worker( client, NULL );
+            }
+            else if( errno != EINTR && errno != EAGAIN )
+                log_error( "control: accept failed (%d)\n", errno );
+        }
+    }
+
+    wx_thread_return();
+}
+
+
+
+#pragma mark -
+
+void control_block_signals( void )
+{
+    sigset_t set = control_signals();
+    pthread_sigmask( SIG_BLOCK, &set, NULL );
+}
+
+
+static int open_socket( const char* path )
+{
+    struct sockaddr_un addr;
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    if( strlen( path ) >= sizeof( addr.sun_path ) )
+    {
+        log_error( "control: socket path too long: %s\n", path );
+        return -1;
+    }
+    strcpy( addr.sun_path, path );
+
+    int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0 );
+    if( fd < 0 )
+    {
+        log_error( "control: failed to create socket (%d)\n", errno );
+        return -1;
+    }
+
+    // a stale socket from the last run would make bind fail
+    unlink( path );
+    if( bind( fd, (struct sockaddr*)&addr, sizeof( addr ) ) != 0 || listen( fd, kMaxWorkers ) != 0 )
+    {
+        log_error( "control: failed to listen on %s (%d)\n", path, errno );
+        close( fd );
+        return -1;
+    }
+    chmod( path, 0660 );
+    return fd;
+}
+
+
+bool control_start( const char* socketPath )
+{
+    if( s_signal_fd >= 0 )
+        return false;
+
+    control_add_command( "help", "list the commands", help_command, NULL );
+
+    sigset_t set = control_signals();
+    s_signal_fd = signalfd( -1, &set, SFD_NONBLOCK | SFD_CLOEXEC );
+    if( s_signal_fd < 0 )
+    {
+        log_error( "control: signalfd failed (%d)\n", errno );
+        return false;
+    }
+
+    if( socketPath )
+    {
+        s_listen_fd = open_socket( socketPath );
+        if( s_listen_fd >= 0 )
+            s_socket_path = socketPath;
+    }
+
+    wx_create_thread_detached( control_thread, NULL );
+    return true;
+}
+
+
+void control_stop( void )
+{
+    if( s_socket_path )
+        unlink( s_socket_path );
+    s_socket_path = NULL;
+}
+
+
+bool control_add_command( const char* name, const char* help, control_handler handler, void* context )
+{
+    if( !name || !handler || s_command_count >= kMaxCommands || find_command( name ) )
+        return false;
+
+    control_command* command = &s_commands[s_command_count];
+    command->name    = name;
+    command->help    = help ? help : "";
+    command->handler = handler;
+    command->context = context;
+    ++s_command_count;
+    return true;
+}
+
+
+// run a command (with no client) whenever this signal shows up, SIGINT and SIGTERM always mean quit
+bool control_signal_command( int sig, const char* name )
+{
+    if( !name || s_signal_count >= kMaxSignalCommands )
+        return false;
+
+    s_signal_commands[s_signal_count].sig = sig;
+    snprintf( s_signal_commands[s_signal_count].name, sizeof( s_signal_commands[0].name ), "%s", name );
+    ++s_signal_count;
+    return true;
+}
+
+
+bool control_quit_requested( void )
+{
+    return atomic_load( &s_quit );
+}
@@ -0,0 +1,25 @@
+//
+//  control.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_control
+#define _H_control
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// runs on a worker thread, out is the client connection or NULL when a signal kicked it off
+typedef void (*control_handler)( FILE* out, const char* args, void* context );
+
+void control_block_signals( void );     // call first thing in main() so every thread we create inherits the mask
+bool control_start( const char* socketPath );
+void control_stop( void );
+bool control_add_command( const char* name, const char* help, control_handler handler, void* context );
+bool control_signal_command( int sig, const char* name );
+bool control_quit_requested( void );
+
+#endif // !_H_control
@@ -0,0 +1,419 @@
+//
+//  history.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  GET /history?from=-7d&to=now&fields=temp_c,pressure_mb&points=500&mode=avg&format=json
+//
+//  Downsampled history for charts so a browser pulls a few hundred points instead of the whole dump.  The last day comes out of
+//  the in-memory history, anything older than that out of the long term archive.  Samples are bucketed as they stream past, avg
+//  and minmax rows go out (chunked) as soon as their bucket is done, lttb buckets into 8x as many averages first and then picks
+//  the visually important points per field with largest-triangle-three-buckets.
+//
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "main.h"
+#include "history.h"
+#include "wx_clock.h"
+
+
+#define kDefaultPoints      500
+#define kMaxPoints          5000
+#define kLTTBOversample     8           // fine buckets per output point before lttb picks from them
+
+
+typedef enum
+{
+    kMode_avg,
+    kMode_minmax,
+    kMode_lttb
+} history_mode;
+
+typedef struct
+{
+    http_request* request;
+    history_mode  mode;
+    bool          csv;
+    int           fields[kArchiveFields];
+    int           field_count;
+    int64_t       from;
+    int64_t       to;
+    int           points;
+
+    int           bucket_count;
+    double        bucket_width;         // seconds
+    uint32_t*     counts;
+    double*       times;                // sum of sample times, for the average time of the bucket
+    double*       sums;                 // [bucket * field_count + field]
+    float*        mins;
+    float*        maxs;
+    int           next_emit;            // buckets before this have gone out already
+    uint64_t      rows;
+    uint64_t      samples;
+} history_query;
+
+
+static history_source_fn s_memory      = NULL;
+static history_oldest_fn s_oldest      = NULL;
+static const char*       s_archivePath = NULL;
+
+static const char* s_mode_names[] = { "avg", "minmax", "lttb" };
+
+
+
+void history_init( history_source_fn memory, history_oldest_fn oldest, const char* archivePath )
+{
+    s_memory      = memory;
+    s_oldest      = oldest;
+    s_archivePath = archivePath;
+}
+
+
+static double elapsed_ms( const struct timespec* start )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+
+
+#pragma mark -
+
+static void emit_row_start( history_query* q, int64_t when )
+{
+    if( q->csv )
+        http_respond_printf( q->request, "%lld", (long long)when );
+    else
+        http_respond_printf( q->request, "%s\n[%lld", q->rows ? "," : "", (long long)when );
+    q->rows++;
+}
+
+
+static void emit_bucket( history_query* q, int b )
+{
+    if( !q->counts[b] )
+        return;
+
+    emit_row_start( q, (int64_t)llround( q->times[b] / q->counts[b] ) );
+    for( int f = 0; f < q->field_count; f++ )
+    {
+        int    i   = b * q->field_count + f;
+        double avg = q->sums[i] / q->counts[b];
+        if( q->mode == kMode_minmax )
+            http_respond_printf( q->request, ",%.7g,%.7g,%.7g", q->mins[i], avg, q->maxs[i] );
+        else
+            http_respond_printf( q->request, ",%.7g", avg );
+    }
+    http_respond_write( q->request, q->csv ? "\n" : "]", 1 );
+}
+
+
+static bool history_sample( const archive_sample* sample, void* context )
+{
+    history_query* q = (history_query*)context;
+    if( sample->time < q->from || sample->time > q->to )
+        return true;
+
+    int b = (int)((sample->time - q->from) / q->bucket_width);
+    if( b >= q->bucket_count )
+        b = q->bucket_count - 1;
+
+    // samples come in time order, so anything before this bucket is done and can go out now
+    if( q->mode != kMode_lttb )
+    {
+        for( ; q->next_emit < b; q->next_emit++ )
+            emit_bucket( q, q->next_emit );
+    }
+
+    bool first = !q->counts[b];
+    q->counts[b]++;
+    q->times[b] += sample->time;
+    for( int f = 0; f < q->field_count; f++ )
+    {
+        int   i     = b * q->field_count + f;
+        float value = sample->values[q->fields[f]];
+        q->sums[i] += value;
+        if( first || value < q->mins[i] )
+            q->mins[i] = value;
+        if( first || value > q->maxs[i] )
+            q->maxs[i] = value;
+    }
+
+    q->samples++;
+    return true;
+}
+
+
+// largest-triangle-three-buckets over the non-empty fine buckets for one field
+static void emit_lttb( history_query* q, int f, double* x, double* y )
+{
+    int n = 0;
+    for( int b = 0; b < q->bucket_count; b++ )
+    {
+        if( !q->counts[b] )
+            continue;
+        x[n] = q->times[b] / q->counts[b] - q->from;
+        y[n] = q->sums[b * q->field_count + f] / q->counts[b];
+        n++;
+    }
+
+    const char* name      = wx_archive_field_name( q->fields[f] );
+    int         threshold = q->points;
+    bool        first     = true;
+
+#define EMIT_POINT( i ) \
+    do \
+    { \
+        if( q->csv ) \
+            http_respond_printf( q->request, "%s,%lld,%.7g\n", name, (long long)llround( x[i] + q->from ), y[i] ); \
+        else \
+            http_respond_printf( q->request, "%s[%lld,%.7g]", first ? "" : ",", (long long)llround( x[i] + q->from ), y[i] ); \
+        first = false; \
+        q->rows++; \
+    } while( 0 )
+
+    if( !q->csv )
+        http_respond_printf( q->request, "%s\n\"%s\":[", f ? "," : "", name );
+
+    if( n <= threshold || threshold < 3 )
+    {
+        for( int i = 0; i < n; i++ )
+            EMIT_POINT( i );
+    }
+    else
+    {
+        double every = (double)(n - 2) / (threshold - 2);
+        int    a     = 0;
+        EMIT_POINT( 0 );
+        for( int i = 0; i < threshold - 2; i++ )
+        {
+            // average of the next bucket is the third point of the triangle
+            int    avg_start = (int)floor( (i + 1) * every ) + 1;
+            int    avg_end   = (int)floor( (i + 2) * every ) + 1;
+            double avg_x     = 0;
+            double avg_y     = 0;
+            if( avg_end > n )
+                avg_end = n;
+            for( int j = avg_start; j < avg_end; j++ )
+            {
+                avg_x += x[j];
+                avg_y += y[j];
+            }
+            if( avg_end > avg_start )
+            {
+                avg_x /= avg_end - avg_start;
+                avg_y /= avg_end - avg_start;
+            }
+
+            int    start   = (int)floor( i * every ) + 1;
+            int    end     = (int)floor( (i + 1) * every ) + 1;
+            double maxArea = -1;
+            int    picked  = start;
+            for( int j = start; j < end; j++ )
+            {
+                double area = fabs( (x[a] - avg_x) * (y[j] - y[a]) - (x[a] - x[j]) * (avg_y - y[a]) );
+                if( area > maxArea )
+                {
+                    maxArea = area;
+                    picked  = j;
+                }
+            }
+            EMIT_POINT( picked );
+            a = picked;
+        }
+        EMIT_POINT( n - 1 );
+    }
+#undef EMIT_POINT
+
+    if( !q->csv )
+        http_respond_write( q->request, "]", 1 );
+}
+
+
+static bool fail( char* error, size_t size, const char* format, ... ) __attribute__(( format( printf, 3, 4 ) ));
+static bool fail( char* error, size_t size, const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    vsnprintf( error, size, format, args );
+    va_end( args );
+    return false;
+}
+
+
+static bool parse_query( http_request* request, history_query* q, char* error, size_t size )
+{
+    char value[256];
+
+    q->from   = wx_clock_now() - 86400;
+    q->to     = wx_clock_now();
+    q->points = kDefaultPoints;
+    q->mode   = kMode_avg;
+
+    if( http_request_param( request, "from", value, sizeof( value ) ) && !wx_archive_parse_time( value, &q->from ) )
+        return fail( error, size, "bad from: %s", value );
+    if( http_request_param( request, "to", value, sizeof( value ) ) && !wx_archive_parse_time( value, &q->to ) )
+        return fail( error, size, "bad to: %s", value );
+    if( q->to <= q->from )
+        return fail( error, size, "empty range" );
+
+    if( http_request_param( request, "points", value, sizeof( value ) ) )
+    {
+        q->points = atoi( value );
+        if( q->points < 1 || q->points > kMaxPoints )
+            return fail( error, size, "points has to be 1 to %d", kMaxPoints );
+    }
+
+    if( http_request_param( request, "mode", value, sizeof( value ) ) )
+    {
+        int mode = 0;
+        while( mode < 3 && strcmp( value, s_mode_names[mode] ) )
+            ++mode;
+        if( mode == 3 )
+            return fail( error, size, "mode is avg, minmax or lttb" );
+        q->mode = (history_mode)mode;
+    }
+
+    q->csv = http_request_param( request, "format", value, sizeof( value ) ) && strcmp( value, "csv" ) == 0;
+
+    strcpy( value, "temp_c" );
+    http_request_param( request, "fields", value, sizeof( value ) );
+    char* save = NULL;
+    for( char* name = strtok_r( value, ",", &save ); name; name = strtok_r( NULL, ",", &save ) )
+    {
+        int field = wx_archive_field_from_name( name );
+        if( field < 0 )
+            return fail( error, size, "unknown field: %s", name );
+        if( q->field_count < kArchiveFields )
+            q->fields[q->field_count++] = field;
+    }
+    if( !q->field_count )
+        return fail( error, size, "no fields" );
+
+    return true;
+}
+
+
+void history_handler( http_request* request, void* context )
+{
+    struct timespec start;
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    history_query q;
+    char          error[128];
+    memset( &q, 0, sizeof( q ) );
+    q.request = request;
+    if( !parse_query( request, &q, error, sizeof( error ) ) )
+    {
+        http_respond_error( request, 400, "Bad Request", error );
+        return;
+    }
+
+    q.bucket_count = q.mode == kMode_lttb ? q.points * kLTTBOversample : q.points;
+    q.bucket_width = (double)(q.to - q.from + 1) / q.bucket_count;
+    if( q.bucket_width < 1 )
+    {
+        q.bucket_width = 1;
+        q.bucket_count = (int)(q.to - q.from + 1);
+    }
+
+    size_t cells = (size_t)q.bucket_count * q.field_count;
+    q.counts = (uint32_t*)calloc( q.bucket_count, sizeof( uint32_t ) );
+    q.times  = (double*)calloc( q.bucket_count, sizeof( double ) );
+    q.sums   = (double*)calloc( cells, sizeof( double ) );
+    q.mins   = (float*)malloc( cells * sizeof( float ) );
+    q.maxs   = (float*)malloc( cells * sizeof( float ) );
+    if( !q.counts || !q.times || !q.sums || !q.mins || !q.maxs )
+    {
+        http_respond_error( request, 503, "Service Unavailable", "out of memory" );
+        goto done;
+    }
+
+    http_respond_start( request, 200, "OK", q.csv ? "text/csv" : "application/json" );
+    if( q.csv )
+    {
+        http_respond_printf( request, q.mode == kMode_lttb ? "field,time,value\n" : "time" );
+        for( int f = 0; f < q.field_count && q.mode != kMode_lttb; f++ )
+        {
+            const char* name = wx_archive_field_name( q.fields[f] );
+            if( q.mode == kMode_minmax )
+                http_respond_printf( request, ",%s_min,%s_avg,%s_max", name, name, name );
+            else
+                http_respond_printf( request, ",%s", name );
+        }
+        if( q.mode != kMode_lttb )
+            http_respond_printf( request, "\n" );
+    }
+    else
+    {
+        http_respond_printf( request, "{\"from\":%lld,\"to\":%lld,\"mode\":\"%s\",\"points\":%d,", (long long)q.from, (long long)q.to, s_mode_names[q.mode], q.points );
+        if( q.mode == kMode_lttb )
+            http_respond_printf( request, "\"series\":{" );
+        else
+        {
+            http_respond_printf( request, "\"columns\":[\"time\"" );
+            for( int f = 0; f < q.field_count; f++ )
+            {
+                const char* name = wx_archive_field_name( q.fields[f] );
+                if( q.mode == kMode_minmax )
+                    http_respond_printf( request, ",\"%s_min\",\"%s_avg\",\"%s_max\"", name, name, name );
+                else
+                    http_respond_printf( request, ",\"%s\"", name );
+            }
+            http_respond_printf( request, "],\"rows\":[" );
+        }
+    }
+
+    // older than what we have in memory comes from the archive, the rest from memory
+    int64_t oldest = s_oldest ? s_oldest() : 0;
+    bool    used_archive = false;
+    if( s_archivePath && (!oldest || q.from < oldest) )
+    {
+        int64_t to = oldest ? oldest - 1 : q.to;
+        if( to > q.to )
+            to = q.to;
+        wx_archive_read_range( s_archivePath, q.from, to, history_sample, &q, NULL );
+        used_archive = true;
+    }
+    if( s_memory && oldest && oldest <= q.to )
+        s_memory( q.from > oldest ? q.from : oldest, q.to, history_sample, &q );
+
+    if( q.mode == kMode_lttb )
+    {
+        double* x = (double*)malloc( q.bucket_count * sizeof( double ) );
+        double* y = (double*)malloc( q.bucket_count * sizeof( double ) );
+        for( int f = 0; f < q.field_count && x && y; f++ )
+            emit_lttb( &q, f, x, y );
+        free( x );
+        free( y );
+    }
+    else
+    {
+        for( ; q.next_emit < q.bucket_count; q.next_emit++ )
+            emit_bucket( &q, q.next_emit );
+    }
+
+    double ms = elapsed_ms( &start );
+    if( !q.csv )
+        http_respond_printf( request, "\n%s,\"rows\":%llu,\"samples\":%llu,\"source\":\"%s\",\"ms\":%.1f}\n", q.mode == kMode_lttb ? "}" : "]", (unsigned long long)q.rows, (unsigned long long)q.samples,
+                             used_archive ? (oldest ? "archive+memory" : "archive") : "memory", ms );
+
+    if( debug_mode() )
+        log_error( "history: %lld secs, %s, %d points, %llu samples -> %llu rows in %.1f ms\n", (long long)(q.to - q.from), s_mode_names[q.mode], q.points, (unsigned long long)q.samples, (unsigned long long)q.rows, ms );
+
+done:
+    free( q.counts );
+    free( q.times );
+    free( q.sums );
+    free( q.mins );
+    free( q.maxs );
+}
@@ -0,0 +1,24 @@
+//
+//  history.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_history
+#define _H_history
+
+#include <stdint.h>
+
+#include "http_server.h"
+#include "wx_archive.h"
+
+// the in-memory history, samples go to the callback oldest first
+typedef void    (*history_source_fn)( int64_t from, int64_t to, archive_sample_fn callback, void* context );
+typedef int64_t (*history_oldest_fn)( void );
+
+void history_init( history_source_fn memory, history_oldest_fn oldest, const char* archivePath );
+void history_handler( http_request* request, void* context );
+
+#endif // !_H_history
@@ -0,0 +1,1185 @@
+//
+//  http_server.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Tiny HTTP/1.1 server so the current conditions don't have to go through Apache and a file on the SD card.  One thread, poll()
+//  and non-blocking sockets, keep-alive and pipelining.  Whatever we serve is published as a complete pre-rendered response
+//  (headers and all) once per update, so a request is just a lookup and a send of a shared buffer, and the ETag is a hash of the
+//  body so a dashboard polling with If-None-Match mostly gets a tiny 304.
+//
+//  Anything that has to be computed per request (history queries) registers a handler instead.  The connection is handed off to a
+//  worker thread that streams a chunked response with plain blocking writes, then gives the connection back to the poll loop so
+//  keep-alive still works.  The poll loop never waits on a handler.
+//
+//  Streams (/events) are Server-Sent Events.  Each event is formatted once into a shared buffer and every subscriber just gets a
+//  reference to it.  A subscriber still sending the last event has the newer one waiting instead, and the one after that replaces
+//  it, so a slow client only ever has the latest.  One that takes nothing for kStreamStallSecs gets dropped.  Broadcasting
+//  never blocks the caller (it's the ingest thread) whatever the clients are doing.
+//
+
+#define _GNU_SOURCE     // accept4, memmem
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "http_server.h"
+#include "logging.h"
+#include "wx_thread.h"
+
+
+#define kMaxClients         512         // mostly for the event stream subscribers
+#define kMaxResources       16
+#define kMaxRequest         4096        // request line + headers
+#define kKeepAliveSecs      30          // idle connections get closed after this
+#define kMaxHandlers        8
+#define kMaxWorkers         4           // handlers running at once, past that it's a 503
+#define kWorkerTimeoutSecs  10          // a client that won't take our data for this long gets dropped
+#define kChunkSize          4096
+#define kMaxStreams         4
+#define kStreamStallSecs    60          // a subscriber with an event waiting that takes nothing for this long is dropped
+#define kHeartbeatSecs      15          // comment line to idle subscribers, keeps proxies from timing them out
+
+
+typedef struct
+{
+    char         path[64];
+    char         etag[24];
+    http_buffer* response;              // the whole 200, headers and body
+} http_resource;
+
+typedef struct
+{
+    int          fd;
+    time_t       last_active;
+    char         in[kMaxRequest];
+    size_t       in_len;
+    http_buffer* out;                   // what we're sending right now, we don't look at the next request until it's gone
+    size_t       out_pos;
+    size_t       out_len;
+    bool         close_after;
+    struct http_request* handoff;       // a handler is about to take this connection
+    int          stream;                // index of the stream it's subscribed to, -1 for a normal connection
+    http_buffer* pending;               // newest event that came in while it was still sending the last one
+} http_conn;
+
+typedef struct
+{
+    char         path[64];
+    http_handler handler;
+    void*        context;
+} http_route;
+
+typedef struct
+{
+    char         path[64];
+    http_buffer* latest;                // newest broadcast, under s_mutex
+    uint64_t     sequence;              // ...and its id
+    http_buffer* current;               // the server thread's, last one fanned out and what new subscribers start with
+    uint64_t     delivered;             // ...and its id
+} http_stream;
+
+struct http_request
+{
+    http_conn          conn;            // the connection while the worker has it, any pipelined input comes along
+    const http_route*  route;
+    char               path[256];
+    char               query[1024];
+    bool               head;
+    bool               started;
+    bool               failed;          // the client went away or stopped reading
+    uint64_t           bytes;
+    size_t             len;
+    char               chunk[kChunkSize];
+};
+
+
+static http_resource   s_resources[kMaxResources];
+static int             s_resource_count = 0;
+static pthread_mutex_t s_mutex          = PTHREAD_MUTEX_INITIALIZER;     // for the resources, everything else is the server thread's
+static http_conn       s_clients[kMaxClients];
+static int             s_client_count   = 0;
+static int             s_listen_fd      = -1;
+static http_stats      s_stats;
+static http_route      s_routes[kMaxHandlers];
+static int             s_route_count    = 0;
+static atomic_int      s_workers        = 0;
+static int             s_wake_fd        = -1;                            // workers poke this when they hand a connection back
+static http_conn       s_returned[kMaxWorkers];                          // ...and leave it here, under s_mutex
+static int             s_returned_count = 0;
+static http_stream     s_streams[kMaxStreams];
+static int             s_stream_count   = 0;
+static http_buffer*    s_stream_header  = NULL;
+static http_buffer*    s_heartbeat      = NULL;
+
+static void start_handler( http_conn* conn, const http_route* route, const char* path, const char* query, bool head );
+
+
+
+#pragma mark -
+
+http_buffer* http_buffer_create( size_t len )
+{
+    http_buffer* buffer = (http_buffer*)malloc( sizeof( http_buffer ) + len + 1 );
+    if( !buffer )
+        return NULL;
+
+    atomic_init( &buffer->refs, 1 );
+    buffer->len        = len;
+    buffer->header_len = len;
+    buffer->data[len]  = '\0';
+    return buffer;
+}
+
+
+http_buffer* http_buffer_retain( http_buffer* buffer )
+{
+    if( buffer )
+        atomic_fetch_add( &buffer->refs, 1 );
+    return buffer;
+}
+
+
+void http_buffer_release( http_buffer* buffer )
+{
+    if( buffer && atomic_fetch_sub( &buffer->refs, 1 ) == 1 )
+        free( buffer );
+}
+
+
+static http_buffer* format_buffer( const char* format, ... ) __attribute__(( format( printf, 1, 2 ) ));
+static http_buffer* format_buffer( const char* format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    int len = vsnprintf( NULL, 0, format, args );
+    va_end( args );
+    if( len < 0 )
+        return NULL;
+
+    http_buffer* buffer = http_buffer_create( len );
+    if( !buffer )
+        return NULL;
+
+    va_start( args, format );
+    vsnprintf( buffer->data, len + 1, format, args );
+    va_end( args );
+    return buffer;
+}
+
+
+static uint64_t hash_body( const char* body, size_t len )
+{
+    uint64_t hash = 14695981039346656037ull;
+    for( size_t i = 0; i < len; i++ )
+        hash = (hash ^ (uint8_t)body[i]) * 1099511628211ull;
+    return hash;
+}
+
+
+static http_resource* find_resource( const char* path )
+{
+    for( int i = 0; i < s_resource_count; i++ )
+        if( strcmp( s_resources[i].path, path ) == 0 )
+            return &s_resources[i];
+    return NULL;
+}
+
+
+// replaces what we serve at path, connections in the middle of sending the old one keep their reference to it
+bool http_server_publish( const char* path, const char* content_type, const char* body, size_t len )
+{
+    if( !path || !content_type || !body || strlen( path ) >= sizeof( s_resources[0].path ) )
+        return false;
+
+    char etag[24];
+    snprintf( etag, sizeof( etag ), "\"%016llx\"", (unsigned long long)hash_body( body, len ) );
+
+    pthread_mutex_lock( &s_mutex );
+    http_resource* resource = find_resource( path );
+    bool           same     = resource && strcmp( resource->etag, etag ) == 0;
+    pthread_mutex_unlock( &s_mutex );
+    if( same )
+        return true;
+
+    char header[512];
+    int  header_len = snprintf( header, sizeof( header ), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nETag: %s\r\nCache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\n\r\n", content_type, len, etag );
+    if( header_len < 0 || header_len >= sizeof( header ) )
+        return false;
+
+    http_buffer* full = http_buffer_create( header_len + len );
+    if( !full )
+        return false;
+    memcpy( full->data, header, header_len );
+    memcpy( full->data + header_len, body, len );
+    full->header_len = header_len;
+
+    http_buffer* old = NULL;
+    pthread_mutex_lock( &s_mutex );
+    resource = find_resource( path );
+    if( !resource && s_resource_count < kMaxResources )
+    {
+        resource = &s_resources[s_resource_count++];
+        snprintf( resource->path, sizeof( resource->path ), "%s", path );
+    }
+    if( resource )
+    {
+        old = resource->response;
+        resource->response = full;
+        strcpy( resource->etag, etag );
+    }
+    pthread_mutex_unlock( &s_mutex );
+
+    http_buffer_release( resource ? old : full );
+    return resource != NULL;
+}
+
+
+
+#pragma mark -
+
+static void close_client( int index )
+{
+    http_conn* conn = &s_clients[index];
+    if( conn->fd >= 0 )             // -1 when a worker has it
+        close( conn->fd );
+    http_buffer_release( conn->out );
+    http_buffer_release( conn->pending );
+    if( conn->stream >= 0 )
+        --s_stats.subscribers;
+
+    // keep the array packed, the last one moves into the hole
+    if( index != s_client_count - 1 )
+        *conn = s_clients[s_client_count - 1];
+    --s_client_count;
+}
+
+
+// send as much as the socket takes, false when the connection should be closed
+static bool send_pending( http_conn* conn )
+{
+    while( conn->out && conn->out_pos < conn->out_len )
+    {
+        ssize_t sent = send( conn->fd, conn->out->data + conn->out_pos, conn->out_len - conn->out_pos, MSG_NOSIGNAL );
+        if( sent < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn->out_pos += sent;
+        __atomic_fetch_add( &s_stats.bytes_sent, sent, __ATOMIC_RELAXED );
+    }
+
+    if( conn->out )
+    {
+        http_buffer_release( conn->out );
+        conn->out = NULL;
+        if( conn->close_after )
+            return false;
+
+        // a subscriber that fell behind goes straight on to the newest event
+        if( conn->pending )
+        {
+            conn->out     = conn->pending;
+            conn->pending = NULL;
+            conn->out_pos = 0;
+            conn->out_len = conn->out->len;
+            return send_pending( conn );
+        }
+    }
+    return true;
+}
+
+
+static void respond( http_conn* conn, http_buffer* buffer, bool headOnly )
+{
+    conn->out     = buffer;
+    conn->out_pos = 0;
+    conn->out_len = buffer ? (headOnly ? buffer->header_len : buffer->len) : 0;
+    if( !buffer )
+        conn->close_after = true;
+}
+
+
+static void respond_error( http_conn* conn, const char* status )
+{
+    respond( conn, format_buffer( "HTTP/1.1 %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n%s\r\n%s\n", status, strlen( status ) + 1, conn->close_after ? "Connection: close\r\n" : "", status ), false );
+}
+
+
+#pragma mark -
+
+static bool write_all( http_request* request, const char* data, size_t len )
+{
+    while( len && !request->failed )
+    {
+        ssize_t sent = send( request->conn.fd, data, len, MSG_NOSIGNAL );
+        if( sent < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            request->failed = true;
+            break;
+        }
+        data += sent;
+        len  -= sent;
+        request->bytes += sent;
+        __atomic_fetch_add( &s_stats.bytes_sent, sent, __ATOMIC_RELAXED );
+    }
+    return !request->failed;
+}
+
+
+static bool flush_chunk( http_request* request )
+{
+    if( !request->len || request->head )
+    {
+        request->len = 0;
+        return !request->failed;
+    }
+
+    char size[16];
+    int  size_len = snprintf( size, sizeof( size ), "%zx\r\n", request->len );
+    bool ok = write_all( request, size, size_len ) && write_all( request, request->chunk, request->len ) && write_all( request, "\r\n", 2 );
+    request->len = 0;
+    return ok;
+}
+
+
+bool http_respond_start( http_request* request, int status, const char* reason, const char* content_type )
+{
+    if( !request || request->started )
+        return false;
+
+    char header[512];
+    int  len = snprintf( header, sizeof( header ), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\nCache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\n%s\r\n",
+                         status, reason, content_type, request->conn.close_after ? "Connection: close\r\n" : "" );
+    request->started = true;
+    return write_all( request, header, len );
+}
+
+
+bool http_respond_write( http_request* request, const void* data, size_t len )
+{
+    if( !request || !request->started )
+        return false;
+
+    const char* bytes = (const char*)data;
+    while( len && !request->failed )
+    {
+        size_t room = sizeof( request->chunk ) - request->len;
+        size_t take = len < room ? len : room;
+        memcpy( request->chunk + request->len, bytes, take );
+        request->len += take;
+        bytes        += take;
+        len          -= take;
+        if( request->len == sizeof( request->chunk ) )
+            flush_chunk( request );
+    }
+    return !request->failed;
+}
+
+
+bool http_respond_printf( http_request* request, const char* format, ... )
+{
+    char    line[1024];
+    va_list args;
+    va_start( args, format );
+    int len = vsnprintf( line, sizeof( line ), format, args );
+    va_end( args );
+    if( len < 0 )
+        return false;
+
+    if( len < sizeof( line ) )
+        return http_respond_write( request, line, len );
+
+    // doesn't happen much, do it the slow way
+    char* big = (char*)malloc( len + 1 );
+    if( !big )
+        return false;
+    va_start( args, format );
+    vsnprintf( big, len + 1, format, args );
+    va_end( args );
+    bool ok = http_respond_write( request, big, len );
+    free( big );
+    return ok;
+}
+
+
+bool http_respond_error( http_request* request, int status, const char* reason, const char* message )
+{
+    if( !http_respond_start( request, status, reason, "text/plain" ) )
+        return false;
+    return http_respond_printf( request, "%s\n", message ? message : reason );
+}
+
+
+static void finish_response( http_request* request )
+{
+    if( !request->started )
+        http_respond_error( request, 500, "Internal Server Error", "no response" );
+
+    flush_chunk( request );
+    if( !request->head )
+        write_all( request, "0\r\n\r\n", 5 );
+}
+
+
+static wx_thread_return_t http_worker( void* args )
+{
+    http_request* request = (http_request*)args;
+    http_conn*    conn    = &request->conn;
+
+    // blocking writes with a timeout are simpler than juggling partial sends in here
+    struct timeval timeout = { kWorkerTimeoutSecs, 0 };
+    setsockopt( conn->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout ) );
+    fcntl( conn->fd, F_SETFL, fcntl( conn->fd, F_GETFL ) & ~O_NONBLOCK );
+
+    request->route->handler( request, request->route->context );
+    finish_response( request );
+
+    fcntl( conn->fd, F_SETFL, fcntl( conn->fd, F_GETFL ) | O_NONBLOCK );
+
+    bool handed_back = false;
+    if( !request->failed && !conn->close_after )
+    {
+        pthread_mutex_lock( &s_mutex );
+        if( s_returned_count < kMaxWorkers )
+        {
+            s_returned[s_returned_count++] = *conn;
+            handed_back = true;
+        }
+        pthread_mutex_unlock( &s_mutex );
+    }
+
+    if( handed_back )
+    {
+        uint64_t one = 1;
+        write( s_wake_fd, &one, sizeof( one ) );
+    }
+    else
+        close( conn->fd );
+
+    free( request );
+    atomic_fetch_sub( &s_workers, 1 );
+    wx_thread_return();
+}
+
+
+static void start_handler( http_conn* conn, const http_route* route, const char* path, const char* query, bool head )
+{
+    ++s_stats.handled;
+
+    if( atomic_fetch_add( &s_workers, 1 ) >= kMaxWorkers )
+    {
+        atomic_fetch_sub( &s_workers, 1 );
+        ++s_stats.busy;
+        respond_error( conn, "503 Service Unavailable" );
+        return;
+    }
+
+    http_request* request = (http_request*)calloc( 1, sizeof( http_request ) );
+    if( !request )
+    {
+        atomic_fetch_sub( &s_workers, 1 );
+        respond_error( conn, "503 Service Unavailable" );
+        return;
+    }
+
+    request->route = route;
+    request->head  = head;
+    snprintf( request->path, sizeof( request->path ), "%s", path );
+    snprintf( request->query, sizeof( request->query ), "%s", query );
+    conn->handoff = request;
+}
+
+
+bool http_server_add_handler( const char* path, http_handler handler, void* context )
+{
+    if( !path || !handler || s_route_count >= kMaxHandlers || strlen( path ) >= sizeof( s_routes[0].path ) )
+        return false;
+
+    http_route* route = &s_routes[s_route_count++];
+    snprintf( route->path, sizeof( route->path ), "%s", path );
+    route->handler = handler;
+    route->context = context;
+    return true;
+}
+
+
+const char* http_request_path( const http_request* request )
+{
+    return request ? request->path : NULL;
+}
+
+
+static int hex_value( char c )
+{
+    if( c >= '0' && c <= '9' )
+        return c - '0';
+    if( c >= 'a' && c <= 'f' )
+        return c - 'a' + 10;
+    if( c >= 'A' && c <= 'F' )
+        return c - 'A' + 10;
+    return -1;
+}
+
+
+// decoded value of name=value from the query string
+bool http_request_param( const http_request* request, const char* name, char* value, size_t size )
+{
+    if( !request || !name || !value || !size )
+        return false;
+
+    size_t name_len = strlen( name );
+    for( const char* p = request->query; *p; )
+    {
+        const char* end = p + strcspn( p, "&" );
+        if( strncmp( p, name, name_len ) == 0 && (p[name_len] == '=' || p + name_len == end) )
+        {
+            const char* v   = p + name_len + (p[name_len] == '=' ? 1 : 0);
+            size_t      len = 0;
+            while( v < end && len < size - 1 )
+            {
+                if( *v == '%' && v + 2 < end && hex_value( v[1] ) >= 0 && hex_value( v[2] ) >= 0 )
+                {
+                    value[len++] = (char)(hex_value( v[1] ) * 16 + hex_value( v[2] ));
+                    v += 3;
+                }
+                else
+                {
+                    value[len++] = *v == '+' ? ' ' : *v;
+                    ++v;
+                }
+            }
+            value[len] = '\0';
+            return true;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return false;
+}
+
+
+#pragma mark -
+
+bool http_server_add_stream( const char* path )
+{
+    if( !path || s_stream_count >= kMaxStreams || strlen( path ) >= sizeof( s_streams[0].path ) )
+        return false;
+
+    if( !s_stream_header )
+    {
+        // no length and no chunking, the body just runs until one of us closes.  retry is how long the browser waits to reconnect
+        static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nAccess-Control-Allow-Origin: *\r\nX-Accel-Buffering: no\r\n\r\n";
+        s_stream_header = format_buffer( "%sretry: 5000\n\n", header );
+        s_heartbeat     = format_buffer( ":\n\n" );
+        if( !s_stream_header || !s_heartbeat )
+            return false;
+        s_stream_header->header_len = sizeof( header ) - 1;
+    }
+
+    http_stream* stream = &s_streams[s_stream_count++];
+    snprintf( stream->path, sizeof( stream->path ), "%s", path );
+    return true;
+}
+
+
+// formats the event once and wakes the server thread to hand it out, never waits on a client
+bool http_server_broadcast( const char* path, const char* event, const char* data, size_t len )
+{
+    if( s_wake_fd < 0 || !path || !data )
+        return false;
+
+    http_stream* stream = NULL;
+    for( int i = 0; i < s_stream_count && !stream; i++ )
+        if( strcmp( s_streams[i].path, path ) == 0 )
+            stream = &s_streams[i];
+    if( !stream )
+        return false;
+
+    // every line of the data needs its own prefix, ours is almost always one line of json
+    while( len && data[len - 1] == '\n' )
+        --len;
+    size_t lines = 1;
+    for( size_t i = 0; i < len; i++ )
+        lines += data[i] == '\n';
+
+    // the id has to match the order they go out in, so this is all done under the lock.  it's one small copy
+    pthread_mutex_lock( &s_mutex );
+    char head[96];
+    int  head_len = snprintf( head, sizeof( head ), "id: %llu\n%s%s%s", (unsigned long long)stream->sequence + 1, event ? "event: " : "", event ? event : "", event ? "\n" : "" );
+    http_buffer* buffer = head_len > 0 && head_len < sizeof( head ) ? http_buffer_create( head_len + len + lines * 7 + 1 ) : NULL;
+    if( !buffer )
+    {
+        pthread_mutex_unlock( &s_mutex );
+        return false;
+    }
+
+    char* out = buffer->data;
+    memcpy( out, head, head_len );
+    out += head_len;
+    for( const char* line = data; line <= data + len; )
+    {
+        const char* end = memchr( line, '\n', data + len - line );
+        if( !end )
+            end = data + len;
+        memcpy( out, "data: ", 6 );
+        memcpy( out + 6, line, end - line );
+        out += 6 + (end - line);
+        *out++ = '\n';
+        line = end + 1;
+    }
+    *out++ = '\n';
+    buffer->len = buffer->header_len = out - buffer->data;
+
+    http_buffer* old = stream->latest;
+    stream->latest   = buffer;
+    ++stream->sequence;
+    pthread_mutex_unlock( &s_mutex );
+    http_buffer_release( old );
+
+    uint64_t one = 1;
+    write( s_wake_fd, &one, sizeof( one ) );
+    return true;
+}
+
+
+static void subscribe( http_conn* conn, int stream, bool head )
+{
+    respond( conn, http_buffer_retain( s_stream_header ), head );
+    if( head )
+    {
+        conn->close_after = true;
+        return;
+    }
+
+    // the stream only ends when somebody closes it, Connection: close or not
+    conn->close_after = false;
+    conn->stream      = stream;
+    conn->pending     = http_buffer_retain( s_streams[stream].current );
+    ++s_stats.subscribers;
+}
+
+
+// hands buffer to every subscriber of the stream, or a heartbeat to every idle subscriber when stream is -1
+static void fan_out( int stream, http_buffer* buffer, time_t now )
+{
+    for( int i = s_client_count - 1; i >= 0; i-- )
+    {
+        http_conn* conn = &s_clients[i];
+        if( conn->stream < 0 || (stream >= 0 && conn->stream != stream) )
+            continue;
+
+        if( conn->out )
+        {
+            if( stream < 0 )
+                continue;
+
+            // still busy with an older one, this replaces whatever was waiting
+            if( conn->pending )
+                ++s_stats.coalesced;
+            http_buffer_release( conn->pending );
+            conn->pending = http_buffer_retain( buffer );
+            continue;
+        }
+
+        respond( conn, http_buffer_retain( buffer ), false );
+        conn->last_active = now;
+        if( !send_pending( conn ) )
+            close_client( i );
+    }
+}
+
+
+static void deliver_events( time_t now )
+{
+    for( int i = 0; i < s_stream_count; i++ )
+    {
+        http_stream* stream = &s_streams[i];
+
+        pthread_mutex_lock( &s_mutex );
+        http_buffer* event = NULL;
+        if( stream->delivered != stream->sequence )
+        {
+            event = http_buffer_retain( stream->latest );
+            s_stats.coalesced += stream->sequence - stream->delivered - 1;     // more than one came in before we got to them
+            stream->delivered = stream->sequence;
+        }
+        pthread_mutex_unlock( &s_mutex );
+
+        if( !event )
+            continue;
+
+        ++s_stats.events;
+        http_buffer_release( stream->current );
+        stream->current = event;
+        fan_out( i, event, now );
+    }
+}
+
+
+
+// value of a header in the block of header lines, NULL if it isn't there
+static const char* find_header( const char* headers, const char* name, size_t* len )
+{
+    size_t name_len = strlen( name );
+    for( const char* line = headers; line && *line; )
+    {
+        const char* end = strstr( line, "\r\n" );
+        if( !end )
+            break;
+
+        if( strncasecmp( line, name, name_len ) == 0 && line[name_len] == ':' )
+        {
+            const char* value = line + name_len + 1;
+            while( *value == ' ' || *value == '\t' )
+                ++value;
+            *len = end - value;
+            return value;
+        }
+        line = end + 2;
+    }
+    return NULL;
+}
+
+
+static void handle_request( http_conn* conn, char* request )
+{
+    ++s_stats.requests;
+
+    // request line
+    char* method  = request;
+    char* target  = strchr( method, ' ' );
+    char* version = target ? strchr( target + 1, ' ' ) : NULL;
+    char* headers = strstr( request, "\r\n" );
+    if( !target || !version || !headers || version > headers )
+    {
+        conn->close_after = true;
+        respond_error( conn, "400 Bad Request" );
+        return;
+    }
+    *target++  = '\0';
+    *version++ = '\0';
+    *headers   = '\0';
+    headers   += 2;
+
+    // HTTP/1.0 closes unless it asks not to, 1.1 stays open unless it asks to close
+    size_t      len        = 0;
+    const char* connection = find_header( headers, "Connection", &len );
+    bool        http10     = strcmp( version, "HTTP/1.0" ) == 0;
+    if( connection && len >= 5 && strncasecmp( connection, "close", 5 ) == 0 )
+        conn->close_after = true;
+    else if( http10 && !(connection && len >= 10 && strncasecmp( connection, "keep-alive", 10 ) == 0) )
+        conn->close_after = true;
+
+    bool head = strcmp( method, "HEAD" ) == 0;
+    if( !head && strcmp( method, "GET" ) != 0 )
+    {
+        respond_error( conn, "405 Method Not Allowed" );
+        return;
+    }
+
+    char* query = target + strcspn( target, "?#" );
+    if( *query == '?' )
+    {
+        *query++ = '\0';
+        query[strcspn( query, "#" )] = '\0';
+    }
+    else
+        *query = '\0';
+
+    for( int i = 0; i < s_route_count; i++ )
+    {
+        if( strcmp( s_routes[i].path, target ) == 0 )
+        {
+            start_handler( conn, &s_routes[i], target, query, head );
+            return;
+        }
+    }
+
+    for( int i = 0; i < s_stream_count; i++ )
+    {
+        if( strcmp( s_streams[i].path, target ) == 0 )
+        {
+            subscribe( conn, i, head );
+            return;
+        }
+    }
+
+    pthread_mutex_lock( &s_mutex );
+    http_resource* resource = find_resource( target );
+    http_buffer*   response = resource ? http_buffer_retain( resource->response ) : NULL;
+    char           etag[24] = "";
+    if( resource )
+        strcpy( etag, resource->etag );
+    pthread_mutex_unlock( &s_mutex );
+
+    if( !response )
+    {
+        ++s_stats.not_found;
+        respond_error( conn, "404 Not Found" );
+        return;
+    }
+
+    const char* match = find_header( headers, "If-None-Match", &len );
+    if( match && ((len == 1 && *match == '*') || memmem( match, len, etag, strlen( etag ) )) )
+    {
+        http_buffer_release( response );
+        ++s_stats.not_modified;
+        respond( conn, format_buffer( "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nCache-Control: no-cache\r\n\r\n", etag ), false );
+        return;
+    }
+
+    respond( conn, response, head );
+}
+
+
+// pull complete requests out of the input, one at a time since we only send one response at a time
+static bool process_input( http_conn* conn )
+{
+    // subscribers have nothing more to say, just throw it away
+    if( conn->stream >= 0 )
+    {
+        conn->in_len = 0;
+        return true;
+    }
+
+    while( !conn->out && conn->stream < 0 )
+    {
+        conn->in[conn->in_len] = '\0';
+        char* end = strstr( conn->in, "\r\n\r\n" );
+        if( !end )
+        {
+            if( conn->in_len >= sizeof( conn->in ) - 1 )
+            {
+                conn->close_after = true;
+                respond_error( conn, "431 Request Header Fields Too Large" );
+                return send_pending( conn );
+            }
+            return true;
+        }
+
+        // keep the blank line's first \r\n so the last header still ends in one
+        size_t used = end + 4 - conn->in;
+        end[2] = '\0';
+        handle_request( conn, conn->in );
+
+        memmove( conn->in, conn->in + used, conn->in_len - used );
+        conn->in_len -= used;
+
+        // the worker gets the connection as it is now, leftover pipelined requests and all
+        if( conn->handoff )
+        {
+            struct http_request* request = conn->handoff;
+            conn->handoff = NULL;
+            request->conn = *conn;
+            wx_create_thread_detached( http_worker, request );
+            conn->fd = -1;
+            return true;
+        }
+
+        if( !send_pending( conn ) )
+            return false;
+        if( conn->close_after && !conn->out )
+            return false;
+    }
+    return true;
+}
+
+
+static bool read_input( http_conn* conn )
+{
+    while( conn->in_len < sizeof( conn->in ) - 1 )
+    {
+        ssize_t got = recv( conn->fd, conn->in + conn->in_len, sizeof( conn->in ) - 1 - conn->in_len, 0 );
+        if( got == 0 )
+            return false;
+        if( got < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn->in_len += got;
+    }
+    return true;
+}
+
+
+static void accept_clients( void )
+{
+    while( 1 )
+    {
+        int fd = accept4( s_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if( fd < 0 )
+        {
+            if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                log_error_throttled( "http: accept failed (%d)\n", errno );
+            return;
+        }
+
+        if( s_client_count >= kMaxClients )
+        {
+            ++s_stats.refused;
+            close( fd );
+            continue;
+        }
+
+        int yes = 1;
+        setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof( yes ) );
+
+        http_conn* conn = &s_clients[s_client_count++];
+        conn->fd          = fd;
+        conn->in_len      = 0;
+        conn->out         = NULL;
+        conn->out_pos     = 0;
+        conn->out_len     = 0;
+        conn->close_after = false;
+        conn->handoff     = NULL;
+        conn->stream      = -1;
+        conn->pending     = NULL;
+        conn->last_active = time( NULL );
+
+        ++s_stats.connections;
+        if( s_client_count > s_stats.max_clients )
+            s_stats.max_clients = s_client_count;
+    }
+}
+
+
+// connections the workers are done with go back on the list, they might have more requests waiting already
+static void take_back_clients( void )
+{
+    uint64_t value;
+    while( read( s_wake_fd, &value, sizeof( value ) ) > 0 )
+        ;
+
+    http_conn returned[kMaxWorkers];
+    pthread_mutex_lock( &s_mutex );
+    int count = s_returned_count;
+    memcpy( returned, s_returned, count * sizeof( http_conn ) );
+    s_returned_count = 0;
+    pthread_mutex_unlock( &s_mutex );
+
+    for( int i = 0; i < count; i++ )
+    {
+        if( s_client_count >= kMaxClients )
+        {
+            close( returned[i].fd );
+            continue;
+        }
+
+        s_clients[s_client_count] = returned[i];
+        s_clients[s_client_count].last_active = time( NULL );
+        if( !process_input( &s_clients[s_client_count++] ) || s_clients[s_client_count - 1].fd < 0 )
+            close_client( s_client_count - 1 );
+    }
+}
+
+
+static wx_thread_return_t http_server_thread( void* args )
+{
+    static struct pollfd fds[kMaxClients + 2];
+    time_t last_heartbeat = time( NULL );
+
+    while( 1 )
+    {
+        fds[0].fd     = s_listen_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd     = s_wake_fd;
+        fds[1].events = POLLIN;
+        for( int i = 0; i < s_client_count; i++ )
+        {
+            fds[i + 2].fd     = s_clients[i].fd;
+            fds[i + 2].events = s_clients[i].out ? POLLOUT : POLLIN;
+        }
+
+        int count = s_client_count;
+        if( poll( fds, count + 2, 1000 ) < 0 )
+        {
+            if( errno != EINTR )
+                log_error_throttled( "http: poll failed (%d)\n", errno );
+            continue;
+        }
+
+        // backwards since closing one moves the last client into its spot
+        time_t now = time( NULL );
+        for( int i = count - 1; i >= 0; i-- )
+        {
+            http_conn* conn    = &s_clients[i];
+            short      revents = fds[i + 2].revents;
+            bool       keep    = true;
+
+            if( revents & (POLLERR | POLLNVAL) )
+                keep = false;
+            else if( revents & POLLOUT )
+                keep = send_pending( conn ) && process_input( conn );
+            else if( revents & (POLLIN | POLLHUP) )
+                keep = read_input( conn ) && process_input( conn );
+            else if( conn->stream >= 0 )
+            {
+                // idle subscribers are fine, one that won't take what we have for it isn't
+                if( conn->out && now - conn->last_active > kStreamStallSecs )
+                {
+                    ++s_stats.dropped;
+                    keep = false;
+                }
+            }
+            else if( now - conn->last_active > kKeepAliveSecs )
+                keep = false;
+
+            if( revents )
+                conn->last_active = now;
+            if( !keep || conn->fd < 0 )
+                close_client( i );
+        }
+
+        if( fds[1].revents & POLLIN )
+        {
+            take_back_clients();
+            deliver_events( now );
+        }
+
+        if( s_stats.subscribers && now - last_heartbeat >= kHeartbeatSecs )
+        {
+            fan_out( -1, s_heartbeat, now );
+            last_heartbeat = now;
+        }
+
+        if( fds[0].revents & POLLIN )
+            accept_clients();
+
+        s_stats.clients = s_client_count;
+    }
+
+    wx_thread_return();
+}
+
+
+
+#pragma mark -
+
+// "8080", ":8080" or "127.0.0.1:8080"
+bool http_server_parse_address( const char* arg, char* host, size_t size, uint16_t* port )
+{
+    if( !arg || !host || !size || !port )
+        return false;
+
+    const char* colon = strrchr( arg, ':' );
+    const char* digits = colon ? colon + 1 : arg;
+    char*       end    = NULL;
+    long        value  = strtol( digits, &end, 10 );
+    if( end == digits || *end || value <= 0 || value > 65535 )
+        return false;
+
+    host[0] = '\0';
+    if( colon && colon != arg )
+    {
+        size_t len = colon - arg;
+        if( len >= size )
+            return false;
+        memcpy( host, arg, len );
+        host[len] = '\0';
+    }
+    *port = (uint16_t)value;
+    return true;
+}
+
+
+bool http_server_start( const char* address, uint16_t port )
+{
+    if( s_listen_fd >= 0 )
+        return false;
+
+    struct addrinfo  hints;
+    struct addrinfo* info = NULL;
+    char             service[8];
+    memset( &hints, 0, sizeof( hints ) );
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    snprintf( service, sizeof( service ), "%u", port );
+
+    int err = getaddrinfo( address && *address ? address : NULL, service, &hints, &info );
+    if( err )
+    {
+        log_error( "http: can't resolve %s: %s\n", address ? address : "", gai_strerror( err ) );
+        return false;
+    }
+
+    for( struct addrinfo* ai = info; ai && s_listen_fd < 0; ai = ai->ai_next )
+    {
+        int fd = socket( ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol );
+        if( fd < 0 )
+            continue;
+
+        int yes = 1;
+        setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof( yes ) );
+        if( bind( fd, ai->ai_addr, ai->ai_addrlen ) == 0 && listen( fd, 128 ) == 0 )
+            s_listen_fd = fd;
+        else
+            close( fd );
+    }
+    freeaddrinfo( info );
+
+    if( s_listen_fd < 0 )
+    {
+        log_error( "http: failed to listen on port %u (%d)\n", port, errno );
+        return false;
+    }
+
+    s_wake_fd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if( s_wake_fd < 0 )
+    {
+        log_error( "http: eventfd failed (%d)\n", errno );
+        close( s_listen_fd );
+        s_listen_fd = -1;
+        return false;
+    }
+
+    wx_create_thread_detached( http_server_thread, NULL );
+    return true;
+}
+
+
+// the counters are only touched by the server thread, a slightly stale copy is fine for the log
+void http_server_get_stats( http_stats* stats )
+{
+    if( stats )
+        *stats = s_stats;
+}
+
+
+void http_server_log_stats( void )
+{
+    if( s_listen_fd < 0 )
+        return;
+
+    http_stats stats;
+    http_server_get_stats( &stats );
+    log_error( "http: connections: %llu, requests: %llu, 304s: %llu, 404s: %llu, sent: %llu bytes, clients: %u (max %u), refused: %u\n",
+               (unsigned long long)stats.connections, (unsigned long long)stats.requests, (unsigned long long)stats.not_modified,
+               (unsigned long long)stats.not_found, (unsigned long long)stats.bytes_sent, stats.clients, stats.max_clients, stats.refused );
+    if( s_stream_count )
+        log_error( "http: subscribers: %u, events: %llu, coalesced: %llu, dropped: %u\n", stats.subscribers, (unsigned long long)stats.events,
+                   (unsigned long long)stats.coalesced, stats.dropped );
+}
@@ -0,0 +1,68 @@
+//
+//  http_server.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_http_server
+#define _H_http_server
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a complete response (or any other bytes) that any number of connections can be sending at once, the last one out frees it
+typedef struct
+{
+    atomic_int refs;
+    size_t     len;
+    size_t     header_len;      // HEAD only sends this much
+    char       data[];
+} http_buffer;
+
+typedef struct
+{
+    uint64_t connections;
+    uint64_t requests;
+    uint64_t not_modified;      // 304s, the dashboards polling with If-None-Match
+    uint64_t not_found;
+    uint64_t bytes_sent;
+    uint32_t clients;           // open right now
+    uint32_t max_clients;
+    uint32_t refused;           // turned away because we were full
+    uint64_t handled;           // requests that went to a handler
+    uint64_t busy;              // ...and got a 503 because all the workers were busy
+    uint32_t subscribers;       // event stream connections open right now
+    uint32_t dropped;           // subscribers closed for not keeping up
+    uint64_t events;            // broadcasts fanned out
+    uint64_t coalesced;         // events a subscriber (or all of them) never got because a newer one replaced it
+} http_stats;
+
+// handlers run on a worker thread and stream their response, http_respond_start() first then write as much as you like
+typedef struct http_request http_request;
+typedef void (*http_handler)( http_request* request, void* context );
+
+bool         http_server_start( const char* address, uint16_t port );
+bool         http_server_parse_address( const char* arg, char* host, size_t size, uint16_t* port );
+bool         http_server_publish( const char* path, const char* content_type, const char* body, size_t len );
+void         http_server_get_stats( http_stats* stats );
+void         http_server_log_stats( void );
+bool         http_server_add_handler( const char* path, http_handler handler, void* context );
+bool         http_server_add_stream( const char* path );
+bool         http_server_broadcast( const char* path, const char* event, const char* data, size_t len );
+
+const char*  http_request_path( const http_request* request );
+bool         http_request_param( const http_request* request, const char* name, char* value, size_t size );
+bool         http_respond_start( http_request* request, int status, const char* reason, const char* content_type );
+bool         http_respond_write( http_request* request, const void* data, size_t len );
+bool         http_respond_printf( http_request* request, const char* format, ... ) __attribute__(( format( printf, 2, 3 ) ));
+bool         http_respond_error( http_request* request, int status, const char* reason, const char* message );
+
+http_buffer* http_buffer_create( size_t len );
+http_buffer* http_buffer_retain( http_buffer* buffer );
+void         http_buffer_release( http_buffer* buffer );
+
+#endif // !_H_http_server
@@ -0,0 +1,596 @@
+//
+//  ingest.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Takes frames from remote nodes (ESP32s next to a rain gauge, receivers around the neighborhood...) over TCP.  This replaces
+//  rain_socket.c, which select()ed over all of FD_SETSIZE on every wakeup, took whatever one read() returned as a whole frame
+//  and exit()ed the relay if it couldn't bind.  One thread runs an epoll loop over the listeners and every connection, so a
+//  wakeup only costs what's ready.  Each connection gets an input_framer to put its frames back together however TCP split them.
+//  Connections come out of a fixed pool and sit on a list in the order we last heard from them, so finding the idle ones is
+//  only ever a look at the front of it.
+//
+//  A listener is either wx, whose frames go to the merge in receivers.c as one more receiver, or rain, whose frames go to the
+//  rain sensor just like the ones off its serial port.  rain_accum only knows one running count, so there's only one rain
+//  listener and it only takes one connection at a time, and main.c doesn't open the rain serial port when there is one.
+//
+//  --capture gets every frame that comes in, wx on its listener's receiver and rain on kIngestRainChannel.  They're recorded
+//  a whole frame at a time once the connection's framer has them, a record of raw reads from hundreds of connections would
+//  get glued together on replay.
+//
+
+#define _GNU_SOURCE     // accept4
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "capture.h"
+#include "ingest.h"
+#include "input.h"
+#include "logging.h"
+#include "metrics.h"
+#include "wx_thread.h"
+#include "rain_sensor.h"
+#include "receivers.h"
+
+
+#define kIngestEvents       64
+#define kIngestReadSize     4096
+
+
+typedef struct
+{
+    char           spec[64];
+    char           host[48];
+    char           port[8];
+    capture_source stream;          // kCapture_wx or kCapture_rain
+    int            receiver;        // wx only
+    int            fd;
+    uint16_t       bound;
+} ingest_listener;
+
+typedef struct ingest_connection
+{
+    int                       fd;
+    ingest_listener*          listener;
+    time_t                    last;
+    input_framer              framer;
+    struct ingest_connection* prev;     // the idle list, least recently heard from first
+    struct ingest_connection* next;
+} ingest_connection;
+
+
+static ingest_listener   s_listeners[kIngestMaxListeners];
+static int               s_listener_count = 0;
+static int               s_epoll          = -1;
+static atomic_bool       s_shutdown       = false;
+static bool              s_started        = false;
+static wx_thread_t       s_thread;
+
+// only the ingest thread touches these
+static ingest_connection  s_pool[kIngestMaxConnections];
+static ingest_connection* s_free      = NULL;
+static ingest_connection* s_idle_head = NULL;
+static ingest_connection* s_idle_tail = NULL;
+static ingest_connection* s_rain_gauge = NULL;     // the one rain connection
+
+static atomic_uint_fast64_t s_accepted     = 0;
+static atomic_uint_fast64_t s_rejected     = 0;
+static atomic_uint_fast64_t s_timed_out    = 0;
+static atomic_uint_fast64_t s_closed       = 0;
+static atomic_uint          s_connections  = 0;
+static atomic_uint          s_peak         = 0;
+static atomic_uint_fast64_t s_wx_frames    = 0;
+static atomic_uint_fast64_t s_rain_frames  = 0;
+static atomic_uint_fast64_t s_bytes        = 0;
+static atomic_uint_fast64_t s_short_frames = 0;
+static atomic_uint_fast64_t s_wakeups      = 0;
+
+
+
+#pragma mark -
+
+bool ingest_parse_option( const char* arg )
+{
+    if( !arg || s_started )
+        return false;
+
+    if( s_listener_count >= kIngestMaxListeners )
+    {
+        printf( "too many ingest listeners, %s is more than %d\n", arg, kIngestMaxListeners );
+        return false;
+    }
+
+    ingest_listener* listener = &s_listeners[s_listener_count];
+    memset( listener, 0, sizeof( ingest_listener ) );
+    listener->fd       = -1;
+    listener->receiver = -1;
+
+    const char* rest = NULL;
+    if( !strncmp( arg, "wx:", 3 ) )
+    {
+        listener->stream = kCapture_wx;
+        rest = arg + 3;
+    }
+    else if( !strncmp( arg, "rain:", 5 ) )
+    {
+        if( ingest_has_rain() )
+        {
+            printf( "only one rain ingest, %s would be a second rain gauge and the totals can only come from one\n", arg );
+            return false;
+        }
+        listener->stream = kCapture_rain;
+        rest = arg + 5;
+    }
+
+    // [address:]port
+    const char* colon = rest ? strrchr( rest, ':' ) : NULL;
+    const char* port  = colon ? colon + 1 : rest;
+    if( !port || !*port || strspn( port, "0123456789" ) != strlen( port ) || strlen( port ) >= sizeof( listener->port ) ||
+        (colon && (size_t)(colon - rest) >= sizeof( listener->host )) )
+    {
+        printf( "ingest wants wx|rain:[address:]port, not %s\n", arg );
+        return false;
+    }
+    snprintf( listener->port, sizeof( listener->port ), "%s", port );
+    snprintf( listener->host, sizeof( listener->host ), "%.*s", colon ? (int)(colon - rest) : 0, rest );
+    snprintf( listener->spec, sizeof( listener->spec ), "ingest:%s", arg );
+
+    // the wx nodes show up in the merge as one receiver, it has to be there before the receivers start
+    if( listener->stream == kCapture_wx )
+    {
+        listener->receiver = receivers_add_remote( listener->spec );
+        if( listener->receiver < 0 )
+        {
+            printf( "too many receivers, %s would be more than %d\n", arg, kMaxReceivers );
+            return false;
+        }
+    }
+
+    ++s_listener_count;
+    return true;
+}
+
+
+static int open_listener( ingest_listener* listener )
+{
+    struct addrinfo  hints  = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE };
+    struct addrinfo* result = NULL;
+    int              error  = getaddrinfo( *listener->host ? listener->host : NULL, listener->port, &hints, &result );
+    if( error )
+    {
+        log_error( "ingest: can't look up %s: %s\n", listener->spec, gai_strerror( error ) );
+        return -1;
+    }
+
+    int fd = -1;
+    for( struct addrinfo* ai = result; ai && fd < 0; ai = ai->ai_next )
+    {
+        fd = socket( ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol );
+        if( fd < 0 )
+            continue;
+
+        int on = 1;
+        setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+        if( bind( fd, ai->ai_addr, ai->ai_addrlen ) < 0 || listen( fd, SOMAXCONN ) < 0 )
+        {
+            log_error( "ingest: can't listen on %s (%d)\n", listener->spec, errno );
+            close( fd );
+            fd = -1;
+        }
+    }
+    freeaddrinfo( result );
+
+    struct sockaddr_storage address;
+    socklen_t               size = sizeof( address );
+    if( fd >= 0 && getsockname( fd, (struct sockaddr*)&address, &size ) == 0 )
+        listener->bound = ntohs( address.ss_family == AF_INET6 ? ((struct sockaddr_in6*)&address)->sin6_port : ((struct sockaddr_in*)&address)->sin_port );
+    return fd;
+}
+
+
+// every connection is a descriptor, make sure the process is allowed enough of them
+static void raise_file_limit( void )
+{
+    struct rlimit limit;
+    rlim_t        want = kIngestMaxConnections + 64;
+    if( getrlimit( RLIMIT_NOFILE, &limit ) < 0 || limit.rlim_cur >= want )
+        return;
+
+    limit.rlim_cur = limit.rlim_max < want ? limit.rlim_max : want;
+    setrlimit( RLIMIT_NOFILE, &limit );
+}
+
+
+
+#pragma mark -
+
+static void idle_unlink( ingest_connection* conn )
+{
+    if( conn->prev )
+        conn->prev->next = conn->next;
+    else
+        s_idle_head = conn->next;
+    if( conn->next )
+        conn->next->prev = conn->prev;
+    else
+        s_idle_tail = conn->prev;
+    conn->prev = conn->next = NULL;
+}
+
+
+static void idle_append( ingest_connection* conn )
+{
+    conn->prev = s_idle_tail;
+    conn->next = NULL;
+    if( s_idle_tail )
+        s_idle_tail->next = conn;
+    else
+        s_idle_head = conn;
+    s_idle_tail = conn;
+}
+
+
+static void close_connection( ingest_connection* conn )
+{
+    if( conn->framer.have && conn->framer.have < conn->framer.size )
+    {
+        atomic_fetch_add_explicit( &s_short_frames, 1, memory_order_relaxed );
+        if( conn->listener->stream == kCapture_wx )
+            metrics_count( kCounter_frames_short );
+    }
+
+    if( conn == s_rain_gauge )
+        s_rain_gauge = NULL;
+
+    // closing it takes it out of the epoll set
+    close( conn->fd );
+    idle_unlink( conn );
+    conn->fd   = -1;
+    conn->next = s_free;
+    s_free     = conn;
+    atomic_fetch_sub_explicit( &s_connections, 1, memory_order_relaxed );
+}
+
+
+static void accept_connections( ingest_listener* listener, time_t now )
+{
+    while( 1 )
+    {
+        int fd = accept4( listener->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if( fd < 0 )
+        {
+            if( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                log_error_throttled( "ingest: accept on %s failed (%d)\n", listener->spec, errno );
+            return;
+        }
+
+        // a second gauge's count would look like the first one's jumping around, it can have a turn when the first one goes away
+        if( listener->stream == kCapture_rain && s_rain_gauge )
+        {
+            atomic_fetch_add_explicit( &s_rejected, 1, memory_order_relaxed );
+            log_error_throttled( "ingest: %s already has a rain gauge connected, turning another one away\n", listener->spec );
+            close( fd );
+            continue;
+        }
+
+        ingest_connection* conn = s_free;
+        if( !conn )
+        {
+            atomic_fetch_add_explicit( &s_rejected, 1, memory_order_relaxed );
+            log_error_throttled( "ingest: already have %d connections, turning one away\n", kIngestMaxConnections );
+            close( fd );
+            continue;
+        }
+        s_free = conn->next;
+
+        conn->fd       = fd;
+        conn->listener = listener;
+        conn->last     = now;
+        if( listener->stream == kCapture_wx )
+            input_framer_init( &conn->framer, sizeof( Frame ), receivers_frame_ok );
+        else
+            input_framer_init( &conn->framer, sizeof( RainFrame ), NULL );
+        idle_append( conn );
+
+        struct epoll_event event = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = conn };
+        if( epoll_ctl( s_epoll, EPOLL_CTL_ADD, fd, &event ) < 0 )
+        {
+            log_error_throttled( "ingest: can't watch a connection on %s (%d)\n", listener->spec, errno );
+            idle_unlink( conn );
+            close( fd );
+            conn->fd   = -1;
+            conn->next = s_free;
+            s_free     = conn;
+            continue;
+        }
+
+        if( listener->stream == kCapture_rain )
+            s_rain_gauge = conn;
+        atomic_fetch_add_explicit( &s_accepted, 1, memory_order_relaxed );
+        unsigned int count = atomic_fetch_add_explicit( &s_connections, 1, memory_order_relaxed ) + 1;
+        if( count > atomic_load_explicit( &s_peak, memory_order_relaxed ) )
+            atomic_store_explicit( &s_peak, count, memory_order_relaxed );
+    }
+}
+
+
+// level triggered, one read per wakeup keeps a chatty node from starving the others
+static void read_connection( ingest_connection* conn, time_t now )
+{
+    uint8_t buffer[kIngestReadSize];
+    ssize_t result = read( conn->fd, buffer, sizeof( buffer ) );
+    if( result < 0 && (errno == EAGAIN || errno == EINTR) )
+        return;
+    if( result <= 0 )
+    {
+        atomic_fetch_add_explicit( &s_closed, 1, memory_order_relaxed );
+        close_connection( conn );
+        return;
+    }
+
+    uint64_t micros = metrics_now_us();
+    atomic_fetch_add_explicit( &s_bytes, result, memory_order_relaxed );
+    conn->last = now;
+    idle_unlink( conn );
+    idle_append( conn );
+
+    ingest_listener* listener = conn->listener;
+    for( size_t used = 0; used < (size_t)result; )
+    {
+        bool complete = false;
+        used += input_framer_add( &conn->framer, &buffer[used], result - used, micros, &complete );
+        if( !complete )
+            break;
+
+        if( listener->stream == kCapture_wx )
+        {
+            capture_chunk( kCapture_wx, listener->receiver, conn->framer.bytes, sizeof( Frame ) );
+
+            Frame frame;
+            memcpy( &frame, conn->framer.bytes, sizeof( Frame ) );
+            receivers_push( listener->receiver, &frame, conn->framer.first_us );
+            atomic_fetch_add_explicit( &s_wx_frames, 1, memory_order_relaxed );
+        }
+        else
+        {
+            capture_chunk( kCapture_rain, kIngestRainChannel, conn->framer.bytes, sizeof( RainFrame ) );
+
+            RainFrame frame;
+            memcpy( &frame, conn->framer.bytes, sizeof( RainFrame ) );
+            process_rain_frame( &frame );
+            atomic_fetch_add_explicit( &s_rain_frames, 1, memory_order_relaxed );
+        }
+    }
+}
+
+
+static void expire_idle( time_t now )
+{
+    while( s_idle_head && now - s_idle_head->last >= kIngestIdleSecs )
+    {
+        atomic_fetch_add_explicit( &s_timed_out, 1, memory_order_relaxed );
+        close_connection( s_idle_head );
+    }
+}
+
+
+static bool is_listener( const void* ptr )
+{
+    return ptr >= (const void*)s_listeners && ptr < (const void*)&s_listeners[kIngestMaxListeners];
+}
+
+
+static wx_thread_return_t ingest_thread( void* args )
+{
+    struct epoll_event events[kIngestEvents];
+    while( !atomic_load( &s_shutdown ) )
+    {
+        int count = epoll_wait( s_epoll, events, kIngestEvents, 1000 );
+        if( count < 0 && errno != EINTR )
+        {
+            log_error_throttled( "ingest: epoll_wait failed (%d)\n", errno );
+            sleep( 1 );
+        }
+
+        time_t now = time( NULL );
+        if( count > 0 )
+            atomic_fetch_add_explicit( &s_wakeups, 1, memory_order_relaxed );
+        for( int i = 0; i < count; i++ )
+        {
+            if( is_listener( events[i].data.ptr ) )
+                accept_connections( (ingest_listener*)events[i].data.ptr, now );
+            else
+                read_connection( (ingest_connection*)events[i].data.ptr, now );
+        }
+        expire_idle( now );
+    }
+
+    while( s_idle_head )
+        close_connection( s_idle_head );
+    wx_thread_return();
+}
+
+
+bool ingest_start( void )
+{
+    if( s_started || !s_listener_count )
+        return false;
+
+    s_epoll = epoll_create1( EPOLL_CLOEXEC );
+    if( s_epoll < 0 )
+    {
+        log_error( "ingest: can't create an epoll instance (%d)\n", errno );
+        return false;
+    }
+    raise_file_limit();
+
+    for( int i = kIngestMaxConnections - 1; i >= 0; i-- )
+    {
+        s_pool[i].fd   = -1;
+        s_pool[i].next = s_free;
+        s_free         = &s_pool[i];
+    }
+
+    // a listener that can't bind is logged and left out, the relay carries on without it
+    int listening = 0;
+    for( int i = 0; i < s_listener_count; i++ )
+    {
+        ingest_listener* listener = &s_listeners[i];
+        listener->fd = open_listener( listener );
+        if( listener->fd < 0 )
+            continue;
+
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = listener };
+        if( epoll_ctl( s_epoll, EPOLL_CTL_ADD, listener->fd, &event ) < 0 )
+        {
+            log_error( "ingest: can't watch %s (%d)\n", listener->spec, errno );
+            close( listener->fd );
+            listener->fd = -1;
+            continue;
+        }
+        log_error( "ingest: listening for %s frames on port %u\n", capture_source_name( listener->stream ), listener->bound );
+        ++listening;
+    }
+
+    if( !listening )
+    {
+        close( s_epoll );
+        s_epoll = -1;
+        return false;
+    }
+
+    s_thread  = wx_create_thread( ingest_thread, NULL );
+    s_started = true;
+    return true;
+}
+
+
+void ingest_shutdown( void )
+{
+    if( !s_started )
+        return;
+
+    atomic_store( &s_shutdown, true );
+    wx_thread_join( s_thread );
+    for( int i = 0; i < s_listener_count; i++ )
+    {
+        if( s_listeners[i].fd >= 0 )
+            close( s_listeners[i].fd );
+        s_listeners[i].fd = -1;
+    }
+    close( s_epoll );
+    s_epoll   = -1;
+    s_started = false;
+}
+
+
+uint16_t ingest_port( int listener )
+{
+    return listener >= 0 && listener < s_listener_count ? s_listeners[listener].bound : 0;
+}
+
+
+int ingest_listeners( void )
+{
+    return s_listener_count;
+}
+
+
+bool ingest_has_rain( void )
+{
+    for( int i = 0; i < s_listener_count; i++ )
+        if( s_listeners[i].stream == kCapture_rain )
+            return true;
+    return false;
+}
+
+
+
+#pragma mark -
+
+void ingest_get_stats( ingest_stats* stats )
+{
+    if( !stats )
+        return;
+
+    stats->accepted     = atomic_load_explicit( &s_accepted, memory_order_relaxed );
+    stats->rejected     = atomic_load_explicit( &s_rejected, memory_order_relaxed );
+    stats->timed_out    = atomic_load_explicit( &s_timed_out, memory_order_relaxed );
+    stats->closed       = atomic_load_explicit( &s_closed, memory_order_relaxed );
+    stats->connections  = atomic_load_explicit( &s_connections, memory_order_relaxed );
+    stats->peak         = atomic_load_explicit( &s_peak, memory_order_relaxed );
+    stats->wx_frames    = atomic_load_explicit( &s_wx_frames, memory_order_relaxed );
+    stats->rain_frames  = atomic_load_explicit( &s_rain_frames, memory_order_relaxed );
+    stats->bytes        = atomic_load_explicit( &s_bytes, memory_order_relaxed );
+    stats->short_frames = atomic_load_explicit( &s_short_frames, memory_order_relaxed );
+    stats->wakeups      = atomic_load_explicit( &s_wakeups, memory_order_relaxed );
+}
+
+
+void ingest_command( FILE* out, const char* args, void* context )
+{
+    for( int i = 0; i < s_listener_count; i++ )
+        fprintf( out, "%-32s port %u%s\n", s_listeners[i].spec, s_listeners[i].bound, s_listeners[i].fd < 0 ? " (not listening)" : "" );
+
+    ingest_stats stats;
+    ingest_get_stats( &stats );
+    fprintf( out, "connections: %u (peak %u), accepted: %llu, rejected: %llu, timed out: %llu, closed: %llu\n", stats.connections, stats.peak,
+             (unsigned long long)stats.accepted, (unsigned long long)stats.rejected, (unsigned long long)stats.timed_out, (unsigned long long)stats.closed );
+    fprintf( out, "wx frames: %llu, rain frames: %llu, bytes: %llu, short: %llu, wakeups: %llu\n", (unsigned long long)stats.wx_frames,
+             (unsigned long long)stats.rain_frames, (unsigned long long)stats.bytes, (unsigned long long)stats.short_frames, (unsigned long long)stats.wakeups );
+}
+
+
+void ingest_log_stats( void )
+{
+    if( !s_listener_count )
+        return;
+
+    ingest_stats stats;
+    ingest_get_stats( &stats );
+    log_error( "ingest connections: %u (peak %u), accepted: %llu, rejected: %llu, timed out: %llu, wx frames: %llu, rain frames: %llu, short: %llu\n",
+               stats.connections, stats.peak, (unsigned long long)stats.accepted, (unsigned long long)stats.rejected, (unsigned long long)stats.timed_out,
+               (unsigned long long)stats.wx_frames, (unsigned long long)stats.rain_frames, (unsigned long long)stats.short_frames );
+}
+
+
+static double connections_value( void* context )
+{
+    return atomic_load_explicit( &s_connections, memory_order_relaxed );
+}
+
+
+static double frames_value( void* context )
+{
+    return atomic_load_explicit( &s_wx_frames, memory_order_relaxed ) + atomic_load_explicit( &s_rain_frames, memory_order_relaxed );
+}
+
+
+static double bytes_value( void* context )
+{
+    return atomic_load_explicit( &s_bytes, memory_order_relaxed );
+}
+
+
+void ingest_add_metrics( void )
+{
+    if( !s_listener_count )
+        return;
+
+    metrics_add_value( "wxrelay_ingest_connections", "gauge",   "Remote nodes connected right now",        connections_value, NULL );
+    metrics_add_value( "wxrelay_ingest_frames_total", "counter", "Wx and rain frames from remote nodes",    frames_value,      NULL );
+    metrics_add_value( "wxrelay_ingest_bytes_total",  "counter", "Bytes read from remote nodes",            bytes_value,       NULL );
+}
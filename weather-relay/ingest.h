@@ -0,0 +1,49 @@
+//
+//  ingest.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_ingest
+#define _H_ingest
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define kIngestMaxListeners     4
+#define kIngestMaxConnections   1024
+#define kIngestIdleSecs         120         // the nodes send every few seconds, one that's quiet this long is gone
+#define kIngestRainChannel      1           // what a rain: node's frames are captured as, the --rain serial port is 0
+
+typedef struct
+{
+    uint64_t accepted;
+    uint64_t rejected;          // over kIngestMaxConnections, or a second rain gauge
+    uint64_t timed_out;         // idle longer than kIngestIdleSecs
+    uint64_t closed;            // the node hung up
+    uint32_t connections;
+    uint32_t peak;
+    uint64_t wx_frames;
+    uint64_t rain_frames;
+    uint64_t bytes;
+    uint64_t short_frames;      // connection went away in the middle of a frame
+    uint64_t wakeups;           // epoll_wait() calls that came back with something
+} ingest_stats;
+
+// wx|rain:[address:]port, which kind of frame the nodes connecting to it send
+bool     ingest_parse_option( const char* arg );
+bool     ingest_start( void );
+void     ingest_shutdown( void );
+uint16_t ingest_port( int listener );      // what it's bound to, for port 0
+int      ingest_listeners( void );          // how many --ingest options there were
+bool     ingest_has_rain( void );           // a rain: listener, the rain gauge is on the other end of it instead of the serial port
+
+void     ingest_get_stats( ingest_stats* stats );
+void     ingest_command( FILE* out, const char* args, void* context );
+void     ingest_log_stats( void );
+void     ingest_add_metrics( void );
+
+#endif // !_H_ingest
@@ -0,0 +1,681 @@
+//
+//  input.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Everything the readers pull bytes from, picked at run time from a spec string instead of being hard wired to a serial port.
+//  Each kind only differs in how it gets a descriptor (open, connect, accept...) and what it does when that goes away, after that
+//  it's all the same poll() and read().  A capture plays back through here too, paced by the gaps between the recorded reads, so
+//  the live pipeline (threads, merge, send queues and all) can be run from the desk without a receiver.  Nothing in here gives up
+//  for good: an input that can't be opened gets tried again every kInputRetrySecs, only stdin and captures ever run out.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "input.h"
+#include "logging.h"
+#include "metrics.h"
+
+
+#define kConnectTimeoutMs   5000
+
+
+struct input_source
+{
+    input_kind      kind;
+    char            spec[PATH_MAX];
+    char            path[PATH_MAX];     // device, FIFO, socket or capture file, the host for tcp
+    char            port[16];
+    int             speed;              // serial baud rate
+    capture_source  stream;
+    int             channel;
+    double          replaySpeed;
+
+    int             fd;                 // what we read from, -1 when it isn't open
+    int             listener;           // tcp server only
+    time_t          retryAt;
+    bool            finished;
+
+    // capture playback, a record that isn't due yet waits here
+    capture_reader* capture;
+    capture_record  record;
+    uint8_t         pending[kCaptureChunkMax];
+    size_t          pendingLength;
+    size_t          pendingOffset;
+    uint64_t        baseNs;
+    uint64_t        startUs;
+};
+
+
+static const char* s_kind_names[kInput_count] = { "serial", "fifo", "tcp", "listen", "unix", "stdin", "capture" };
+
+
+
+#pragma mark -
+
+static int baud_rate( long baud )
+{
+    switch( baud )
+    {
+        case 1200:   return B1200;
+        case 2400:   return B2400;
+        case 4800:   return B4800;
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+    }
+    return -1;
+}
+
+
+// host:port or port, the last colon splits them so a bare port works too
+static bool split_host_port( const char* arg, char* host, size_t hostSize, char* port, size_t portSize )
+{
+    const char* colon = strrchr( arg, ':' );
+    const char* p     = colon ? colon + 1 : arg;
+    if( !*p || strspn( p, "0123456789" ) != strlen( p ) || strlen( p ) >= portSize )
+        return false;
+
+    snprintf( port, portSize, "%s", p );
+    snprintf( host, hostSize, "%.*s", colon ? (int)(colon - arg) : 0, arg );
+    return true;
+}
+
+
+static bool parse_spec( input_source* input, const char* spec )
+{
+    const char* colon = strchr( spec, ':' );
+    size_t      len   = colon ? (size_t)(colon - spec) : 0;
+    const char* rest  = colon ? colon + 1 : spec;
+
+    if( !strcmp( spec, "stdin" ) || !strcmp( spec, "-" ) )
+    {
+        input->kind = kInput_stdin;
+        return true;
+    }
+
+    if( len == 6 && !strncmp( spec, "serial", len ) )
+    {
+        input->kind = kInput_serial;
+        snprintf( input->path, sizeof( input->path ), "%s", rest );
+
+        // serial:/dev/ttyACM0@115200
+        char* at = strrchr( input->path, '@' );
+        if( at )
+        {
+            *at = '\0';
+            input->speed = baud_rate( strtol( at + 1, NULL, 10 ) );
+            if( input->speed < 0 )
+                return false;
+        }
+        return *input->path;
+    }
+
+    if( (len == 4 && !strncmp( spec, "fifo", len )) || (len == 4 && !strncmp( spec, "unix", len )) )
+    {
+        input->kind = spec[0] == 'f' ? kInput_fifo : kInput_unix;
+        snprintf( input->path, sizeof( input->path ), "%s", rest );
+        return *input->path;
+    }
+
+    if( len == 3 && !strncmp( spec, "tcp", len ) )
+    {
+        input->kind = kInput_tcp_client;
+        return split_host_port( rest, input->path, sizeof( input->path ), input->port, sizeof( input->port ) ) && *input->path;
+    }
+
+    if( len == 6 && !strncmp( spec, "listen", len ) )
+    {
+        input->kind = kInput_tcp_server;
+        return split_host_port( rest, input->path, sizeof( input->path ), input->port, sizeof( input->port ) );
+    }
+
+    if( len == 7 && !strncmp( spec, "capture", len ) )
+    {
+        // capture:file[:speed]
+        input->kind        = kInput_capture;
+        input->replaySpeed = 1;
+        snprintf( input->path, sizeof( input->path ), "%s", rest );
+
+        char* speed = strrchr( input->path, ':' );
+        if( speed )
+        {
+            char* end = NULL;
+            double value = strtod( speed + 1, &end );
+            if( end != speed + 1 && !*end && value >= 0 )
+            {
+                *speed = '\0';
+                input->replaySpeed = value;
+            }
+        }
+        return *input->path;
+    }
+
+    // a plain path, go by what's there now and call it a serial port if there's nothing there yet
+    struct stat info;
+    input->kind = kInput_serial;
+    if( stat( spec, &info ) == 0 )
+    {
+        if( S_ISFIFO( info.st_mode ) )
+            input->kind = kInput_fifo;
+        else if( S_ISSOCK( info.st_mode ) )
+            input->kind = kInput_unix;
+    }
+    snprintf( input->path, sizeof( input->path ), "%s", spec );
+    return *input->path;
+}
+
+
+input_source* input_create( const char* spec, capture_source stream, int channel, int speed )
+{
+    if( !spec || !*spec )
+        return NULL;
+
+    input_source* input = (input_source*)calloc( 1, sizeof( input_source ) );
+    if( !input )
+        return NULL;
+
+    input->fd       = PORT_ERROR;
+    input->listener = PORT_ERROR;
+    input->speed    = speed;
+    input->stream   = stream;
+    input->channel  = channel;
+    snprintf( input->spec, sizeof( input->spec ), "%s", spec );
+
+    if( !parse_spec( input, spec ) )
+    {
+        printf( "can't make sense of input %s\n", spec );
+        free( input );
+        return NULL;
+    }
+    return input;
+}
+
+
+static void close_input( input_source* input )
+{
+    if( input->fd >= 0 && input->kind != kInput_stdin )
+        close( input->fd );
+    input->fd = PORT_ERROR;
+}
+
+
+void input_destroy( input_source* input )
+{
+    if( !input )
+        return;
+
+    close_input( input );
+    if( input->listener >= 0 )
+        close( input->listener );
+    capture_close( input->capture );
+    free( input );
+}
+
+
+
+#pragma mark -
+
+static void set_nonblocking( int fd )
+{
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+}
+
+
+// a connect() to a host that isn't answering can hang for minutes, don't let it hold up shutdown that long
+static int connect_with_timeout( int fd, const struct sockaddr* address, socklen_t length )
+{
+    set_nonblocking( fd );
+    if( connect( fd, address, length ) == 0 )
+        return 0;
+    if( errno != EINPROGRESS )
+        return -1;
+
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    if( poll( &pfd, 1, kConnectTimeoutMs ) <= 0 )
+        return -1;
+
+    int       error = 0;
+    socklen_t size  = sizeof( error );
+    if( getsockopt( fd, SOL_SOCKET, SO_ERROR, &error, &size ) < 0 || error )
+        return -1;
+    return 0;
+}
+
+
+static int open_tcp_client( input_source* input )
+{
+    struct addrinfo  hints  = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* result = NULL;
+    if( getaddrinfo( input->path, input->port, &hints, &result ) != 0 )
+        return PORT_ERROR;
+
+    int fd = PORT_ERROR;
+    for( struct addrinfo* ai = result; ai && fd < 0; ai = ai->ai_next )
+    {
+        fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+        if( fd >= 0 && connect_with_timeout( fd, ai->ai_addr, ai->ai_addrlen ) < 0 )
+        {
+            close( fd );
+            fd = PORT_ERROR;
+        }
+    }
+    freeaddrinfo( result );
+    return fd;
+}
+
+
+static int open_listener( input_source* input )
+{
+    struct addrinfo  hints  = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE };
+    struct addrinfo* result = NULL;
+    if( getaddrinfo( *input->path ? input->path : NULL, input->port, &hints, &result ) != 0 )
+        return PORT_ERROR;
+
+    int fd = PORT_ERROR;
+    for( struct addrinfo* ai = result; ai && fd < 0; ai = ai->ai_next )
+    {
+        fd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+        if( fd < 0 )
+            continue;
+
+        int on = 1;
+        setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+        if( bind( fd, ai->ai_addr, ai->ai_addrlen ) < 0 || listen( fd, 4 ) < 0 )
+        {
+            close( fd );
+            fd = PORT_ERROR;
+        }
+    }
+    freeaddrinfo( result );
+    return fd;
+}
+
+
+static int open_unix( input_source* input )
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if( strlen( input->path ) >= sizeof( address.sun_path ) )
+        return PORT_ERROR;
+    strcpy( address.sun_path, input->path );
+
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if( fd >= 0 && connect( fd, (struct sockaddr*)&address, sizeof( address ) ) < 0 )
+    {
+        close( fd );
+        fd = PORT_ERROR;
+    }
+    return fd;
+}
+
+
+// false if it's not there yet, input_read() waits kInputRetrySecs before trying again
+static bool open_input( input_source* input )
+{
+    switch( input->kind )
+    {
+        case kInput_serial:
+            input->fd = open_serial_port( input->path, input->speed );
+            break;
+
+        case kInput_fifo:
+            // read-write so there's always a writer, otherwise every time the other end closes poll() says hangup until it comes back
+            input->fd = open( input->path, O_RDWR | O_NONBLOCK );
+            break;
+
+        case kInput_tcp_client:
+            input->fd = open_tcp_client( input );
+            break;
+
+        case kInput_tcp_server:
+            // the listener sticks around, the connection comes later
+            if( input->listener < 0 )
+                input->listener = open_listener( input );
+            if( input->listener >= 0 )
+            {
+                log_error( "input: listening on %s\n", input->spec );
+                return true;
+            }
+            break;
+
+        case kInput_unix:
+            input->fd = open_unix( input );
+            break;
+
+        case kInput_stdin:
+            input->fd = STDIN_FILENO;
+            break;
+
+        case kInput_capture:
+            input->capture = capture_open( input->path );
+            if( input->capture )
+            {
+                log_error( "input: playing %s back at %gx\n", input->path, input->replaySpeed );
+                return true;
+            }
+            break;
+
+        case kInput_count:
+            break;
+    }
+
+    if( input->fd < 0 )
+    {
+        log_error_throttled( "input: can't open %s (%d), trying again in %d seconds\n", input->spec, errno, kInputRetrySecs );
+        input->retryAt = time( NULL ) + kInputRetrySecs;
+        return false;
+    }
+
+    set_nonblocking( input->fd );
+    log_error( "input: reading from %s\n", input->spec );
+    return true;
+}
+
+
+static bool needs_open( const input_source* input )
+{
+    switch( input->kind )
+    {
+        case kInput_tcp_server: return input->listener < 0;
+        case kInput_capture:    return !input->capture;
+        default:                return input->fd < 0;
+    }
+}
+
+
+static void lost_input( input_source* input )
+{
+    if( input->kind == kInput_stdin )
+    {
+        log_error( "input: end of stdin\n" );
+        input->finished = true;
+        input->fd       = PORT_ERROR;
+        return;
+    }
+
+    log_error( "input: lost %s\n", input->spec );
+    close_input( input );
+
+    // a serial port that went away usually comes right back (the USB receiver reset...), give it a second
+    if( input->kind != kInput_tcp_server )
+        input->retryAt = time( NULL ) + 1;
+}
+
+
+static void wait_ms( int timeoutMs )
+{
+    if( timeoutMs > 0 )
+        poll( NULL, 0, timeoutMs );
+}
+
+
+
+#pragma mark -
+
+// the next record from our stream, paced off the first one's recorded time
+static ssize_t read_capture( input_source* input, void* buffer, size_t size, int timeoutMs, uint64_t* micros )
+{
+    while( !input->pendingLength )
+    {
+        int length = capture_next( input->capture, &input->record, input->pending, sizeof( input->pending ) );
+        if( length <= 0 )
+        {
+            log_error( "input: finished playing %s\n", input->path );
+            input->finished = true;
+            return 0;
+        }
+        if( input->record.source != input->stream || input->record.channel != input->channel )
+            continue;
+
+        if( !input->startUs )
+        {
+            input->startUs = metrics_now_us();
+            input->baseNs  = input->record.monotonic_ns;
+        }
+        input->pendingLength = length;
+        input->pendingOffset = 0;
+    }
+
+    if( input->replaySpeed > 0 )
+    {
+        uint64_t due = input->startUs + (uint64_t)((input->record.monotonic_ns - input->baseNs) / 1000 / input->replaySpeed);
+        uint64_t now = metrics_now_us();
+        if( due > now )
+        {
+            uint64_t wait = (due - now + 999) / 1000;
+            if( wait > (uint64_t)timeoutMs )
+            {
+                wait_ms( timeoutMs );
+                return 0;
+            }
+            wait_ms( (int)wait );
+        }
+    }
+
+    size_t length = input->pendingLength - input->pendingOffset;
+    if( length > size )
+        length = size;
+    memcpy( buffer, &input->pending[input->pendingOffset], length );
+    input->pendingOffset += length;
+    if( input->pendingOffset == input->pendingLength )
+        input->pendingLength = 0;
+
+    if( micros )
+        *micros = metrics_now_us();
+    return (ssize_t)length;
+}
+
+
+// a new connection takes over from the old one, a receiver that rebooted won't have closed its end.  true if there was an old
+// one, half a frame from it can't be glued onto the new one's first bytes
+static bool accept_connection( input_source* input )
+{
+    int fd = accept( input->listener, NULL, NULL );
+    if( fd < 0 )
+        return false;
+
+    bool replaced = input->fd >= 0;
+    if( replaced )
+        log_error( "input: a new connection on %s replaces the old one\n", input->spec );
+    close_input( input );
+
+    set_nonblocking( fd );
+    input->fd = fd;
+    log_error( "input: connection on %s\n", input->spec );
+    return replaced;
+}
+
+
+ssize_t input_read( input_source* input, void* buffer, size_t size, int timeoutMs, uint64_t* micros )
+{
+    if( !input || !buffer || !size )
+        return -1;
+
+    if( input->finished )
+    {
+        wait_ms( timeoutMs );
+        return 0;
+    }
+
+    if( needs_open( input ) )
+    {
+        if( time( NULL ) < input->retryAt || !open_input( input ) )
+        {
+            wait_ms( timeoutMs );
+            return 0;
+        }
+    }
+
+    if( input->kind == kInput_capture )
+        return read_capture( input, buffer, size, timeoutMs, micros );
+
+    struct pollfd pfds[2];
+    nfds_t        count = 0;
+    if( input->fd >= 0 )
+        pfds[count++] = (struct pollfd){ .fd = input->fd, .events = POLLIN };
+    if( input->listener >= 0 )
+        pfds[count++] = (struct pollfd){ .fd = input->listener, .events = POLLIN };
+
+    int ready = poll( pfds, count, timeoutMs );
+    if( ready <= 0 )
+        return 0;
+
+    // the listener is always last
+    if( input->listener >= 0 && (pfds[count - 1].revents & POLLIN) )
+        return accept_connection( input ) ? -1 : 0;
+    if( input->fd < 0 || !pfds[0].revents )
+        return 0;
+
+    ssize_t result = read( input->fd, buffer, size );
+    if( result > 0 )
+    {
+        if( micros )
+            *micros = metrics_now_us();
+        return result;
+    }
+
+    // a serial port with nothing for us reads 0, anything else that reads 0 has hung up
+    if( result < 0 && (errno == EAGAIN || errno == EINTR) )
+        return 0;
+    if( result == 0 && input->kind == kInput_serial && !(pfds[0].revents & (POLLHUP | POLLERR)) )
+        return 0;
+
+    lost_input( input );
+    return -1;
+}
+
+
+
+#pragma mark -
+
+input_kind input_get_kind( const input_source* input )
+{
+    return input ? input->kind : kInput_count;
+}
+
+
+const char* input_kind_name( input_kind kind )
+{
+    return kind < kInput_count ? s_kind_names[kind] : "unknown";
+}
+
+
+const char* input_spec( const input_source* input )
+{
+    return input ? input->spec : "";
+}
+
+
+bool input_is_open( const input_source* input )
+{
+    if( !input )
+        return false;
+    return input->kind == kInput_capture ? input->capture && !input->finished : input->fd >= 0;
+}
+
+
+bool input_finished( const input_source* input )
+{
+    return input && input->finished;
+}
+
+
+
+#pragma mark -
+
+void input_framer_init( input_framer* framer, size_t size, input_frame_check check )
+{
+    memset( framer, 0, sizeof( input_framer ) );
+    framer->size  = size < kInputFrameMax ? size : kInputFrameMax;
+    framer->check = check;
+}
+
+
+size_t input_framer_add( input_framer* framer, const uint8_t* data, size_t length, uint64_t micros, bool* complete )
+{
+    size_t used = 0;
+    for( ;; )
+    {
+        // a full frame from last time has been dealt with, if it was bad the next one might start anywhere after its first byte
+        if( framer->have == framer->size )
+        {
+            if( framer->bad )
+            {
+                memmove( framer->bytes, &framer->bytes[1], framer->size - 1 );
+                framer->have = framer->size - 1;
+                ++framer->skipped;
+            }
+            else
+            {
+                framer->have    = 0;
+                framer->skipped = 0;
+            }
+            framer->bad = false;
+        }
+
+        size_t take = framer->size - framer->have;
+        if( take > length - used )
+            take = length - used;
+
+        if( !framer->have )
+            framer->first_us = micros;
+        memcpy( &framer->bytes[framer->have], &data[used], take );
+        framer->have += take;
+        used         += take;
+
+        if( framer->have < framer->size )
+            break;
+
+        // only the first bad one comes out, the rest are just us looking for where the frames start again
+        framer->bad = framer->check && !framer->check( framer->bytes, framer->size );
+        if( framer->bad && framer->hunting )
+            continue;
+        framer->hunting = framer->bad;
+        break;
+    }
+
+    if( complete )
+        *complete = framer->have == framer->size && !framer->hunting == !framer->bad;
+    return used;
+}
+
+
+size_t input_framer_expire( input_framer* framer, uint64_t nowUs, uint64_t timeoutUs )
+{
+    size_t have = framer->have;
+    if( !have || nowUs - framer->first_us <= timeoutUs )
+        return 0;
+
+    // a whole frame already went out, even if it was a bad one and we're still hunting the line going quiet lines us back up
+    input_framer_reset( framer );
+    return have == framer->size ? 0 : have;
+}
+
+
+// whatever comes next starts a frame, that's as good as finding one
+void input_framer_reset( input_framer* framer )
+{
+    framer->have    = 0;
+    framer->bad     = false;
+    framer->hunting = false;
+    framer->skipped = 0;
+}
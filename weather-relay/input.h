@@ -0,0 +1,87 @@
+//
+//  input.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_input
+#define _H_input
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "capture.h"
+
+#define kInputRetrySecs     10          // between tries at opening something that isn't there
+#define kInputFrameMax      64          // biggest frame the framer puts back together, a Frame is 56
+#define kInputPartialUs     2000000     // the rest of a frame that takes longer than this isn't coming
+
+// where bytes come from, picked by the --device and --rain specs:
+//   /dev/serial0, serial:/dev/ttyACM0[@115200]     termios serial (a bare path that's a FIFO or socket gets that instead)
+//   fifo:/tmp/wx                                   named pipe, wxloadgen writes these
+//   tcp:host:port                                  connect out to a remote receiver
+//   listen:[address:]port                          a remote receiver connects to us, the newest connection wins
+//   unix:/path                                     connect to a UNIX domain socket
+//   stdin, -                                       whatever is piped in
+//   capture:file[:speed]                           play a capture back in real time (1, the default) or faster, 0 is flat out
+typedef enum
+{
+    kInput_serial = 0,
+    kInput_fifo,
+    kInput_tcp_client,
+    kInput_tcp_server,
+    kInput_unix,
+    kInput_stdin,
+    kInput_capture,
+    kInput_count
+} input_kind;
+
+typedef struct input_source input_source;
+
+// stream and channel say which of a capture's reads to play back, speed is the baud rate for serial ports
+input_source* input_create( const char* spec, capture_source stream, int channel, int speed );
+void          input_destroy( input_source* input );
+
+// bytes read, 0 if nothing came in within timeoutMs, -1 if the connection went away or a new one took its place (the next call
+// reads the new one), either way a frame in progress is gone.  *micros is on the metrics clock
+ssize_t       input_read( input_source* input, void* buffer, size_t size, int timeoutMs, uint64_t* micros );
+
+input_kind    input_get_kind( const input_source* input );
+const char*   input_kind_name( input_kind kind );
+const char*   input_spec( const input_source* input );
+bool          input_is_open( const input_source* input );
+bool          input_finished( const input_source* input );       // stdin or a capture ran out, nothing more is coming
+
+
+// true if bytes is a good frame (its CRC checks out)
+typedef bool (*input_frame_check)( const uint8_t* bytes, size_t size );
+
+// puts fixed size frames back together out of whatever size chunks the input hands us.  With a check, a frame that fails it
+// still comes out (so it gets counted) but then the framer slides along a byte at a time until one passes, so a dropped byte
+// costs a frame or two instead of every frame until the line goes quiet
+typedef struct
+{
+    size_t            size;
+    size_t            have;
+    uint64_t          first_us;     // when the first byte of the frame in progress came in
+    input_frame_check check;
+    bool              bad;          // the whole frame in bytes failed the check
+    bool              hunting;      // looking for the start of a frame after a bad one
+    size_t            skipped;      // bytes thrown away to find the frame that just came out, 0 if it lined up
+    uint8_t           bytes[kInputFrameMax];
+} input_framer;
+
+void   input_framer_init( input_framer* framer, size_t size, input_frame_check check );
+
+// takes as much of data as the frame in progress needs and returns how much that was, *complete means bytes holds a whole frame
+size_t input_framer_add( input_framer* framer, const uint8_t* data, size_t length, uint64_t micros, bool* complete );
+
+// throws out a frame in progress that's been waiting longer than timeoutUs, returns how many bytes it had
+size_t input_framer_expire( input_framer* framer, uint64_t nowUs, uint64_t timeoutUs );
+void   input_framer_reset( input_framer* framer );
+
+#endif // !_H_input
@@ -0,0 +1,354 @@
+//
+//  loadgen.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Makes up weather for as many stations as we want so we can see how far the relay scales with only one real TX31U.  Each station
+//  has its own offsets and drifts: temperature follows the sun (coldest before dawn, warmest mid afternoon), humidity goes the other
+//  way, wind picks up in the afternoon with the odd gust burst on top, pressure wanders and every so often it rains for a while.
+//  Frames come out exactly as the receiver sends them, CRC and all, and then get the damage a noisy radio does to them: a flipped
+//  bit here, a few bytes lost there.  It's all driven by its own seeded generator so a run can be repeated.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loadgen.h"
+
+
+#define kMeanTempC          14.0
+#define kDailySwingC        7.0
+#define kWarmestHour        15.0
+#define kMeanHumidity       62.0
+#define kMeanPressure       1013.0
+#define kRainMmPerTip       0.5         // rawRainCount2mm()
+#define kRainsPerDay        1.0         // chance of a rain starting, spread over the day
+#define kMaxDroppedBytes    4
+
+
+typedef struct
+{
+    double tempOffsetC;
+    double humidityOffset;
+    double windScale;
+    double direction;
+    double pressure;
+    double airQuality;
+    time_t gustUntil;
+    double gustMs;
+    time_t last;
+} station_state;
+
+struct loadgen
+{
+    loadgen_config config;
+    uint32_t       random;
+    int            next_station;
+    station_state  stations[kLoadgenMaxStations];
+
+    // the one rain gauge
+    double         rainTips;
+    double         rainRate;            // tips per hour, zero when it's dry
+    time_t         rainUntil;
+    time_t         rainLast;
+
+    loadgen_stats  stats;
+};
+
+
+
+#pragma mark -
+
+// xorshift32, never zero
+static uint32_t next_random( loadgen* gen )
+{
+    uint32_t x = gen->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    gen->random = x;
+    return x;
+}
+
+
+// 0...1
+static double uniform( loadgen* gen )
+{
+    return next_random( gen ) / 4294967296.0;
+}
+
+
+static double between( loadgen* gen, double low, double high )
+{
+    return low + (high - low) * uniform( gen );
+}
+
+
+// roughly normal, good enough for sensor noise
+static double noise( loadgen* gen, double sigma )
+{
+    return (uniform( gen ) + uniform( gen ) + uniform( gen ) - 1.5) * 2.0 * sigma;
+}
+
+
+static bool chance( loadgen* gen, double probability )
+{
+    return probability > 0 && uniform( gen ) < probability;
+}
+
+
+static double clamp( double value, double low, double high )
+{
+    return value < low ? low : (value > high ? high : value);
+}
+
+
+// -1 at night...1 in the afternoon
+static double sun_height( time_t when )
+{
+    struct tm tm;
+    localtime_r( &when, &tm );
+    double hour = tm.tm_hour + tm.tm_min / 60.0 + tm.tm_sec / 3600.0;
+    return cos( (hour - kWarmestHour) * M_PI / 12.0 );
+}
+
+
+uint8_t loadgen_crc( const uint8_t* data, size_t length )
+{
+    uint8_t res = 0;
+    for( size_t j = 0; j < length; j++ )
+    {
+        uint8_t val = data[j];
+        for( int i = 0; i < 8; i++ )
+        {
+            uint8_t tmp = (uint8_t)((res ^ val) & 0x80);
+            res <<= 1;
+            if( 0 != tmp )
+                res ^= 0x31;
+            val <<= 1;
+        }
+    }
+    return res;
+}
+
+
+
+#pragma mark -
+
+void loadgen_default_config( loadgen_config* config )
+{
+    if( !config )
+        return;
+
+    memset( config, 0, sizeof( loadgen_config ) );
+    config->stations     = 1;
+    config->seed         = 1;
+    config->gustsPerHour = 4;
+}
+
+
+loadgen* loadgen_create( const loadgen_config* config )
+{
+    if( !config || config->stations < 1 || config->stations > kLoadgenMaxStations )
+        return NULL;
+
+    loadgen* gen = calloc( 1, sizeof( loadgen ) );
+    if( !gen )
+        return NULL;
+
+    gen->config = *config;
+    gen->random = config->seed ? config->seed : 1;
+
+    // every station gets its own little micro climate
+    for( int i = 0; i < config->stations; i++ )
+    {
+        station_state* station  = &gen->stations[i];
+        station->tempOffsetC    = between( gen, -3, 3 );
+        station->humidityOffset = between( gen, -8, 8 );
+        station->windScale      = between( gen, 0.5, 1.5 );
+        station->direction      = between( gen, 0, 360 );
+        station->pressure       = kMeanPressure + between( gen, -4, 4 );
+        station->airQuality     = between( gen, 4, 20 );
+    }
+    return gen;
+}
+
+
+void loadgen_destroy( loadgen* gen )
+{
+    free( gen );
+}
+
+
+void loadgen_get_stats( const loadgen* gen, loadgen_stats* stats )
+{
+    if( gen && stats )
+        *stats = gen->stats;
+}
+
+
+
+#pragma mark -
+
+static bool raining( const loadgen* gen, time_t when )
+{
+    return gen->rainRate > 0 && when < gen->rainUntil;
+}
+
+
+void loadgen_wx_frame( loadgen* gen, time_t when, Frame* frame )
+{
+    if( !gen || !frame )
+        return;
+
+    int            index   = gen->next_station;
+    station_state* station = &gen->stations[index];
+    gen->next_station = (index + 1) % gen->config.stations;
+
+    double elapsed = station->last && when > station->last ? (double)(when - station->last) : 0;
+    station->last  = when;
+
+    double sun  = sun_height( when );
+    bool   wet  = raining( gen, when );
+    double temp = kMeanTempC + station->tempOffsetC + kDailySwingC * sun - (wet ? 3 : 0) + noise( gen, 0.2 );
+
+    double humidity = kMeanHumidity + station->humidityOffset - 20 * sun + noise( gen, 1 );
+    if( wet )
+        humidity = 92 + noise( gen, 3 );
+
+    // wind picks up in the afternoon
+    double wind = station->windScale * (2.0 + 1.5 * sun) + noise( gen, 0.6 );
+    station->direction = fmod( station->direction + noise( gen, 8 ) + 360, 360 );
+
+    // a burst lasts up to a minute, gusts well over the steady wind
+    if( when >= station->gustUntil && chance( gen, gen->config.gustsPerHour * elapsed / 3600.0 ) )
+    {
+        station->gustUntil = when + (time_t)between( gen, 10, 60 );
+        station->gustMs    = between( gen, 3, 8 );
+    }
+    double gust = wind + 1 + noise( gen, 0.5 );
+    if( when < station->gustUntil )
+        gust = wind + station->gustMs + noise( gen, 1 );
+
+    station->pressure   = clamp( station->pressure + noise( gen, 0.05 ) - (wet ? 0.01 : 0), 980, 1040 );
+    station->airQuality = clamp( station->airQuality + noise( gen, 0.5 ), 1, 150 );
+
+    memset( frame, 0, sizeof( Frame ) );
+    frame->station_id    = (uint8_t)(index + 1);
+    frame->flags         = kDataFlag_temp | kDataFlag_humidity | kDataFlag_wind | kDataFlag_gust | kDataFlag_intTemp | kDataFlag_pressure | kDataFlag_airQuality;
+    frame->tempC         = (float)temp;
+    frame->humidity      = (uint8_t)clamp( humidity, 5, 100 );
+    frame->windSpeedMs   = (float)clamp( wind, 0, 40 );
+    frame->windDirection = (float)station->direction;
+    frame->windGustMs    = (float)clamp( gust, frame->windSpeedMs, 45 );
+    frame->intTempC      = (float)(21 + 2 * sun + noise( gen, 0.1 ));
+    frame->pressure      = (float)station->pressure;
+
+    // the particle counts scale with the PM2.5 reading, the way the PMS5003 numbers tend to
+    double pm25 = station->airQuality;
+    frame->pm10_standard   = (uint16_t)(pm25 * 0.7);
+    frame->pm25_standard   = (uint16_t)pm25;
+    frame->pm100_standard  = (uint16_t)(pm25 * 1.3);
+    frame->pm10_env        = frame->pm10_standard;
+    frame->pm25_env        = frame->pm25_standard;
+    frame->pm100_env       = frame->pm100_standard;
+    frame->particles_03um  = (uint16_t)(pm25 * 180);
+    frame->particles_05um  = (uint16_t)(pm25 * 50);
+    frame->particles_10um  = (uint16_t)(pm25 * 9);
+    frame->particles_25um  = (uint16_t)(pm25 * 1.2);
+    frame->particles_50um  = (uint16_t)(pm25 * 0.3);
+    frame->particles_100um = (uint16_t)(pm25 * 0.1);
+
+    frame->CRC = 0;
+    frame->CRC = loadgen_crc( (const uint8_t*)frame, sizeof( Frame ) );
+}
+
+
+void loadgen_rain_frame( loadgen* gen, time_t when, RainFrame* frame )
+{
+    if( !gen || !frame )
+        return;
+
+    double elapsed = gen->rainLast && when > gen->rainLast ? (double)(when - gen->rainLast) : 0;
+    gen->rainLast  = when;
+
+    if( !raining( gen, when ) )
+    {
+        gen->rainRate = 0;
+        if( chance( gen, kRainsPerDay * elapsed / (24 * 60 * 60) ) )
+        {
+            // anything from a passing shower to a soaker, in tips per hour
+            gen->rainUntil = when + (time_t)between( gen, 20 * 60, 3 * 60 * 60 );
+            gen->rainRate  = between( gen, 1, 25 ) / kRainMmPerTip;
+        }
+    }
+    else
+        gen->rainTips += gen->rainRate * elapsed / 3600.0;
+
+    frame->raw_rain_count = (uint32_t)gen->rainTips;
+}
+
+
+
+#pragma mark -
+
+// a few bytes lost somewhere in the middle, the rest of the frame slides down
+static size_t drop_bytes( loadgen* gen, uint8_t* buffer, size_t length )
+{
+    size_t count = 1 + next_random( gen ) % kMaxDroppedBytes;
+    if( count >= length )
+        count = length - 1;
+
+    size_t at = next_random( gen ) % (length - count);
+    memmove( buffer + at, buffer + at + count, length - at - count );
+    ++gen->stats.short_frames;
+    return length - count;
+}
+
+
+size_t loadgen_wx_bytes( loadgen* gen, time_t when, uint8_t* buffer, size_t size )
+{
+    if( !gen || !buffer || size < sizeof( Frame ) )
+        return 0;
+
+    Frame frame;
+    loadgen_wx_frame( gen, when, &frame );
+    memcpy( buffer, &frame, sizeof( Frame ) );
+    size_t length = sizeof( Frame );
+
+    if( chance( gen, gen->config.crcErrorRate ) )
+    {
+        buffer[next_random( gen ) % length] ^= (uint8_t)(1 << (next_random( gen ) % 8));
+        ++gen->stats.corrupted;
+    }
+
+    if( chance( gen, gen->config.dropRate ) )
+        length = drop_bytes( gen, buffer, length );
+
+    ++gen->stats.wx_frames;
+    gen->stats.bytes += length;
+    return length;
+}
+
+
+// the rain gauge has no CRC, so all that can happen to it is losing bytes
+size_t loadgen_rain_bytes( loadgen* gen, time_t when, uint8_t* buffer, size_t size )
+{
+    if( !gen || !buffer || size < sizeof( RainFrame ) )
+        return 0;
+
+    RainFrame frame;
+    loadgen_rain_frame( gen, when, &frame );
+    memcpy( buffer, &frame, sizeof( RainFrame ) );
+    size_t length = sizeof( RainFrame );
+
+    if( chance( gen, gen->config.dropRate ) )
+        length = drop_bytes( gen, buffer, length );
+
+    ++gen->stats.rain_frames;
+    gen->stats.bytes += length;
+    return length;
+}
@@ -0,0 +1,59 @@
+//
+//  loadgen.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_loadgen
+#define _H_loadgen
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "TXDecoderFrame.h"
+
+#define kLoadgenFramePeriod     5       // seconds between frames from one station, what the TX31U does
+#define kLoadgenMaxStations     255     // station_id is a byte and zero isn't one
+
+typedef struct
+{
+    int      stations;          // station_ids 1...stations, round robin
+    uint32_t seed;              // same seed, same weather
+    double   crcErrorRate;      // 0...1, wx frames sent with a flipped bit
+    double   dropRate;          // 0...1, frames sent with a few bytes missing
+    double   gustsPerHour;      // how often a station starts a gust burst
+} loadgen_config;
+
+typedef struct
+{
+    uint64_t wx_frames;
+    uint64_t rain_frames;
+    uint64_t bytes;
+    uint64_t corrupted;         // went out with a bad CRC
+    uint64_t short_frames;      // went out with bytes dropped
+} loadgen_stats;
+
+typedef struct loadgen loadgen;
+
+void     loadgen_default_config( loadgen_config* config );
+loadgen* loadgen_create( const loadgen_config* config );
+void     loadgen_destroy( loadgen* gen );
+
+// the next station's weather at simulated time when, exactly as the receiver would send it
+void     loadgen_wx_frame( loadgen* gen, time_t when, Frame* frame );
+void     loadgen_rain_frame( loadgen* gen, time_t when, RainFrame* frame );
+
+// the same with the configured damage done to it, returns how many bytes to send
+size_t   loadgen_wx_bytes( loadgen* gen, time_t when, uint8_t* buffer, size_t size );
+size_t   loadgen_rain_bytes( loadgen* gen, time_t when, uint8_t* buffer, size_t size );
+
+void     loadgen_get_stats( const loadgen* gen, loadgen_stats* stats );
+
+// the receiver's CRC-8, run over the frame with the CRC byte zeroed
+uint8_t  loadgen_crc( const uint8_t* data, size_t length );
+
+#endif // !_H_loadgen
@@ -0,0 +1,517 @@
+//
+//  logging.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  log_error() used to do the localtime(), fprintf() and fflush() right there on whatever thread called it (no lock either), so a slow
+//  SD card stalled the ingest thread and the senders.  Now callers just format into a slot of a lock-free ring (bounded multi-producer,
+//  single consumer, each slot carries a sequence number) and a writer thread does the timestamps, batches up the writes and rolls the log.
+//  If the ring is full the message is dropped and counted rather than making anyone wait.  log_error_throttled() sits on top of this for
+//  the errors that fire on every frame when a sensor goes bad, it keeps a per call site count and collapses the repeats into a summary.
+//
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "logging.h"
+#include "wx_thread.h"
+
+
+#define kLogSlots       256         // must be a power of two
+#define kLogSlotMask    (kLogSlots - 1)
+#define kLogTextSize    480         // everything we log fits in this, longer messages get truncated
+#define kLogBatchMax    64          // flush at least this often while draining
+#define kLogFileBuffer  (16 * 1024)
+#define kLogBudget      5           // log_error_throttled() messages per call site per window...
+#define kLogWindow      (60 * 10)   // ...and the window in seconds
+
+
+typedef struct
+{
+    atomic_size_t   sequence;
+    struct timespec when;           // wall clock for the timestamp
+    uint64_t        queued_us;      // monotonic for the latency
+    char            text[kLogTextSize];
+} log_slot;
+
+
+static log_slot      s_ring[kLogSlots];
+static atomic_size_t s_head         = 0;    // next slot to claim
+static size_t        s_tail         = 0;    // next slot to write, only the writer touches this
+static atomic_bool   s_ring_ready   = false;
+static sem_t         s_ready;               // one post per message (and for roll/shutdown requests)
+
+static atomic_uint_fast64_t s_logged  = 0;
+static atomic_uint_fast64_t s_dropped = 0;
+static atomic_bool          s_roll     = false;
+static atomic_bool          s_shutdown = false;
+static atomic_bool          s_done     = false;
+
+static unsigned int         s_budget   = kLogBudget;
+static unsigned int         s_window   = kLogWindow;
+static _Atomic(log_site*)   s_sites    = NULL;      // every throttled call site that has fired at least once
+static atomic_uint_fast64_t s_throttle_emitted    = 0;
+static atomic_uint_fast64_t s_throttle_suppressed = 0;
+
+// only the writer thread touches these
+static const char* s_path       = NULL;
+static FILE*       s_file       = NULL;
+static bool        s_echo       = false;
+static char*       s_file_buffer = NULL;
+static log_stats   s_stats;
+static time_t      s_stamp_secs = -1;
+static char        s_stamp[80]  = {0};      // "YYYY-MM-DD HH:MM:SS: "
+
+
+
+static uint64_t monotonic_us( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void ring_init( void )
+{
+    static atomic_flag s_initializing = ATOMIC_FLAG_INIT;
+
+    if( atomic_load_explicit( &s_ring_ready, memory_order_acquire ) )
+        return;
+
+    // first one in sets it up, anyone else racing us spins for the microsecond it takes
+    if( atomic_flag_test_and_set( &s_initializing ) )
+    {
+        while( !atomic_load_explicit( &s_ring_ready, memory_order_acquire ) )
+            ;
+        return;
+    }
+
+    for( size_t i = 0; i < kLogSlots; i++ )
+        atomic_init( &s_ring[i].sequence, i );
+    sem_init( &s_ready, 0, 0 );
+    atomic_store_explicit( &s_ring_ready, true, memory_order_release );
+}
+
+
+static void log_verror( const char* format, va_list vaList )
+{
+    ring_init();
+
+    size_t    pos  = atomic_load_explicit( &s_head, memory_order_relaxed );
+    log_slot* slot = NULL;
+    while( 1 )
+    {
+        slot = &s_ring[pos & kLogSlotMask];
+        size_t   sequence = atomic_load_explicit( &slot->sequence, memory_order_acquire );
+        intptr_t diff     = (intptr_t)sequence - (intptr_t)pos;
+        if( diff == 0 )
+        {
+            if( atomic_compare_exchange_weak_explicit( &s_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed ) )
+                break;
+        }
+        else if( diff < 0 )
+        {
+            // the writer is behind a whole ring's worth, don't wait on it
+            atomic_fetch_add_explicit( &s_dropped, 1, memory_order_relaxed );
+            return;
+        }
+        else
+            pos = atomic_load_explicit( &s_head, memory_order_relaxed );
+    }
+
+    clock_gettime( CLOCK_REALTIME, &slot->when );
+    slot->queued_us = monotonic_us();
+
+    vsnprintf( slot->text, sizeof( slot->text ), format, vaList );
+
+    atomic_store_explicit( &slot->sequence, pos + 1, memory_order_release );
+    atomic_fetch_add_explicit( &s_logged, 1, memory_order_relaxed );
+    sem_post( &s_ready );
+}
+
+
+void log_error( const char* format, ... )
+{
+    va_list vaList;
+    va_start( vaList, format );
+    log_verror( format, vaList );
+    va_end( vaList );
+}
+
+
+void log_unix_error( const char* prefix )
+{
+    char buffer[512] = {0};
+    strerror_r( errno, buffer, sizeof( buffer ) );
+    log_error( "%s%s\n", prefix, buffer );
+}
+
+
+// the writer does the actual roll, this just asks for it
+void log_roll( void )
+{
+    ring_init();
+    atomic_store( &s_roll, true );
+    sem_post( &s_ready );
+}
+
+
+#pragma mark -
+
+// the summary line uses the message up to the first argument: " wind temporal check failed [%0.2f°]..." -> "wind temporal check failed"
+static void site_label( const log_site* site, char* label, size_t size )
+{
+    const char* start = site->format;
+    while( *start == ' ' )
+        ++start;
+
+    size_t len = strcspn( start, "%\n" );
+    if( len >= size )
+        len = size - 1;
+
+    while( len && strchr( " [(:=", start[len - 1] ) )
+        --len;
+    if( len >= 2 && strncmp( &start[len - 2], "0x", 2 ) == 0 )
+        len -= 2;
+    while( len && start[len - 1] == ' ' )
+        --len;
+
+    memcpy( label, start, len );
+    label[len] = '\0';
+}
+
+
+// starts a new window if this one is up, and says how much got suppressed in the last one
+static void site_roll_window( log_site* site, time_t now )
+{
+    long long start = atomic_load( &site->window_start );
+    if( now - start < s_window )
+        return;
+
+    // only one thread gets to roll it
+    if( !atomic_compare_exchange_strong( &site->window_start, &start, (long long)now ) )
+        return;
+
+    unsigned int suppressed = atomic_exchange( &site->suppressed, 0 );
+    atomic_store( &site->in_window, 0 );
+
+    if( suppressed )
+    {
+        char label[128];
+        site_label( site, label, sizeof( label ) );
+        if( s_window % 60 )
+            log_error( " %s ×%u in last %u secs (%s)\n", label, suppressed + s_budget, s_window, site->where );
+        else
+            log_error( " %s ×%u in last %u min (%s)\n", label, suppressed + s_budget, s_window / 60, site->where );
+    }
+}
+
+
+void log_error_site( log_site* site, const char* format, ... )
+{
+    time_t now = time( NULL );
+
+    if( !atomic_flag_test_and_set( &site->registered ) )
+    {
+        // first time through, add it to the list so the flush can find it
+        site->next = atomic_load( &s_sites );
+        while( !atomic_compare_exchange_weak( &s_sites, &site->next, site ) )
+            ;
+    }
+
+    site_roll_window( site, now );
+
+    if( atomic_fetch_add( &site->in_window, 1 ) >= s_budget )
+    {
+        atomic_fetch_add( &site->suppressed, 1 );
+        atomic_fetch_add( &site->suppressed_total, 1 );
+        atomic_fetch_add_explicit( &s_throttle_suppressed, 1, memory_order_relaxed );
+        return;
+    }
+
+    atomic_fetch_add( &site->emitted_total, 1 );
+    atomic_fetch_add_explicit( &s_throttle_emitted, 1, memory_order_relaxed );
+
+    va_list vaList;
+    va_start( vaList, format );
+    log_verror( format, vaList );
+    va_end( vaList );
+}
+
+
+// call this every once in a while so summaries go out even if the messages stopped
+void log_throttle_flush( void )
+{
+    time_t now = time( NULL );
+    for( log_site* site = atomic_load( &s_sites ); site; site = site->next )
+        site_roll_window( site, now );
+}
+
+
+void log_set_throttle( unsigned int budget, unsigned int window_secs )
+{
+    s_budget = budget;
+    s_window = window_secs ? window_secs : 1;
+}
+
+
+// "budget" or "budget/seconds"
+bool log_parse_throttle( const char* arg, unsigned int* budget, unsigned int* window_secs )
+{
+    if( !arg || !budget || !window_secs )
+        return false;
+
+    char*         end = NULL;
+    unsigned long b   = strtoul( arg, &end, 10 );
+    if( end == arg )
+        return false;
+
+    unsigned long w = *window_secs;
+    if( *end == '/' )
+    {
+        const char* start = end + 1;
+        w = strtoul( start, &end, 10 );
+        if( end == start || !w )
+            return false;
+    }
+    if( *end )
+        return false;
+
+    *budget      = (unsigned int)b;
+    *window_secs = (unsigned int)w;
+    return true;
+}
+
+
+#pragma mark -
+
+static const char* stamp( time_t secs )
+{
+    if( secs != s_stamp_secs )
+    {
+        struct tm tm;
+        localtime_r( &secs, &tm );
+        snprintf( s_stamp, sizeof( s_stamp ), "%d-%02d-%02d %02d:%02d:%02d: ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec );
+        s_stamp_secs = secs;
+    }
+    return s_stamp;
+}
+
+
+static void open_log( void )
+{
+    if( !s_path )
+        return;
+
+    s_file = fopen( s_path, "a" );
+    if( !s_file )
+    {
+        perror( "log fopen" );
+        return;
+    }
+
+    if( !s_file_buffer )
+        s_file_buffer = malloc( kLogFileBuffer );
+    if( s_file_buffer )
+        setvbuf( s_file, s_file_buffer, _IOFBF, kLogFileBuffer );
+}
+
+
+static void roll_log( void )
+{
+    if( !s_file || !s_path )
+        return;
+
+    fclose( s_file );
+    s_file = NULL;
+
+    char* buffer = malloc( strlen( s_path ) + 10 );   // 8 date/time characters, a '.', and null byte
+    if( buffer )
+    {
+        time_t t = time( NULL );
+        struct tm tm;
+        localtime_r( &t, &tm );
+        sprintf( buffer, "%s.%d%02d%02d", s_path, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday );
+
+        // rename it
+        if( rename( s_path, buffer ) != 0 )
+            perror( "rename" );
+
+        free( buffer );
+    }
+
+    // now reopen new file and carry on
+    open_log();
+}
+
+
+static void flush_batch( const uint64_t* queued, int count )
+{
+    uint64_t start = monotonic_us();
+    if( s_file )
+        fflush( s_file );
+    if( s_echo )
+        fflush( stdout );
+
+    uint64_t now   = monotonic_us();
+    uint32_t flush = (uint32_t)(now - start);
+    s_stats.last_flush_us = flush;
+    if( flush > s_stats.max_flush_us )
+        s_stats.max_flush_us = flush;
+
+    for( int i = 0; i < count; i++ )
+    {
+        uint32_t latency = (uint32_t)(now - queued[i]);
+        s_stats.total_latency_us += latency;
+        if( latency > s_stats.max_latency_us )
+            s_stats.max_latency_us = latency;
+        s_stats.last_latency_us = latency;
+    }
+    s_stats.written += count;
+    ++s_stats.batches;
+}
+
+
+// writes out everything in the ring, returns how many
+static int drain( void )
+{
+    uint64_t queued[kLogBatchMax];
+    int      count = 0;
+    int      total = 0;
+
+    while( 1 )
+    {
+        log_slot* slot     = &s_ring[s_tail & kLogSlotMask];
+        size_t    sequence = atomic_load_explicit( &slot->sequence, memory_order_acquire );
+        if( sequence != s_tail + 1 )
+            break;  // nothing there yet (or a producer is still filling it in)
+
+        const char* prefix = stamp( slot->when.tv_sec );
+        if( s_file )
+        {
+            fputs( prefix, s_file );
+            fputs( slot->text, s_file );
+        }
+
+        // print to debug as well...
+        if( s_echo )
+        {
+            fputs( prefix, stdout );
+            fputs( slot->text, stdout );
+        }
+
+        queued[count++] = slot->queued_us;
+        atomic_store_explicit( &slot->sequence, s_tail + kLogSlots, memory_order_release );
+        ++s_tail;
+        ++total;
+
+        if( count == kLogBatchMax )
+        {
+            flush_batch( queued, count );
+            count = 0;
+        }
+    }
+
+    if( count )
+        flush_batch( queued, count );
+    return total;
+}
+
+
+static wx_thread_return_t log_writer_thread( void* args )
+{
+    while( !atomic_load( &s_shutdown ) )
+    {
+        while( sem_wait( &s_ready ) == -1 && errno == EINTR )
+            ;
+
+        // eat the posts for whatever else piled up while we were asleep so it all goes out in one batch instead of a wakeup per line.
+        // every message is in the ring before its post, so the drain after this sees all of them.
+        while( sem_trywait( &s_ready ) == 0 )
+            ;
+        drain();
+
+        if( atomic_exchange( &s_roll, false ) )
+            roll_log();
+    }
+
+    drain();
+    if( s_file )
+        fclose( s_file );
+    s_file = NULL;
+    atomic_store( &s_done, true );
+    wx_thread_return();
+}
+
+
+void log_init( const char* path, bool echo )
+{
+    ring_init();
+
+    s_path = path;
+    s_echo = echo;
+    open_log();
+    if( path && !s_file )
+        log_error( "  failed to open log file: %s\n", path );
+
+    wx_create_thread_detached( log_writer_thread, NULL );
+}
+
+
+// get everything that's in the ring out to disk before we exit
+void log_shutdown( void )
+{
+    atomic_store( &s_shutdown, true );
+    sem_post( &s_ready );
+
+    // give the writer up to a second to finish up
+    for( int i = 0; i < 100 && !atomic_load( &s_done ); i++ )
+        usleep( 10000 );
+}
+
+
+void log_get_stats( log_stats* stats )
+{
+    if( !stats )
+        return;
+
+    *stats = s_stats;   // written by the writer thread, a slightly torn read is fine for stats
+    stats->logged  = atomic_load_explicit( &s_logged, memory_order_relaxed );
+    stats->dropped = atomic_load_explicit( &s_dropped, memory_order_relaxed );
+    stats->throttle_emitted    = atomic_load_explicit( &s_throttle_emitted, memory_order_relaxed );
+    stats->throttle_suppressed = atomic_load_explicit( &s_throttle_suppressed, memory_order_relaxed );
+}
+
+
+void log_print_stats( void )
+{
+    log_stats stats;
+    log_get_stats( &stats );
+    log_error( "logging: logged: %llu, written: %llu, dropped: %llu, batches: %llu, latency last: %uus, max: %uus, ave: %0.1fus, flush last: %uus, max: %uus\n",
+               (unsigned long long)stats.logged, (unsigned long long)stats.written, (unsigned long long)stats.dropped, (unsigned long long)stats.batches,
+               stats.last_latency_us, stats.max_latency_us, stats.written ? (double)stats.total_latency_us / stats.written : 0.0,
+               stats.last_flush_us, stats.max_flush_us );
+
+    log_error( "logging: throttled messages emitted: %llu, suppressed: %llu\n", (unsigned long long)stats.throttle_emitted, (unsigned long long)stats.throttle_suppressed );
+    for( log_site* site = atomic_load( &s_sites ); site; site = site->next )
+    {
+        unsigned long long suppressed = atomic_load( &site->suppressed_total );
+        if( !suppressed )
+            continue;
+
+        char label[128];
+        site_label( site, label, sizeof( label ) );
+        log_error( "logging:   %s: emitted: %llu, suppressed: %llu (%s)\n", label, (unsigned long long)atomic_load( &site->emitted_total ), suppressed, site->where );
+    }
+}
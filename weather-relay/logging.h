@@ -0,0 +1,70 @@
+//
+//  logging.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_logging
+#define _H_logging
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef struct
+{
+    uint64_t logged;            // made it into the ring
+    uint64_t written;           // made it to the file (or stdout)
+    uint64_t dropped;           // ring was full
+    uint64_t batches;
+    uint32_t last_latency_us;   // log_error() call to the write being flushed
+    uint32_t max_latency_us;
+    uint64_t total_latency_us;
+    uint32_t last_flush_us;     // how long the last fflush took, this is the SD card being slow
+    uint32_t max_flush_us;
+    uint64_t throttle_emitted;  // log_error_throttled() messages that went through
+    uint64_t throttle_suppressed;
+} log_stats;
+
+// one of these lives at every log_error_throttled() call site, don't use it directly
+typedef struct log_site
+{
+    const char*          format;
+    const char*          where;
+    atomic_flag          registered;
+    atomic_llong         window_start;
+    atomic_uint          in_window;         // messages in this window so far
+    atomic_uint          suppressed;        // ones that were over budget this window
+    atomic_ullong        emitted_total;
+    atomic_ullong        suppressed_total;
+    struct log_site*     next;
+} log_site;
+
+// for errors that can fire on every frame when a sensor goes bad: each call site gets a budget of messages per window,
+// anything over that is counted and collapsed into a single "×N in last 10 min" line when the window is up.
+#define log_error_throttled( format, ... ) \
+    do \
+    { \
+        static log_site s_log_site = { format, __FILE__ ":" LOG_STRINGIFY( __LINE__ ), ATOMIC_FLAG_INIT }; \
+        log_error_site( &s_log_site, format, ##__VA_ARGS__ ); \
+    } while( 0 )
+
+#define LOG_STRINGIFY( x )    LOG_STRINGIFY_( x )
+#define LOG_STRINGIFY_( x )   #x
+
+void log_init( const char* path, bool echo );
+void log_shutdown( void );
+void log_get_stats( log_stats* stats );
+void log_print_stats( void );
+
+void log_error_site( log_site* site, const char* format, ... ) __attribute__(( format( printf, 2, 3 ) ));
+void log_set_throttle( unsigned int budget, unsigned int window_secs );
+bool log_parse_throttle( const char* arg, unsigned int* budget, unsigned int* window_secs );
+void log_throttle_flush( void );
+
+// log_error(), log_unix_error() and log_roll() are declared in main.h since everyone already includes that
+
+#endif // !_H_logging
@@ -24,6 +24,8 @@
 #include <netdb.h>
 #include <getopt.h>
 #include <signal.h>
+#include <limits.h>
+#include <pthread.h>
 
 #include "main.h"
 
@@ -34,9 +36,27 @@
 
 #include "ax25_pad.h"
 #include "kiss_frame.h"
-#include "rain_socket.h"
 #include "rain_sensor.h"
 #include "co2_sensor.h"
+#include "aprs_format.h"
+#include "scheduler.h"
+#include "send_queue.h"
+#include "logging.h"
+#include "state.h"
+#include "wx_archive.h"
+#include "control.h"
+#include "http_server.h"
+#include "history.h"
+#include "metrics.h"
+#include "trace.h"
+#include "stations.h"
+#include "receivers.h"
+#include "ingest.h"
+#include "rain_accum.h"
+#include "capture.h"
+#include "replay.h"
+#include "input.h"
+#include "wx_clock.h"
 
 // don't use old history if it's too far away from now...
 #define TIME_OUT_OLD_DATA
@@ -46,9 +66,8 @@
 //#define TRACE_INSERTS
 //#define TRACE_AVERAGES
 
-// define this to accept input from an internet socket (that an ESP32 connects to).  I've simplified this code to just use the USB serial as the interface
-// so this code isn't really necessary anymore-
-//#define USE_RAIN_SOCKET
+// define this to build every wx packet the old way too (APRSPacket + printAPRSPacket) and complain if they differ
+//#define VERIFY_WX_FORMAT
 
 // use this to go back to sending out APRS for the destination instead of our new one
 //#define REPLACE_DESTINATION
@@ -61,6 +80,8 @@
 #define kIGPath      "TCPIP*"
 #define kDestination "APNFOL"
 #define kRadioDest   "APRS"
+#define kLatitude     34.108
+#define kLongitude  -118.3349371
 
 #define kHistoryTimeout        60 * 2         // 2 minutes (to restart the app before the history rots)
 #define kMaxNumberOfRecords    20000          // 24 hours (86400 seconds) we need 86400 / 5 sec = 17280 wxrecords minimum.  Let's round up to 20k.
@@ -68,6 +89,14 @@
 #define kLogRollInterval       60 * 60 * 24   // (roll the log daily)
 #define kWxWideInterval        60 * 15        // send our weather out to WIDE2-1 every quarter hour
 #define kTelemetryWideInterval 60 * 15        // send our telemetry out to WIDE2-1 every quarter hour
+#define kPositionInterval      60 * 30        // position beacon for destinations getting positionless wx reports
+#define kISRate                1.0            // packets per second to APRS-IS...
+#define kISBurst               4.0            // ...and how many we can fire off back to back
+#define kRadioRate             0.2            // 1200 baud is slow and it's a shared channel, one packet every 5 seconds
+#define kRadioBurst            2.0
+#define kBase91TelemetryScale  8              // base-91 telemetry tops out at 8280, so particle counts and CO2 go out divided by this
+#define kDumpFilePath          "/var/www/html/wx.dump.txt"
+#define kWwwFilePath           "/var/www/html/wx.html"
 
 
 typedef struct
@@ -77,23 +106,24 @@ typedef struct
 } __attribute__ ((__packed__)) wxrecord;
 
 
-static time_t s_lastSentTime      = 0;
-static time_t s_lastWxTime        = 0;
-static time_t s_lastWindTime      = 0;
-static time_t s_lastGustTime      = 0;
-static time_t s_lastBaroTime      = 0;
-static time_t s_lastTempTime      = 0;
-static time_t s_lastIntTempTime   = 0;
-static time_t s_lastHumiTime      = 0;
-static time_t s_lastAirTime       = 0;
-static time_t s_lastAQITime       = 0;
-static time_t s_lastParamsTime    = 0;
-static time_t s_lastTelemetryTime = 0;
-static time_t s_lastStatusTime    = 0;
-static time_t s_startupTime       = 0;
-static time_t s_last_log_roll     = 0;
-static time_t s_lastWxWideTime    = 0;
-static time_t s_lastTelemetryWideTime = 0;
+// our own station's averaging windows, the others each have one of these in stations.c
+static wx_validation s_validation = { .rainGauge = true };
+
+// the periodic jobs set these so the next packet of that kind goes out over WIDE2-1 instead
+static bool s_wxWidePending        = false;
+static bool s_telemetryWidePending = false;
+
+// this holds all the min/max/averages
+static Frame   s_minFrame;
+static Frame   s_maxFrame;
+static Frame   s_aveFrame;
+static Frame   s_wxFrame;      // primary weather frame that is used to create APRS message
+static uint8_t s_receivedFlags = 0;
+
+// traces are all stamped on the main thread until they go in a send queue
+static wx_trace s_frame_trace;      // the frame being processed
+static wx_trace s_last_trace;       // newest frame that made it into the wxlog
+static wx_trace s_wx_trace;         // the wx packet being built
 
 //static float s_localOffsetInHg = 0.33f;
 static float s_localOffsetInHg = 0.33f + 0.10f;         // added 0.10 offset on 8/20 during hurricane's low pressure
@@ -101,6 +131,8 @@ static float s_localTempErrorC = 2.033333333333333;
 
 static bool s_debug = false;
 static bool s_rain_measurement_done = false;
+static time_t s_rain_time          = 0;     // when the rain baseline (ave rain) was last accepted
+static int    s_rain_raw_count     = 0;
 
 
 static time_t s_sendInterval     = kSendInterval;
@@ -121,17 +153,32 @@ static time_t s_rainLastHrPeriod = kRainLastHrPeriod;
 
 
 static const char* s_logFilePath = NULL;
-static FILE*       s_logFile     = NULL;
 
 static const char* s_seqFilePath = NULL;
+static const char* s_statePath   = NULL;
+static const char* s_archivePath = NULL;
+static bool        s_have_state  = false;
 static FILE*       s_seqFile     = NULL;
 
 static const char* s_wxlogFilePath = NULL;
 static FILE*       s_wxlogFile     = NULL;
 static wxrecord*   s_wxlog         = NULL;
-
-static const char* s_port_device  = PORT_DEVICE;
-static const char* s_rain_device  = RAIN_DEVICE;
+static const char* s_controlPath   = NULL;
+static char        s_httpHost[64]  = "";
+static uint16_t    s_httpPort      = 0;                      // zero means no http server, we write kWwwFilePath for Apache instead
+static char        s_capturePath[PATH_MAX] = "";              // raw receiver bytes go here when it's set
+static size_t      s_captureBytes  = 0;
+static char        s_replayPath[PATH_MAX] = "";               // feed this capture through under virtual time instead of reading the receivers
+static double      s_replaySpeed   = kReplayDefaultSpeed;
+static const char* s_replayOutPath = NULL;                    // where the packets go while replaying, stdout if this isn't set
+static FILE*       s_replayOut     = NULL;
+static int         s_stationWorkers = 0;                      // zero means one per core
+static bool        s_stationsSharded = false;                 // other stations are being tracked on the workers
+
+// the history is only changed from the main thread, this is so the control workers can take a consistent copy of it
+static pthread_mutex_t s_wxlog_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* s_rain_device  = NULL;          // RAIN_DEVICE unless -r says otherwise
 static const char* s_kiss_server  = "localhost";
 static uint16_t    s_kiss_port    = 8001;
 static uint8_t     s_num_retries  = 10;
@@ -140,7 +187,16 @@ static size_t      s_wx_count     = 0;
 static size_t      s_wx_size_secs = 0;
 static bool        s_test_mode    = false;
 static int16_t     s_last_aqi     = 0;
-static int16_t     s_average_aqi  = 0;
+static wx_format   s_is_format    = kWxFormat_uncompressed;  // APRS-IS gets everything
+static wx_format   s_rf_format    = kWxFormat_compressed;    // the radio gets the shortest thing we can send
+static bool        s_base91_telemetry = false;                // air quality goes in the wx comment instead of T# packets
+static uint32_t    s_params_hash  = 0;                        // what the last PARM/UNIT/EQNS/BITS we sent looked like
+static double      s_is_rate      = kISRate;
+static double      s_is_burst     = kISBurst;
+static double      s_rf_rate      = kRadioRate;
+static double      s_rf_burst     = kRadioBurst;
+static unsigned int s_log_budget  = 5;                        // throttled errors per call site...
+static unsigned int s_log_window  = 60 * 10;                  // ...per this many seconds
 
 static sig_atomic_t s_queue_busy = 0;
 static sig_atomic_t s_queue_num  = 0;
@@ -150,44 +206,78 @@ static const char*  s_queue[kMaxQueueItems] = {};        // these are packets wa
 //static sig_atomic_t s_error_bucket_num  = 0;
 //static const char*  s_error_bucket[kMaxQueueItems] = {};  // these are packets that failed to send after already being queued for later send.  These will get requeued later...
 
-static wx_thread_return_t sendToRadio_thread_entry( void* args );
-static wx_thread_return_t sendToRadioWIDE_thread_entry( void* args );
-static wx_thread_return_t sendPacket_thread_entry( void* args );
+static void send_to_aprs_is( const char* packet, bool wide );
+static void send_to_radio( const char* packet, bool wide );
 
 static int  connectToDireWolf( void );
 static int  sendToRadio( const char* p, bool wide );    // wide = send out to WIDE2-1 instead of TCPIP*
 static int  send_to_kiss_tnc( int chan, int cmd, char *data, int dlen );
 
 static void transmit_wx_frame( const Frame* frame );
+static void transmit_station_wx( const char* callsign, const Frame* frame );
+static void wx_report_from_frame( const Frame* frame, wx_report* wx );
 static void transmit_wx_data( const Frame* min, const Frame* max, const Frame* ave );
 static void transmit_air_data( const Frame* frame );
 static void transmit_status( const Frame* frame );
+static void air_telemetry_channels( const Frame* frame, float co2, int* values );
+static void save_sequence_number( void );
+static void save_state( void );
+static void restore_state( bool sequenceOverride );
+
+static void schedule_jobs( void );
+static bool have_all_wx_data( void );
+static bool status_job( void* context );
+static bool telemetry_job( void* context );
+static bool wx_job( void* context );
+static bool params_job( void* context );
+static bool wx_wide_job( void* context );
+static bool telemetry_wide_job( void* context );
+static bool position_job( void* context );
+static bool stations_job( void* context );
+static bool log_roll_job( void* context );
+static bool log_summary_job( void* context );
+static void transmit_position( void );
+static void transmit_telemetry_params( bool refresh );
+static void print_wx_formats( const wx_report* wx, time_t now );
 static bool validate_wx_frame( const Frame* frame );
 
 static void print_wx_for_www( const Frame* frame, int lastHour100sInch, int last24Hours100sInch, int sinceMidnight100sInch, int32_t co2_level );
+static void broadcast_wx_frame( const Frame* frame, const Frame* aveFrame );
+static int  pm25_to_aqi( float pm25 );
+static bool write_file_atomically( const char* path, const char* data, size_t len );
 
 static bool wxlog_startup( void );
 static bool wxlog_shutdown( void );
-static bool wxlog_frame( const Frame* wxFrame );
-static bool wxlog_get_wx_averages( Frame* wxFrame );
-static bool wxlog_get_rain_counts( int* lastHour100sInch, int* last24Hours100sInch, int* sinceMidnight100sInch );
-
-static void dump_frames( void );
-static void dump_frames_to_disk( void );
+static void wxlog_seed_rain( void );
+static size_t wxlog_snapshot( wxrecord** records );
+static void   wxlog_history( int64_t from, int64_t to, archive_sample_fn callback, void* context );
+static int64_t wxlog_oldest( void );
+
+static void dump_frames( FILE* out, const wxrecord* records, size_t count );
+static bool dump_frames_to_disk( const char* path, size_t* count );
+static void dump_command( FILE* out, const char* args, void* context );
+static void export_command( FILE* out, const char* args, void* context );
+static void metrics_command( FILE* out, const char* args, void* context );
+static void trace_command( FILE* out, const char* args, void* context );
+static double wxlog_records_value( void* context );
+static void shutdown_relay( void );
+
+static void replay_capture( void );
+static void replay_chunk( const capture_record* record, const uint8_t* data, void* context );
+static bool replay_tick( time_t now, void* context );
 
 static void        queue_packet( const char* packetData );
 static const char* queue_get_next_packet( void );
 
-static void        queue_error_packet( const char* packetData );
 //static const char* error_bucket_get_next_packet( void );
 
 static int  ignoreSIGPIPE( void );
 static int  getErrno( int result );
-static void signalHandler( int sig );
 
 static void  nullprint( const char* format, ... );
 static char* copy_string( const char* stringToCopy );
 static void  printTime( int printNewline );
+static time_t timeGetTimeSec( void );
 static void  printTimePlus5( void );
 //static void buffer_input_flush( void );
 
@@ -226,28 +316,19 @@ int ignoreSIGPIPE( void )
 }
 
 
-void signalHandler( int sig )
+// SIGINT/SIGTERM land here via the main loop, no longer from inside a signal handler
+void shutdown_relay( void )
 {
-    switch( sig )
-    {
-        case SIGHUP:
-            if( s_debug )
-                dump_frames();
-            dump_frames_to_disk();
-            break;
-            
-        case SIGINT:
-        case SIGTERM:
-            wxlog_shutdown();
-            if( s_logFile )
-                fclose( s_logFile );
-            exit( EXIT_SUCCESS );
-            break;
-
-        default:
-            assert( false );
-            break;
-    }
+    log_error( "shutting down\n" );
+    wxlog_shutdown();
+    wx_archive_close();
+    state_close();
+    control_stop();
+    ingest_shutdown();
+    receivers_shutdown();
+    stations_shutdown();
+    capture_shutdown();
+    log_shutdown();
 }
 
 
@@ -287,7 +368,7 @@ char* copy_string( const char* stringToCopy )
 
 void printTime( int printNewline )
 {
-    time_t t = time( NULL );
+    time_t t = timeGetTimeSec();
     struct tm tm = *localtime( &t );
     if( printNewline )
         printf( "%d-%02d-%02d %02d:%02d:%02d\n", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec );
@@ -298,7 +379,7 @@ void printTime( int printNewline )
 
 void printTimePlus5()
 {
-  time_t t = time( NULL );
+  time_t t = timeGetTimeSec();
   struct tm tm = *localtime(&t);
   printf("%d-%02d-%02d %02d:%02d:%02d\n", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min + 5, tm.tm_sec);
 }
@@ -332,49 +413,122 @@ void printCurrentWeather( const Frame* frame, bool alwaysPrint, FILE* outfile )
 
 
 
-void dump_frames( void )
+void dump_frames( FILE* out, const wxrecord* records, size_t count )
 {
-    if( !s_wxlog )
-        return;
-    
-    printf( "dumping %zu frames:\n", s_wx_count );
-    
-    for( int i = 0; i < s_wx_count; i++ )
+    fprintf( out, "dumping %zu frames:\n", count );
+
+    for( int i = 0; i < count; i++ )
     {
-        struct tm tm = *localtime( &s_wxlog[i].timeStampSecs );
-        printf( "%d-%02d-%02d %02d:%02d:%02d.%03d: ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, i );
-        printCurrentWeather( &s_wxlog[i].frame, true, NULL );
+        struct tm tm;
+        localtime_r( &records[i].timeStampSecs, &tm );
+        fprintf( out, "%d-%02d-%02d %02d:%02d:%02d.%03d: ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, i );
+        printCurrentWeather( &records[i].frame, true, out );
     }
 }
 
 
-void dump_frames_to_disk( void )
+// writes a snapshot of the history next to the target and renames it over, so the web server never sees half a file
+bool dump_frames_to_disk( const char* path, size_t* count )
 {
-    if( !s_wxlog )
-        return;
-    
-    FILE* wxfile = fopen( "/var/www/html/wx.dump.txt", "w" );
+    wxrecord* records = NULL;
+    *count = wxlog_snapshot( &records );
+    if( !records )
+        return false;
+
+    char tempPath[PATH_MAX];
+    snprintf( tempPath, sizeof( tempPath ), "%s.tmp", path );
+
+    FILE* wxfile = fopen( tempPath, "w" );
     if( !wxfile )
+    {
+        free( records );
+        return false;
+    }
+
+    dump_frames( wxfile, records, *count );
+    if( s_debug )
+        dump_frames( stdout, records, *count );
+    free( records );
+
+    bool ok = fclose( wxfile ) == 0;
+    if( ok )
+        ok = rename( tempPath, path ) == 0;
+    else
+        unlink( tempPath );
+    return ok;
+}
+
+
+// control socket: streams the history back to the client
+void dump_command( FILE* out, const char* args, void* context )
+{
+    if( !out )
         return;
-    
-    fprintf( wxfile, "dumping %zu frames:\n", s_wx_count );
-    
-    for( int i = 0; i < s_wx_count; i++ )
+
+    wxrecord* records = NULL;
+    size_t    count   = wxlog_snapshot( &records );
+    if( !records )
     {
-        struct tm tm = *localtime( &s_wxlog[i].timeStampSecs );
-        fprintf( wxfile, "%d-%02d-%02d %02d:%02d:%02d.%03d: ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, i );
-        printCurrentWeather( &s_wxlog[i].frame, true, wxfile );
+        fprintf( out, "no wx history\n" );
+        return;
     }
-    
-    fclose( wxfile );
+
+    dump_frames( out, records, count );
+    free( records );
+}
+
+
+// control socket and SIGHUP: writes the history to disk, defaults to where the web server picks it up
+void export_command( FILE* out, const char* args, void* context )
+{
+    const char* path  = args && *args ? args : kDumpFilePath;
+    size_t      count = 0;
+
+    if( dump_frames_to_disk( path, &count ) )
+    {
+        if( out )
+            fprintf( out, "exported %zu frames to %s\n", count, path );
+    }
+    else
+    {
+        log_error( "  failed to export wx history to %s (%d)\n", path, errno );
+        if( out )
+            fprintf( out, "failed to export to %s (%d)\n", path, errno );
+    }
+}
+
+
+
+// control socket: same text /metrics serves
+void metrics_command( FILE* out, const char* args, void* context )
+{
+    if( out )
+        metrics_write( out );
+}
+
+
+// control socket: "trace 5" shows the five slowest recent packets, stage by stage
+void trace_command( FILE* out, const char* args, void* context )
+{
+    int count = args && *args ? atoi( args ) : 10;
+    trace_dump( out, count );
+}
+
+
+double wxlog_records_value( void* context )
+{
+    pthread_mutex_lock( &s_wxlog_mutex );
+    size_t count = s_wx_count;
+    pthread_mutex_unlock( &s_wxlog_mutex );
+    return count;
 }
 
 
 
+// virtual while we're replaying a capture
 time_t timeGetTimeSec( void )
 {
-    time_t rawtime = 0;
-    return time( &rawtime );
+    return wx_clock_now();
 }
 
 
@@ -429,28 +583,28 @@ bool validate_wx_frame( const Frame* frame )
     if( tempF < kTempLowBar || tempF > kTempHighBar )
     {
         // blow off this entire frame of data- it's probably all wrong
-        log_error( "validate_wx_frame: temp out of range %0.2f°F\n", tempF );
+        log_error_throttled( "validate_wx_frame: temp out of range %0.2f°F\n", tempF );
         return false;
     }
     
     if( frame->humidity < kHumidityLowBar || frame->humidity > kHumidityHighBar )
     {
         // blow off this entire frame of data- it's probably all wrong
-        log_error( "validate_wx_frame: humidity out of range %d%%\n", frame->humidity );
+        log_error_throttled( "validate_wx_frame: humidity out of range %d%%\n", frame->humidity );
         return false;
     }
 
     if( ms2mph( frame->windSpeedMs ) > kWindHighBar || ms2mph( frame->windSpeedMs ) < kWindLowBar )
     {
         // blow off this entire frame of data- it's probably all wrong (except for baro and int temp)
-        log_error( "validate_wx_frame: wind speed out of range [%0.2f°]: %0.2f mph\n", frame->windDirection, ms2mph( frame->windSpeedMs ) );
+        log_error_throttled( "validate_wx_frame: wind speed out of range [%0.2f°]: %0.2f mph\n", frame->windDirection, ms2mph( frame->windSpeedMs ) );
         return false;
     }
 
     if( frame->windDirection < 0 || frame->windDirection > 360 )
     {
         // blow off this entire frame of data- it's probably all wrong
-        log_error( "validate_wx_frame: wind direction out of range [%0.2f°]: %0.2f mph\n", frame->windDirection, ms2mph( frame->windSpeedMs ) );
+        log_error_throttled( "validate_wx_frame: wind direction out of range [%0.2f°]: %0.2f mph\n", frame->windDirection, ms2mph( frame->windSpeedMs ) );
         return false;
     }
 
@@ -458,7 +612,7 @@ bool validate_wx_frame( const Frame* frame )
     if( ms2mph( frame->windGustMs ) > kWindHighBar || ms2mph( frame->windGustMs ) < kWindLowBar  )
     {
         // blow off this entire frame of data- it's probably all wrong (except for baro and int temp)
-        log_error( "validate_wx_frame: wind gust out of range [%0.2f°]: %0.2f mph\n", frame->windDirection, ms2mph( frame->windGustMs ) );
+        log_error_throttled( "validate_wx_frame: wind gust out of range [%0.2f°]: %0.2f mph\n", frame->windDirection, ms2mph( frame->windGustMs ) );
         return false;
     }
     
@@ -476,22 +630,60 @@ bool validate_wx_frame( const Frame* frame )
 
 
 
-void print_wx_for_www( const Frame* frame, int lastHour100sInch, int last24Hours100sInch, int sinceMidnight100sInch, int32_t co2_level )
+// US EPA breakpoints for PM2.5 (µg/m³, 24 hour average)
+int pm25_to_aqi( float pm25 )
 {
-//    snprintf( wx.windDirection, 4, "%03d", (int)(round(frame->windDirection)) );
-//    snprintf( wx.windSpeed, 4, "%03d", (int)(round(ms2mph(frame->windSpeedMs))) );
-//    snprintf( wx.gust, 4, "%03d", (int)(round(ms2mph(frame->windGustMs))) );
+    static const struct { float low, high; int aqi_low, aqi_high; } table[] = {
+        {   0.0f,  12.0f,   0,  50 },
+        {  12.1f,  35.4f,  51, 100 },
+        {  35.5f,  55.4f, 101, 150 },
+        {  55.5f, 150.4f, 151, 200 },
+        { 150.5f, 250.4f, 201, 300 },
+        { 250.5f, 350.4f, 301, 400 },
+        { 350.5f, 500.4f, 401, 500 },
+    };
+
+    if( pm25 < 0 )
+        return 0;
+
+    pm25 = floorf( pm25 * 10 ) / 10;    // the breakpoints are truncated to a tenth
+    for( int i = 0; i < sizeof( table ) / sizeof( table[0] ); i++ )
+        if( pm25 <= table[i].high )
+            return (int)roundf( (table[i].aqi_high - table[i].aqi_low) / (table[i].high - table[i].low) * (pm25 - table[i].low) + table[i].aqi_low );
+    return 500;
+}
 
-//    if( co2_level <= 0 )
-//        log_error( "print_wx_for_www: co2_level is zero... %d\n", co2_level );
 
-    
-    FILE* www_file = fopen( "/var/www/html/wx.html", "w" ); // obviously only will work on RPi with Apache running...
-    if( www_file )
-    {
-        time_t t = time( NULL );
-        struct tm tm = *localtime( &t );
-        fprintf( www_file, "%02d:%02d:%02d, %g, %d, %g, %g, %g, %g, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d\n", tm.tm_hour, tm.tm_min, tm.tm_sec, c2f( frame->tempC ), frame->humidity, (frame->pressure * millibar2inchHg) + s_localOffsetInHg, frame->windDirection, ms2mph( frame->windSpeedMs ), ms2mph( frame->windGustMs ),
+// readers see the old file or the new one, never half of one
+bool write_file_atomically( const char* path, const char* data, size_t len )
+{
+    char tempPath[PATH_MAX];
+    snprintf( tempPath, sizeof( tempPath ), "%s.tmp", path );
+
+    FILE* file = fopen( tempPath, "w" );
+    if( !file )
+        return false;
+
+    bool ok = fwrite( data, 1, len, file ) == len;
+    ok = (fclose( file ) == 0) && ok;
+    if( ok )
+        ok = rename( tempPath, path ) == 0;
+    else
+        unlink( tempPath );
+    return ok;
+}
+
+
+// renders the current conditions once per update, the http server hands out these same bytes to everybody until the next one
+void print_wx_for_www( const Frame* frame, int lastHour100sInch, int last24Hours100sInch, int sinceMidnight100sInch, int32_t co2_level )
+{
+    time_t    t = timeGetTimeSec();
+    struct tm tm;
+    localtime_r( &t, &tm );
+
+    // the original wx.html line, the web page splits this on commas so don't change the order
+    char line[512];
+    int  lineLen = snprintf( line, sizeof( line ), "%02d:%02d:%02d, %g, %d, %g, %g, %g, %g, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d\n", tm.tm_hour, tm.tm_min, tm.tm_sec, c2f( frame->tempC ), frame->humidity, (frame->pressure * millibar2inchHg) + s_localOffsetInHg, frame->windDirection, ms2mph( frame->windSpeedMs ), ms2mph( frame->windGustMs ),
                  frame->pm10_standard,       // Standard PM1.0
                  frame->pm25_standard,       // Standard PM2.5
                  frame->pm100_standard,      // Standard PM10.0
@@ -510,8 +702,89 @@ void print_wx_for_www( const Frame* frame, int lastHour100sInch, int last24Hours
                  sinceMidnight100sInch,      // rain since midnight
                  co2_level                   // current co2 reading
                );
-        fclose( www_file );
+    if( lineLen < 0 || lineLen >= sizeof( line ) )
+        return;
+
+    if( !s_httpPort )
+    {
+        // a replay isn't what's going on outside right now
+        if( !*s_replayPath && !write_file_atomically( kWwwFilePath, line, lineLen ) )   // obviously only will work on RPi with Apache running...
+            log_error_throttled( "print_wx_for_www: failed to write %s (%d)\n", kWwwFilePath, errno );
+        return;
     }
+
+    http_server_publish( "/wx.html", "text/html", line, lineLen );
+
+    char csv[1024];
+    int  csvLen = snprintf( csv, sizeof( csv ), "time,temp_f,humidity,pressure_inhg,wind_dir,wind_mph,gust_mph,pm10,pm25,pm100,pm10_env,pm25_env,pm100_env,p03um,p05um,p10um,p25um,p50um,p100um,pm25_24h,aqi,rain_1h_in,rain_24h_in,rain_midnight_in,co2_ppm\n"
+                            "%lld,%.1f,%d,%.2f,%.0f,%.1f,%.1f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.2f,%.2f,%.2f,%d\n",
+                            (long long)t, c2f( frame->tempC ), frame->humidity, (frame->pressure * millibar2inchHg) + s_localOffsetInHg, frame->windDirection, ms2mph( frame->windSpeedMs ), ms2mph( frame->windGustMs ),
+                            frame->pm10_standard, frame->pm25_standard, frame->pm100_standard, frame->pm10_env, frame->pm25_env, frame->pm100_env,
+                            frame->particles_03um, frame->particles_05um, frame->particles_10um, frame->particles_25um, frame->particles_50um, frame->particles_100um,
+                            s_last_aqi, pm25_to_aqi( s_last_aqi ), lastHour100sInch / 100.0, last24Hours100sInch / 100.0, sinceMidnight100sInch / 100.0, co2_level );
+    if( csvLen > 0 && csvLen < sizeof( csv ) )
+        http_server_publish( "/wx.csv", "text/csv", csv, csvLen );
+
+    char json[1024];
+    int  jsonLen = snprintf( json, sizeof( json ), "{\"time\":%lld,\"temp_f\":%.1f,\"humidity\":%d,\"pressure_inhg\":%.2f,\"wind_dir\":%.0f,\"wind_mph\":%.1f,\"gust_mph\":%.1f,"
+                             "\"pm\":{\"pm10\":%d,\"pm25\":%d,\"pm100\":%d,\"pm10_env\":%d,\"pm25_env\":%d,\"pm100_env\":%d,\"p03um\":%d,\"p05um\":%d,\"p10um\":%d,\"p25um\":%d,\"p50um\":%d,\"p100um\":%d},"
+                             "\"pm25_24h\":%d,\"aqi\":%d,\"rain\":{\"last_hour_in\":%.2f,\"last_24h_in\":%.2f,\"since_midnight_in\":%.2f},\"co2_ppm\":%d}\n",
+                             (long long)t, c2f( frame->tempC ), frame->humidity, (frame->pressure * millibar2inchHg) + s_localOffsetInHg, frame->windDirection, ms2mph( frame->windSpeedMs ), ms2mph( frame->windGustMs ),
+                             frame->pm10_standard, frame->pm25_standard, frame->pm100_standard, frame->pm10_env, frame->pm25_env, frame->pm100_env,
+                             frame->particles_03um, frame->particles_05um, frame->particles_10um, frame->particles_25um, frame->particles_50um, frame->particles_100um,
+                             s_last_aqi, pm25_to_aqi( s_last_aqi ), lastHour100sInch / 100.0, last24Hours100sInch / 100.0, sinceMidnight100sInch / 100.0, co2_level );
+    if( jsonLen > 0 && jsonLen < sizeof( json ) )
+        http_server_publish( "/wx.json", "application/json", json, jsonLen );
+}
+
+
+// every frame that made it past updateStats goes out on /events, just the fields it actually has plus the running averages
+void broadcast_wx_frame( const Frame* frame, const Frame* aveFrame )
+{
+    if( !s_httpPort || !frame->flags )
+        return;
+
+    char   json[1024];
+    size_t len   = 0;
+    bool   first = true;
+#define APPEND( ... ) \
+    do \
+    { \
+        if( len < sizeof( json ) ) \
+            len += snprintf( json + len, sizeof( json ) - len, __VA_ARGS__ ); \
+    } while( 0 )
+#define FIELD( format, ... ) \
+    do \
+    { \
+        APPEND( "%s" format, first ? "" : ",", __VA_ARGS__ ); \
+        first = false; \
+    } while( 0 )
+
+    APPEND( "{\"time\":%lld,\"station_id\":%u,\"flags\":%u,\"frame\":{", (long long)timeGetTimeSec(), frame->station_id, frame->flags );
+    if( frame->flags & kDataFlag_temp )
+        FIELD( "\"temp_f\":%.1f", c2f( frame->tempC ) );
+    if( frame->flags & kDataFlag_humidity )
+        FIELD( "\"humidity\":%d", frame->humidity );
+    if( frame->flags & kDataFlag_wind )
+        FIELD( "\"wind_mph\":%.1f,\"wind_dir\":%.0f", ms2mph( frame->windSpeedMs ), frame->windDirection );
+    if( frame->flags & kDataFlag_gust )
+        FIELD( "\"gust_mph\":%.1f", ms2mph( frame->windGustMs ) );
+    if( frame->flags & kDataFlag_rain )
+        FIELD( "\"rain_in\":%.2f", frame->rain );
+    if( frame->flags & kDataFlag_intTemp )
+        FIELD( "\"int_temp_f\":%.1f", c2f( frame->intTempC - s_localTempErrorC ) );
+    if( frame->flags & kDataFlag_pressure )
+        FIELD( "\"pressure_inhg\":%.2f", (frame->pressure * millibar2inchHg) + s_localOffsetInHg );
+    if( frame->flags & kDataFlag_airQuality )
+        FIELD( "\"pm10\":%d,\"pm25\":%d,\"pm100\":%d", frame->pm10_standard, frame->pm25_standard, frame->pm100_standard );
+    APPEND( "},\"average\":{\"temp_f\":%.1f,\"humidity\":%d,\"wind_mph\":%.1f,\"wind_dir\":%.0f,\"int_temp_f\":%.1f,\"pressure_inhg\":%.2f,\"pm25\":%d,\"aqi\":%d}}",
+            c2f( aveFrame->tempC ), aveFrame->humidity, ms2mph( aveFrame->windSpeedMs ), aveFrame->windDirection, c2f( aveFrame->intTempC - s_localTempErrorC ),
+            (aveFrame->pressure * millibar2inchHg) + s_localOffsetInHg, aveFrame->pm25_standard, pm25_to_aqi( s_validation.averageAqi ) );
+#undef FIELD
+#undef APPEND
+
+    if( len < sizeof( json ) )
+        http_server_broadcast( "/events", "wx", json, len );
 }
 
 
@@ -523,7 +796,7 @@ void print_wx_for_www( const Frame* frame, int lastHour100sInch, int last24Hours
 // this does a few things, it averages data until we have enough history to do it properly.
 // it also checks the incoming wx sensor data to make sure it isn't nuts.  also does some check from CWOP guide.
 // https://weather.gladstonefamily.net/CWOP_Guide.pdf
-void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
+void updateStationStats( wx_validation* state, Frame* data, Frame* min, Frame* max, Frame* ave )
 {
     if( data->flags & kDataFlag_temp )
     {
@@ -532,8 +805,9 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
         if( tempF < kTempLowBar || tempF > kTempHighBar )
         {
             // blow off this entire frame of data- it's probably all wrong
-            log_error( " temp out of range %0.2f°F, time left: %ld\n", tempF, s_tempPeriod - (timeGetTimeSec() - s_lastTempTime) );
+            log_error_throttled( " temp out of range %0.2f°F, time left: %ld\n", tempF, s_tempPeriod - (timeGetTimeSec() - state->lastTempTime) );
             data->flags &= ~kDataFlag_temp;
+            metrics_count( kCounter_rejected_temp );
             frameOk = false;
         }
         
@@ -545,18 +819,19 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
             if( fabs( tempF - c2f( ave->tempC ) ) > kTempTemporalLimit )
             {
                 // blow off this entire frame of data- it's probably all wrong
-                log_error( " temperature temporal check failed: %0.2f°F, ave: %0.2f°F time left: %ld\n", tempF, c2f( ave->tempC ), s_tempPeriod - (timeGetTimeSec() - s_lastTempTime) );
+                log_error_throttled( " temperature temporal check failed: %0.2f°F, ave: %0.2f°F time left: %ld\n", tempF, c2f( ave->tempC ), s_tempPeriod - (timeGetTimeSec() - state->lastTempTime) );
                 data->flags &= ~kDataFlag_temp;
+                metrics_count( kCounter_rejected_temp );
                 frameOk = false;
             }
         }
         
         if( frameOk )
         {
-            if( timeGetTimeSec() > s_lastTempTime + s_tempPeriod )
+            if( timeGetTimeSec() > state->lastTempTime + s_tempPeriod )
             {
                 ave->tempC = 0;
-                s_lastTempTime = timeGetTimeSec();
+                state->lastTempTime = timeGetTimeSec();
             }
 
             // check for no data before calculating mean
@@ -566,17 +841,17 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
                 ave->tempC = (data->tempC + ave->tempC) * 0.5f;
 #ifdef TRACE_STATS
             printTime( false );
-            stats( " temp average: %0.2f°F, time left: %ld\n", c2f( ave->tempC ), s_tempPeriod - (timeGetTimeSec() - s_lastTempTime) );
+            stats( " temp average: %0.2f°F, time left: %ld\n", c2f( ave->tempC ), s_tempPeriod - (timeGetTimeSec() - state->lastTempTime) );
 #endif
         }
     }
 
     if( data->flags & kDataFlag_intTemp )
     {
-        if( timeGetTimeSec() > s_lastIntTempTime + s_intTempPeriod )
+        if( timeGetTimeSec() > state->lastIntTempTime + s_intTempPeriod )
         {
             ave->intTempC = 0;
-            s_lastIntTempTime = timeGetTimeSec();
+            state->lastIntTempTime = timeGetTimeSec();
         }
 
         // check for no data before calculating mean
@@ -586,7 +861,7 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
         ave->intTempC = (data->intTempC + ave->intTempC) * 0.5f;
 #ifdef TRACE_STATS
         printTime( false );
-        stats( " int temp average: %0.2f°F, time left: %ld\n", c2f( ave->intTempC ), s_intTempPeriod - (timeGetTimeSec() - s_lastIntTempTime) );
+        stats( " int temp average: %0.2f°F, time left: %ld\n", c2f( ave->intTempC ), s_intTempPeriod - (timeGetTimeSec() - state->lastIntTempTime) );
 #endif
     }
 
@@ -597,17 +872,18 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
         if( data->humidity < kHumidityLowBar || data->humidity > kHumidityHighBar )
         {
             // blow off this entire frame of data- it's probably all wrong
-            log_error( " humidity out of range %d%%, time left: %ld\n", data->humidity, s_humiPeriod - (timeGetTimeSec() - s_lastHumiTime) );
+            log_error_throttled( " humidity out of range %d%%, time left: %ld\n", data->humidity, s_humiPeriod - (timeGetTimeSec() - state->lastHumiTime) );
             data->flags &= ~kDataFlag_humidity;
+            metrics_count( kCounter_rejected_humidity );
             frameOk = false;
         }
 
         if( frameOk )
         {
-            if( timeGetTimeSec() > s_lastHumiTime + s_humiPeriod )
+            if( timeGetTimeSec() > state->lastHumiTime + s_humiPeriod )
             {
                 ave->humidity = 0;
-                s_lastHumiTime = timeGetTimeSec();
+                state->lastHumiTime = timeGetTimeSec();
             }
 
             // check for no data before calculating mean
@@ -617,7 +893,7 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
                 ave->humidity = (data->humidity + ave->humidity) / 2;
 #ifdef TRACE_STATS
             printTime( false );
-            stats( " humidity average: %d%%, time left: %ld\n", ave->humidity, s_humiPeriod - (timeGetTimeSec() - s_lastHumiTime) );
+            stats( " humidity average: %d%%, time left: %ld\n", ave->humidity, s_humiPeriod - (timeGetTimeSec() - state->lastHumiTime) );
 #endif
         }
     }
@@ -632,8 +908,9 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
         if( (windSpeedMph > kWindHighBar) || (windSpeedMph < kWindLowBar) )
         {
             // blow off this entire frame of data- it's probably all wrong (except for baro and int temp)
-            log_error( " wind speed out of range [%0.2f°]: %0.2f mph, time left: %ld\n", data->windDirection, windSpeedMph, s_windPeriod - (timeGetTimeSec() - s_lastWindTime) );
+            log_error_throttled( " wind speed out of range [%0.2f°]: %0.2f mph, time left: %ld\n", data->windDirection, windSpeedMph, s_windPeriod - (timeGetTimeSec() - state->lastWindTime) );
             data->flags &= ~kDataFlag_wind;
+            metrics_count( kCounter_rejected_wind );
             frameOk = false;
         }
         
@@ -641,8 +918,9 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
         if( frameOk && (data->windDirection < 0 || data->windDirection > 360) )
         {
             // blow off this entire frame of data- it's probably all wrong
-            log_error( " wind direction out of range [%0.2f°]: %0.2f mph, time left: %ld\n", data->windDirection, windSpeedMph, s_windPeriod - (timeGetTimeSec() - s_lastWindTime) );
+            log_error_throttled( " wind direction out of range [%0.2f°]: %0.2f mph, time left: %ld\n", data->windDirection, windSpeedMph, s_windPeriod - (timeGetTimeSec() - state->lastWindTime) );
             data->flags &= ~kDataFlag_wind;
+            metrics_count( kCounter_rejected_wind );
             frameOk = false;
         }
 
@@ -650,18 +928,19 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
         if( frameOk && (fabs( windSpeedMph - aveWindMph ) > kWindTemporalLimit) )
         {
             // blow off this entire frame of data- it's probably all wrong
-            log_error( " wind temporal check failed [%0.2f°]: %0.2f, ave: %0.2f mph, time left: %ld\n", data->windDirection, windSpeedMph, aveWindMph, s_windPeriod - (timeGetTimeSec() - s_lastWindTime) );
+            log_error_throttled( " wind temporal check failed [%0.2f°]: %0.2f, ave: %0.2f mph, time left: %ld\n", data->windDirection, windSpeedMph, aveWindMph, s_windPeriod - (timeGetTimeSec() - state->lastWindTime) );
             data->flags &= ~kDataFlag_wind;
+            metrics_count( kCounter_rejected_wind );
             frameOk = false;
         }
 
         if( frameOk )
         {
-            if( timeGetTimeSec() > s_lastWindTime + s_windPeriod )
+            if( timeGetTimeSec() > state->lastWindTime + s_windPeriod )
             {
                 ave->windSpeedMs = 0;
                 ave->windDirection = 0;
-                s_lastWindTime = timeGetTimeSec();
+                state->lastWindTime = timeGetTimeSec();
             }
 
             // check for no data before calculating mean
@@ -677,7 +956,7 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
             
 #ifdef TRACE_STATS
             printTime( false );
-            stats( " wind average[%0.2f°]: %0.2f mph, time left: %ld\n", ave->windDirection, ms2mph( ave->windSpeedMs ), s_windPeriod - (timeGetTimeSec() - s_lastWindTime) );
+            stats( " wind average[%0.2f°]: %0.2f mph, time left: %ld\n", ave->windDirection, ms2mph( ave->windSpeedMs ), s_windPeriod - (timeGetTimeSec() - state->lastWindTime) );
 #endif
         }
     }
@@ -692,8 +971,9 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
         if( windGustMph > kWindHighBar || windGustMph < kWindLowBar )
         {
             // blow off this entire frame of data- it's probably all wrong (except for baro and int temp)
-            log_error( " wind gust out of range [%0.2f°]: %0.2f mph, time left: %ld\n", data->windDirection, windGustMph, s_gustPeriod - (timeGetTimeSec() - s_lastGustTime) );
+            log_error_throttled( " wind gust out of range [%0.2f°]: %0.2f mph, time left: %ld\n", data->windDirection, windGustMph, s_gustPeriod - (timeGetTimeSec() - state->lastGustTime) );
             data->flags &= ~kDataFlag_gust;
+            metrics_count( kCounter_rejected_gust );
             frameOk = false;
         }
 
@@ -701,34 +981,35 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
         if( frameOk && (windGustMph - ms2mph( max->windGustMs ) > kWindTemporalLimit) )
         {
             // blow off this entire frame of data- it's probably all wrong
-            log_error( " gust temporal check failed [%0.2f°]: %0.2f, last max: %0.2f mph, time left: %ld\n", data->windDirection, windGustMph, ms2mph( max->windGustMs ), s_gustPeriod - (timeGetTimeSec() - s_lastGustTime) );
+            log_error_throttled( " gust temporal check failed [%0.2f°]: %0.2f, last max: %0.2f mph, time left: %ld\n", data->windDirection, windGustMph, ms2mph( max->windGustMs ), s_gustPeriod - (timeGetTimeSec() - state->lastGustTime) );
             data->flags &= ~kDataFlag_gust;
+            metrics_count( kCounter_rejected_gust );
             frameOk = false;
         }
         
         if( frameOk )
         {
             // we create a 10 minute window of instantaneous gust measurements
-            if( timeGetTimeSec() > s_lastGustTime + s_gustPeriod )
+            if( timeGetTimeSec() > state->lastGustTime + s_gustPeriod )
             {
                 max->windGustMs = 0;
-                s_lastGustTime = timeGetTimeSec();
+                state->lastGustTime = timeGetTimeSec();
             }
 
             max->windGustMs = fmax( data->windGustMs, max->windGustMs );
 #ifdef TRACE_STATS
             printTime( false );
-            stats( " gust max: %0.2f mph, time left: %ld\n", ms2mph( max->windGustMs ), s_gustPeriod - (timeGetTimeSec() - s_lastGustTime) );
+            stats( " gust max: %0.2f mph, time left: %ld\n", ms2mph( max->windGustMs ), s_gustPeriod - (timeGetTimeSec() - state->lastGustTime) );
 #endif
         }
     }
 
     if( data->flags & kDataFlag_pressure )
     {
-        if( timeGetTimeSec() > s_lastBaroTime + s_baroPeriod )
+        if( timeGetTimeSec() > state->lastBaroTime + s_baroPeriod )
         {
             min->pressure = 0;
-            s_lastBaroTime = timeGetTimeSec();
+            state->lastBaroTime = timeGetTimeSec();
         }
 
         // check for no data before calculating min
@@ -738,14 +1019,14 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
             min->pressure = fmin( data->pressure, min->pressure );
 #ifdef TRACE_STATS
         printTime( false );
-        stats( " pressure min: %0.2f InHg, time left: %ld\n",(min->pressure * millibar2inchHg) + s_localOffsetInHg, s_baroPeriod - (timeGetTimeSec() - s_lastBaroTime) );
+        stats( " pressure min: %0.2f InHg, time left: %ld\n",(min->pressure * millibar2inchHg) + s_localOffsetInHg, s_baroPeriod - (timeGetTimeSec() - state->lastBaroTime) );
 #endif
     }
 
 
     if( data->flags & kDataFlag_airQuality )
     {
-        if( timeGetTimeSec() > s_lastAirTime + s_airPeriod )
+        if( timeGetTimeSec() > state->lastAirTime + s_airPeriod )
         {
             ave->pm10_standard = 0;
             ave->pm25_standard = 0;
@@ -759,18 +1040,18 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
             ave->particles_25um = 0;
             ave->particles_50um = 0;
             ave->particles_100um = 0;
-            s_lastAirTime = timeGetTimeSec();
+            state->lastAirTime = timeGetTimeSec();
         }
 
-        if( timeGetTimeSec() > s_lastAQITime + s_aqiPeriod )
+        if( timeGetTimeSec() > state->lastAQITime + s_aqiPeriod )
         {
-            s_average_aqi = 0;
-            s_lastAQITime = timeGetTimeSec();
+            state->averageAqi = 0;
+            state->lastAQITime = timeGetTimeSec();
         }
 
-        if( s_average_aqi == 0 )
-            s_average_aqi = data->pm25_standard;
-        s_average_aqi = (data->pm25_standard + s_average_aqi) / 2;
+        if( state->averageAqi == 0 )
+            state->averageAqi = data->pm25_standard;
+        state->averageAqi = (data->pm25_standard + state->averageAqi) / 2;
         
         // check for no data before calculating mean
         if( ave->pm10_standard == 0 )
@@ -827,12 +1108,12 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
 #endif
     }
 
+    // the rain gauge is ours, nobody else's station gets its counts
+    if( !state->rainGauge )
+        return;
+
     // check to see if we have rain counts
-#ifdef USE_RAIN_SOCKET
-    int rain_count = rain_socket_raw_count();
-#else
     int rain_count = rain_sensor_raw_count();
-#endif
 
     float rain_in_mm = rawRainCount2mm( rain_count );
     float rain_in_inches = rawRainCount2inches( rain_count );
@@ -848,7 +1129,8 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
     if( rain_in_mm < kRainLowBar || rain_in_mm > kRainHighBar )
     {
         data->flags &= ~kDataFlag_rain;
-        log_error( " rain out of range: %0.2f mm\n", rain_in_mm );
+        metrics_count( kCounter_rejected_rain );
+        log_error_throttled( " rain out of range: %0.2f mm\n", rain_in_mm );
         frameOk = false;
     }
 
@@ -856,8 +1138,9 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
     if( frameOk && s_rain_measurement_done && (fabs( rain_in_inches - ave->rain ) > kRainTemporalLimitInches) )
     {
         // blow off this entire frame of data- it's probably all wrong
-        log_error( " rain temporal check failed: %0.2f inches, ave: %0.2f inches\n", rain_in_inches, ave->rain );
+        log_error_throttled( " rain temporal check failed: %0.2f inches, ave: %0.2f inches\n", rain_in_inches, ave->rain );
         data->flags &= ~kDataFlag_rain;
+        metrics_count( kCounter_rejected_rain );
         frameOk = false;
     }
 
@@ -869,6 +1152,8 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
             log_error( " rain first measurement: %0.2f inches, ave: %0.2f inches\n", rain_in_inches, ave->rain );
 
         s_rain_measurement_done = true;
+        s_rain_time             = timeGetTimeSec();
+        s_rain_raw_count        = rain_count;
         
         // temporary to see what's going on with the weird rain measurements lately... !!@
 //            if( ave->rain )
@@ -887,19 +1172,33 @@ void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
 }
 
 
+void updateStats( Frame* data, Frame* min, Frame* max, Frame* ave )
+{
+    updateStationStats( &s_validation, data, min, max, ave );
+}
+
+
 void process_wx_frame( Frame* frame, Frame* minFrame, Frame* maxFrame, Frame* aveFrame, Frame* outgoingFrame, uint8_t* receivedFlags )
 {
     uint8_t crc = frame->CRC; // we need this before setting to zero to run CRC over frame to check it (original CRC is run with this set to zero, must match)
     frame->CRC = 0;
     frame->CRC = calculate_crc( (uint8_t*)frame, sizeof( Frame ) );
+    metrics_count( kCounter_frames_received );
+    trace_stamp( &s_frame_trace, kStage_crc );
     if( crc != frame->CRC )
     {
-        log_error( " bad CRC on incoming wx sensor data 0x%x != 0x%x\n", crc, frame->CRC );
+        metrics_count( kCounter_frames_bad_crc );
+        log_error_throttled( " bad CRC on incoming wx sensor data 0x%x != 0x%x\n", crc, frame->CRC );
         frame->flags = 0; // knock out all data as invalid
     }
 
+    // everybody else's sensors get their own pipelines in stations.c, only ours carries on from here
+    if( crc == frame->CRC && stations_route( frame, timeGetTimeSec() ) != kRoute_primary )
+        return;
+
     // doing this first allows us to turn off flags for bad measurements so this code skips them too-
     updateStats( frame, minFrame, maxFrame, aveFrame );
+    trace_stamp( &s_frame_trace, kStage_stats );
     
     // reset the wind gusts each time through here so that it doesn't stick to extra frames before we get another gust message
     outgoingFrame->windGustMs = 0;
@@ -967,82 +1266,193 @@ void process_wx_frame( Frame* frame, Frame* minFrame, Frame* maxFrame, Frame* av
     if( frame->flags & kDataFlag_rain )
     {
         trace( ", rain: %g inches", frame->rain );
-        outgoingFrame->rain = frame->rain;
+        outgoingFrame->rain   = frame->rain;
+        outgoingFrame->flags |= kDataFlag_rain;     // it's a real gauge count, wxlog_seed_rain() only believes the ones with this
     }
 
     trace( "\n" );
     printFullWeather( outgoingFrame, minFrame, maxFrame, aveFrame );
+    broadcast_wx_frame( frame, aveFrame );
 
-    // ok keep track of all the weather data we received, lets only send a packet once we have all the weather data
-    // and at least 5 minutes has passed...
+    // ok keep track of all the weather data we received, lets only record the data once we have all the weather data.
+    // the scheduler takes care of sending things out from here...
     *receivedFlags |= frame->flags;
     
+    // this is where we record the data to disk FILO up to our longest window
+    if( have_all_wx_data() && wxlog_frame( outgoingFrame ) )
+    {
+        // the next wx packet will be built from this one
+        trace_stamp( &s_frame_trace, kStage_insert );
+        s_last_trace = s_frame_trace;
+    }
+}
+
+
+bool have_all_wx_data( void )
+{
     uint8_t dataMask = kDataFlag_allMask;
     if( s_test_mode )
         dataMask = 0x1F; // this is just the data from the radio with no additional sensor data
-        
-    if( (*receivedFlags & dataMask) == dataMask )
-    {
-        // set the startup time to right now so that when we startup we don't send all the messages at the same time - do this only once, first time we get full weather message
-        if( !s_startupTime )
-            s_startupTime = timeGetTimeSec();
 
-        // this is where we record the data to disk FILO up to our longest window
-        wxlog_frame( outgoingFrame );
-        
-        time_t current = timeGetTimeSec();
-        
-        if( (current > s_lastStatusTime + s_statusInterval) && (current - s_startupTime > kStatusDelaySecs) )
-        {
-            // just double check that we aren't sending something at exactly at the same time due to drift
-            if( s_lastSentTime == current )
-            {
-                log_error( " snoozing to prevent sending status exactly at same time as previous send\n" );
-                sleep( 1 );
-            }
+    return (s_receivedFlags & dataMask) == dataMask;
+}
 
-            if( wxlog_get_wx_averages( outgoingFrame ) )
-                transmit_status( outgoingFrame );
-            else
-                transmit_status( aveFrame );
 
-            s_lastStatusTime = timeGetTimeSec();
-        }
 
-        if( (current > s_lastTelemetryTime + s_sendInterval) && (current - s_startupTime > kTelemDelaySecs ) )
+#pragma mark -
+
+// https://www.daculaweather.com/stuff/CWOP_Guide.pdf has all the intervals, etc...  the phase offsets keep things from going out together
+void schedule_jobs( void )
+{
+    scheduler_init( timeGetTimeSec() );
+    scheduler_add_job( "telemetry",      s_sendInterval,         kTelemDelaySecs,   0,  telemetry_job,      NULL );
+    scheduler_add_job( "status",         s_statusInterval,       kStatusDelaySecs,  0,  status_job,         NULL );
+    scheduler_add_job( "wx",             s_sendInterval,         kWxDelaySecs,      0,  wx_job,             NULL );
+    scheduler_add_job( "params",         s_paramsInterval,       s_paramsInterval,  0,  params_job,         NULL );
+    scheduler_add_job( "wx wide",        kWxWideInterval,        kWxWideInterval,   30, wx_wide_job,        NULL );
+    scheduler_add_job( "telemetry wide", kTelemetryWideInterval, kTelemetryWideInterval + 60, 30, telemetry_wide_job, NULL );
+    scheduler_add_job( "log roll",       kLogRollInterval,       kLogRollInterval,  0,  log_roll_job,       NULL );
+    scheduler_add_job( "log summary",    60,                     30,                0,  log_summary_job,    NULL );
+
+    // positionless wx reports need a position every once in a while to show up on the map
+    if( s_is_format == kWxFormat_positionless || s_rf_format == kWxFormat_positionless )
+        scheduler_add_job( "position", kPositionInterval, kWxDelaySecs + 10, 0, position_job, NULL );
+
+    // the other stations we send for go out after ours
+    if( s_stationsSharded )
+        scheduler_add_job( "stations", s_sendInterval, kWxDelaySecs + 20, 0, stations_job, NULL );
+
+    // warm restart, carry on with the schedule we had instead of sending everything again
+    if( s_have_state && state_is_warm() )
+    {
+        for( int i = 0; i < scheduler_job_count(); i++ )
         {
-            // just double check that we aren't sending something at exactly at the same time due to drift
-            if( s_lastSentTime == current )
-            {
-                log_error( " snoozing to prevent sending telemetry exactly at same time as previous send\n" );
-                sleep( 1 );
-            }
-            
-            if( wxlog_get_wx_averages( outgoingFrame ) )
-                transmit_air_data( outgoingFrame );
-            else
-                transmit_air_data( aveFrame );
-            
-            s_lastTelemetryTime = timeGetTimeSec();
+            wx_job_stats stats;
+            if( scheduler_job_stats( i, &stats ) )
+                scheduler_resume_job( i, (time_t)state_job_last_run( stats.name ) );
         }
+    }
+}
 
-        if( (current > s_lastWxTime + s_sendInterval) && (current - s_startupTime > kWxDelaySecs) )
-        {
-            // just double check that we aren't sending something at exactly at the same time due to drift
-            if( s_lastSentTime == current )
-            {
-                log_error( " snoozing to prevent sending wx exactly at same time as previous send\n" );
-                sleep( 1 );
-            }
 
-            if( wxlog_get_wx_averages( outgoingFrame ) )
-                transmit_wx_frame( outgoingFrame );
-            else
-                transmit_wx_data( minFrame, maxFrame, aveFrame );
-            
-            s_lastWxTime = timeGetTimeSec();
-        }
+bool status_job( void* context )
+{
+    if( !have_all_wx_data() )
+        return false;
+
+    if( wxlog_get_wx_averages( &s_wxFrame ) )
+        transmit_status( &s_wxFrame );
+    else
+        transmit_status( &s_aveFrame );
+    return true;
+}
+
+
+bool telemetry_job( void* context )
+{
+    if( !have_all_wx_data() )
+        return false;
+
+    if( wxlog_get_wx_averages( &s_wxFrame ) )
+        transmit_air_data( &s_wxFrame );
+    else
+        transmit_air_data( &s_aveFrame );
+    return true;
+}
+
+
+bool wx_job( void* context )
+{
+    if( !have_all_wx_data() )
+        return false;
+
+    s_wx_trace = s_last_trace;
+    if( wxlog_get_wx_averages( &s_wxFrame ) )
+    {
+        trace_stamp( &s_wx_trace, kStage_aggregate );
+        transmit_wx_frame( &s_wxFrame );
+    }
+    else
+        transmit_wx_data( &s_minFrame, &s_maxFrame, &s_aveFrame );
+    s_wx_trace.id = 0;
+    return true;
+}
+
+
+bool params_job( void* context )
+{
+    transmit_telemetry_params( true );
+    return true;
+}
+
+
+bool wx_wide_job( void* context )
+{
+    s_wxWidePending = true;
+    return true;
+}
+
+
+bool telemetry_wide_job( void* context )
+{
+    s_telemetryWidePending = true;
+    return true;
+}
+
+
+bool position_job( void* context )
+{
+    transmit_position();
+    return true;
+}
+
+
+bool stations_job( void* context )
+{
+    static station_info info[kStationsMax];
+    int    count = stations_list( info, kStationsMax );
+    time_t since = timeGetTimeSec() - s_sendInterval;
+    for( int i = 0; i < count; i++ )
+    {
+        Frame average;
+        if( info[i].primary || !*info[i].callsign || !stations_get_averages( info[i].id, since, &average ) )
+            continue;
+        transmit_station_wx( info[i].callsign, &average );
+    }
+    return true;
+}
+
+
+bool log_roll_job( void* context )
+{
+    log_roll();
+    scheduler_log_stats();
+    send_queue_log_stats();
+    metrics_log_stats();
+    http_server_log_stats();
+    capture_log_stats();
+    stations_log_stats();
+    receivers_log_stats();
+    ingest_log_stats();
+    rain_accum_log_stats();
+    log_print_stats();
+
+    if( s_archivePath )
+    {
+        archive_stats stats;
+        wx_archive_get_stats( &stats );
+        log_error( "archive: samples: %llu, blocks: %u, bytes: %llu (%0.2f per sample, %0.3f per field), flushes: %u\n", (unsigned long long)stats.samples, stats.blocks, (unsigned long long)stats.data_bytes,
+                   stats.samples ? (double)stats.data_bytes / stats.samples : 0.0, stats.samples ? (double)stats.data_bytes / stats.samples / kArchiveFields : 0.0, stats.flushes );
     }
+    return true;
+}
+
+
+// repeated errors get collapsed into summaries, this makes sure they go out even after the errors stop
+bool log_summary_job( void* context )
+{
+    log_throttle_flush();
+    return true;
 }
 
 
@@ -1094,8 +1504,28 @@ void help( int argc, const char* argv[] )
             -k, --kiss                 Set the server we want to use, defaults to localhost.\n\
             -p, --port                 Set the port we want to use, defaults to 8001.\n\
             -s, --seq                  Set the starting sequence number.\n\
-            -e, --device               Set the serial device to use for the wx radio (defaults to /dev/serial0).\n\
-            -r, --rain                 Set the serial device to use for the rain sensor radio (defaults to /dev/ttyUSB0).\n\
+            -e, --device               Set the input for the wx radio (defaults to /dev/serial0), repeat for up to 4 receivers.  Frames more than one of them heard are only used once.\n\
+            -r, --rain                 Set the input for the rain sensor radio (defaults to /dev/ttyACM0).\n\
+                                       Inputs are a serial device or serial:device[@baud], fifo:path, tcp:host:port, listen:[address:]port,\n\
+                                       unix:path, stdin, or capture:file[:speed] to play a capture back live (1x by default, 0 is flat out).\n\
+            -I, --is-format            Set the wx packet format for APRS-IS: uncompressed, compressed or positionless (defaults to uncompressed).\n\
+            -F, --rf-format            Set the wx packet format for the radio: uncompressed, compressed or positionless (defaults to compressed).\n\
+            -T, --telemetry            Set the air quality telemetry format: classic (T# packets) or base91 (in the wx comment), defaults to classic.\n\
+            -S, --is-rate              Set the APRS-IS send rate as packets per second[/burst], defaults to 1/4.\n\
+            -K, --kiss-rate            Set the radio send rate as packets per second[/burst], defaults to 0.2/2.\n\
+            -L, --log-budget           Set how many repeats of a sensor error get logged per window as count[/seconds], defaults to 5/600.\n\
+            -A, --archive              Set the compressed long term wx archive file to append to.\n\
+            -P, --state                Set the state file used for warm restarts (defaults to the sequence file + .state).\n\
+            -C, --control              Set the UNIX domain socket to listen on for commands like dump and export.\n\
+            -W, --http                 Serve current conditions over HTTP on [address:]port (/wx.json, /wx.csv, /wx.html, /history, /events, /metrics) instead of writing wx.html.\n\
+            -c, --capture              Record the raw bytes from both receivers to file[:megabytes], rotating to file.1, file.2... at that size (defaults to 16).\n\
+            -R, --replay               Replay a capture file[:speed] through the relay under virtual time instead of reading the receivers (defaults to 1000x, 0 is flat out).\n\
+                                       It doesn't touch the live relay's receivers or files, so -e, -G, -r, -f, -P, -w, -A and -W can't be used with it and wx.html isn't written.\n\
+            -O, --replay-out           Write the packets a replay would have sent to this file instead of stdout, one line each: time, destination, packet.\n\
+            -N, --station              Take frames from this station_id[:CALL-SSID], repeat for more.  The first one is ours, the others are sent to APRS-IS as their CALL-SSID.\n\
+            -D, --discover             Track every other station we hear (see the stations command) instead of dropping them.\n\
+            -J, --station-workers      Set how many threads the other stations are spread across (defaults to one per core).\n\
+            -G, --ingest               Take frames from remote nodes over TCP on wx|rain:[address:]port, repeat for more.  With a wx one and no --device only the nodes are read, a rain one (only one, one node at a time) replaces --rain.\n\
          Required parameters:\n\
             -f, --file                 Set the sequence file to use.\n\
         " );
@@ -1122,11 +1552,28 @@ void handle_command( int argc, const char * argv[] )
         {"wxlog",                   required_argument, 0, 'w'},
         {"device",                  required_argument, 0, 'e'},
         {"rain",                    required_argument, 0, 'r'},
+        {"is-format",               required_argument, 0, 'I'},
+        {"rf-format",               required_argument, 0, 'F'},
+        {"telemetry",               required_argument, 0, 'T'},
+        {"is-rate",                 required_argument, 0, 'S'},
+        {"kiss-rate",               required_argument, 0, 'K'},
+        {"log-budget",              required_argument, 0, 'L'},
+        {"state",                   required_argument, 0, 'P'},
+        {"archive",                 required_argument, 0, 'A'},
+        {"control",                 required_argument, 0, 'C'},
+        {"http",                    required_argument, 0, 'W'},
+        {"capture",                 required_argument, 0, 'c'},
+        {"replay",                  required_argument, 0, 'R'},
+        {"replay-out",              required_argument, 0, 'O'},
+        {"station",                 required_argument, 0, 'N'},
+        {"discover",                no_argument,       0, 'D'},
+        {"station-workers",         required_argument, 0, 'J'},
+        {"ingest",                  required_argument, 0, 'G'},
 
         {0, 0, 0, 0}
         };
 
-    while( (c = getopt_long( argc, (char* const*)argv, "Hvdxt:b:l:k:p:s:f:w:e:", long_options, &option_index)) != -1 )
+    while( (c = getopt_long( argc, (char* const*)argv, "Hvdxt:b:l:k:p:s:f:w:e:r:I:F:T:S:K:L:P:A:C:W:c:R:O:N:DJ:G:", long_options, &option_index)) != -1 )
     {
         switch( c )
         {
@@ -1171,19 +1618,104 @@ void handle_command( int argc, const char * argv[] )
             case 'f':
                 s_seqFilePath = optarg;
                 break;
+
+            case 'P':
+                s_statePath = optarg;
+                break;
+
+            case 'A':
+                s_archivePath = optarg;
+                break;
+
+            case 'C':
+                s_controlPath = optarg;
+                break;
+
+            case 'W':
+                if( !http_server_parse_address( optarg, s_httpHost, sizeof( s_httpHost ), &s_httpPort ) )
+                    printf( "bad http address: %s, expected [address:]port, writing %s instead\n", optarg, kWwwFilePath );
+                break;
+
+            case 'c':
+                if( !capture_parse_option( optarg, s_capturePath, sizeof( s_capturePath ), &s_captureBytes ) )
+                    printf( "bad capture file: %s, expected file[:megabytes], not capturing\n", optarg );
+                break;
+
+            case 'R':
+                if( !replay_parse_option( optarg, s_replayPath, sizeof( s_replayPath ), &s_replaySpeed ) )
+                {
+                    printf( "bad replay: %s, expected file[:speed]\n", optarg );
+                    exit( EXIT_FAILURE );   // not going to quietly go live instead
+                }
+                break;
+
+            case 'O':
+                s_replayOutPath = optarg;
+                break;
+
+            case 'N':
+                if( !stations_parse_option( optarg ) )
+                    exit( EXIT_FAILURE );   // it said why, skipping it could make a neighbor's station ours
+                break;
+
+            case 'D':
+                stations_set_discovery( true );
+                break;
+
+            case 'G':
+                if( !ingest_parse_option( optarg ) )
+                    exit( EXIT_FAILURE );   // it said why
+                break;
+
+            case 'J':
+                s_stationWorkers = atoi( optarg );
+                break;
                 
             case 'w':
                 s_wxlogFilePath = optarg;
                 break;
 
             case 'e':
-                s_port_device = optarg;
+                if( !receivers_add( optarg ) )
+                    exit( EXIT_FAILURE );   // it said why, not going to quietly read /dev/serial0 instead
                 break;
 
             case 'r':
                 s_rain_device = optarg;
                 break;
 
+            case 'I':
+                if( !aprs_format_from_name( optarg, &s_is_format ) )
+                    printf( "unknown wx format: %s, using %s for APRS-IS\n", optarg, aprs_format_name( s_is_format ) );
+                break;
+
+            case 'F':
+                if( !aprs_format_from_name( optarg, &s_rf_format ) )
+                    printf( "unknown wx format: %s, using %s for the radio\n", optarg, aprs_format_name( s_rf_format ) );
+                break;
+
+            case 'T':
+                if( !strcmp( optarg, "base91" ) || !strcmp( optarg, "classic" ) )
+                    s_base91_telemetry = !strcmp( optarg, "base91" );
+                else
+                    printf( "bad telemetry format: %s, using %s\n", optarg, s_base91_telemetry ? "base91" : "classic" );
+                break;
+
+            case 'S':
+                if( !send_queue_parse_rate( optarg, &s_is_rate, &s_is_burst ) )
+                    printf( "bad rate: %s, using %0.2f/%0.0f for APRS-IS\n", optarg, s_is_rate, s_is_burst );
+                break;
+
+            case 'K':
+                if( !send_queue_parse_rate( optarg, &s_rf_rate, &s_rf_burst ) )
+                    printf( "bad rate: %s, using %0.2f/%0.0f for the radio\n", optarg, s_rf_rate, s_rf_burst );
+                break;
+
+            case 'L':
+                if( !log_parse_throttle( optarg, &s_log_budget, &s_log_window ) )
+                    printf( "bad log budget: %s, using %u/%u\n", optarg, s_log_budget, s_log_window );
+                break;
+
             case 'x':
                 s_test_mode = true;
                 s_sendInterval     = kSendInterval_debug;
@@ -1207,106 +1739,106 @@ void handle_command( int argc, const char * argv[] )
 
 #pragma mark -
          
-void log_error( const char* format, ... )
+bool debug_mode( void )
 {
-    char buf[2048] = {0};
-    va_list vaList;
-    va_start( vaList, format );
-    vsprintf( buf, format, vaList );
-    va_end( vaList );
-    
-    time_t t = time(NULL);
-    struct tm tm = *localtime(&t);
-    
-    if( s_logFile )
-    {
-        fprintf( s_logFile, "%d-%02d-%02d %02d:%02d:%02d: %s", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, buf );
-        fflush( s_logFile );
-    }
-    
-    // print to debug as well...
-    if( s_debug )
-        printf( "%d-%02d-%02d %02d:%02d:%02d: %s", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, buf );
-    
-    if( s_logFile && (timeGetTimeSec() > (s_last_log_roll + kLogRollInterval)) )
-    {
-        fclose( s_logFile );
-        
-        char* buffer = malloc( strlen( s_logFilePath ) + 10 );   // 8 date/time characters, a '.', and null byte
-        if( buffer )
-        {
-            time_t t = time( NULL );
-            struct tm tm = *localtime( &t );
-            sprintf( buffer, "%s.%d%02d%02d", s_logFilePath, tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday );
-            
-            // rename it
-            if( rename( s_logFilePath, buffer ) != 0 )
-                perror( "rename" );
-            
-            // now reopen new file and carry on
-            s_logFile = fopen( s_logFilePath, "a" );
-            free( buffer );
-        }
-        s_last_log_roll = timeGetTimeSec();
-    }
-}
-
-
-void log_unix_error( const char* prefix )
-{
-    char buffer[512] = {0};
-    strerror_r( errno, buffer, sizeof( buffer ) );
-    
-    char finalBuffer[1024] = {0};
-    strcat( finalBuffer, prefix );
-    strcat( finalBuffer, buffer );
-    strcat( finalBuffer, "\n" );
-    log_error( finalBuffer );
-}
-
-
-bool debug_mode( void )
-{
-    return s_debug;
+    return s_debug;
 }
 
 #pragma mark -
 
+#ifdef WXRELAY_NO_MAIN
+#define main wxrelay_main       // bench.c brings its own main() and links the rest of the relay as is
+#endif
+
 int main( int argc, const char * argv[] )
 {
-    int err = ignoreSIGPIPE();
-    if( err == 0 )
-    {
-        signal( SIGINT,  signalHandler );
-        signal( SIGTERM, signalHandler );
-        signal( SIGHUP,  signalHandler );
-    }
+    // SIGINT, SIGTERM and SIGHUP get picked up by the control thread, this has to happen before any other threads start
+    ignoreSIGPIPE();
+    control_block_signals();
 
     // do some command processing...
     if( argc >= 2 )
         handle_command( argc, argv );
+    if( !receivers_count() && !*s_replayPath )
+        receivers_add( PORT_DEVICE );
+    if( s_rain_device && ingest_has_rain() )
+    {
+        printf( "can't use -r with a rain: --ingest, the rain totals can only come from one gauge\n" );
+        return EXIT_FAILURE;
+    }
+    rain_accum_init( s_rainLastHrPeriod, s_rain24HrPeriod );
+
+    // the clock has to be on the capture's time before anything asks it, a fixed seed keeps the schedule jitter the same every run
+    if( *s_replayPath )
+    {
+        // no sequence number, state page, wxlog or archive carried over from (or written back to) the live relay either, that's
+        // what makes the same capture come out the same way every time
+        if( s_seqFilePath || s_statePath || s_wxlogFilePath || s_archivePath || s_httpPort || receivers_count() || ingest_listeners() || s_rain_device )
+        {
+            printf( "can't replay with -e, -G, -r, -f, -P, -w, -A or -W, those belong to the live relay\n" );
+            return EXIT_FAILURE;
+        }
+
+        time_t start = replay_start_time( s_replayPath );
+        if( !start )
+        {
+            printf( "can't replay %s, not a capture file\n", s_replayPath );
+            return EXIT_FAILURE;
+        }
+        wx_clock_set( start );
+        srand( (unsigned int)start );
+
+        s_replayOut = s_replayOutPath ? fopen( s_replayOutPath, "w" ) : stdout;
+        if( !s_replayOut )
+        {
+            printf( "can't write replayed packets to %s\n", s_replayOutPath );
+            return EXIT_FAILURE;
+        }
+        send_queue_record_to( s_replayOut );
+
+        // a stand-in for each receiver the capture heard from, replay_chunk() pushes their frames through the merge like the readers did
+        static char names[kMaxReceivers][16];
+        int         channels = replay_channels( s_replayPath, kCapture_wx );
+        for( int i = 0; i < channels && i < kMaxReceivers; i++ )
+        {
+            snprintf( names[i], sizeof( names[i] ), "replay:%d", i );
+            receivers_add_remote( names[i] );
+        }
+    }
     
     if( s_debug )
         printf( "%s, version %s -- pressure offset: %0.2f InHg, interior temp offset: %0.2f °C, kiss: %s:%d\n", PROGRAM_NAME, VERSION, s_localOffsetInHg, s_localTempErrorC, s_kiss_server, s_kiss_port );
     
-    s_last_log_roll = timeGetTimeSec();
-    if( s_logFilePath && !s_logFile )
+    // the log writer runs on its own thread from here on out
+    log_set_throttle( s_log_budget, s_log_window );
+    log_init( s_logFilePath, s_debug );
+    if( s_logFilePath )
     {
-        s_logFile = fopen( s_logFilePath, "a" );
-        if( !s_logFile )
-            log_error( "  failed to open log file: %s\n", s_logFilePath );
         if( s_debug )
             printf( "logging errors to: %s\n", s_logFilePath );
+        log_error( "%s, version %s -- pressure offset: %0.2f InHg, interior temp offset: %0.2f °C, kiss: %s:%d\n", PROGRAM_NAME, VERSION, s_localOffsetInHg, s_localTempErrorC, s_kiss_server, s_kiss_port );
+    }
 
-        time_t t = time(NULL);
-        struct tm tm = *localtime(&t);
-        
-        if( s_logFile )
-            fprintf( s_logFile, "%d-%02d-%02d %02d:%02d:%02d: %s, version %s -- pressure offset: %0.2f InHg, interior temp offset: %0.2f °C, kiss: %s:%d\n", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, PROGRAM_NAME, VERSION, s_localOffsetInHg, s_localTempErrorC, s_kiss_server, s_kiss_port );
+    // has to be going before the serial readers start
+    if( *s_capturePath && !capture_start( s_capturePath, s_captureBytes ) )
+        log_error( "  failed to start capture: %s\n", s_capturePath );
+
+    // the state page lives next to the sequence file unless we're told otherwise
+    bool sequenceOverride = s_sequence_num != 0;
+    if( !s_statePath && s_seqFilePath )
+    {
+        static char statePath[PATH_MAX];
+        snprintf( statePath, sizeof( statePath ), "%s.state", s_seqFilePath );
+        s_statePath = statePath;
     }
+    s_have_state = state_open( s_statePath );
+
+    // has to happen before the receivers start, otherwise whichever station we hear first gets to be ours again
+    if( s_have_state && state_is_warm() && state_get()->primary_valid )
+        stations_restore_primary( state_get()->primary_station );
 
-    // look for sequence file if we have a path and do not have a sequence number override
-    if( !s_sequence_num && s_seqFilePath && !s_seqFile )
+    // look for sequence file if we have a path and do not have a sequence number override (only until we have a state page)
+    if( !s_sequence_num && s_seqFilePath && !s_seqFile && !(s_have_state && state_is_warm()) )
     {
         s_seqFile = fopen( s_seqFilePath, "rb" );
         if( !s_seqFile )
@@ -1319,66 +1851,195 @@ int main( int argc, const char * argv[] )
     }
     
     wxlog_startup();
+    wxlog_seed_rain();
+    if( s_archivePath && !wx_archive_open( s_archivePath ) )
+    {
+        log_error( "  failed to open wx archive: %s (%d)\n", s_archivePath, errno );
+        s_archivePath = NULL;
+    }
+    aprs_format_init( kCallSign, kDestination, kIGPath, kLatitude, kLongitude );
+
+    control_add_command( "dump",   "print the wx history",                           dump_command,   NULL );
+    control_add_command( "export", "write the wx history to a file (default " kDumpFilePath ")", export_command, NULL );
+    control_add_command( "metrics", "print the counters and latency histograms",   metrics_command, NULL );
+    control_add_command( "trace",   "show the slowest N recent packets, stage by stage (default 10)", trace_command, NULL );
+    control_add_command( "stations", "list the stations we hear and what each one is doing", stations_command, NULL );
+    control_add_command( "receivers", "frames, duplicates and errors for each receiver", receivers_command, NULL );
+    control_add_command( "ingest",    "remote node connections and what they've sent", ingest_command, NULL );
+    control_add_command( "rain",      "rainfall totals, rain rate and what the gauge has been reporting", rain_accum_command, NULL );
+    control_signal_command( SIGHUP, "export" );
+    control_start( s_controlPath );
+
+    history_init( wxlog_history, wxlog_oldest, s_archivePath );
+    http_server_add_handler( "/history", history_handler, NULL );
+    http_server_add_stream( "/events" );
+    http_server_add_handler( "/metrics", metrics_handler, NULL );
+    send_queue_add_metrics();
+    capture_add_metrics();
+    stations_add_metrics();
+    receivers_add_metrics();
+    ingest_add_metrics();
+    metrics_add_value( "wxrelay_wxlog_records", "gauge", "Frames in the in-memory log", wxlog_records_value, NULL );
+    if( s_httpPort && !http_server_start( s_httpHost, s_httpPort ) )
+        s_httpPort = 0;     // fall back to writing the file for Apache
+
+    if( s_debug )
+        printf( "wx format for APRS-IS: %s, radio: %s\n", aprs_format_name( s_is_format ), aprs_format_name( s_rf_format ) );
 
     if( s_test_mode )
         printf( "WARNING using debug periods, packets will get sent very often!\n" );
     
-    int fd = open_serial_port( s_port_device, B9600 );
-    
-    // start up our rain sensor relay...
-#ifdef USE_RAIN_SOCKET
-    wx_create_thread_detached( rain_socket_thread, NULL );
-#else
-    wx_create_thread_detached( rain_sensor_thread, (void*)s_rain_device );
-#endif
+    // the other stations' workers have to be going before the first frame shows up
+    s_stationsSharded = stations_start( s_stationWorkers ? s_stationWorkers : stations_default_workers() );
+
+    // a replay's receivers don't have readers, it brings its own data
+    receivers_start();
+    if( !*s_replayPath )
+    {
+        ingest_start();
+
+        // start up our rain sensor relay, listen:5555 is what the old rain socket did.  a rain: ingest is the gauge instead
+        if( !ingest_has_rain() )
+            wx_create_thread_detached( rain_sensor_thread, (void*)(s_rain_device ? s_rain_device : RAIN_DEVICE) );
+    }
 
-    // this holds all the min/max/averages
-    Frame minFrame;
-    Frame maxFrame;
-    Frame aveFrame;
-    Frame wxFrame;      // primary weather frame that is used to create APRS message
-    
-    memset( &minFrame, 0, sizeof( Frame ) );
-    memset( &maxFrame, 0, sizeof( Frame ) );
-    memset( &aveFrame, 0, sizeof( Frame ) );
-    memset( &wxFrame,  0, sizeof( Frame ) );
-
-    uint8_t receivedFlags = 0;
-    ssize_t result = 0;
-    while( 1 )
-    {
-        Frame frame;
-       
-        result = read( fd, &frame, sizeof( frame ) );
-        if( result == sizeof( frame ) )
+    memset( &s_minFrame, 0, sizeof( Frame ) );
+    memset( &s_maxFrame, 0, sizeof( Frame ) );
+    memset( &s_aveFrame, 0, sizeof( Frame ) );
+    memset( &s_wxFrame,  0, sizeof( Frame ) );
+
+    if( s_have_state )
+        restore_state( sequenceOverride );
+
+    send_queue_start( kDest_aprs_is, "APRS-IS", s_is_rate, s_is_burst, send_to_aprs_is );
+    send_queue_start( kDest_radio,   "radio",   s_rf_rate, s_rf_burst, send_to_radio );
+    schedule_jobs();
+
+    if( *s_replayPath )
+        replay_capture();
+
+    // the readers put frames back together and the merge tosses the copies, all that's left here is to wait on the next one
+    time_t lastTick = 0;
+    while( !*s_replayPath && !control_quit_requested() )
+    {
+        Frame    frame;
+        uint64_t readMicros = 0;
+        if( receivers_next( &frame, &readMicros, 1000 ) )
         {
-            process_wx_frame( &frame, &minFrame, &maxFrame, &aveFrame, &wxFrame, &receivedFlags );
+            trace_begin( &s_frame_trace );
+            trace_stamp_at( &s_frame_trace, kStage_read, readMicros );
+            process_wx_frame( &frame, &s_minFrame, &s_maxFrame, &s_aveFrame, &s_wxFrame, &s_receivedFlags );
         }
-        else if( result )
+
+        time_t now = timeGetTimeSec();
+        if( now != lastTick )
         {
-#ifdef DEBUG
-            log_error( " partial incoming wx sensor data %d (%d)\n", result, sizeof( frame )  );
-#endif
-            // we most likely have received a partially transmitted frame, try to do another read now to get the remainder of it
-            sleep( 1 );
-            uint8_t* partialFrame = (uint8_t*)&frame;
-            uint8_t  lastRead = result;
-            result = read( fd, &partialFrame[lastRead], sizeof( frame ) - lastRead );
-            if( result + lastRead == sizeof( frame ) )
-                process_wx_frame( &frame, &minFrame, &maxFrame, &aveFrame, &wxFrame, &receivedFlags );
-            else
-                log_error( " bad frame size on incoming wx sensor data %d != %d\n", result, sizeof( frame )  );
+            lastTick = now;
+            scheduler_run( now );
+            save_state();
         }
-        
-        sleep( 1 );
     }
-    
-    // loop never finishes so this code never executes...
+
+    shutdown_relay();
     return EXIT_SUCCESS;
 }
 
 
 
+#pragma mark -
+
+// the readers' framing, so a read that holds several frames (a socket, a FIFO) or a piece of one (a serial port) comes out the
+// same as it did live.  Each receiver gets its own, and the capture's own clock says how long the rest of a frame took.
+static input_framer s_replayFramers[kCapture_count][kMaxReceivers];
+
+
+void replay_chunk( const capture_record* record, const uint8_t* data, void* context )
+{
+    if( record->source >= kCapture_count || record->channel >= kMaxReceivers )
+        return;
+
+    capture_source source = (capture_source)record->source;
+    input_framer*  framer = &s_replayFramers[source][record->channel];
+    uint64_t       micros = record->monotonic_ns / 1000;
+    if( !framer->size )
+    {
+        if( source == kCapture_wx )
+            input_framer_init( framer, sizeof( Frame ), receivers_frame_ok );
+        else
+            input_framer_init( framer, sizeof( RainFrame ), NULL );
+    }
+
+    size_t stale = input_framer_expire( framer, micros, kInputPartialUs );
+    if( stale )
+    {
+        if( source == kCapture_wx )
+            metrics_count( kCounter_frames_short );
+        log_error_throttled( " bad frame size on replayed %s data %zu != %zu\n", capture_source_name( source ), stale, framer->size );
+    }
+
+    bool partial = false;
+    for( size_t used = 0; used < record->length; )
+    {
+        bool complete = false;
+        used += input_framer_add( framer, &data[used], record->length - used, micros, &complete );
+        partial = !complete;
+        if( !complete )
+            break;
+
+        if( source == kCapture_wx )
+        {
+            Frame wx;
+            memcpy( &wx, framer->bytes, sizeof( Frame ) );
+            receivers_push( record->channel, &wx, framer->first_us );
+        }
+        else
+        {
+            RainFrame rain;
+            memcpy( &rain, framer->bytes, sizeof( RainFrame ) );
+            process_rain_frame( &rain );
+        }
+    }
+    if( partial )
+        metrics_count( source == kCapture_wx ? kCounter_partial_reads_wx : kCounter_partial_reads_rain );
+
+    // the merge throws out what another receiver already delivered, same as the main loop
+    Frame frame;
+    while( receivers_next( &frame, NULL, 0 ) )
+    {
+        trace_begin( &s_frame_trace );
+        process_wx_frame( &frame, &s_minFrame, &s_maxFrame, &s_aveFrame, &s_wxFrame, &s_receivedFlags );
+    }
+}
+
+
+// what the read loop does every time around
+bool replay_tick( time_t now, void* context )
+{
+    scheduler_run( now );
+    save_state();
+    return !control_quit_requested();
+}
+
+
+void replay_capture( void )
+{
+    replay_stats stats;
+    bool         ok = replay_run( s_replayPath, s_replaySpeed, replay_chunk, replay_tick, NULL, &stats );
+
+    send_queue_record_to( NULL );
+    if( s_replayOut && s_replayOut != stdout )
+        fclose( s_replayOut );
+    else if( s_replayOut )
+        fflush( s_replayOut );
+    s_replayOut = NULL;
+
+    double span = difftime( stats.last, stats.first );
+    fprintf( stderr, "replayed %s: %llu reads, %llu bytes, %0.1f hours in %0.2f secs (%0.0fx)%s\n", s_replayPath, (unsigned long long)stats.records,
+             (unsigned long long)stats.bytes, span / 3600, stats.real_secs, stats.real_secs > 0 ? span / stats.real_secs : 0.0, ok ? "" : ", capture is truncated or corrupt" );
+}
+
+
+
 int open_serial_port( const char* serial_port_device, int port_speed )
 {
     if( !serial_port_device )
@@ -1430,114 +2091,74 @@ int open_serial_port( const char* serial_port_device, int port_speed )
 #pragma mark -
 
 
-wx_thread_return_t sendPacket_thread_entry( void* args )
+// these run on the send queue threads, the queue takes care of pacing things out
+void send_to_aprs_is( const char* packetToSend, bool wide )
 {
-    int         err          = 0;
-    bool        success      = false;
-    const char* packetToSend = (const char*)args;
-    if( !packetToSend )
-        wx_thread_return();
+    int  err     = 0;
+    bool success = false;
 
     if( s_test_mode )
     {
         log_error( "packet that would be sent: %s\n", packetToSend );
-//        queue_packet( packetToSend );
-//        success = true;
+        return;
     }
-    else
+
+    for( int i = 0; i < s_num_retries; i++ )
     {
-        for( int i = 0; i < s_num_retries; i++ )
-        {
-            // send packet to APRS-IS directly...  oh btw, if you use this code, please get your own callsign and passcode!  PLEASE
-            err = sendPacket( "noam.aprs2.net", 10152, kCallSign, kPasscode, packetToSend );
-            if( err == 0 )
-            {
-                log_error( "sent:   %s\n", packetToSend );
-                success = true;
-                break;
-            }
-            
-            // check for authentication error case and don't retry in that case, just queue the packet for the next server that accepts us
-            if( err == -2 )
-                break;
+        // send packet to APRS-IS directly...  oh btw, if you use this code, please get your own callsign and passcode!  PLEASE
+        long     connectMicros = -1;
+        uint64_t start         = metrics_now_us();
+        err = sendPacket( "noam.aprs2.net", 10152, kCallSign, kPasscode, packetToSend, &connectMicros );
+        metrics_observe( kHistogram_aprs_is_submit, metrics_now_us() - start );
+        if( connectMicros >= 0 )
+            metrics_observe( kHistogram_aprs_is_connect, connectMicros );
 
-            log_error( "retry (%d/%d): (%d) %s\n", i + 1, s_num_retries, err, packetToSend );
+        if( err == 0 )
+        {
+            if( connectMicros >= 0 )
+                trace_stamp_at( trace_current(), kStage_connect, start + connectMicros );
+            trace_stamp( trace_current(), kStage_send );
+            log_error( "sent:   %s\n", packetToSend );
+            success = true;
+            break;
         }
         
-        if( !success )
+        // check for authentication error case and don't retry in that case, just queue the packet for the next server that accepts us
+        if( err == -2 )
         {
-            // for packets that failed to send, we queue them up for the next time we send data
-            queue_packet( packetToSend );
+            metrics_count( kCounter_aprs_is_auth_failed );
+            break;
         }
+
+        metrics_count( kCounter_aprs_is_retries );
+        log_error( "retry (%d/%d): (%d) %s\n", i + 1, s_num_retries, err, packetToSend );
     }
     
-    free( (void*)packetToSend );
-    
-    // for the initial send, the code is super aggressive but for the packet queue, it's less so
-    // we also don't want to try sending when we just got an error, so make sure we didn't just have a failure...
-    if( success && !s_queue_busy  )
+    metrics_count( success ? kCounter_aprs_is_sent : kCounter_aprs_is_failed );
+    if( !success )
     {
-        // see if there are any packets we should try sending
-        const char* queued = NULL;
-        do
-        {
-            queued = queue_get_next_packet();
-            if( queued )
-            {
-                if( s_test_mode )
-                    log_error( "queued packet that would be sent: %s\n", queued );
-                else
-                {
-                    err = sendPacket( "noam.aprs2.net", 10152, kCallSign, kPasscode, queued );
-                    if( err == 0 )
-                        log_error( "resent: %s\n", queued );
-                    else
-                    {
-                        // the idea behind this queue is it is sent to the main queue once it's empty on the next invocation
-                        queue_error_packet( queued );
-                    }
-                    sleep( 1 ); // wait a second between each packet
-                }
-                free( (void*)queued );
-            }
-        } while( queued );
+        // for packets that failed to send, we queue them up for the next time we send data
+        queue_packet( packetToSend );
+        return;
     }
-    
-    // !!@ need code to spill error queue into delayed queue !
-    // 
-    wx_thread_return();
-}
-
 
-wx_thread_return_t sendToRadio_thread_entry( void* args )
-{
-    char* packetToSend = (char*)args;
-    if( !packetToSend )
-        wx_thread_return();
-    
-    // also send a packet to Direwolf running locally to hit the radio path...
-    int err = sendToRadio( packetToSend, false );
-    if( err != 0 )
-        log_error( "failed to radio path, error: %d...\n", err );
-    
-    free( packetToSend );
-    wx_thread_return();
+    // we got through, so put anything that failed earlier back in line (only this thread touches the queue now)
+    const char* queued = NULL;
+    while( (queued = queue_get_next_packet()) )
+    {
+        log_error( "resending: %s\n", queued );
+        send_queue_packet( kDest_aprs_is, queued, false );
+        free( (void*)queued );
+    }
 }
 
 
-wx_thread_return_t sendToRadioWIDE_thread_entry( void* args )
+void send_to_radio( const char* packetToSend, bool wide )
 {
-    char* packetToSend = (char*)args;
-    if( !packetToSend )
-        wx_thread_return();
-    
     // also send a packet to Direwolf running locally to hit the radio path...
-    int err = sendToRadio( packetToSend, true );
+    int err = sendToRadio( packetToSend, wide );
     if( err != 0 )
-        log_error( "failed to WIDE radio path, error: %d...\n", err );
-    
-    free( packetToSend );
-    wx_thread_return();
+        log_error( "failed to %sradio path, error: %d...\n", wide ? "WIDE " : "", err );
 }
 
 
@@ -1568,49 +2189,91 @@ void transmit_wx_data( const Frame* minFrame, const Frame* maxFrame, const Frame
     wx.particles_100um = aveFrame->particles_100um;
     
     // transfer over running aqi average too
-    s_last_aqi = s_average_aqi;
+    s_last_aqi = s_validation.averageAqi;
 
     transmit_wx_frame( &wx );
 }
 
 
-void transmit_wx_frame( const Frame* frame )
+#ifdef VERIFY_WX_FORMAT
+static void verify_wx_format( const wx_report* report, const char* packet )
 {
-    if( !validate_wx_frame( frame ) )
-        return;
-        
-    char packetToSend[BUFSIZE];
-    char packetFormat = UNCOMPRESSED_PACKET;
+    char old[BUFSIZE];
+    APRSPacket wx;
+    packetConstructor( &wx );
 
-    if( s_debug )
+    uncompressedPosition( wx.latitude,  kLatitude,  IS_LATITUDE );
+    uncompressedPosition( wx.longitude, kLongitude, IS_LONGITUDE );
+
+    snprintf( wx.callsign,      10, kCallSign );
+    snprintf( wx.windDirection,  4, "%03d", report->windDirection );
+    snprintf( wx.windSpeed,      4, "%03d", report->windSpeed );
+    snprintf( wx.gust,           4, "%03d", report->gust );
+    snprintf( wx.temperature,    4, "%03d", report->temperature );
+    snprintf( wx.humidity,       3, "%.2d", report->humidity );
+    snprintf( wx.pressure,       6, "%.5d", report->pressure );
+
+    if( report->rainLastHour != kWxFieldUnknown )
     {
-        printf( "\n" );
-        printTime( false );
-        printf( " Sending weather info to APRS-IS...  next update @ " );
-        printTimePlus5();   // total hack and will display times such as 13:64 ?! (which is really 14:04)
-        printCurrentWeather( frame, false, NULL );
+        snprintf( wx.rainfallLastHour,      4, "%03d", report->rainLastHour );
+        snprintf( wx.rainfallLast24Hours,   4, "%03d", report->rainLast24Hours );
+        snprintf( wx.rainfallSinceMidnight, 4, "%03d", report->rainSinceMidnight );
     }
 
-    APRSPacket wx;
-    packetConstructor( &wx );
+    memset( old, 0, sizeof( old ) );
+    printAPRSPacket( &wx, old, UNCOMPRESSED_PACKET, 0, false );
+    strcat( old, PROGRAM_NAME );
+    strcat( old, VERSION );
 
-    uncompressedPosition( wx.latitude,    34.108,     IS_LATITUDE );
-    uncompressedPosition( wx.longitude, -118.3349371, IS_LONGITUDE );
+    // the old code reads the clock itself so this can false alarm right at the turn of a minute
+    if( strcmp( old, packet ) != 0 )
+        log_error( "verify_wx_format: mismatch\n  old: %s\n  new: %s\n", old, packet );
+}
+#endif
 
-    int formatTruncationCheck = snprintf( wx.callsign, 10, "K6LOT-13" );
-    assert( formatTruncationCheck >= 0 );
 
-    formatTruncationCheck = snprintf( wx.windDirection, 4, "%03d", (int)(round(frame->windDirection)) );
-    assert( formatTruncationCheck >= 0 );
+// show what the same report costs in each of the wire formats
+void print_wx_formats( const wx_report* wx, time_t now )
+{
+    char packet[BUFSIZE];
 
-    formatTruncationCheck = snprintf( wx.windSpeed, 4, "%03d", (int)(round(ms2mph(frame->windSpeedMs))) );
-    assert( formatTruncationCheck >= 0 );
+    for( int i = 0; i < kWxFormat_count; i++ )
+    {
+        size_t len = aprs_format_wx( packet, sizeof( packet ), (wx_format)i, wx, now, PROGRAM_NAME VERSION );
+        if( len )
+            printf( "%-12s: %3zu bytes, ~%d ms on air%s\n", aprs_format_name( (wx_format)i ), len, aprs_estimate_airtime_ms( packet ), (i == s_is_format || i == s_rf_format) ? " *" : "" );
+    }
 
-    formatTruncationCheck = snprintf( wx.gust, 4, "%03d", (int)(round(ms2mph(frame->windGustMs))) );
-    assert( formatTruncationCheck >= 0 );
+    size_t len = aprs_format_position( packet, sizeof( packet ), PROGRAM_NAME VERSION );
+    if( len )
+        printf( "%-12s: %3zu bytes, ~%d ms on air, every %d minutes\n\n", "position", len, aprs_estimate_airtime_ms( packet ), kPositionInterval / 60 );
+}
 
-    formatTruncationCheck = snprintf( wx.temperature, 4, "%03d", (int)(round(c2f(frame->tempC))) );
-    assert( formatTruncationCheck >= 0 );
+
+void transmit_position( void )
+{
+    char packetToSend[BUFSIZE];
+    if( !aprs_format_position( packetToSend, sizeof( packetToSend ), PROGRAM_NAME VERSION ) )
+        return;
+
+    if( s_debug )
+        printf( "%s\n\n", packetToSend );
+
+    if( s_is_format == kWxFormat_positionless )
+        send_queue_packet( kDest_aprs_is, packetToSend, false );
+
+    if( s_rf_format == kWxFormat_positionless )
+        send_queue_packet( kDest_radio, packetToSend, false );
+}
+
+
+// everything but the rain, that's only ours
+void wx_report_from_frame( const Frame* frame, wx_report* wx )
+{
+    wx->windDirection = (int)(round(frame->windDirection));
+    wx->windSpeed     = (int)(round(ms2mph(frame->windSpeedMs)));
+    wx->gust          = (int)(round(ms2mph(frame->windGustMs)));
+    wx->temperature   = (int)(round(c2f(frame->tempC)));
 
     unsigned short int h = frame->humidity;
     // APRS only supports values 1-100. Round 0% up to 1%.
@@ -1621,72 +2284,280 @@ void transmit_wx_frame( const Frame* frame )
     else if( h >= 100 )
         h = 0;
 
-    formatTruncationCheck = snprintf( wx.humidity, 3, "%.2d", h );
-    assert( formatTruncationCheck >= 0 );
+    wx->humidity = h;
 
     // we are converting back from InHg because that's the offset we know based on airport data! (this means we go from millibars -> InHg + offset -> millibars)
-    formatTruncationCheck = snprintf( wx.pressure, 6, "%.5d", (int)(round(inHg2millibars((frame->pressure * millibar2inchHg) + s_localOffsetInHg) * 10)) );
-    assert( formatTruncationCheck >= 0 );
+    wx->pressure = (int)(round(inHg2millibars((frame->pressure * millibar2inchHg) + s_localOffsetInHg) * 10));
+
+    wx->rainLastHour      = kWxFieldUnknown;
+    wx->rainLast24Hours   = kWxFieldUnknown;
+    wx->rainSinceMidnight = kWxFieldUnknown;
+}
+
 
-    // do rain here...
-    int lastHour100sInch      = 0;
-    int last24Hours100sInch   = 0;
-    int sinceMidnight100sInch = 0;
-    if( wxlog_get_rain_counts( &lastHour100sInch, &last24Hours100sInch, &sinceMidnight100sInch ) )
+void transmit_wx_frame( const Frame* frame )
+{
+    if( !validate_wx_frame( frame ) )
+        return;
+        
+    char packetToSend[BUFSIZE];
+    char radioPacket[BUFSIZE];
+
+    if( s_debug )
     {
-        if( lastHour100sInch < 0 )
-            lastHour100sInch = 0;
-        if( last24Hours100sInch < 0 )
-            last24Hours100sInch = 0;
-        if( sinceMidnight100sInch < 0 )
-            sinceMidnight100sInch = 0;
+        printf( "\n" );
+        printTime( false );
+        printf( " Sending weather info to APRS-IS...  next update @ " );
+        printTimePlus5();   // total hack and will display times such as 13:64 ?! (which is really 14:04)
+        printCurrentWeather( frame, false, NULL );
+    }
 
-        formatTruncationCheck = snprintf( wx.rainfallLastHour, 4, "%03d", lastHour100sInch );
-        assert( formatTruncationCheck >= 0 );
+    wx_report wx;
+    wx_report_from_frame( frame, &wx );
 
-        formatTruncationCheck = snprintf( wx.rainfallLast24Hours, 4, "%03d", last24Hours100sInch );
-        assert( formatTruncationCheck >= 0 );
+    // do rain here, a window we haven't been counting for all of yet goes out as zero
+    int         lastHour100sInch      = 0;
+    int         last24Hours100sInch   = 0;
+    int         sinceMidnight100sInch = 0;
+    rain_totals rain;
+    if( rain_accum_get_totals( timeGetTimeSec(), &rain ) )
+    {
+        if( rain.hourValid )
+            lastHour100sInch = (int)round( rawRainCount2inches( rain.lastHour ) * 100 );
+        if( rain.dayValid )
+            last24Hours100sInch = (int)round( rawRainCount2inches( rain.last24Hours ) * 100 );
+        if( rain.midnightValid )
+            sinceMidnight100sInch = (int)round( rawRainCount2inches( rain.sinceMidnight ) * 100 );
 
-        formatTruncationCheck = snprintf( wx.rainfallSinceMidnight, 4, "%03d", sinceMidnight100sInch );
-        assert( formatTruncationCheck >= 0 );
+        wx.rainLastHour      = lastHour100sInch;
+        wx.rainLast24Hours   = last24Hours100sInch;
+        wx.rainSinceMidnight = sinceMidnight100sInch;
     }
     
-    memset( packetToSend, 0, sizeof( packetToSend ) );
-    printAPRSPacket( &wx, packetToSend, packetFormat, 0, false );
-    
-    // add a comment with our software version info
-    strcat( packetToSend, PROGRAM_NAME );
-    strcat( packetToSend, VERSION );
-    if( s_debug )
-        printf( "%s\n\n", packetToSend );
-
     // pickup CO2 reading here
     float co2 = co2_read_sensor( NULL, NULL );
-    
+
+    // add a comment with our software version info (and the air quality telemetry if we are doing that the compact way)
+    char comment[64] = PROGRAM_NAME VERSION;
+    if( s_base91_telemetry )
+    {
+        int channels[kTelemetryChannels];
+        air_telemetry_channels( frame, co2, channels );
+
+        size_t len = strlen( comment );
+        if( s_sequence_num >= 999 )
+            s_sequence_num = 0;
+        aprs_format_telemetry( &comment[len], sizeof( comment ) - len, s_sequence_num++, channels, kTelemetryChannels );
+        save_sequence_number();
+    }
+
+    time_t now       = timeGetTimeSec();
+    size_t packetLen = aprs_format_wx( packetToSend, sizeof( packetToSend ), s_is_format, &wx, now, comment );
+    size_t radioLen  = aprs_format_wx( radioPacket, sizeof( radioPacket ), s_rf_format, &wx, now, comment );
+    if( !packetLen || !radioLen )
+    {
+        log_error( "transmit_wx_frame: failed to format wx packet\n" );
+        return;
+    }
+
+#ifdef VERIFY_WX_FORMAT
+    if( s_is_format == kWxFormat_uncompressed && !s_base91_telemetry )
+        verify_wx_format( &wx, packetToSend );
+#endif
+
+    if( s_debug )
+    {
+        printf( "%s\n", packetToSend );
+        printf( "%s\n\n", radioPacket );
+        print_wx_formats( &wx, now );
+    }
+
     print_wx_for_www( frame, lastHour100sInch, last24Hours100sInch, sinceMidnight100sInch, (int32_t)co2 );
 
     // we need to create copies of the packet buffer and send that instead as we don't know the life of those other threads we light off...
-    wx_create_thread_detached( sendPacket_thread_entry, copy_string( packetToSend ) );
+    trace_stamp( &s_wx_trace, kStage_format );
+    send_queue_packet_traced( kDest_aprs_is, packetToSend, false, &s_wx_trace );
 
-    if( timeGetTimeSec() > s_lastWxWideTime + kWxWideInterval )
+    if( s_wxWidePending )
     {
         // send packet over WIDE2-1 as well maybe every once in a while
-        wx_create_thread_detached( sendToRadioWIDE_thread_entry, copy_string( packetToSend ) );
-        s_lastWxWideTime = timeGetTimeSec();
+        send_queue_packet_traced( kDest_radio, radioPacket, true, &s_wx_trace );
+        s_wxWidePending = false;
     }
     else
-        wx_create_thread_detached( sendToRadio_thread_entry, copy_string( packetToSend ) ); // send locally to me path is to TCPIP so don't get repeated
-    
-    
-    s_lastSentTime = timeGetTimeSec();
+        send_queue_packet_traced( kDest_radio, radioPacket, false, &s_wx_trace ); // send locally to me path is to TCPIP so don't get repeated
 }
 
 
 
+// another station's averages under its own callsign, APRS-IS only since the radio channel is shared and already busy with ours
+void transmit_station_wx( const char* callsign, const Frame* frame )
+{
+    // the pressure (and inside temp, air quality) came from our receiver board, not their station
+    uint8_t flags  = frame->flags & kRadioFlags;
+
+    // every wx format has to have the wind in it
+    uint8_t needed = kDataFlag_temp | kDataFlag_wind;
+    if( (flags & needed) != needed || !validate_wx_frame( frame ) )
+        return;
+
+    wx_report wx;
+    wx_report_from_frame( frame, &wx );
+    if( !(flags & kDataFlag_gust) )
+        wx.gust = kWxFieldUnknown;
+    if( !(flags & kDataFlag_humidity) )
+        wx.humidity = kWxFieldUnknown;
+    wx.pressure = kWxFieldUnknown;
+
+    char packet[BUFSIZE];
+    if( !aprs_format_wx( packet, sizeof( packet ), s_is_format, &wx, timeGetTimeSec(), PROGRAM_NAME VERSION ) ||
+        !aprs_format_set_source( packet, sizeof( packet ), callsign ) )
+    {
+        log_error( "transmit_station_wx: failed to format wx packet for %s\n", callsign );
+        return;
+    }
+
+    if( s_debug )
+        printf( "%s\n", packet );
+    send_queue_packet( kDest_aprs_is, packet, false );
+}
+
+
+
+// scale the air channels down so they fit in base-91 telemetry (0-8280), the EQNS we send multiplies them back up
+void air_telemetry_channels( const Frame* frame, float co2, int* values )
+{
+    values[0] = (frame->particles_03um + kBase91TelemetryScale / 2) / kBase91TelemetryScale;
+    values[1] = (frame->particles_05um + kBase91TelemetryScale / 2) / kBase91TelemetryScale;
+    values[2] = (frame->particles_10um + kBase91TelemetryScale / 2) / kBase91TelemetryScale;
+    values[3] = (frame->particles_25um + kBase91TelemetryScale / 2) / kBase91TelemetryScale;
+    values[4] = (int)round( co2 / kBase91TelemetryScale );
+}
+
+
+void save_sequence_number( void )
+{
+    if( s_sequence_num >= 999 )
+        s_sequence_num = 0;
+
+    if( s_have_state )
+        save_state();
+    else if( s_seqFilePath )
+    {
+        s_seqFile = fopen( s_seqFilePath, "wb" );
+        if( !s_seqFile )
+            log_error( "  failed to open sequence file: %s\n", s_seqFilePath );
+        if( s_seqFile )
+        {
+            fwrite( &s_sequence_num, sizeof( uint16_t ), 1, s_seqFile );
+            fclose( s_seqFile );
+        }
+    }
+}
+
+
+// everything goes into the mapped state page as plain stores, the page only gets written when something actually changed
+void save_state( void )
+{
+    if( !s_have_state )
+        return;
+
+    wx_state* state = state_get();
+    state->sequence_num = s_sequence_num;
+    state->params_hash  = s_params_hash;
+
+    int primary = stations_primary();
+    if( primary >= 0 )
+    {
+        state->primary_station = (uint8_t)primary;
+        state->primary_valid   = 1;
+    }
+    if( s_rain_measurement_done )
+    {
+        state->rain_baseline  = s_aveFrame.rain;
+        state->rain_raw_count = s_rain_raw_count;
+        state->rain_time      = s_rain_time;
+    }
+
+    for( int i = 0; i < scheduler_job_count(); i++ )
+    {
+        wx_job_stats stats;
+        if( scheduler_job_stats( i, &stats ) )
+            state_set_job_last_run( i, stats.name, stats.last_run );
+    }
+
+    state_commit();
+    state_sync( false );
+}
+
+
+void restore_state( bool sequenceOverride )
+{
+    if( !state_is_warm() )
+        return;
+
+    const wx_state* state = state_get();
+    if( !sequenceOverride )
+        s_sequence_num = state->sequence_num;
+    s_params_hash = state->params_hash;
+
+    // the rain baseline is only good if we weren't down long enough to miss any rain
+    if( state->rain_time && timeGetTimeSec() - state->rain_time < kHistoryTimeout )
+    {
+        s_aveFrame.rain         = state->rain_baseline;
+        s_rain_raw_count        = state->rain_raw_count;
+        s_rain_time             = (time_t)state->rain_time;
+        s_rain_measurement_done = true;
+    }
+
+    log_error( "warm restart: state saved %lld secs ago, sequence: %u\n", (long long)(timeGetTimeSec() - state_saved_time()), s_sequence_num );
+}
+
+
+// the parameters, units and equations only need to go out when they change (or once in a long while for anyone who missed them)
+// these never go out over wide...
+void transmit_telemetry_params( bool refresh )
+{
+    char params[4][BUFSIZE];
+    sprintf( params[0], "%s>APNFOL,TCPIP*::%s :PARM.0.3um,0.5um,1.0um,2.5um,CO2", kCallSign, kCallSign );
+    sprintf( params[1], "%s>APNFOL,TCPIP*::%s :UNIT.pm/0.1L,pm/0.1L,pm/0.1L,pm/0.1L,ppm", kCallSign, kCallSign );
+    if( s_base91_telemetry )
+        sprintf( params[2], "%s>APNFOL,TCPIP*::%s :EQNS.0,%d,0,0,%d,0,0,%d,0,0,%d,0,0,%d,0", kCallSign, kCallSign, kBase91TelemetryScale, kBase91TelemetryScale, kBase91TelemetryScale, kBase91TelemetryScale, kBase91TelemetryScale );
+    else
+        sprintf( params[2], "%s>APNFOL,TCPIP*::%s :EQNS.0,256,0,0,256,0,0,256,0,0,256,0,0,256,0", kCallSign, kCallSign );
+    sprintf( params[3], "%s>APNFOL,TCPIP*::%s :BITS.10101010,Lab Air Quality", kCallSign, kCallSign );
+
+    // FNV-1a over all of it so we notice any change
+    uint32_t hash = 2166136261u;
+    for( int i = 0; i < 4; i++ )
+        for( const char* c = params[i]; *c; c++ )
+            hash = (hash ^ (uint8_t)*c) * 16777619u;
+
+    if( hash == s_params_hash && !refresh )
+        return;
+
+    for( int i = 0; i < 4; i++ )
+    {
+        if( s_debug )
+            printf( "%s\n", params[i] );
+        send_queue_packet( kDest_aprs_is, params[i], false );
+        send_queue_packet( kDest_radio, params[i], false );
+    }
+
+    s_params_hash = hash;
+}
+
+
 void transmit_air_data( const Frame* frame )
 {
     char packetToSend[BUFSIZE];
 
+    transmit_telemetry_params( false );
+
+    // with base-91 telemetry the air data rides along in the wx packet comment, no need for a packet of its own
+    if( s_base91_telemetry )
+        return;
+
     // pickup CO2 reading here as well
     float co2 = co2_read_sensor( NULL, NULL );
     
@@ -1700,41 +2571,6 @@ void transmit_air_data( const Frame* frame )
     if( s_sequence_num >= 999 )
         s_sequence_num = 0;
     
-    // we need to see if we ever sent the parameters, units and equations...
-    // these never go out over wide...
-    if( timeGetTimeSec() > s_lastParamsTime + s_paramsInterval )
-    {
-        sprintf( packetToSend, "%s>APNFOL,TCPIP*::%s :PARM.0.3um,0.5um,1.0um,2.5um,CO2", kCallSign, kCallSign );
-        if( s_debug )
-            printf( "%s\n", packetToSend );
-        wx_create_thread_detached( sendPacket_thread_entry, copy_string( packetToSend ) );
-        wx_create_thread_detached( sendToRadio_thread_entry, copy_string( packetToSend ) );
-        sleep( 1 ); // avoid rate limiting
-        
-        sprintf( packetToSend, "%s>APNFOL,TCPIP*::%s :UNIT.pm/0.1L,pm/0.1L,pm/0.1L,pm/0.1L,ppm", kCallSign, kCallSign );
-        if( s_debug )
-            printf( "%s\n", packetToSend );
-        wx_create_thread_detached( sendPacket_thread_entry, copy_string( packetToSend ) );
-        wx_create_thread_detached( sendToRadio_thread_entry, copy_string( packetToSend ) );
-        sleep( 1 ); // avoid rate limiting
-
-        sprintf( packetToSend, "%s>APNFOL,TCPIP*::%s :EQNS.0,256,0,0,256,0,0,256,0,0,256,0,0,256,0", kCallSign, kCallSign );
-        if( s_debug )
-            printf( "%s\n", packetToSend );
-        wx_create_thread_detached( sendPacket_thread_entry, copy_string( packetToSend ) );
-        wx_create_thread_detached( sendToRadio_thread_entry, copy_string( packetToSend ) );
-        sleep( 1 ); // avoid rate limiting
-
-        sprintf( packetToSend, "%s>APNFOL,TCPIP*::%s :BITS.10101010,Lab Air Quality", kCallSign, kCallSign );
-        if( s_debug )
-            printf( "%s\n", packetToSend );
-        wx_create_thread_detached( sendPacket_thread_entry, copy_string( packetToSend ) );
-        wx_create_thread_detached( sendToRadio_thread_entry, copy_string( packetToSend ) );
-        sleep( 1 ); // avoid rate limiting
-        
-        s_lastParamsTime = timeGetTimeSec();
-    }
-    
     sprintf( packetToSend, "%s>APNFOL,TCPIP*:T#%03d,%0.2f,%0.2f,%0.2f,%0.2f,%0.2f,%d%d%d%d%d%d%d%d", kCallSign, s_sequence_num++,
               frame->particles_03um / 256.0,
               frame->particles_05um / 256.0,
@@ -1747,30 +2583,18 @@ void transmit_air_data( const Frame* frame )
         printf( "%s\n\n", packetToSend );
 
     // we need to create copies of the packet buffer and send that instead as we don't know the life of those other threads we light off...
-    wx_create_thread_detached( sendPacket_thread_entry, copy_string( packetToSend ) );
+    send_queue_packet( kDest_aprs_is, packetToSend, false );
     
-    if( timeGetTimeSec() > s_lastTelemetryWideTime + kTelemetryWideInterval )
+    if( s_telemetryWidePending )
     {
         // send packet over WIDE2-1 as well maybe every once in a while
-        wx_create_thread_detached( sendToRadioWIDE_thread_entry, copy_string( packetToSend ) );
-        s_lastTelemetryWideTime = timeGetTimeSec();
+        send_queue_packet( kDest_radio, packetToSend, true );
+        s_telemetryWidePending = false;
     }
     else
-        wx_create_thread_detached( sendToRadio_thread_entry, copy_string( packetToSend ) );
+        send_queue_packet( kDest_radio, packetToSend, false );
     
-    if( s_seqFilePath )
-    {
-        s_seqFile = fopen( s_seqFilePath, "wb" );
-        if( !s_seqFile )
-            log_error( "  failed to open sequence file: %s\n", s_seqFilePath );
-        if( s_seqFile )
-        {
-            fwrite( &s_sequence_num, sizeof( uint16_t ), 1, s_seqFile );
-            fclose( s_seqFile );
-        }
-    }
-
-    s_lastSentTime = timeGetTimeSec();
+    save_sequence_number();
 }
 
 
@@ -1785,17 +2609,19 @@ void transmit_status( const Frame* frame )
         printf( "wx-relay case temp: %0.2f°F\n", c2f( frame->intTempC - s_localTempErrorC ) );
     }
     
-    time_t     t   = time( NULL );
+    time_t     t   = timeGetTimeSec();
     struct tm* now = gmtime(&t);  // APRS uses GMT
-    sprintf( packetToSend, "%s>APNFOL,TCPIP*:>%.2d%.2d%.2dzwx-relay %0.1fF", kCallSign, now->tm_mday, now->tm_hour, now->tm_min, c2f( frame->intTempC - s_localTempErrorC ) );
+    int len = sprintf( packetToSend, "%s>APNFOL,TCPIP*:>%.2d%.2d%.2dzwx-relay %0.1fF", kCallSign, now->tm_mday, now->tm_hour, now->tm_min, c2f( frame->intTempC - s_localTempErrorC ) );
+
+    // the five telemetry channels are taken, so the rest of the particulate data goes out in the status text
+    if( s_base91_telemetry )
+        sprintf( &packetToSend[len], " pm %d/%d/%d env %d/%d/%d 5/10um %d/%d", frame->pm10_standard, frame->pm25_standard, frame->pm100_standard, frame->pm10_env, frame->pm25_env, frame->pm100_env, frame->particles_50um, frame->particles_100um );
     if( s_debug )
         printf( "%s\n\n", packetToSend );
 
     // we need to create copies of the packet buffer and send that instead as we don't know the life of those other threads we light off...
-    wx_create_thread_detached( sendPacket_thread_entry, copy_string( packetToSend ) );
-    wx_create_thread_detached( sendToRadio_thread_entry, copy_string( packetToSend ) );
-
-    s_lastSentTime = timeGetTimeSec();
+    send_queue_packet( kDest_aprs_is, packetToSend, false );
+    send_queue_packet( kDest_radio, packetToSend, false );
 }
 
 
@@ -1928,7 +2754,10 @@ int send_to_kiss_tnc( int chan, int cmd, char* data, int dlen )
     klen = kiss_encapsulate( temp, dlen + 1, kissed );
     
     // connect to direwolf and send data
-    int server_sock = connectToDireWolf();
+    uint64_t start       = metrics_now_us();
+    int      server_sock = connectToDireWolf();
+    metrics_observe( kHistogram_kiss_connect, metrics_now_us() - start );
+    trace_stamp( trace_current(), kStage_connect );
     if( server_sock < 0 )
     {
         log_error( "can't connect to direwolf...\n" );
@@ -1942,10 +2771,14 @@ int send_to_kiss_tnc( int chan, int cmd, char* data, int dlen )
         log_error( "error writing KISS frame to socket.\n" );
         err = -1;
     }
+    else
+        trace_stamp( trace_current(), kStage_send );
 
 exit_gracefully:
     shutdown( server_sock, 2 );
     close( server_sock );
+    metrics_observe( kHistogram_kiss_submit, metrics_now_us() - start );
+    metrics_count( err ? kCounter_kiss_failed : kCounter_kiss_sent );
     return err;
 }
 
@@ -2139,6 +2972,27 @@ bool wxlog_startup( void )
 }
 
 
+// the rain windows only live in memory, so after a restart they're rebuilt from the counts in the history we just read back
+void wxlog_seed_rain( void )
+{
+    if( !s_wxlog || !s_wx_size_secs )
+        return;
+
+    // records from before the rain thread's first count (or since the averages cleared the frame) have whatever rain was lying
+    // around in it, they'd look like the gauge restarting
+    pthread_mutex_lock( &s_wxlog_mutex );
+    for( size_t i = s_wx_count; i-- > 0; )
+        if( s_wxlog[i].frame.flags & kDataFlag_rain )
+            rain_accum_count( (uint32_t)lround( s_wxlog[i].frame.rain / rawRainCount2inches( 1 ) ), s_wxlog[i].timeStampSecs );
+    pthread_mutex_unlock( &s_wxlog_mutex );
+
+    rain_totals rain;
+    rain_accum_get_totals( timeGetTimeSec(), &rain );
+    log_error( " rain from the wx log: %0.2f in the last hour, %0.2f in the last 24 hours, %0.2f since midnight\n",
+               rawRainCount2inches( rain.lastHour ), rawRainCount2inches( rain.last24Hours ), rawRainCount2inches( rain.sinceMidnight ) );
+}
+
+
 bool wxlog_shutdown( void )
 {
     if( !s_wxlogFilePath || !s_wxlog || !s_wx_count )
@@ -2157,20 +3011,76 @@ bool wxlog_shutdown( void )
     fclose( s_wxlogFile );
     s_wxlogFile = NULL;
     
+    pthread_mutex_lock( &s_wxlog_mutex );
     free( s_wxlog );
     s_wxlog = NULL;
+    pthread_mutex_unlock( &s_wxlog_mutex );
     return true;
 }
 
 
+// copies the history under the lock, a memcpy of at most 20k records so ingestion barely notices.  free the records when done.
+size_t wxlog_snapshot( wxrecord** records )
+{
+    *records = NULL;
+
+    pthread_mutex_lock( &s_wxlog_mutex );
+    size_t count = s_wxlog ? s_wx_count : 0;
+    if( s_wxlog )
+    {
+        *records = (wxrecord*)malloc( count ? count * sizeof( wxrecord ) : 1 );
+        if( *records )
+            memcpy( *records, s_wxlog, count * sizeof( wxrecord ) );
+    }
+    pthread_mutex_unlock( &s_wxlog_mutex );
+
+    return *records ? count : 0;
+}
+
+
+// feeds /history from a snapshot, oldest first since that's how the archive hands them out too
+void wxlog_history( int64_t from, int64_t to, archive_sample_fn callback, void* context )
+{
+    wxrecord* records = NULL;
+    size_t    count   = wxlog_snapshot( &records );
+
+    archive_sample sample;
+    for( size_t i = count; i-- > 0; )
+    {
+        sample.time = records[i].timeStampSecs;
+        if( sample.time < from )
+            continue;
+        if( sample.time > to )
+            break;
+
+        wx_archive_frame_values( &records[i].frame, sample.values );
+        if( !callback( &sample, context ) )
+            break;
+    }
+    free( records );
+}
+
+
+int64_t wxlog_oldest( void )
+{
+    pthread_mutex_lock( &s_wxlog_mutex );
+    int64_t oldest = s_wxlog && s_wx_count ? s_wxlog[s_wx_count - 1].timeStampSecs : 0;
+    pthread_mutex_unlock( &s_wxlog_mutex );
+    return oldest;
+}
+
+
 bool wxlog_frame( const Frame* wxFrame )
 {
     if( !wxFrame || !s_wxlog )
         return false;
 
     // add entry
-    wxrecord wx = { .timeStampSecs = timeGetTimeSec(), .frame = *wxFrame };
+    uint64_t start = metrics_now_us();
+    wxrecord wx    = { .timeStampSecs = timeGetTimeSec(), .frame = *wxFrame };
     
+    pthread_mutex_lock( &s_wxlog_mutex );
+
     // see if there's room to move stuff without truncating
     if( s_wx_count )
     {
@@ -2192,8 +3102,14 @@ bool wxlog_frame( const Frame* wxFrame )
 
     // put the actual data in there now
     memcpy( s_wxlog, &wx, sizeof( wxrecord ) );
-
     s_wx_size_secs = timeGetTimeSec() - s_wxlog[s_wx_count - 1].timeStampSecs;
+
+    pthread_mutex_unlock( &s_wxlog_mutex );
+
+    // and keep it for the long haul
+    if( s_archivePath && !wx_archive_append( wx.timeStampSecs, wxFrame ) )
+        log_error_throttled( " failed to write wx archive: %d\n", errno );
+    metrics_observe( kHistogram_wxlog_insert, metrics_now_us() - start );
     
 #ifdef TRACE_INSERTS
     printTime( false );
@@ -2213,7 +3129,8 @@ bool wxlog_get_wx_averages( Frame* wxFrame )
     if( s_wx_size_secs < kLongestInterval )
         return false;
     
-    time_t current = timeGetTimeSec();
+    uint64_t start   = metrics_now_us();
+    time_t   current = timeGetTimeSec();
     memset( wxFrame, 0, sizeof( Frame ) );
     
     // these counts are used to derive the averages
@@ -2352,6 +3269,7 @@ bool wxlog_get_wx_averages( Frame* wxFrame )
     
     // kinda a hack but I don't want to mess with the Frame struct size
     s_last_aqi = pm25_aqi / aqiCount;
+    metrics_observe( kHistogram_wxlog_aggregate, metrics_now_us() - start );
     
 #ifdef TRACE_AVERAGES
     printCurrentWeather( wxFrame, false, NULL );
@@ -2360,49 +3278,34 @@ bool wxlog_get_wx_averages( Frame* wxFrame )
 }
 
 
-bool wxlog_get_rain_counts( int* lastHour100sInch, int* last24Hours100sInch, int* sinceMidnight100sInch )
+#ifdef WXRELAY_NO_MAIN
+// bench.c links all of this without main(), this gives it a wxlog of count copies of frame spread evenly over the last spanSecs.
+// count gets clamped to what the log can hold, the count actually used comes back (zero on failure)
+size_t wxlog_seed( const Frame* frame, size_t count, time_t spanSecs )
 {
-    if( !lastHour100sInch || !last24Hours100sInch || !sinceMidnight100sInch )
-        return false;
-
-    *lastHour100sInch      = 0;
-    *last24Hours100sInch   = 0;
-    *sinceMidnight100sInch = 0;
+    if( count > kMaxNumberOfRecords - 1 )
+        count = kMaxNumberOfRecords - 1;
 
-    float current_rain_inches = s_wxlog[0].frame.rain;
+    if( !frame || count < 2 )
+        return 0;
 
-    // figure out a period based on when midnight passed (we do this by looking at the current hour and minute and second)
-    time_t t = time( NULL );
-    struct tm tm = *localtime( &t );
-    time_t secondsSinceMidnight = (tm.tm_hour * 60 * 60) + (tm.tm_min * 60) + tm.tm_sec;  // hour is in 24 hour format, phew!
+    if( !s_wxlog && !wxlog_startup() )
+        return 0;
 
-    // short-circuit if possible: the smallest time period is last hour (although, we could be a few minutes from midnight so check that)
-    time_t smallestPeriod = secondsSinceMidnight < s_rainLastHrPeriod ? secondsSinceMidnight : s_rainLastHrPeriod;
-    if( s_wx_size_secs < smallestPeriod )
-        return false;
+    time_t now = timeGetTimeSec();
 
-    time_t current = timeGetTimeSec();
-    
-    // go thru all records, they are in order of newest to oldest
-    for( int i = 0; i < s_wx_count; i++ )
+    pthread_mutex_lock( &s_wxlog_mutex );
+    for( size_t i = 0; i < count; i++ )
     {
-        time_t timeIndexSecs = current - s_wxlog[i].timeStampSecs;  // timestamps go in decreasing order
-        int    rain_inches   = (int)round( (current_rain_inches - s_wxlog[i].frame.rain) * 100 );
-        if( rain_inches < 0 )
-            rain_inches = 0;
-
-        if( (s_wx_size_secs >= s_rainLastHrPeriod) && (timeIndexSecs < s_rainLastHrPeriod) )
-            *lastHour100sInch = rain_inches;
-
-        if( (s_wx_size_secs >= s_rain24HrPeriod) && (timeIndexSecs < s_rain24HrPeriod) )
-            *last24Hours100sInch = rain_inches;
-        
-        if( (s_wx_size_secs >= secondsSinceMidnight) && (timeIndexSecs < secondsSinceMidnight) )
-            *sinceMidnight100sInch = rain_inches;
+        s_wxlog[i].timeStampSecs = now - (time_t)(i * spanSecs / (count - 1));
+        s_wxlog[i].frame         = *frame;
     }
-    
-    return true;
+    s_wx_count     = count;
+    s_wx_size_secs = now - s_wxlog[count - 1].timeStampSecs;
+    pthread_mutex_unlock( &s_wxlog_mutex );
+    return count;
 }
+#endif
 
 
 
@@ -2413,6 +3316,7 @@ void queue_packet( const char* packetData )
 {
     if( s_queue_num >= kMaxQueueItems )
     {
+        metrics_count( kCounter_resend_dropped );
         log_error( "queue is full, dropping: %s\n", packetData );
         return;
     }
@@ -2425,25 +3329,6 @@ void queue_packet( const char* packetData )
 }
 
 
-void queue_error_packet( const char* packetData )
-{
-//    if( s_error_bucket_num >= kMaxQueueItems )
-//    {
-//        log_error( "error queue is full, dropping: %s\n", packetData );
-//        return;
-//    }
-    
-    // avoid a memory leak until this is completely implemented... right now we don't have any direct evidence that we need this code at all
-    log_error( "error bucket: dropping packet: %s\n", packetData );
-    
-//    s_error_bucket_busy = true;
-//    const char* entry = copy_string( packetData );
-//    s_error_bucket[s_error_bucket_num++] = entry;
-//    s_error_bucket_busy = false;
-//    log_error( "error queued: %s\n", entry );
-}
-
-
 const char* queue_get_next_packet( void )
 {
     if( !s_queue_num )
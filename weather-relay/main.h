@@ -10,7 +10,11 @@
 #define _H_main
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <time.h>
+
+#include "TXDecoderFrame.h"
 
 
 // define this to see incoming weather data from weather sensors...
@@ -77,7 +81,7 @@
 
 
 #define kSendInterval    60 * 5        // 5 minutes
-#define kParamsInterval  60 * 60 * 2   // every two hours
+#define kParamsInterval  60 * 60 * 24  // once a day, or whenever they change
 #define kStatusInterval  60 * 10 + 15  // every ten minutes + 15 seconds offset
 
 #define kTempPeriod       60 * 5   // 5 minute average
@@ -120,9 +124,35 @@
 
 bool debug_mode( void );
 void log_error( const char* format, ... );
+void log_roll( void );
 void log_unix_error( const char* prefix );
 int open_serial_port( const char* serial_port_device, int port_speed );
 
+// when each of a station's averaging windows started over, updateStats() keeps one for our own station and stations.c one per neighbor
+typedef struct
+{
+    time_t  lastWindTime;
+    time_t  lastGustTime;
+    time_t  lastBaroTime;
+    time_t  lastTempTime;
+    time_t  lastIntTempTime;
+    time_t  lastHumiTime;
+    time_t  lastAirTime;
+    time_t  lastAQITime;
+    int16_t averageAqi;
+    bool    rainGauge;          // the rain gauge's counts go into this station's frames
+} wx_validation;
+
+// the relay's hot paths, bench.c drives these directly
+uint8_t calculate_crc( uint8_t* data, uint8_t len );
+void    updateStats( Frame* data, Frame* min, Frame* max, Frame* ave );
+void    updateStationStats( wx_validation* state, Frame* data, Frame* min, Frame* max, Frame* ave );
+bool    wxlog_frame( const Frame* wxFrame );
+bool    wxlog_get_wx_averages( Frame* wxFrame );
+#ifdef WXRELAY_NO_MAIN
+size_t  wxlog_seed( const Frame* frame, size_t count, time_t spanSecs );
+#endif
+
 #endif // !_H_main
 
 // EOF
@@ -1,2 +1,7 @@
-gcc -g main.c wx_thread.c rain_socket.c rain_sensor.c co2_sensor.c ../stubs.c ../ax25_pad.c ../kiss_frame.c ../fcs_calc.c ../aprs-weather-submit/src/aprs-is.c ../aprs-weather-submit/src/aprs-wx.c -D__insecure_redirect__ -DKISSUTIL -I. -I.. -I../../tx31u-receiver/ -I../aprs-weather-submit/src/ -l wiringPi -lm -o wxrelay -pthread
+gcc -g main.c wx_thread.c rain_sensor.c co2_sensor.c aprs_format.c scheduler.c send_queue.c logging.c state.c wx_archive.c control.c http_server.c history.c metrics.c trace.c capture.c capture_reader.c replay.c wx_clock.c stations.c receivers.c input.c ingest.c rain_accum.c ../stubs.c ../ax25_pad.c ../kiss_frame.c ../fcs_calc.c ../aprs-weather-submit/src/aprs-is.c ../aprs-weather-submit/src/aprs-wx.c -D__insecure_redirect__ -DKISSUTIL -I. -I.. -I../../tx31u-receiver/ -I../aprs-weather-submit/src/ -l wiringPi -lm -o wxrelay -pthread
 
+gcc -g -DWXRELAY_NO_MAIN bench.c main.c wx_thread.c rain_sensor.c co2_sensor.c aprs_format.c scheduler.c send_queue.c logging.c state.c wx_archive.c control.c http_server.c history.c metrics.c trace.c capture.c capture_reader.c replay.c wx_clock.c stations.c receivers.c input.c ingest.c rain_accum.c ../stubs.c ../ax25_pad.c ../kiss_frame.c ../fcs_calc.c ../aprs-weather-submit/src/aprs-is.c ../aprs-weather-submit/src/aprs-wx.c -D__insecure_redirect__ -DKISSUTIL -Istubs -I. -I.. -I../../tx31u-receiver/ -I../aprs-weather-submit/src/ -lm -o wxbench -pthread
+
+gcc -O2 wxquery.c wx_archive.c -I. -I.. -I../../tx31u-receiver/ -o wxquery
+gcc -O2 wxcapture.c capture_reader.c -I. -I.. -I../../tx31u-receiver/ -o wxcapture
+gcc -O2 wxloadgen.c loadgen.c -I. -I.. -I../../tx31u-receiver/ -lm -o wxloadgen
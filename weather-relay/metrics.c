@@ -0,0 +1,357 @@
+//
+//  metrics.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Counters and latency histograms, served as Prometheus text on /metrics.  Every thread bumps its own shard with relaxed atomics
+//  so the hot paths never take a lock or fight over a cache line, a scrape just adds the shards up.  Histograms are log-linear like
+//  HdrHistogram, four buckets per power of two (within 25%) from 1 µs to over an hour.  Prometheus gets the power of two edges, the
+//  log summary uses all of them for its percentiles.
+//
+
+#define _GNU_SOURCE     // open_memstream
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "main.h"
+#include "metrics.h"
+
+
+#define kShards         8           // threads past this many share, it's still correct just not contention free
+#define kSubBuckets     4           // per power of two
+#define kMaxOctave      32          // 2^32 µs is about 71 minutes, anything longer goes in the last bucket
+#define kBuckets        ((kMaxOctave - 1) * kSubBuckets)
+#define kMaxValues      32
+
+
+typedef struct
+{
+    const char* name;
+    const char* labels;
+    const char* help;
+} metric_info;
+
+typedef struct
+{
+    atomic_uint_fast64_t counters[kCounter_count];
+    atomic_uint_fast64_t buckets[kHistogram_count][kBuckets];
+    atomic_uint_fast64_t sums[kHistogram_count];
+} __attribute__(( aligned( 64 ) )) metrics_shard;
+
+typedef struct
+{
+    const char*     name;
+    const char*     type;
+    const char*     help;
+    metric_value_fn value;
+    void*           context;
+} metric_value;
+
+
+// same name in a row is one family with different labels, keep them together
+static const metric_info s_counter_info[kCounter_count] =
+{
+    [kCounter_frames_received]    = { "wxrelay_frames_received_total",        NULL,                "Weather frames read from the receiver" },
+    [kCounter_frames_bad_crc]     = { "wxrelay_frames_crc_errors_total",      NULL,                "Weather frames with a bad CRC" },
+    [kCounter_frames_short]       = { "wxrelay_frames_short_total",           NULL,                "Partial weather frames that never completed" },
+    [kCounter_partial_reads_wx]   = { "wxrelay_partial_reads_total",          "source=\"wx\"",     "Reads that returned part of a frame" },
+    [kCounter_partial_reads_rain] = { "wxrelay_partial_reads_total",          "source=\"rain\"",   NULL },
+    [kCounter_rejected_temp]      = { "wxrelay_rejected_total",               "field=\"temp\"",    "Measurements thrown out by validation" },
+    [kCounter_rejected_humidity]  = { "wxrelay_rejected_total",               "field=\"humidity\"", NULL },
+    [kCounter_rejected_wind]      = { "wxrelay_rejected_total",               "field=\"wind\"",    NULL },
+    [kCounter_rejected_gust]      = { "wxrelay_rejected_total",               "field=\"gust\"",    NULL },
+    [kCounter_rejected_rain]      = { "wxrelay_rejected_total",               "field=\"rain\"",    NULL },
+    [kCounter_aprs_is_sent]       = { "wxrelay_aprs_is_packets_total",        "result=\"sent\"",   "Packets handed to APRS-IS" },
+    [kCounter_aprs_is_failed]     = { "wxrelay_aprs_is_packets_total",        "result=\"failed\"", NULL },
+    [kCounter_aprs_is_retries]    = { "wxrelay_aprs_is_retries_total",        NULL,                "APRS-IS send attempts that had to be retried" },
+    [kCounter_aprs_is_auth_failed]= { "wxrelay_aprs_is_auth_failures_total",  NULL,                "APRS-IS logins that were refused" },
+    [kCounter_kiss_sent]          = { "wxrelay_kiss_packets_total",           "result=\"sent\"",   "Packets handed to the KISS TNC" },
+    [kCounter_kiss_failed]        = { "wxrelay_kiss_packets_total",           "result=\"failed\"", NULL },
+    [kCounter_resend_dropped]     = { "wxrelay_resend_dropped_total",         NULL,                "Failed APRS-IS packets dropped because the resend queue was full" },
+};
+
+static const metric_info s_histogram_info[kHistogram_count] =
+{
+    [kHistogram_aprs_is_connect]  = { "wxrelay_aprs_is_connect_seconds",      NULL, "APRS-IS lookup and connect" },
+    [kHistogram_aprs_is_submit]   = { "wxrelay_aprs_is_submit_seconds",       NULL, "APRS-IS connect, login and send" },
+    [kHistogram_kiss_connect]     = { "wxrelay_kiss_connect_seconds",         NULL, "KISS TNC lookup and connect" },
+    [kHistogram_kiss_submit]      = { "wxrelay_kiss_submit_seconds",          NULL, "KISS TNC connect and send" },
+    [kHistogram_wxlog_insert]     = { "wxrelay_wxlog_insert_seconds",         NULL, "Adding a frame to the in-memory log and the archive" },
+    [kHistogram_wxlog_aggregate]  = { "wxrelay_wxlog_aggregate_seconds",      NULL, "Computing the averages over the in-memory log" },
+    [kHistogram_stage_crc]        = { "wxrelay_trace_stage_seconds",          "stage=\"crc\"",       "Time from the previous stage of a traced packet" },
+    [kHistogram_stage_stats]      = { "wxrelay_trace_stage_seconds",          "stage=\"stats\"",     NULL },
+    [kHistogram_stage_insert]     = { "wxrelay_trace_stage_seconds",          "stage=\"insert\"",    NULL },
+    [kHistogram_stage_aggregate]  = { "wxrelay_trace_stage_seconds",          "stage=\"aggregate\"", NULL },
+    [kHistogram_stage_format]     = { "wxrelay_trace_stage_seconds",          "stage=\"format\"",    NULL },
+    [kHistogram_stage_queue]      = { "wxrelay_trace_stage_seconds",          "stage=\"queue\"",     NULL },
+    [kHistogram_stage_connect]    = { "wxrelay_trace_stage_seconds",          "stage=\"connect\"",   NULL },
+    [kHistogram_stage_send]       = { "wxrelay_trace_stage_seconds",          "stage=\"send\"",      NULL },
+    [kHistogram_trace_total]      = { "wxrelay_trace_total_seconds",          NULL,                    "Serial port to the wire for traced packets" },
+};
+
+static metrics_shard   s_shards[kShards];
+static atomic_int      s_next_shard = 0;
+static __thread int    s_shard      = -1;
+static metric_value    s_values[kMaxValues];
+static int             s_value_count = 0;
+
+
+
+static metrics_shard* my_shard( void )
+{
+    if( s_shard < 0 )
+        s_shard = atomic_fetch_add( &s_next_shard, 1 ) % kShards;
+    return &s_shards[s_shard];
+}
+
+
+// values land in (lower, upper], so the power of two edges are exact for Prometheus' le
+static int bucket_index( uint64_t micros )
+{
+    uint64_t v = micros ? micros - 1 : 0;
+    if( v < kSubBuckets )
+        return (int)v;
+
+    int msb = 63 - __builtin_clzll( v );
+    if( msb >= kMaxOctave )
+        return kBuckets - 1;
+    return (msb - 1) * kSubBuckets + (int)((v >> (msb - 2)) & (kSubBuckets - 1));
+}
+
+
+// biggest value (µs) that lands in bucket
+static uint64_t bucket_upper( int bucket )
+{
+    if( bucket < kSubBuckets )
+        return bucket + 1;
+
+    int msb = bucket / kSubBuckets + 1;
+    int sub = bucket % kSubBuckets;
+    return (uint64_t)(kSubBuckets + sub + 1) << (msb - 2);
+}
+
+
+void metrics_count( metric_counter counter )
+{
+    metrics_add( counter, 1 );
+}
+
+
+void metrics_add( metric_counter counter, uint64_t amount )
+{
+    if( counter < kCounter_count )
+        atomic_fetch_add_explicit( &my_shard()->counters[counter], amount, memory_order_relaxed );
+}
+
+
+void metrics_observe( metric_histogram histogram, uint64_t micros )
+{
+    if( histogram >= kHistogram_count )
+        return;
+
+    metrics_shard* shard = my_shard();
+    atomic_fetch_add_explicit( &shard->buckets[histogram][bucket_index( micros )], 1, memory_order_relaxed );
+    atomic_fetch_add_explicit( &shard->sums[histogram], micros, memory_order_relaxed );
+}
+
+
+uint64_t metrics_now_us( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+// name can carry labels, "wxrelay_send_queue_depth{queue=\"radio\"}".  register them before anything can scrape
+bool metrics_add_value( const char* name, const char* type, const char* help, metric_value_fn value, void* context )
+{
+    if( !name || !value || s_value_count >= kMaxValues )
+        return false;
+
+    metric_value* v = &s_values[s_value_count++];
+    v->name    = name;
+    v->type    = type ? type : "gauge";
+    v->help    = help;
+    v->value   = value;
+    v->context = context;
+    return true;
+}
+
+
+
+#pragma mark -
+
+static uint64_t sum_counter( metric_counter counter )
+{
+    uint64_t total = 0;
+    for( int i = 0; i < kShards; i++ )
+        total += atomic_load_explicit( &s_shards[i].counters[counter], memory_order_relaxed );
+    return total;
+}
+
+
+static uint64_t sum_histogram( metric_histogram histogram, uint64_t* buckets )
+{
+    uint64_t sum = 0;
+    memset( buckets, 0, kBuckets * sizeof( uint64_t ) );
+    for( int i = 0; i < kShards; i++ )
+    {
+        for( int b = 0; b < kBuckets; b++ )
+            buckets[b] += atomic_load_explicit( &s_shards[i].buckets[histogram][b], memory_order_relaxed );
+        sum += atomic_load_explicit( &s_shards[i].sums[histogram], memory_order_relaxed );
+    }
+    return sum;
+}
+
+
+static int thread_count( void )
+{
+    FILE* status = fopen( "/proc/self/status", "r" );
+    if( !status )
+        return 0;
+
+    char line[128];
+    int  threads = 0;
+    while( fgets( line, sizeof( line ), status ) )
+        if( sscanf( line, "Threads: %d", &threads ) == 1 )
+            break;
+    fclose( status );
+    return threads;
+}
+
+
+// HELP and TYPE once per family, base is the name up to any labels
+static void write_family( FILE* out, const char* name, const char* type, const char* help, const char** last )
+{
+    size_t len = strcspn( name, "{" );
+    if( *last && strlen( *last ) == len && strncmp( *last, name, len ) == 0 )
+        return;
+
+    if( help )
+        fprintf( out, "# HELP %.*s %s\n", (int)len, name, help );
+    fprintf( out, "# TYPE %.*s %s\n", (int)len, name, type );
+    *last = name;
+}
+
+
+void metrics_write( FILE* out )
+{
+    const char* last = NULL;
+    for( int c = 0; c < kCounter_count; c++ )
+    {
+        const metric_info* info = &s_counter_info[c];
+        write_family( out, info->name, "counter", info->help, &last );
+        if( info->labels )
+            fprintf( out, "%s{%s} %llu\n", info->name, info->labels, (unsigned long long)sum_counter( c ) );
+        else
+            fprintf( out, "%s %llu\n", info->name, (unsigned long long)sum_counter( c ) );
+    }
+
+    uint64_t buckets[kBuckets];
+    for( int h = 0; h < kHistogram_count; h++ )
+    {
+        const metric_info* info = &s_histogram_info[h];
+        uint64_t           sum   = sum_histogram( h, buckets );
+        uint64_t           count = 0;
+
+        write_family( out, info->name, "histogram", info->help, &last );
+        const char*        labels = info->labels ? info->labels : "";
+        const char*        comma  = info->labels ? "," : "";
+        for( int b = 0; b < kBuckets; b++ )
+        {
+            // the last bucket also takes everything too big to fit, that only belongs under +Inf
+            count += buckets[b];
+            uint64_t upper = bucket_upper( b );
+            if( (upper & (upper - 1)) == 0 && b < kBuckets - 1 )
+                fprintf( out, "%s_bucket{%s%sle=\"%.10g\"} %llu\n", info->name, labels, comma, upper / 1e6, (unsigned long long)count );
+        }
+        fprintf( out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", info->name, labels, comma, (unsigned long long)count );
+        if( info->labels )
+        {
+            fprintf( out, "%s_sum{%s} %.6f\n", info->name, labels, sum / 1e6 );
+            fprintf( out, "%s_count{%s} %llu\n", info->name, labels, (unsigned long long)count );
+        }
+        else
+        {
+            fprintf( out, "%s_sum %.6f\n", info->name, sum / 1e6 );
+            fprintf( out, "%s_count %llu\n", info->name, (unsigned long long)count );
+        }
+    }
+
+    for( int i = 0; i < s_value_count; i++ )
+    {
+        write_family( out, s_values[i].name, s_values[i].type, s_values[i].help, &last );
+        fprintf( out, "%s %.15g\n", s_values[i].name, s_values[i].value( s_values[i].context ) );
+    }
+
+    fprintf( out, "# HELP wxrelay_threads Threads in the process\n# TYPE wxrelay_threads gauge\nwxrelay_threads %d\n", thread_count() );
+}
+
+
+// smallest bucket edge with at least fraction of the samples at or under it
+static uint64_t percentile( const uint64_t* buckets, uint64_t count, double fraction )
+{
+    uint64_t want = (uint64_t)(count * fraction + 0.5);
+    uint64_t seen = 0;
+    for( int b = 0; b < kBuckets; b++ )
+    {
+        seen += buckets[b];
+        if( seen >= want && seen )
+            return bucket_upper( b );
+    }
+    return 0;
+}
+
+
+void metrics_log_stats( void )
+{
+    uint64_t buckets[kBuckets];
+    for( int h = 0; h < kHistogram_count; h++ )
+    {
+        uint64_t sum   = sum_histogram( h, buckets );
+        uint64_t count = 0;
+        int      top   = -1;
+        for( int b = 0; b < kBuckets; b++ )
+        {
+            count += buckets[b];
+            if( buckets[b] )
+                top = b;
+        }
+        if( !count )
+            continue;
+
+        // skip the wxrelay_ and _seconds, the log has enough going on
+        const metric_info* info = &s_histogram_info[h];
+        const char*        name = info->name + strlen( "wxrelay_" );
+        char               label[64];
+        snprintf( label, sizeof( label ), "%.*s%s%s%s", (int)(strlen( name ) - strlen( "_seconds" )), name, info->labels ? "{" : "", info->labels ? info->labels : "", info->labels ? "}" : "" );
+        log_error( "metrics: %s: %llu, avg: %.3f ms, p50: %.3f ms, p99: %.3f ms, max: %.3f ms\n", label, (unsigned long long)count, sum / 1e3 / count,
+                   percentile( buckets, count, 0.5 ) / 1e3, percentile( buckets, count, 0.99 ) / 1e3, bucket_upper( top ) / 1e3 );
+    }
+}
+
+
+void metrics_handler( http_request* request, void* context )
+{
+    char*  text = NULL;
+    size_t len  = 0;
+    FILE*  out  = open_memstream( &text, &len );
+    if( !out )
+    {
+        http_respond_error( request, 500, "Internal Server Error", NULL );
+        return;
+    }
+
+    metrics_write( out );
+    fclose( out );
+
+    http_respond_start( request, 200, "OK", "text/plain; version=0.0.4" );
+    http_respond_write( request, text, len );
+    free( text );
+}
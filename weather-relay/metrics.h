@@ -0,0 +1,75 @@
+//
+//  metrics.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_metrics
+#define _H_metrics
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "http_server.h"
+
+// things we count on the hot paths, safe to bump from any thread
+typedef enum
+{
+    kCounter_frames_received = 0,
+    kCounter_frames_bad_crc,
+    kCounter_frames_short,              // partial read whose remainder never showed up
+    kCounter_partial_reads_wx,
+    kCounter_partial_reads_rain,
+    kCounter_rejected_temp,             // thrown out by updateStats, per field
+    kCounter_rejected_humidity,
+    kCounter_rejected_wind,
+    kCounter_rejected_gust,
+    kCounter_rejected_rain,
+    kCounter_aprs_is_sent,
+    kCounter_aprs_is_failed,
+    kCounter_aprs_is_retries,
+    kCounter_aprs_is_auth_failed,
+    kCounter_kiss_sent,
+    kCounter_kiss_failed,
+    kCounter_resend_dropped,            // the APRS-IS resend queue was full
+    kCounter_count
+} metric_counter;
+
+// latencies, in microseconds
+typedef enum
+{
+    kHistogram_aprs_is_connect = 0,
+    kHistogram_aprs_is_submit,
+    kHistogram_kiss_connect,
+    kHistogram_kiss_submit,
+    kHistogram_wxlog_insert,
+    kHistogram_wxlog_aggregate,
+    kHistogram_stage_crc,               // trace stages, in trace_stage order, time since the stage before
+    kHistogram_stage_stats,
+    kHistogram_stage_insert,
+    kHistogram_stage_aggregate,
+    kHistogram_stage_format,
+    kHistogram_stage_queue,
+    kHistogram_stage_connect,
+    kHistogram_stage_send,
+    kHistogram_trace_total,             // serial port to the wire
+    kHistogram_count
+} metric_histogram;
+
+// read when someone scrapes, for things that are already kept elsewhere (queue depths...)
+typedef double (*metric_value_fn)( void* context );
+
+void     metrics_count( metric_counter counter );
+void     metrics_add( metric_counter counter, uint64_t amount );
+void     metrics_observe( metric_histogram histogram, uint64_t micros );
+uint64_t metrics_now_us( void );
+bool     metrics_add_value( const char* name, const char* type, const char* help, metric_value_fn value, void* context );
+
+void     metrics_write( FILE* out );
+void     metrics_log_stats( void );
+void     metrics_handler( http_request* request, void* context );
+
+#endif // !_H_metrics
@@ -0,0 +1,306 @@
+//
+//  rain_accum.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Rainfall for the last hour, the last 24 hours and since midnight, plus how hard it's coming down right now.  These used to be
+//  worked out by walking the whole wxlog (and calling localtime()) every time a wx packet went out.  Now every time the gauge's
+//  count goes up the difference goes into a ring as a tip event, (when, tips), and running totals for each window are kept as we
+//  go: a tip gets added to all of them when it comes in and subtracted from the hour and day totals when it falls out of their
+//  window.  Two cursors into the ring mark where the hour and the day start, moving them is all the expiring there is.  Midnight
+//  is worked out once a day and kept, when we pass it the since-midnight total goes back to zero.
+//
+//  The gauge only ever sends its running count, so anything odd about that count gets sorted out here: it rolling over (24 or
+//  32 bits), it going backwards (the sensor restarted, or a bad read) and it jumping further than any real rain could.  Those
+//  last two are only believed once the next report agrees, the jump itself never counts as rain.
+//
+
+#include <pthread.h>
+#include <string.h>
+
+#include "main.h"
+#include "rain_accum.h"
+#include "logging.h"
+#include "wx_clock.h"
+
+
+#define kRainTipSlotMask    (kRainTipSlots - 1)
+#define kRainCounter24      (1u << 24)
+
+
+typedef struct
+{
+    uint32_t when;
+    uint32_t tips;
+} rain_tip;
+
+
+static pthread_mutex_t  s_mutex           = PTHREAD_MUTEX_INITIALIZER;
+static rain_tip         s_tips[kRainTipSlots];
+static size_t           s_head            = 0;      // next slot to fill, these three only ever go up
+static size_t           s_day             = 0;      // oldest tip inside the day window
+static size_t           s_hour            = 0;      // oldest tip inside the hour window
+static uint32_t         s_hour_tips       = 0;
+static uint32_t         s_day_tips        = 0;
+static uint32_t         s_midnight_tips   = 0;
+static time_t           s_hour_secs       = kRainLastHrPeriod;
+static time_t           s_day_secs        = kRain24HrPeriod;
+static time_t           s_midnight        = 0;      // the one we last passed
+static time_t           s_next_midnight   = 0;
+
+static bool             s_have_count      = false;
+static uint32_t         s_last_count      = 0;
+static bool             s_have_suspect    = false;  // a count that went backwards or jumped too far, waiting to see if the next one agrees
+static uint32_t         s_suspect         = 0;
+static time_t           s_started         = 0;      // first count we got
+static time_t           s_last_tip        = 0;
+static double           s_tip_secs        = 0;      // seconds per tip between the last two tips, zero if we don't know
+
+static rain_accum_stats s_stats;
+
+
+
+#pragma mark -
+
+void rain_accum_init( time_t hourSecs, time_t daySecs )
+{
+    pthread_mutex_lock( &s_mutex );
+    s_hour_secs = hourSecs > 0 ? hourSecs : kRainLastHrPeriod;
+    s_day_secs  = daySecs >= s_hour_secs ? daySecs : s_hour_secs;      // the hour cursor can't be behind the day's
+    pthread_mutex_unlock( &s_mutex );
+}
+
+
+static void find_midnight( time_t now )
+{
+    struct tm tm;
+    localtime_r( &now, &tm );
+    tm.tm_hour  = 0;
+    tm.tm_min   = 0;
+    tm.tm_sec   = 0;
+    tm.tm_isdst = -1;
+    s_midnight = mktime( &tm );
+
+    // mktime sorts out the end of the month and a 23 or 25 hour day
+    tm.tm_mday += 1;
+    tm.tm_hour  = 0;
+    tm.tm_min   = 0;
+    tm.tm_sec   = 0;
+    tm.tm_isdst = -1;
+    s_next_midnight = mktime( &tm );
+}
+
+
+// drop whatever has fallen out of the windows, all this ever does is move a cursor or two
+static void advance( time_t now )
+{
+    while( s_hour != s_head && now - (time_t)s_tips[s_hour & kRainTipSlotMask].when >= s_hour_secs )
+        s_hour_tips -= s_tips[s_hour++ & kRainTipSlotMask].tips;
+
+    while( s_day != s_head && now - (time_t)s_tips[s_day & kRainTipSlotMask].when >= s_day_secs )
+        s_day_tips -= s_tips[s_day++ & kRainTipSlotMask].tips;
+
+    // the clock getting set back past midnight starts the day over too
+    if( now >= s_next_midnight || now < s_midnight )
+    {
+        if( s_next_midnight )
+            s_midnight_tips = 0;
+        find_midnight( now );
+    }
+}
+
+
+static void add_tips( uint32_t tips, time_t now )
+{
+    // same second as the last one, or no room for another: it goes in with the newest instead
+    rain_tip* newest = s_head != s_day ? &s_tips[(s_head - 1) & kRainTipSlotMask] : NULL;
+    if( newest && newest->when == (uint32_t)now )
+        newest->tips += tips;
+    else
+    {
+        if( s_head - s_day == kRainTipSlots )
+        {
+            // fold the oldest tip into the next one, it'll fall out of the day a little late but none of it gets lost
+            rain_tip* oldest = &s_tips[s_day & kRainTipSlotMask];
+            s_tips[(s_day + 1) & kRainTipSlotMask].tips += oldest->tips;
+            if( s_hour == s_day )
+                ++s_hour;
+            else if( s_hour == s_day + 1 )
+                s_hour_tips += oldest->tips;        // they're inside the hour now, they have to come back out with it
+            ++s_day;
+        }
+        s_tips[s_head & kRainTipSlotMask] = (rain_tip){ (uint32_t)now, tips };
+        ++s_head;
+        ++s_stats.events;
+    }
+
+    s_hour_tips     += tips;
+    s_day_tips      += tips;
+    s_midnight_tips += tips;
+    s_stats.tips    += tips;
+
+    // a tip after a dry spell doesn't say anything about the rate yet
+    if( s_last_tip && now - s_last_tip <= kRainRateTimeout )
+        s_tip_secs = (double)(now > s_last_tip ? now - s_last_tip : 1) / tips;
+    else
+        s_tip_secs = 0;
+    s_last_tip = now;
+}
+
+
+// how many tips since last, false if the count can't be believed
+static bool tips_since( uint32_t last, uint32_t count, uint32_t* tips )
+{
+    if( count >= last )
+    {
+        *tips = count - last;
+        return *tips <= kRainMaxJump;
+    }
+
+    // rolled over, whichever size the counter is
+    if( last < kRainCounter24 && count + kRainCounter24 - last <= kRainMaxJump )
+    {
+        ++s_stats.wraps;
+        *tips = count + kRainCounter24 - last;
+        return true;
+    }
+    if( count - last <= kRainMaxJump )
+    {
+        ++s_stats.wraps;
+        *tips = count - last;
+        return true;
+    }
+
+    // a drop to a small count looks just like a sensor restart but one bad read does it too, so that waits for the next report
+    return false;
+}
+
+
+void rain_accum_count( uint32_t rawCount, time_t now )
+{
+    pthread_mutex_lock( &s_mutex );
+    ++s_stats.reports;
+    advance( now );
+
+    if( !s_have_count )
+    {
+        s_have_count = true;
+        s_last_count = rawCount;
+        s_started    = now;
+        pthread_mutex_unlock( &s_mutex );
+        return;
+    }
+
+    uint32_t tips = 0;
+    if( tips_since( s_last_count, rawCount, &tips ) )
+    {
+        s_have_suspect = false;
+        s_last_count   = rawCount;
+        if( tips )
+            add_tips( tips, now );
+    }
+    else if( s_have_suspect && tips_since( s_suspect, rawCount, &tips ) )
+    {
+        // two in a row agree, it's a different count now (the sensor restarted, a new sensor...) but only what came after the first is rain
+        if( s_suspect < s_last_count )
+            log_error( "rain_accum: the gauge went from %u back to %u, it must have restarted\n", s_last_count, s_suspect );
+        else
+            log_error( "rain_accum: the gauge's count moved from %u to %u, starting over from there\n", s_last_count, s_suspect );
+        ++s_stats.resets;
+        s_have_suspect = false;
+        s_last_count   = rawCount;
+        if( tips )
+            add_tips( tips, now );
+    }
+    else
+    {
+        log_error_throttled( "rain_accum: ignoring a rain count of %u, the last one was %u\n", rawCount, s_last_count );
+        ++s_stats.rejected;
+        s_have_suspect = true;
+        s_suspect      = rawCount;
+    }
+    pthread_mutex_unlock( &s_mutex );
+}
+
+
+
+#pragma mark -
+
+static double rate( time_t now )
+{
+    if( !s_last_tip || now < s_last_tip || now - s_last_tip > kRainRateTimeout )
+        return 0;
+
+    // the time between the last two tips, or longer if the next one is overdue so the rate trails off when the rain stops
+    double secs = s_tip_secs ? s_tip_secs : kRainRateTimeout;
+    if( now - s_last_tip > secs )
+        secs = (double)(now - s_last_tip);
+    return rawRainCount2inches( 1 ) * 3600.0 / secs;
+}
+
+
+bool rain_accum_get_totals( time_t now, rain_totals* totals )
+{
+    if( !totals )
+        return false;
+
+    memset( totals, 0, sizeof( rain_totals ) );
+    pthread_mutex_lock( &s_mutex );
+    advance( now );
+
+    bool   counting = s_have_count;
+    time_t elapsed  = now - s_started;
+    time_t today    = now - s_midnight;
+
+    totals->lastHour          = s_hour_tips;
+    totals->last24Hours       = s_day_tips;
+    totals->sinceMidnight     = s_midnight_tips;
+    totals->hourValid         = counting && elapsed >= s_hour_secs;
+    totals->dayValid          = counting && elapsed >= s_day_secs;
+    totals->midnightValid     = counting && s_started <= s_midnight;
+    totals->rateInchesPerHour = rate( now );
+    pthread_mutex_unlock( &s_mutex );
+
+    return counting && elapsed >= (today < s_hour_secs ? today : s_hour_secs);
+}
+
+
+void rain_accum_get_stats( rain_accum_stats* stats )
+{
+    if( !stats )
+        return;
+
+    pthread_mutex_lock( &s_mutex );
+    *stats          = s_stats;
+    stats->buffered = (uint32_t)(s_head - s_day);
+    pthread_mutex_unlock( &s_mutex );
+}
+
+
+void rain_accum_command( FILE* out, const char* args, void* context )
+{
+    rain_totals totals;
+    bool        ready = rain_accum_get_totals( wx_clock_now(), &totals );
+
+    fprintf( out, "last hour: %0.2f in%s, last 24 hours: %0.2f in%s, since midnight: %0.2f in%s\n",
+             rawRainCount2inches( totals.lastHour ),      totals.hourValid     ? "" : " (not a whole hour yet)",
+             rawRainCount2inches( totals.last24Hours ),   totals.dayValid      ? "" : " (not a whole day yet)",
+             rawRainCount2inches( totals.sinceMidnight ), totals.midnightValid ? "" : " (only since we started)" );
+    fprintf( out, "rate: %0.2f in/hr%s\n", totals.rateInchesPerHour, ready ? "" : ", not reporting yet" );
+
+    rain_accum_stats stats;
+    rain_accum_get_stats( &stats );
+    fprintf( out, "reports: %llu, tips: %llu, events: %llu (%u buffered), wraps: %u, resets: %u, rejected: %u\n", (unsigned long long)stats.reports,
+             (unsigned long long)stats.tips, (unsigned long long)stats.events, stats.buffered, stats.wraps, stats.resets, stats.rejected );
+}
+
+
+void rain_accum_log_stats( void )
+{
+    rain_accum_stats stats;
+    rain_accum_get_stats( &stats );
+    log_error( "rain: reports: %llu, tips: %llu, events: %llu (%u buffered), wraps: %u, resets: %u, rejected: %u\n", (unsigned long long)stats.reports,
+               (unsigned long long)stats.tips, (unsigned long long)stats.events, stats.buffered, stats.wraps, stats.resets, stats.rejected );
+}
@@ -0,0 +1,57 @@
+//
+//  rain_accum.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_rain_accum
+#define _H_rain_accum
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#define kRainTipSlots       4096        // must be a power of two, a day of tips would take 2 meters of rain to fill it
+#define kRainMaxJump        200         // tips between two reports we'll believe (100 mm), more than that is a bad read or a new sensor
+#define kRainRateTimeout    (15 * 60)   // no tip in this long and it isn't raining
+
+typedef struct
+{
+    uint32_t lastHour;                  // tips, see rawRainCount2inches()
+    uint32_t last24Hours;
+    uint32_t sinceMidnight;
+    bool     hourValid;                 // we've been counting for the whole window
+    bool     dayValid;
+    bool     midnightValid;
+    double   rateInchesPerHour;
+} rain_totals;
+
+typedef struct
+{
+    uint64_t reports;                   // counts handed to rain_accum_count()
+    uint64_t tips;
+    uint64_t events;                    // slots used, tips in the same second share one
+    uint32_t wraps;                     // the sensor's counter rolled over
+    uint32_t resets;                    // the count went backwards or jumped and the next report agreed, we count from there
+    uint32_t rejected;                  // counts we didn't believe, at least until the next one agreed
+    uint32_t buffered;                  // tip events in the ring right now
+} rain_accum_stats;
+
+// the hour and day windows are shorter in test mode
+void rain_accum_init( time_t hourSecs, time_t daySecs );
+
+// every count the gauge reports, changed or not, now is wx_clock_now() time.  the wxlog's counts come back through here
+// oldest first after a restart, so the windows carry on from where they were
+void rain_accum_count( uint32_t rawCount, time_t now );
+
+// false until we've been counting for the shortest window (an hour, or since midnight if that's sooner)
+bool rain_accum_get_totals( time_t now, rain_totals* totals );
+
+void rain_accum_get_stats( rain_accum_stats* stats );
+void rain_accum_command( FILE* out, const char* args, void* context );
+void rain_accum_log_stats( void );
+
+#endif // !_H_rain_accum
@@ -22,6 +22,12 @@
 #include <signal.h>
 
 #include "main.h"
+#include "capture.h"
+#include "input.h"
+#include "logging.h"
+#include "metrics.h"
+#include "rain_accum.h"
+#include "wx_clock.h"
 #include "wx_thread.h"
 #include "TXDecoderFrame.h"
 
@@ -36,6 +42,7 @@ void process_rain_frame( RainFrame* frame )
         return;
     
     s_raw_rain_count = frame->raw_rain_count;
+    rain_accum_count( frame->raw_rain_count, wx_clock_now() );
     
     if( debug_mode() )
         log_error( "rain_sensor: raw rain message: %d\n\n", frame->raw_rain_count );
@@ -45,48 +52,58 @@ void process_rain_frame( RainFrame* frame )
 
 wx_thread_return_t rain_sensor_thread( void* args )
 {
-    if( !args )
+    input_source* input = args ? input_create( (const char*)args, kCapture_rain, 0, B115200 ) : NULL;
+    if( !input )
     {
         log_error( "rain_sensor_thread failed to startup, no device...\n" );
         wx_thread_return();
     }
-    
-    int fd = open_serial_port( (const char*)args, B115200 );
-    if( fd < 0 )
-    {
-        log_error( "rain_sensor_thread failed to open serial port: %s...\n", (const char*)args );
-        wx_thread_return();
-    }
 
     log_error( "rain_sensor_thread running: %s...\n", (const char*)args );
 
-    ssize_t result = 0;
+    input_framer framer;
+    input_framer_init( &framer, sizeof( RainFrame ), NULL );     // no CRC, nothing to line back up on
     while( !s_quit )
     {
-        RainFrame frame;
+        uint8_t  chunk[4 * sizeof( RainFrame )];
+        uint64_t micros = 0;
+        ssize_t  result = input_read( input, chunk, sizeof( chunk ), 1000, &micros );
+
+        // the gauge sends its count every few seconds, the rest of a frame won't be along later than that
+        size_t stale = input_framer_expire( &framer, metrics_now_us(), kInputPartialUs );
+        if( stale )
+            log_error_throttled( " bad frame size on incoming rain sensor data %zu != %zu\n", stale, sizeof( RainFrame )  );
+
+        if( result < 0 )
+            input_framer_reset( &framer );
+        if( result <= 0 )
+            continue;
 
-        result = read( fd, &frame, sizeof( frame ) );
-        if( result == sizeof( frame ) )
+        capture_chunk( kCapture_rain, 0, chunk, result );
+
+        bool partial = false;
+        for( size_t used = 0; used < (size_t)result; )
+        {
+            bool complete = false;
+            used += input_framer_add( &framer, &chunk[used], result - used, micros, &complete );
+            partial = !complete;
+            if( !complete )
+                break;
+
+            RainFrame frame;
+            memcpy( &frame, framer.bytes, sizeof( RainFrame ) );
             process_rain_frame( &frame );
-        else if( result )
+        }
+
+        if( partial )
         {
+            metrics_count( kCounter_partial_reads_rain );
             if( debug_mode() )
-                log_error( " partial incoming rain sensor data %d (%d)\n", result, sizeof( frame )  );
-
-            // we most likely have received a partially transmitted frame, try to do another read now to get the remainder of it
-            sleep( 1 );
-            uint8_t* partialFrame = (uint8_t*)&frame;
-            uint8_t  lastRead = result;
-            result = read( fd, &partialFrame[lastRead], sizeof( frame ) - lastRead );
-            if( result + lastRead == sizeof( frame ) )
-                process_rain_frame( &frame );
-            else
-                log_error( " bad frame size on incoming rain sensor data %d != %d\n", result, sizeof( frame )  );
+                log_error_throttled( " partial incoming rain sensor data %zd (%zu)\n", result, sizeof( RainFrame )  );
         }
-        
-        sleep( 1 );
     }
-        
+
+    input_destroy( input );
     wx_thread_return();
 }
 
@@ -12,7 +12,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "TXDecoderFrame.h"
+
 wx_thread_return_t rain_sensor_thread( void* args );
+void               process_rain_frame( RainFrame* frame );
 void               rain_sensor_thread_quit( void );
 int                rain_sensor_raw_count( void );
 
@@ -0,0 +1,508 @@
+//
+//  receivers.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  One reader thread per tx31u receiver (--device, as many as kMaxReceivers), all feeding one merge stage that the main loop
+//  pulls from.  A receiver can be anything input.c knows how to read: a serial port, a remote receiver over TCP, a capture...
+//  The readers put partial reads back together, capture the raw bytes and drop whole frames into a bounded multi-
+//  producer, single consumer ring (the same one logging.c uses).  The ingest server's nodes all count as one more receiver that
+//  pushes its own frames into the same ring.  With receivers in different spots the same transmission shows
+//  up more than once, so the merge keys every good frame on its station_id and a hash of what came over the air and remembers it
+//  for kDedupeWindowMs in a direct mapped table: one probe, nothing to clean up, and a collision only costs us a duplicate.  Only
+//  the TX31U's own fields go in the hash, the receiver boards fill in their own pressure, inside temp and air quality so those
+//  differ between copies of the same transmission.
+//
+//  Each receiver keeps score: frames, who got there first, duplicates, CRC errors and partials, that's how we tell whether
+//  another receiver is adding coverage or just echoing the first one.
+//
+
+#include <errno.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+
+#include "main.h"
+#include "receivers.h"
+#include "capture.h"
+#include "input.h"
+#include "logging.h"
+#include "metrics.h"
+#include "stations.h"
+#include "wx_thread.h"
+#include "wx_clock.h"
+
+
+#define kMergeSlots         256         // must be a power of two
+#define kMergeSlotMask      (kMergeSlots - 1)
+#define kDedupeSlots        4096        // must be a power of two, a window's worth of frames is a handful
+#define kDedupeSlotMask     (kDedupeSlots - 1)
+#define kReadChunk          (4 * sizeof( Frame ))
+
+_Static_assert( sizeof( Frame ) <= kInputFrameMax, "the framer can't hold a whole Frame" );
+
+
+typedef struct
+{
+    const char*          device;
+    input_source*        input;
+    int                  index;
+    atomic_bool          open;
+    atomic_uint_fast64_t reads;
+    atomic_uint_fast64_t frames;
+    atomic_uint_fast64_t short_frames;
+    atomic_uint_fast64_t bad_crc;
+    atomic_uint_fast64_t first;
+    atomic_uint_fast64_t duplicates;
+    atomic_uint_fast64_t dropped;
+    atomic_llong         last_frame;
+    wx_thread_t          thread;
+} receiver;
+
+typedef struct
+{
+    atomic_size_t sequence;
+    int           receiver;
+    uint64_t      read_us;      // when the first byte of it came in
+    Frame         frame;
+} merge_slot;
+
+typedef struct
+{
+    uint64_t key;
+    uint64_t expires_us;
+} dedupe_entry;
+
+
+static receiver      s_receivers[kMaxReceivers];
+static int           s_count    = 0;
+static atomic_bool   s_shutdown = false;
+static bool          s_started  = false;
+
+static merge_slot    s_ring[kMergeSlots];
+static atomic_size_t s_head = 0;        // next slot to claim
+static size_t        s_tail = 0;        // next slot to merge, only the main loop touches this
+static sem_t         s_ready;           // one post per frame in the ring
+
+static dedupe_entry  s_dedupe[kDedupeSlots];    // only the main loop touches this either
+
+
+
+#pragma mark -
+
+bool receivers_add( const char* device )
+{
+    if( !device || !*device || s_started )
+        return false;
+
+    if( s_count >= kMaxReceivers )
+    {
+        printf( "too many receivers, %s is more than %d\n", device, kMaxReceivers );
+        return false;
+    }
+
+    input_source* input = input_create( device, kCapture_wx, s_count, B9600 );
+    if( !input )
+        return false;
+
+    receiver* rx = &s_receivers[s_count];
+    rx->device = device;
+    rx->input  = input;
+    rx->index  = s_count++;
+    return true;
+}
+
+
+int receivers_add_remote( const char* name )
+{
+    if( !name || !*name || s_started || s_count >= kMaxReceivers )
+        return -1;
+
+    // no input and no reader thread, whoever added it pushes its frames
+    receiver* rx = &s_receivers[s_count];
+    rx->device = name;
+    rx->index  = s_count++;
+    atomic_store( &rx->open, true );
+    return rx->index;
+}
+
+
+int receivers_count( void )
+{
+    return s_count;
+}
+
+
+static bool push_frame( receiver* rx, const Frame* frame, uint64_t read_us )
+{
+    size_t      pos  = atomic_load_explicit( &s_head, memory_order_relaxed );
+    merge_slot* slot = NULL;
+    while( 1 )
+    {
+        slot = &s_ring[pos & kMergeSlotMask];
+        size_t   sequence = atomic_load_explicit( &slot->sequence, memory_order_acquire );
+        intptr_t diff     = (intptr_t)sequence - (intptr_t)pos;
+        if( diff == 0 )
+        {
+            if( atomic_compare_exchange_weak_explicit( &s_head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed ) )
+                break;
+        }
+        else if( diff < 0 )
+        {
+            // the main loop is a whole ring behind, the reader doesn't wait on it
+            atomic_fetch_add_explicit( &rx->dropped, 1, memory_order_relaxed );
+            return false;
+        }
+        else
+            pos = atomic_load_explicit( &s_head, memory_order_relaxed );
+    }
+
+    slot->receiver = rx->index;
+    slot->read_us  = read_us;
+    slot->frame    = *frame;
+    atomic_store_explicit( &slot->sequence, pos + 1, memory_order_release );
+    sem_post( &s_ready );
+    return true;
+}
+
+
+static wx_thread_return_t receiver_thread( void* args )
+{
+    receiver*    rx = (receiver*)args;
+    input_framer framer;
+    input_framer_init( &framer, sizeof( Frame ), receivers_frame_ok );
+
+    while( !atomic_load( &s_shutdown ) )
+    {
+        uint8_t  chunk[kReadChunk];
+        uint64_t micros = 0;
+        ssize_t  result = input_read( rx->input, chunk, sizeof( chunk ), 1000, &micros );
+        atomic_store( &rx->open, input_is_open( rx->input ) );
+
+        size_t stale = input_framer_expire( &framer, metrics_now_us(), kInputPartialUs );
+        if( stale )
+        {
+            atomic_fetch_add_explicit( &rx->short_frames, 1, memory_order_relaxed );
+            metrics_count( kCounter_frames_short );
+            log_error_throttled( " bad frame size on incoming wx sensor data %zu != %zu from %s\n", stale, sizeof( Frame ), rx->device );
+        }
+
+        // whatever we had of a frame went with the connection
+        if( result < 0 )
+            input_framer_reset( &framer );
+        if( result <= 0 )
+            continue;
+
+        capture_chunk( kCapture_wx, rx->index, chunk, result );
+        atomic_fetch_add_explicit( &rx->reads, 1, memory_order_relaxed );
+
+        // a socket can hand us several frames at once, a serial port usually hands us pieces of one
+        bool partial = false;
+        for( size_t used = 0; used < (size_t)result; )
+        {
+            bool complete = false;
+            used += input_framer_add( &framer, &chunk[used], result - used, micros, &complete );
+            partial = !complete;
+            if( !complete )
+                break;
+
+            if( framer.skipped )
+                log_error_throttled( " skipped %zu bytes from %s to find the start of a frame\n", framer.skipped, rx->device );
+
+            Frame frame;
+            memcpy( &frame, framer.bytes, sizeof( Frame ) );
+            atomic_fetch_add_explicit( &rx->frames, 1, memory_order_relaxed );
+            atomic_store_explicit( &rx->last_frame, wx_clock_now(), memory_order_relaxed );
+            push_frame( rx, &frame, framer.first_us );
+        }
+        if( partial )
+            metrics_count( kCounter_partial_reads_wx );
+    }
+
+    wx_thread_return();
+}
+
+
+bool receivers_push( int index, const Frame* frame, uint64_t readMicros )
+{
+    if( !s_started || index < 0 || index >= s_count || !frame )
+        return false;
+
+    receiver* rx = &s_receivers[index];
+    atomic_fetch_add_explicit( &rx->frames, 1, memory_order_relaxed );
+    atomic_store_explicit( &rx->last_frame, wx_clock_now(), memory_order_relaxed );
+    return push_frame( rx, frame, readMicros );
+}
+
+
+bool receivers_start( void )
+{
+    if( s_started || !s_count )
+        return false;
+
+    for( size_t i = 0; i < kMergeSlots; i++ )
+        atomic_init( &s_ring[i].sequence, i );
+    sem_init( &s_ready, 0, 0 );
+
+    for( int i = 0; i < s_count; i++ )
+        if( s_receivers[i].input )
+            s_receivers[i].thread = wx_create_thread( receiver_thread, &s_receivers[i] );
+    s_started = true;
+    return true;
+}
+
+
+void receivers_shutdown( void )
+{
+    if( !s_started )
+        return;
+
+    // the readers notice within a read timeout
+    atomic_store( &s_shutdown, true );
+    for( int i = 0; i < s_count; i++ )
+    {
+        if( !s_receivers[i].input )
+            continue;
+        wx_thread_join( s_receivers[i].thread );
+        input_destroy( s_receivers[i].input );
+        s_receivers[i].input = NULL;
+    }
+    s_started = false;
+}
+
+
+
+#pragma mark -
+
+// FNV-1a over what the sensor sent, none of what the receiver board added
+static uint64_t frame_key( const Frame* frame )
+{
+    struct
+    {
+        uint8_t station_id;
+        uint8_t flags;
+        float   tempC;
+        uint8_t humidity;
+        float   windSpeedMs;
+        float   windDirection;
+        float   windGustMs;
+        float   rain;
+    } __attribute__ ((__packed__)) radio = { frame->station_id, frame->flags & kRadioFlags, frame->tempC, frame->humidity, frame->windSpeedMs,
+                                             frame->windDirection, frame->windGustMs, frame->rain };
+
+    const uint8_t* p    = (const uint8_t*)&radio;
+    uint64_t       hash = 14695981039346656037ull;
+    for( size_t i = 0; i < sizeof( radio ); i++ )
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+static bool seen_recently( uint64_t key, uint64_t now_us )
+{
+    dedupe_entry* entry = &s_dedupe[key & kDedupeSlotMask];
+    if( entry->key == key && now_us < entry->expires_us )
+        return true;
+
+    entry->key        = key;
+    entry->expires_us = now_us + kDedupeWindowMs * 1000ull;
+    return false;
+}
+
+
+static bool wait_for_frame( int timeoutMs )
+{
+    if( timeoutMs <= 0 )
+        return sem_trywait( &s_ready ) == 0;
+
+    struct timespec until;
+    clock_gettime( CLOCK_REALTIME, &until );
+    until.tv_sec  += timeoutMs / 1000;
+    until.tv_nsec += (timeoutMs % 1000) * 1000000L;
+    if( until.tv_nsec >= 1000000000L )
+    {
+        until.tv_sec  += 1;
+        until.tv_nsec -= 1000000000L;
+    }
+
+    int result;
+    while( (result = sem_timedwait( &s_ready, &until )) == -1 && errno == EINTR )
+        ;
+    return result == 0;
+}
+
+
+bool receivers_frame_ok( const uint8_t* bytes, size_t size )
+{
+    if( size != sizeof( Frame ) )
+        return false;
+
+    Frame check;
+    memcpy( &check, bytes, sizeof( Frame ) );
+    check.CRC = 0;
+    return calculate_crc( (uint8_t*)&check, sizeof( Frame ) ) == ((const Frame*)bytes)->CRC;
+}
+
+
+bool receivers_next( Frame* frame, uint64_t* readMicros, int timeoutMs )
+{
+    if( !s_started || !frame )
+        return false;
+
+    while( wait_for_frame( timeoutMs ) )
+    {
+        // the post means a frame is in, but with more than one reader the slot at the tail might still be getting filled in
+        merge_slot* slot = &s_ring[s_tail & kMergeSlotMask];
+        while( atomic_load_explicit( &slot->sequence, memory_order_acquire ) != s_tail + 1 )
+            sched_yield();
+
+        receiver* rx = &s_receivers[slot->receiver];
+        *frame = slot->frame;
+        if( readMicros )
+            *readMicros = slot->read_us;
+        uint64_t read_us = slot->read_us;
+
+        atomic_store_explicit( &slot->sequence, s_tail + kMergeSlots, memory_order_release );
+        ++s_tail;
+
+        // CRC failures go on through so they get counted and logged like always, but they can't be trusted to match anything
+        if( !receivers_frame_ok( (const uint8_t*)frame, sizeof( Frame ) ) )
+        {
+            atomic_fetch_add_explicit( &rx->bad_crc, 1, memory_order_relaxed );
+            return true;
+        }
+
+        if( seen_recently( frame_key( frame ), read_us ) )
+        {
+            atomic_fetch_add_explicit( &rx->duplicates, 1, memory_order_relaxed );
+            continue;
+        }
+
+        atomic_fetch_add_explicit( &rx->first, 1, memory_order_relaxed );
+        return true;
+    }
+    return false;
+}
+
+
+
+#pragma mark -
+
+bool receivers_get_stats( int index, receiver_stats* stats )
+{
+    if( index < 0 || index >= s_count || !stats )
+        return false;
+
+    receiver* rx = &s_receivers[index];
+    stats->device       = rx->device;
+    stats->open         = atomic_load( &rx->open );
+    stats->reads        = atomic_load_explicit( &rx->reads, memory_order_relaxed );
+    stats->frames       = atomic_load_explicit( &rx->frames, memory_order_relaxed );
+    stats->short_frames = atomic_load_explicit( &rx->short_frames, memory_order_relaxed );
+    stats->bad_crc      = atomic_load_explicit( &rx->bad_crc, memory_order_relaxed );
+    stats->first        = atomic_load_explicit( &rx->first, memory_order_relaxed );
+    stats->duplicates   = atomic_load_explicit( &rx->duplicates, memory_order_relaxed );
+    stats->dropped      = atomic_load_explicit( &rx->dropped, memory_order_relaxed );
+    stats->last_frame   = (time_t)atomic_load_explicit( &rx->last_frame, memory_order_relaxed );
+    return true;
+}
+
+
+// good frames that only this one heard, or heard first, out of everything we kept
+static double coverage( const receiver_stats* stats, uint64_t kept )
+{
+    return kept ? 100.0 * stats->first / kept : 0;
+}
+
+
+static uint64_t frames_kept( void )
+{
+    uint64_t kept = 0;
+    for( int i = 0; i < s_count; i++ )
+        kept += atomic_load_explicit( &s_receivers[i].first, memory_order_relaxed );
+    return kept;
+}
+
+
+void receivers_command( FILE* out, const char* args, void* context )
+{
+    uint64_t kept = frames_kept();
+    time_t   now  = wx_clock_now();
+
+    fprintf( out, "device                 open   frames    first  dupes  bad crc  short  dropped  first %%  last frame\n" );
+    for( int i = 0; i < s_count; i++ )
+    {
+        receiver_stats stats;
+        receivers_get_stats( i, &stats );
+
+        char seen[16] = "never";
+        if( stats.last_frame )
+            snprintf( seen, sizeof( seen ), "%lds ago", (long)(now - stats.last_frame) );
+        fprintf( out, "%-21s  %-4s  %7llu  %7llu  %5llu  %7llu  %5llu  %7llu  %6.1f  %s\n", stats.device, stats.open ? "yes" : "no", (unsigned long long)stats.frames,
+                 (unsigned long long)stats.first, (unsigned long long)stats.duplicates, (unsigned long long)stats.bad_crc, (unsigned long long)stats.short_frames,
+                 (unsigned long long)stats.dropped, coverage( &stats, kept ), seen );
+    }
+}
+
+
+void receivers_log_stats( void )
+{
+    uint64_t kept = frames_kept();
+    for( int i = 0; i < s_count; i++ )
+    {
+        receiver_stats stats;
+        receivers_get_stats( i, &stats );
+        log_error( "receiver %s: frames: %llu, first: %llu (%0.1f%%), duplicates: %llu, bad crc: %llu, short: %llu, dropped: %llu\n", stats.device,
+                   (unsigned long long)stats.frames, (unsigned long long)stats.first, coverage( &stats, kept ), (unsigned long long)stats.duplicates,
+                   (unsigned long long)stats.bad_crc, (unsigned long long)stats.short_frames, (unsigned long long)stats.dropped );
+    }
+}
+
+
+static double frames_value( void* context )
+{
+    return atomic_load_explicit( &s_receivers[(intptr_t)context].frames, memory_order_relaxed );
+}
+
+
+static double first_value( void* context )
+{
+    return atomic_load_explicit( &s_receivers[(intptr_t)context].first, memory_order_relaxed );
+}
+
+
+static double duplicates_value( void* context )
+{
+    return atomic_load_explicit( &s_receivers[(intptr_t)context].duplicates, memory_order_relaxed );
+}
+
+
+void receivers_add_metrics( void )
+{
+    static char frames[kMaxReceivers][128];
+    static char first[kMaxReceivers][128];
+    static char duplicates[kMaxReceivers][128];
+
+    for( intptr_t i = 0; i < s_count; i++ )
+    {
+        snprintf( frames[i],     sizeof( frames[i] ),     "wxrelay_receiver_frames_total{receiver=\"%s\"}",     s_receivers[i].device );
+        snprintf( first[i],      sizeof( first[i] ),      "wxrelay_receiver_first_total{receiver=\"%s\"}",      s_receivers[i].device );
+        snprintf( duplicates[i], sizeof( duplicates[i] ), "wxrelay_receiver_duplicates_total{receiver=\"%s\"}", s_receivers[i].device );
+    }
+
+    // one family at a time so the HELP lines come out right
+    for( intptr_t i = 0; i < s_count; i++ )
+        metrics_add_value( frames[i], "counter", "Whole frames read from each receiver", frames_value, (void*)i );
+    for( intptr_t i = 0; i < s_count; i++ )
+        metrics_add_value( first[i], "counter", "Frames each receiver delivered before any other", first_value, (void*)i );
+    for( intptr_t i = 0; i < s_count; i++ )
+        metrics_add_value( duplicates[i], "counter", "Frames another receiver had already delivered", duplicates_value, (void*)i );
+}
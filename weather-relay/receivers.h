@@ -0,0 +1,56 @@
+//
+//  receivers.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_receivers
+#define _H_receivers
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "TXDecoderFrame.h"
+
+#define kMaxReceivers       4
+#define kDedupeWindowMs     2000        // well under the TX31U's 5 seconds between transmissions
+
+typedef struct
+{
+    const char* device;
+    bool        open;
+    uint64_t    reads;
+    uint64_t    frames;         // whole frames read
+    uint64_t    short_frames;   // partial frames that never finished
+    uint64_t    bad_crc;
+    uint64_t    first;          // frames this receiver got to the merge before any other
+    uint64_t    duplicates;     // frames another receiver already delivered
+    uint64_t    dropped;        // the merge was a whole queue behind
+    time_t      last_frame;
+} receiver_stats;
+
+bool receivers_add( const char* device );
+
+// a receiver without a reader thread of its own (the ingest server's nodes), returns its index for receivers_push() or -1
+int  receivers_add_remote( const char* name );
+bool receivers_push( int receiver, const Frame* frame, uint64_t readMicros );
+int  receivers_count( void );
+bool receivers_start( void );
+void receivers_shutdown( void );
+
+// a whole Frame whose CRC checks out, the framers use it to find where frames start again after a bad one
+bool receivers_frame_ok( const uint8_t* bytes, size_t size );
+
+// the next frame that hasn't already come in on another receiver, false if nothing showed up in timeoutMs
+bool receivers_next( Frame* frame, uint64_t* readMicros, int timeoutMs );
+
+bool receivers_get_stats( int receiver, receiver_stats* stats );
+void receivers_command( FILE* out, const char* args, void* context );
+void receivers_log_stats( void );
+void receivers_add_metrics( void );
+
+#endif // !_H_receivers
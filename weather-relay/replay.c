@@ -0,0 +1,175 @@
+//
+//  replay.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Feeds a capture (see capture.c) back through the relay under virtual time.  The clock jumps to each read's wall clock time
+//  and steps a second at a time in between so the scheduler sees every second it would have live.  At 1000x a day takes under a
+//  minute and a half, at 0 it goes as fast as the processing allows.
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "replay.h"
+#include "wx_clock.h"
+
+
+typedef struct
+{
+    struct timespec start;
+    double          speed;
+    time_t          first;
+} replay_pace;
+
+
+
+static double elapsed_secs( const struct timespec* start )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+// sleeps off however far ahead of speed we are
+static void pace( const replay_pace* p, time_t now )
+{
+    if( p->speed <= 0 )
+        return;
+
+    double ahead = (now - p->first) / p->speed - elapsed_secs( &p->start );
+    if( ahead <= 0 )
+        return;
+
+    struct timespec ts = { (time_t)ahead, (long)((ahead - (time_t)ahead) * 1e9) };
+    while( nanosleep( &ts, &ts ) == -1 && errno == EINTR )
+        ;
+}
+
+
+// "file" or "file:speed"
+bool replay_parse_option( const char* arg, char* path, size_t pathSize, double* speed )
+{
+    if( !arg || !*arg || !path || !pathSize || !speed )
+        return false;
+
+    *speed = kReplayDefaultSpeed;
+
+    const char* colon = strrchr( arg, ':' );
+    size_t      len   = colon ? (size_t)(colon - arg) : strlen( arg );
+    if( colon )
+    {
+        char*  end   = NULL;
+        double value = strtod( colon + 1, &end );
+        if( end == colon + 1 || *end || value < 0 )
+            return false;
+        *speed = value;
+    }
+
+    if( !len || len >= pathSize )
+        return false;
+    memcpy( path, arg, len );
+    path[len] = '\0';
+    return true;
+}
+
+
+// so the clock can be set before anything else asks it the time
+time_t replay_start_time( const char* path )
+{
+    capture_reader* reader = capture_open( path );
+    if( !reader )
+        return 0;
+
+    capture_record record;
+    uint8_t        data[kCaptureChunkMax];
+    time_t         start = capture_next( reader, &record, data, sizeof( data ) ) > 0 ? (time_t)(record.wall_us / 1000000) : 0;
+    capture_close( reader );
+    return start;
+}
+
+
+// the relay needs a receiver for each one the capture heard from before it starts
+int replay_channels( const char* path, capture_source source )
+{
+    capture_reader* reader = capture_open( path );
+    if( !reader )
+        return 0;
+
+    capture_record record;
+    uint8_t        data[kCaptureChunkMax];
+    int            channels = 0;
+    while( capture_next( reader, &record, data, sizeof( data ) ) > 0 )
+        if( record.source == source && record.channel >= channels )
+            channels = record.channel + 1;
+    capture_close( reader );
+    return channels;
+}
+
+
+bool replay_run( const char* path, double speed, replay_chunk_fn chunk, replay_tick_fn tick, void* context, replay_stats* stats )
+{
+    if( !path || !chunk || !tick )
+        return false;
+
+    replay_stats local;
+    if( !stats )
+        stats = &local;
+    memset( stats, 0, sizeof( replay_stats ) );
+
+    capture_reader* reader = capture_open( path );
+    if( !reader )
+        return false;
+
+    replay_pace p = { .speed = speed };
+    clock_gettime( CLOCK_MONOTONIC, &p.start );
+
+    capture_record record;
+    uint8_t        data[kCaptureChunkMax];
+    int            length  = 0;
+    time_t         now     = 0;
+    bool           running = true;
+    while( running && (length = capture_next( reader, &record, data, sizeof( data ) )) > 0 )
+    {
+        time_t when = (time_t)(record.wall_us / 1000000);
+        if( !stats->records )
+        {
+            now = p.first = stats->first = when;
+            wx_clock_set( now );
+        }
+
+        // the rest of the second the last read came in, then every second up to this one
+        while( now < when && running )
+        {
+            running = tick( now, context );
+            ++stats->ticks;
+            wx_clock_set( ++now );
+            pace( &p, now );
+        }
+
+        // the clock never goes backwards (NTP stepping it back while we were capturing), the read just goes in now
+        if( running )
+        {
+            chunk( &record, data, context );
+            ++stats->records;
+            stats->bytes += length;
+            stats->last   = now;
+        }
+    }
+
+    if( running && stats->records )
+    {
+        tick( now, context );
+        ++stats->ticks;
+    }
+
+    stats->real_secs = elapsed_secs( &p.start );
+    capture_close( reader );
+    return length >= 0;
+}
@@ -0,0 +1,41 @@
+//
+//  replay.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_replay
+#define _H_replay
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "capture.h"
+
+#define kReplayDefaultSpeed  1000.0
+
+typedef struct
+{
+    uint64_t records;
+    uint64_t bytes;
+    time_t   first;             // virtual time of the first and last reads
+    time_t   last;
+    uint64_t ticks;             // virtual seconds stepped through
+    double   real_secs;
+} replay_stats;
+
+// each captured read goes to chunk at the virtual time it was recorded, tick gets called for every virtual second
+// in between just like the main loop does once a second, returning false from tick stops the replay
+typedef void (*replay_chunk_fn)( const capture_record* record, const uint8_t* data, void* context );
+typedef bool (*replay_tick_fn)( time_t now, void* context );
+
+bool   replay_parse_option( const char* arg, char* path, size_t pathSize, double* speed );     // file[:speed], 0 is flat out
+time_t replay_start_time( const char* path );
+int    replay_channels( const char* path, capture_source source );        // how many receivers of that source it has reads from
+bool   replay_run( const char* path, double speed, replay_chunk_fn chunk, replay_tick_fn tick, void* context, replay_stats* stats );
+
+#endif // !_H_replay
@@ -0,0 +1,270 @@
+//
+//  scheduler.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Hashed timer wheel for all the periodic stuff we send.  One slot per second, jobs hash into the slot for the second they are due
+//  and carry their full due time so a slot can hold jobs from different trips around the wheel.  No two jobs are ever allowed to be
+//  due in the same second and at most one job runs per second, which replaces the old sleep( 1 ) snoozing.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "scheduler.h"
+
+
+#define kWheelSlots   64        // must be a power of two, one slot per second
+#define kWheelMask    (kWheelSlots - 1)
+#define kMaxJobs      16
+#define kLateWarning  2         // complain about jobs that run this many seconds late
+
+
+typedef struct wx_job
+{
+    const char*    name;
+    time_t         period;
+    time_t         jitter;
+    wx_job_entry   entry;
+    void*          context;
+    time_t         nominal;     // when the job should run, without jitter or staggering
+    time_t         due;         // when it's actually going to run
+    time_t         last_run;
+    uint32_t       runs;
+    uint32_t       retries;
+    time_t         last_late;
+    time_t         max_late;
+    uint64_t       total_late;
+    struct wx_job* next;        // the rest of the slot
+} wx_job;
+
+
+static wx_job  s_jobs[kMaxJobs];
+static int     s_num_jobs          = 0;
+static wx_job* s_wheel[kWheelSlots] = {0};
+static time_t  s_current           = 0;     // last second we looked at
+static time_t  s_last_run          = 0;     // last second a job actually ran
+
+
+
+static bool second_taken( time_t due, const wx_job* job )
+{
+    for( wx_job* j = s_wheel[due & kWheelMask]; j; j = j->next )
+        if( j != job && j->due == due )
+            return true;
+    return false;
+}
+
+
+// find the first free second at or after due and put the job in that slot
+static void insert_job( wx_job* job, time_t due )
+{
+    while( second_taken( due, job ) )
+        ++due;
+
+    job->due  = due;
+    job->next = s_wheel[due & kWheelMask];
+    s_wheel[due & kWheelMask] = job;
+}
+
+
+static void remove_job( wx_job* job )
+{
+    wx_job** link = &s_wheel[job->due & kWheelMask];
+    while( *link )
+    {
+        if( *link == job )
+        {
+            *link = job->next;
+            job->next = NULL;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+
+static time_t jitter( const wx_job* job )
+{
+    return job->jitter ? rand() % (job->jitter + 1) : 0;
+}
+
+
+void scheduler_init( time_t now )
+{
+    memset( s_jobs, 0, sizeof( s_jobs ) );
+    memset( s_wheel, 0, sizeof( s_wheel ) );
+    s_num_jobs = 0;
+    s_current  = now;
+    s_last_run = 0;
+}
+
+
+// returns the job number or -1, the first run is at now + phase (+ jitter)
+int scheduler_add_job( const char* name, time_t period, time_t phase, time_t jitter_secs, wx_job_entry entry, void* context )
+{
+    if( !entry || period <= 0 || s_num_jobs >= kMaxJobs )
+    {
+        log_error( "scheduler_add_job: can't add job: %s\n", name ? name : "?" );
+        return -1;
+    }
+
+    wx_job* job  = &s_jobs[s_num_jobs];
+    job->name    = name;
+    job->period  = period;
+    job->jitter  = jitter_secs;
+    job->entry   = entry;
+    job->context = context;
+    job->nominal = s_current + phase;
+
+    insert_job( job, job->nominal + jitter( job ) );
+    return s_num_jobs++;
+}
+
+
+static void run_job( wx_job* job, time_t now )
+{
+    bool done = job->entry( job->context );
+    if( !done )
+    {
+        // not ready, try again next second (the lateness keeps adding up since nominal didn't move)
+        ++job->retries;
+        insert_job( job, now + 1 );
+        return;
+    }
+
+    time_t late = now - job->nominal;
+    job->last_run    = now;
+    job->last_late   = late;
+    job->total_late += late;
+    if( late > job->max_late )
+        job->max_late = late;
+    ++job->runs;
+
+    if( late >= kLateWarning && debug_mode() )
+        log_error( "scheduler: %s ran %ld secs late\n", job->name, (long)late );
+
+    // keep the phase, if we missed whole periods just skip them
+    job->nominal += job->period;
+    if( job->nominal <= now )
+        job->nominal += ((now - job->nominal) / job->period + 1) * job->period;
+
+    insert_job( job, job->nominal + jitter( job ) );
+}
+
+
+// picks the schedule back up after a restart: the next run is one period after the last one, or as soon as we can if that already passed
+bool scheduler_resume_job( int job, time_t last_run )
+{
+    if( job < 0 || job >= s_num_jobs || last_run <= 0 )
+        return false;
+
+    wx_job* j = &s_jobs[job];
+    if( last_run > s_current )
+        return false;   // clock went backwards, just keep the fresh schedule
+
+    remove_job( j );
+    j->last_run = last_run;
+    j->nominal  = last_run + j->period;
+    if( j->nominal <= s_current )
+        j->nominal = s_current + 1;
+
+    insert_job( j, j->nominal );
+    return true;
+}
+
+
+// call this at least once a second, it never blocks (unless a job does)
+void scheduler_run( time_t now )
+{
+    if( now <= s_current )
+        return;
+
+    // gather everything that's due from the slots we haven't looked at yet
+    wx_job* due[kMaxJobs];
+    int     num_due = 0;
+
+    time_t first = s_current + 1;
+    if( now - first >= kWheelSlots )
+        first = now - kWheelSlots + 1;  // been away a whole trip around the wheel, every slot needs a look
+
+    for( time_t t = first; t <= now; t++ )
+    {
+        wx_job* job = s_wheel[t & kWheelMask];
+        while( job )
+        {
+            wx_job* next = job->next;
+            if( job->due <= now )
+            {
+                remove_job( job );
+                due[num_due++] = job;
+            }
+            job = next;
+        }
+    }
+    s_current = now;
+
+    if( !num_due )
+        return;
+
+    // oldest first
+    for( int i = 1; i < num_due; i++ )
+    {
+        wx_job* job = due[i];
+        int     j   = i - 1;
+        for( ; j >= 0 && due[j]->due > job->due; j-- )
+            due[j + 1] = due[j];
+        due[j + 1] = job;
+    }
+
+    // only one job gets to go per second, the rest move down the line
+    int start = 0;
+    if( s_last_run != now )
+    {
+        s_last_run = now;
+        run_job( due[0], now );
+        start = 1;
+    }
+
+    for( int i = start; i < num_due; i++ )
+        insert_job( due[i], now + 1 );
+}
+
+
+int scheduler_job_count( void )
+{
+    return s_num_jobs;
+}
+
+
+bool scheduler_job_stats( int job, wx_job_stats* stats )
+{
+    if( job < 0 || job >= s_num_jobs || !stats )
+        return false;
+
+    const wx_job* j = &s_jobs[job];
+    stats->name       = j->name;
+    stats->period     = j->period;
+    stats->next_due   = j->due;
+    stats->last_run   = j->last_run;
+    stats->runs       = j->runs;
+    stats->retries    = j->retries;
+    stats->last_late  = j->last_late;
+    stats->max_late   = j->max_late;
+    stats->total_late = j->total_late;
+    return true;
+}
+
+
+void scheduler_log_stats( void )
+{
+    for( int i = 0; i < s_num_jobs; i++ )
+    {
+        const wx_job* j = &s_jobs[i];
+        log_error( "scheduler: %-14s every %5lds, runs: %u, retries: %u, late last: %lds, max: %lds, ave: %0.2fs\n", j->name, (long)j->period, j->runs, j->retries, (long)j->last_late, (long)j->max_late, j->runs ? (double)j->total_late / j->runs : 0.0 );
+    }
+}
@@ -0,0 +1,40 @@
+//
+//  scheduler.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_scheduler
+#define _H_scheduler
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// return false if the job couldn't do its thing yet (no data, etc) and it will get another shot next second
+typedef bool (*wx_job_entry)( void* context );
+
+typedef struct
+{
+    const char* name;
+    time_t      period;
+    time_t      next_due;
+    time_t      last_run;       // zero if it hasn't run yet
+    uint32_t    runs;
+    uint32_t    retries;
+    time_t      last_late;      // seconds between when the job was due and when it actually ran
+    time_t      max_late;
+    uint64_t    total_late;
+} wx_job_stats;
+
+void scheduler_init( time_t now );
+int  scheduler_add_job( const char* name, time_t period, time_t phase, time_t jitter, wx_job_entry entry, void* context );
+bool scheduler_resume_job( int job, time_t last_run );
+void scheduler_run( time_t now );
+int  scheduler_job_count( void );
+bool scheduler_job_stats( int job, wx_job_stats* stats );
+void scheduler_log_stats( void );
+
+#endif // !_H_scheduler
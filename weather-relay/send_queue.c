@@ -0,0 +1,349 @@
+//
+//  send_queue.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Outbound packet queues, one per destination.  Producers hand packets off without ever blocking and a single thread per destination
+//  pulls them off and paces them with a token bucket (rate tokens per second, up to burst saved up).  This replaces all the sleep( 1 )
+//  calls that used to be sprinkled around the senders, which blocked whoever called them and didn't help when several threads sent at once.
+//
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "main.h"
+#include "metrics.h"
+#include "send_queue.h"
+#include "wx_clock.h"
+#include "wx_thread.h"
+
+
+#define kMaxQueued  64      // per destination, when it's full the oldest packet goes
+
+
+typedef struct queued_packet
+{
+    char*                 packet;
+    bool                  wide;
+    uint64_t              queued_ms;
+    wx_trace              trace;        // id is zero when it isn't traced
+    struct queued_packet* next;
+} queued_packet;
+
+
+typedef struct
+{
+    const char*      name;
+    bool             running;
+    double           rate;      // tokens per second
+    double           burst;     // most tokens we can save up
+    double           tokens;
+    uint64_t         refill_ms;
+    send_queue_entry entry;
+    pthread_mutex_t  mutex;
+    pthread_cond_t   cond;
+    queued_packet*   head;
+    queued_packet*   tail;
+    send_queue_stats stats;
+} send_queue;
+
+
+static send_queue  s_queues[kDest_count];
+static FILE*       s_recorder = NULL;   // replays write their packets here instead of sending them
+static const char* s_dest_names[kDest_count] = { "aprs-is", "radio" };
+
+
+
+static uint64_t now_ms( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static void refill( send_queue* q, uint64_t now )
+{
+    q->tokens += (now - q->refill_ms) * q->rate / 1000.0;
+    if( q->tokens > q->burst )
+        q->tokens = q->burst;
+    q->refill_ms = now;
+}
+
+
+static wx_thread_return_t send_queue_thread( void* args )
+{
+    send_queue* q = (send_queue*)args;
+
+    pthread_mutex_lock( &q->mutex );
+    while( 1 )
+    {
+        while( !q->head )
+            pthread_cond_wait( &q->cond, &q->mutex );
+
+        uint64_t now = now_ms();
+        refill( q, now );
+
+        if( q->tokens < 1.0 )
+        {
+            // out of tokens, wait (without the lock) until the next one shows up
+            ++q->stats.throttled;
+            uint64_t wait_ms = (uint64_t)((1.0 - q->tokens) * 1000.0 / q->rate) + 1;
+            if( debug_mode() )
+                log_error( "%s: throttled, %u queued, waiting %lu ms\n", q->name, q->stats.depth, (unsigned long)wait_ms );
+
+            pthread_mutex_unlock( &q->mutex );
+            struct timespec ts = { wait_ms / 1000, (wait_ms % 1000) * 1000000 };
+            while( nanosleep( &ts, &ts ) == -1 && errno == EINTR )
+                ;
+            pthread_mutex_lock( &q->mutex );
+            continue;
+        }
+
+        q->tokens -= 1.0;
+        queued_packet* item = q->head;
+        q->head = item->next;
+        if( !q->head )
+            q->tail = NULL;
+        --q->stats.depth;
+
+        uint32_t delay = (uint32_t)(now - item->queued_ms);
+        q->stats.last_delay_ms   = delay;
+        q->stats.total_delay_ms += delay;
+        if( delay > q->stats.max_delay_ms )
+            q->stats.max_delay_ms = delay;
+        ++q->stats.sent;
+
+        pthread_mutex_unlock( &q->mutex );
+
+        // the sender stamps connect and send through trace_current()
+        wx_trace* trace = item->trace.id ? &item->trace : NULL;
+        trace_stamp( trace, kStage_queue );
+        trace_set_current( trace );
+        q->entry( item->packet, item->wide );
+        trace_set_current( NULL );
+        trace_finish( trace );
+
+        free( item->packet );
+        free( item );
+        pthread_mutex_lock( &q->mutex );
+    }
+
+    pthread_mutex_unlock( &q->mutex );
+    wx_thread_return();
+}
+
+
+bool send_queue_start( wx_destination dest, const char* name, double rate, double burst, send_queue_entry entry )
+{
+    if( dest < 0 || dest >= kDest_count || !entry || rate <= 0 )
+        return false;
+
+    send_queue* q = &s_queues[dest];
+    if( q->running )
+        return false;
+
+    memset( q, 0, sizeof( send_queue ) );
+    q->name      = name;
+    q->rate      = rate;
+    q->burst     = burst < 1.0 ? 1.0 : burst;
+    q->tokens    = q->burst;
+    q->refill_ms = now_ms();
+    q->entry     = entry;
+    pthread_mutex_init( &q->mutex, NULL );
+    pthread_cond_init( &q->cond, NULL );
+    q->running = true;
+
+    wx_create_thread_detached( send_queue_thread, q );
+    return true;
+}
+
+
+// copies the packet, never blocks waiting on the network or the bucket
+bool send_queue_packet( wx_destination dest, const char* packet, bool wide )
+{
+    return send_queue_packet_traced( dest, packet, wide, NULL );
+}
+
+
+bool send_queue_packet_traced( wx_destination dest, const char* packet, bool wide, const wx_trace* trace )
+{
+    if( dest < 0 || dest >= kDest_count || !packet )
+        return false;
+
+    // no pacing either, the token buckets run on real time
+    if( s_recorder )
+    {
+        fprintf( s_recorder, "%lld\t%s%s\t%s\n", (long long)wx_clock_now(), s_dest_names[dest], wide ? " wide" : "", packet );
+        return true;
+    }
+
+    if( !s_queues[dest].running )
+        return false;
+
+    queued_packet* item = (queued_packet*)malloc( sizeof( queued_packet ) );
+    if( !item )
+        return false;
+
+    item->packet = strdup( packet );
+    if( !item->packet )
+    {
+        free( item );
+        return false;
+    }
+    item->wide      = wide;
+    item->queued_ms = now_ms();
+    item->next      = NULL;
+
+    send_queue*    q       = &s_queues[dest];
+    queued_packet* dropped = NULL;
+
+    memset( &item->trace, 0, sizeof( item->trace ) );
+    if( trace && trace->id )
+    {
+        item->trace = *trace;
+        snprintf( item->trace.dest, sizeof( item->trace.dest ), "%s", q->name );
+        snprintf( item->trace.packet, sizeof( item->trace.packet ), "%s", packet );
+    }
+
+    pthread_mutex_lock( &q->mutex );
+    if( q->stats.depth >= kMaxQueued )
+    {
+        // stale wx isn't worth much, make room by tossing the oldest
+        dropped = q->head;
+        q->head = dropped->next;
+        if( !q->head )
+            q->tail = NULL;
+        --q->stats.depth;
+        ++q->stats.dropped;
+    }
+
+    if( q->tail )
+        q->tail->next = item;
+    else
+        q->head = item;
+    q->tail = item;
+
+    ++q->stats.queued;
+    if( ++q->stats.depth > q->stats.max_depth )
+        q->stats.max_depth = q->stats.depth;
+
+    pthread_cond_signal( &q->cond );
+    pthread_mutex_unlock( &q->mutex );
+
+    if( dropped )
+    {
+        log_error( "%s: queue is full, dropping: %s\n", q->name, dropped->packet );
+        free( dropped->packet );
+        free( dropped );
+    }
+    return true;
+}
+
+
+// everything that would have gone out goes to out instead, one line each: time, destination and the packet
+void send_queue_record_to( FILE* out )
+{
+    s_recorder = out;
+}
+
+
+bool send_queue_get_stats( wx_destination dest, send_queue_stats* stats )
+{
+    if( dest < 0 || dest >= kDest_count || !stats || !s_queues[dest].running )
+        return false;
+
+    send_queue* q = &s_queues[dest];
+    pthread_mutex_lock( &q->mutex );
+    *stats = q->stats;
+    pthread_mutex_unlock( &q->mutex );
+    return true;
+}
+
+
+void send_queue_log_stats( void )
+{
+    for( int i = 0; i < kDest_count; i++ )
+    {
+        send_queue_stats stats;
+        if( !send_queue_get_stats( (wx_destination)i, &stats ) )
+            continue;
+
+        log_error( "send queue: %-8s queued: %u, sent: %u, dropped: %u, throttled: %u, depth: %u (max %u), delay last: %ums, max: %ums, ave: %0.1fms\n",
+                   s_queues[i].name, stats.queued, stats.sent, stats.dropped, stats.throttled, stats.depth, stats.max_depth,
+                   stats.last_delay_ms, stats.max_delay_ms, stats.sent ? (double)stats.total_delay_ms / stats.sent : 0.0 );
+    }
+}
+
+
+#pragma mark -
+
+static double depth_value( void* context )
+{
+    send_queue_stats stats;
+    return send_queue_get_stats( (wx_destination)(intptr_t)context, &stats ) ? stats.depth : 0;
+}
+
+
+static double sent_value( void* context )
+{
+    send_queue_stats stats;
+    return send_queue_get_stats( (wx_destination)(intptr_t)context, &stats ) ? stats.sent : 0;
+}
+
+
+static double dropped_value( void* context )
+{
+    send_queue_stats stats;
+    return send_queue_get_stats( (wx_destination)(intptr_t)context, &stats ) ? stats.dropped : 0;
+}
+
+
+void send_queue_add_metrics( void )
+{
+    static const char* depth[kDest_count]   = { "wxrelay_send_queue_depth{queue=\"aprs_is\"}",         "wxrelay_send_queue_depth{queue=\"radio\"}" };
+    static const char* sent[kDest_count]    = { "wxrelay_send_queue_sent_total{queue=\"aprs_is\"}",    "wxrelay_send_queue_sent_total{queue=\"radio\"}" };
+    static const char* dropped[kDest_count] = { "wxrelay_send_queue_dropped_total{queue=\"aprs_is\"}", "wxrelay_send_queue_dropped_total{queue=\"radio\"}" };
+
+    // one family at a time so the HELP lines come out right
+    for( intptr_t i = 0; i < kDest_count; i++ )
+        metrics_add_value( depth[i], "gauge", "Packets waiting to go out", depth_value, (void*)i );
+    for( intptr_t i = 0; i < kDest_count; i++ )
+        metrics_add_value( sent[i], "counter", "Packets handed to the sender", sent_value, (void*)i );
+    for( intptr_t i = 0; i < kDest_count; i++ )
+        metrics_add_value( dropped[i], "counter", "Packets dropped because the queue was full", dropped_value, (void*)i );
+}
+
+
+// "rate" or "rate/burst", rate is in packets per second
+bool send_queue_parse_rate( const char* arg, double* rate, double* burst )
+{
+    if( !arg || !rate || !burst )
+        return false;
+
+    char*  end = NULL;
+    double r   = strtod( arg, &end );
+    if( end == arg || r <= 0 )
+        return false;
+
+    double b = *burst;
+    if( *end == '/' )
+    {
+        const char* start = end + 1;
+        b = strtod( start, &end );
+        if( end == start || b < 1 )
+            return false;
+    }
+    if( *end )
+        return false;
+
+    *rate  = r;
+    *burst = b;
+    return true;
+}
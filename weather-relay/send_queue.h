@@ -0,0 +1,51 @@
+//
+//  send_queue.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_send_queue
+#define _H_send_queue
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "trace.h"
+
+// everywhere a packet can go out, each one gets its own queue, token bucket and sending thread
+typedef enum
+{
+    kDest_aprs_is = 0,
+    kDest_radio,
+    kDest_count
+} wx_destination;
+
+// does the actual sending on the destination's thread, wide = send out to WIDE2-1 (only means something to the radio)
+typedef void (*send_queue_entry)( const char* packet, bool wide );
+
+typedef struct
+{
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t dropped;           // queue was full, oldest packet got tossed
+    uint32_t throttled;         // packets that had to wait for a token
+    uint32_t depth;
+    uint32_t max_depth;
+    uint32_t last_delay_ms;     // time from send_queue_packet() to being handed to the entry
+    uint32_t max_delay_ms;
+    uint64_t total_delay_ms;
+} send_queue_stats;
+
+bool send_queue_start( wx_destination dest, const char* name, double rate, double burst, send_queue_entry entry );
+bool send_queue_packet( wx_destination dest, const char* packet, bool wide );
+bool send_queue_packet_traced( wx_destination dest, const char* packet, bool wide, const wx_trace* trace );
+void send_queue_record_to( FILE* out );
+bool send_queue_get_stats( wx_destination dest, send_queue_stats* stats );
+void send_queue_log_stats( void );
+void send_queue_add_metrics( void );
+bool send_queue_parse_rate( const char* arg, double* rate, double* burst );
+
+#endif // !_H_send_queue
@@ -0,0 +1,228 @@
+//
+//  state.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Small mmap'd state page so a restart carries on with the same sequence numbers and send schedule instead of blasting out
+//  params, status and wx all over again.  The page has two copies of the state, each with a generation and a checksum, and a
+//  commit always writes the older one, so if we die in the middle of a commit the other copy is still good.  Commits are just
+//  memory stores, the kernel writes the page back on its own and we msync() every once in a while to be sure.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "state.h"
+#include "wx_clock.h"
+
+
+#define kStateMagic         0x54535857      // "WXST"
+#define kStatePageSize      4096
+#define kStateSyncInterval  60              // seconds between msync() calls
+
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                  // sizeof( wx_state ) when it was written
+    uint32_t generation;
+    uint32_t checksum;              // over everything below
+    int64_t  saved_time;
+    wx_state state;
+} state_slot;
+
+
+static state_slot* s_page      = NULL;  // two slots
+static int         s_fd        = -1;
+static int         s_current   = -1;    // slot the live state came from / was last committed to
+static bool        s_warm      = false;
+static time_t      s_last_sync = 0;
+static wx_state    s_state;             // working copy, callers poke at this and commit
+
+
+
+// FNV-1a, good enough to catch a torn write
+static uint32_t checksum( const state_slot* slot )
+{
+    const uint8_t* bytes = (const uint8_t*)&slot->saved_time;
+    size_t         len   = sizeof( state_slot ) - offsetof( state_slot, saved_time );
+
+    uint32_t hash = 2166136261u;
+    for( size_t i = 0; i < len; i++ )
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+
+static bool slot_valid( const state_slot* slot )
+{
+    return slot->magic == kStateMagic && slot->version == kStateVersion && slot->size == sizeof( wx_state ) && slot->checksum == checksum( slot );
+}
+
+
+bool state_open( const char* path )
+{
+    if( !path || s_page )
+        return false;
+
+    s_fd = open( path, O_RDWR | O_CREAT, 0644 );
+    if( s_fd < 0 )
+    {
+        log_error( "state_open: failed to open state file: %s (%d)\n", path, errno );
+        return false;
+    }
+
+    if( ftruncate( s_fd, kStatePageSize ) != 0 )
+    {
+        log_error( "state_open: failed to size state file: %s (%d)\n", path, errno );
+        close( s_fd );
+        s_fd = -1;
+        return false;
+    }
+
+    void* page = mmap( NULL, kStatePageSize, PROT_READ | PROT_WRITE, MAP_SHARED, s_fd, 0 );
+    if( page == MAP_FAILED )
+    {
+        log_error( "state_open: failed to map state file: %s (%d)\n", path, errno );
+        close( s_fd );
+        s_fd = -1;
+        return false;
+    }
+    s_page = (state_slot*)page;
+
+    // newest good copy wins
+    bool valid0 = slot_valid( &s_page[0] );
+    bool valid1 = slot_valid( &s_page[1] );
+    if( valid0 && valid1 )
+        s_current = (int32_t)(s_page[1].generation - s_page[0].generation) > 0 ? 1 : 0;
+    else if( valid0 )
+        s_current = 0;
+    else if( valid1 )
+        s_current = 1;
+    else
+        s_current = -1;
+
+    memset( &s_state, 0, sizeof( s_state ) );
+    s_warm = s_current >= 0;
+    if( s_warm )
+        s_state = s_page[s_current].state;
+    else
+        log_error( "state_open: no saved state in %s, starting fresh\n", path );
+
+    s_last_sync = time( NULL );
+    return true;
+}
+
+
+bool state_is_warm( void )
+{
+    return s_warm;
+}
+
+
+// when the state we started up with was last committed
+int64_t state_saved_time( void )
+{
+    return s_warm && s_current >= 0 ? s_page[s_current].saved_time : 0;
+}
+
+
+wx_state* state_get( void )
+{
+    return &s_state;
+}
+
+
+void state_commit( void )
+{
+    if( !s_page )
+        return;
+
+    // nothing changed, don't dirty the page
+    if( s_current >= 0 && memcmp( &s_page[s_current].state, &s_state, sizeof( wx_state ) ) == 0 )
+        return;
+
+    int         next = s_current == 0 ? 1 : 0;
+    state_slot* slot = &s_page[next];
+
+    // knock out the magic first so a half written slot never looks good
+    slot->magic      = 0;
+    slot->version    = kStateVersion;
+    slot->size       = sizeof( wx_state );
+    slot->generation = s_current >= 0 ? s_page[s_current].generation + 1 : 1;
+    slot->saved_time = wx_clock_now();
+    slot->state      = s_state;
+    slot->checksum   = checksum( slot );
+    __atomic_store_n( &slot->magic, kStateMagic, __ATOMIC_RELEASE );
+
+    s_current = next;
+}
+
+
+// the kernel writes dirty pages back on its own, this just makes sure it doesn't sit for too long
+void state_sync( bool force )
+{
+    if( !s_page )
+        return;
+
+    time_t now = time( NULL );
+    if( !force && now < s_last_sync + kStateSyncInterval )
+        return;
+
+    if( msync( s_page, kStatePageSize, force ? MS_SYNC : MS_ASYNC ) != 0 )
+        log_error( "state_sync: msync failed (%d)\n", errno );
+    s_last_sync = now;
+}
+
+
+void state_close( void )
+{
+    if( !s_page )
+        return;
+
+    state_commit();
+    state_sync( true );
+    munmap( s_page, kStatePageSize );
+    close( s_fd );
+    s_page = NULL;
+    s_fd   = -1;
+}
+
+
+uint32_t state_hash_name( const char* name )
+{
+    uint32_t hash = 2166136261u;
+    for( const char* c = name; c && *c; c++ )
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    return hash;
+}
+
+
+int64_t state_job_last_run( const char* name )
+{
+    uint32_t hash = state_hash_name( name );
+    for( int i = 0; i < kStateMaxJobs; i++ )
+        if( s_state.jobs[i].name_hash == hash )
+            return s_state.jobs[i].last_run;
+    return 0;
+}
+
+
+void state_set_job_last_run( int index, const char* name, int64_t last_run )
+{
+    if( index < 0 || index >= kStateMaxJobs )
+        return;
+
+    s_state.jobs[index].name_hash = state_hash_name( name );
+    s_state.jobs[index].last_run  = last_run;
+}
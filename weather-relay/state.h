@@ -0,0 +1,49 @@
+//
+//  state.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_state
+#define _H_state
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#define kStateVersion   1
+#define kStateMaxJobs   16
+
+// everything we need to pick up where we left off after a restart.  bump kStateVersion if you change this, old pages get ignored.
+typedef struct
+{
+    uint16_t sequence_num;
+    uint8_t  primary_station;       // the station_id we locked onto without --station
+    uint8_t  primary_valid;         // pages from before this was here have zero
+    uint32_t params_hash;           // the PARM/UNIT/EQNS/BITS we last sent
+    float    rain_baseline;         // inches, last accepted rain total
+    int32_t  rain_raw_count;
+    int64_t  rain_time;
+    struct
+    {
+        uint32_t name_hash;         // scheduler job name, so reordering the jobs doesn't mix up the times
+        uint32_t reserved;
+        int64_t  last_run;
+    } jobs[kStateMaxJobs];
+} wx_state;
+
+bool      state_open( const char* path );
+bool      state_is_warm( void );
+int64_t   state_saved_time( void );
+wx_state* state_get( void );
+void      state_commit( void );
+void      state_sync( bool force );
+void      state_close( void );
+
+uint32_t  state_hash_name( const char* name );
+int64_t   state_job_last_run( const char* name );
+void      state_set_job_last_run( int index, const char* name, int64_t last_run );
+
+#endif // !_H_state
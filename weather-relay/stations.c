@@ -0,0 +1,579 @@
+//
+//  stations.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  The receiver hears every LaCrosse sensor in range, not just ours, and the frames only say whose they are in station_id.  Our
+//  own station keeps going through process_wx_frame() and the wxlog like it always has, everybody else gets their own pipeline
+//  here: their own min/max/ave and averaging windows (so a neighbor's TX31U can't drag our numbers around), an hour of history,
+//  and optionally their own CALL-SSID to send as.  Stations are sharded across worker threads by station_id, each worker has a
+//  bounded multi-producer, single consumer ring (the same one logging.c uses) and only it ever writes to the stations it owns, so
+//  dozens of stations spread across the cores without fighting over anything.  The per station mutex is only there for readers.
+//
+//  Which stations count: --station id[:CALL-SSID] builds an allowlist and the first one is ours.  Without any, we lock onto the
+//  first station we hear and main.c keeps that in the state page, so after a restart it's still ours even if a neighbor's is
+//  the first one we hear.  --discover picks up anything else we hear and tracks it without sending it, otherwise it's dropped.
+//
+
+#include <ctype.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "stations.h"
+#include "logging.h"
+#include "metrics.h"
+#include "wx_thread.h"
+#include "wx_clock.h"
+
+
+#define kStationSlots       256         // per worker, must be a power of two
+#define kStationSlotMask    (kStationSlots - 1)
+
+
+typedef struct
+{
+    time_t when;
+    Frame  frame;
+} station_sample;
+
+typedef struct
+{
+    uint8_t         id;
+    bool            discovered;
+    char            callsign[kStationCallsignMax];
+    pthread_mutex_t mutex;      // the owning worker writes, everyone else reads
+
+    wx_validation   validation;
+    Frame           min;
+    Frame           max;
+    Frame           ave;
+    station_sample  history[kStationHistory];
+    size_t          head;       // next sample to write
+    size_t          count;
+
+    uint64_t        frames;
+    uint64_t        rejected;
+    time_t          first_seen;
+    time_t          last_seen;
+} station;
+
+typedef struct
+{
+    atomic_size_t sequence;
+    time_t        when;
+    Frame         frame;
+} station_slot;
+
+typedef struct
+{
+    station_slot  ring[kStationSlots];
+    atomic_size_t head;         // next slot to claim
+    size_t        tail;         // next slot to process, only the worker touches this
+    sem_t         ready;
+    wx_thread_t   thread;
+} station_worker;
+
+
+static _Atomic( station* ) s_stations[kStationsMax];
+static atomic_int          s_primary     = -1;      // station_id of ours, -1 until we know
+static int                 s_allowed     = 0;       // stations from --station
+static bool                s_discover    = false;
+static station_worker*     s_workers     = NULL;
+static int                 s_workerCount = 0;
+static atomic_bool         s_shutdown    = false;
+static atomic_int          s_known       = 0;
+
+static atomic_uint_fast64_t s_sharded = 0;
+static atomic_uint_fast64_t s_dropped = 0;
+
+
+
+#pragma mark -
+
+static station* new_station( uint8_t id, bool discovered )
+{
+    station* st = calloc( 1, sizeof( station ) );
+    if( !st )
+        return NULL;
+
+    st->id         = id;
+    st->discovered = discovered;
+    pthread_mutex_init( &st->mutex, NULL );
+    atomic_store( &s_stations[id], st );
+    atomic_fetch_add( &s_known, 1 );
+    return st;
+}
+
+
+// CALL-SSID, letters and digits with an optional -0 to -15
+static bool valid_callsign( const char* call )
+{
+    size_t len = strlen( call );
+    if( !len || len >= kStationCallsignMax - 1 )
+        return false;
+
+    const char* dash = strchr( call, '-' );
+    size_t      base = dash ? (size_t)(dash - call) : len;
+    if( !base )
+        return false;
+    for( size_t i = 0; i < base; i++ )
+        if( !isalnum( (unsigned char)call[i] ) )
+            return false;
+    if( !dash )
+        return true;
+
+    // one or two digits, no leading zero on 10-15
+    const char* ssid = dash + 1;
+    size_t      digits = strlen( ssid );
+    if( !digits || digits > 2 || !isdigit( (unsigned char)ssid[0] ) || (digits == 2 && (ssid[0] == '0' || !isdigit( (unsigned char)ssid[1] ))) )
+        return false;
+    return atoi( ssid ) <= 15;
+}
+
+
+bool stations_parse_option( const char* arg )
+{
+    if( !arg || !*arg )
+    {
+        printf( "bad station: it should be id[:CALL-SSID]\n" );
+        return false;
+    }
+
+    char*         end = NULL;
+    unsigned long id  = strtoul( arg, &end, 0 );
+    if( end == arg || (*end && *end != ':') )
+    {
+        printf( "bad station: %s, it should be id[:CALL-SSID] with a decimal or 0x hex id\n", arg );
+        return false;
+    }
+    if( id >= kStationsMax )
+    {
+        printf( "bad station: %s, a station_id is one byte so it has to be 0 to %d\n", arg, kStationsMax - 1 );
+        return false;
+    }
+
+    const char* call = *end == ':' ? end + 1 : "";
+    if( *call && !valid_callsign( call ) )
+    {
+        printf( "bad station: %s, %s should be a callsign of letters and digits with an optional SSID of -0 to -15\n", arg, call );
+        return false;
+    }
+
+    station* st = atomic_load( &s_stations[id] );
+    if( !st && !(st = new_station( (uint8_t)id, false )) )
+    {
+        printf( "bad station: %s, out of memory\n", arg );
+        return false;
+    }
+
+    for( int i = 0; call[i] && i < kStationCallsignMax - 1; i++ )
+        st->callsign[i] = toupper( (unsigned char)call[i] );
+
+    int unknown = -1;
+    atomic_compare_exchange_strong( &s_primary, &unknown, (int)id );
+    ++s_allowed;
+    return true;
+}
+
+
+void stations_set_discovery( bool discover )
+{
+    s_discover = discover;
+}
+
+
+int stations_default_workers( void )
+{
+    long cores = sysconf( _SC_NPROCESSORS_ONLN );
+    if( cores < 1 )
+        return 1;
+    return cores > kStationsMaxWorkers ? kStationsMaxWorkers : (int)cores;
+}
+
+
+
+#pragma mark -
+
+static void add_sample( station* st, time_t when, const Frame* frame )
+{
+    st->history[st->head].when  = when;
+    st->history[st->head].frame = *frame;
+    st->head = (st->head + 1) % kStationHistory;
+    if( st->count < kStationHistory )
+        ++st->count;
+}
+
+
+static void process_frame( station_slot* slot )
+{
+    station* st = atomic_load( &s_stations[slot->frame.station_id] );
+    if( !st )
+        return;
+
+    pthread_mutex_lock( &st->mutex );
+    uint8_t flags = slot->frame.flags;
+    updateStationStats( &st->validation, &slot->frame, &st->min, &st->max, &st->ave );
+    if( slot->frame.flags != flags )
+        ++st->rejected;
+
+    add_sample( st, slot->when, &slot->frame );
+    ++st->frames;
+    if( !st->first_seen )
+        st->first_seen = slot->when;
+    st->last_seen = slot->when;
+    pthread_mutex_unlock( &st->mutex );
+}
+
+
+static wx_thread_return_t station_worker_thread( void* args )
+{
+    station_worker* worker = (station_worker*)args;
+    while( !atomic_load( &s_shutdown ) )
+    {
+        while( sem_wait( &worker->ready ) == -1 && errno == EINTR )
+            ;
+
+        while( 1 )
+        {
+            station_slot* slot     = &worker->ring[worker->tail & kStationSlotMask];
+            size_t        sequence = atomic_load_explicit( &slot->sequence, memory_order_acquire );
+            if( sequence != worker->tail + 1 )
+                break;
+
+            process_frame( slot );
+            atomic_store_explicit( &slot->sequence, worker->tail + kStationSlots, memory_order_release );
+            ++worker->tail;
+        }
+    }
+    wx_thread_return();
+}
+
+
+static bool queue_frame( station_worker* worker, const Frame* frame, time_t when )
+{
+    size_t        pos  = atomic_load_explicit( &worker->head, memory_order_relaxed );
+    station_slot* slot = NULL;
+    while( 1 )
+    {
+        slot = &worker->ring[pos & kStationSlotMask];
+        size_t   sequence = atomic_load_explicit( &slot->sequence, memory_order_acquire );
+        intptr_t diff     = (intptr_t)sequence - (intptr_t)pos;
+        if( diff == 0 )
+        {
+            if( atomic_compare_exchange_weak_explicit( &worker->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed ) )
+                break;
+        }
+        else if( diff < 0 )
+            return false;   // the worker is a whole ring behind, the ingest thread doesn't wait
+        else
+            pos = atomic_load_explicit( &worker->head, memory_order_relaxed );
+    }
+
+    slot->when  = when;
+    slot->frame = *frame;
+    atomic_store_explicit( &slot->sequence, pos + 1, memory_order_release );
+    sem_post( &worker->ready );
+    return true;
+}
+
+
+bool stations_start( int workers )
+{
+    // nothing to shard if ours is the only one we'll ever take
+    if( s_workers || (!s_discover && s_allowed <= 1) )
+        return false;
+
+    if( workers < 1 )
+        workers = 1;
+    if( workers > kStationsMaxWorkers )
+        workers = kStationsMaxWorkers;
+
+    s_workers = calloc( workers, sizeof( station_worker ) );
+    if( !s_workers )
+        return false;
+
+    for( int i = 0; i < workers; i++ )
+    {
+        station_worker* worker = &s_workers[i];
+        for( size_t slot = 0; slot < kStationSlots; slot++ )
+            atomic_init( &worker->ring[slot].sequence, slot );
+        sem_init( &worker->ready, 0, 0 );
+        worker->thread = wx_create_thread( station_worker_thread, worker );
+    }
+    s_workerCount = workers;
+
+    log_error( "stations: %d allowed, discovery %s, %d worker%s\n", s_allowed, s_discover ? "on" : "off", workers, workers == 1 ? "" : "s" );
+    return true;
+}
+
+
+void stations_shutdown( void )
+{
+    if( !s_workers )
+        return;
+
+    atomic_store( &s_shutdown, true );
+    for( int i = 0; i < s_workerCount; i++ )
+        sem_post( &s_workers[i].ready );
+    for( int i = 0; i < s_workerCount; i++ )
+        wx_thread_join( s_workers[i].thread );
+}
+
+
+int stations_primary( void )
+{
+    return atomic_load( &s_primary );
+}
+
+
+// the one we locked onto last time, --station still wins
+void stations_restore_primary( uint8_t id )
+{
+    int unknown = -1;
+    if( !atomic_compare_exchange_strong( &s_primary, &unknown, id ) )
+        return;
+
+    if( !atomic_load( &s_stations[id] ) )
+        new_station( id, false );
+    log_error( "stations: station 0x%02x is still ours from last time, use --station to pick a different one\n", id );
+}
+
+
+station_route stations_route( const Frame* frame, time_t when )
+{
+    uint8_t id      = frame->station_id;
+    int     primary = atomic_load( &s_primary );
+    if( primary < 0 && atomic_compare_exchange_strong( &s_primary, &primary, id ) )
+    {
+        primary = id;
+        if( !atomic_load( &s_stations[id] ) )
+            new_station( id, false );
+        log_error( "stations: locked onto station 0x%02x as ours, use --station to pick a different one\n", id );
+    }
+
+    if( id == primary )
+        return kRoute_primary;
+
+    station* st = atomic_load( &s_stations[id] );
+    if( !st && s_discover && s_workers )
+    {
+        st = new_station( id, true );
+        if( st )
+            log_error( "stations: discovered station 0x%02x\n", id );
+    }
+
+    if( !st || !s_workers || !queue_frame( &s_workers[id % s_workerCount], frame, when ) )
+    {
+        atomic_fetch_add_explicit( &s_dropped, 1, memory_order_relaxed );
+        if( !st )
+            log_error_throttled( "stations: ignoring station 0x%02x, it's not on the allowlist\n", id );
+        return kRoute_dropped;
+    }
+
+    atomic_fetch_add_explicit( &s_sharded, 1, memory_order_relaxed );
+    return kRoute_sharded;
+}
+
+
+
+#pragma mark -
+
+int stations_list( station_info* info, int max )
+{
+    if( !info )
+        return 0;
+
+    int count = 0;
+    for( int id = 0; id < kStationsMax && count < max; id++ )
+    {
+        station* st = atomic_load( &s_stations[id] );
+        if( !st )
+            continue;
+
+        station_info* out = &info[count++];
+        pthread_mutex_lock( &st->mutex );
+        out->id         = st->id;
+        out->primary    = id == atomic_load( &s_primary );
+        out->discovered = st->discovered;
+        memcpy( out->callsign, st->callsign, sizeof( out->callsign ) );
+        out->frames     = st->frames;
+        out->rejected   = st->rejected;
+        out->first_seen = st->first_seen;
+        out->last_seen  = st->last_seen;
+        out->history    = st->count;
+        out->ave        = st->ave;
+        pthread_mutex_unlock( &st->mutex );
+    }
+    return count;
+}
+
+
+// same idea as wxlog_get_wx_averages(): means, except the lowest pressure and the highest gust, over one window
+bool stations_get_averages( uint8_t id, time_t since, Frame* average )
+{
+    station* st = atomic_load( &s_stations[id] );
+    if( !st || !average )
+        return false;
+
+    memset( average, 0, sizeof( Frame ) );
+    average->station_id = id;
+
+    size_t   tempCount = 0, intTempCount = 0, humidityCount = 0, windCount = 0;
+    uint32_t humidity  = 0;
+    bool     found     = false;
+
+    pthread_mutex_lock( &st->mutex );
+    for( size_t i = 0; i < st->count; i++ )
+    {
+        const station_sample* sample = &st->history[(st->head + kStationHistory - 1 - i) % kStationHistory];
+        if( sample->when < since )
+            break;      // newest to oldest
+
+        const Frame* frame = &sample->frame;
+        if( !found )
+        {
+            // the air quality numbers are already averaged by the sensor, the newest ones are fine
+            memcpy( &average->pm10_standard, &frame->pm10_standard, sizeof( Frame ) - offsetof( Frame, pm10_standard ) - 1 );
+            average->flags |= frame->flags & kDataFlag_airQuality;
+            found = true;
+        }
+
+        if( frame->flags & kDataFlag_temp )
+        {
+            average->tempC += frame->tempC;
+            ++tempCount;
+        }
+        if( frame->flags & kDataFlag_intTemp )
+        {
+            average->intTempC += frame->intTempC;
+            ++intTempCount;
+        }
+        if( frame->flags & kDataFlag_humidity )
+        {
+            humidity += frame->humidity;
+            ++humidityCount;
+        }
+        if( frame->flags & kDataFlag_wind )
+        {
+            average->windSpeedMs   += frame->windSpeedMs;
+            average->windDirection += frame->windDirection;
+            ++windCount;
+        }
+        if( (frame->flags & kDataFlag_gust) && frame->windGustMs > average->windGustMs )
+        {
+            average->windGustMs = frame->windGustMs;
+            average->flags |= kDataFlag_gust;
+        }
+        if( (frame->flags & kDataFlag_pressure) && (!(average->flags & kDataFlag_pressure) || frame->pressure < average->pressure) )
+        {
+            average->pressure = frame->pressure;
+            average->flags |= kDataFlag_pressure;
+        }
+    }
+    pthread_mutex_unlock( &st->mutex );
+
+    if( tempCount )
+    {
+        average->tempC /= tempCount;
+        average->flags |= kDataFlag_temp;
+    }
+    if( intTempCount )
+    {
+        average->intTempC /= intTempCount;
+        average->flags |= kDataFlag_intTemp;
+    }
+    if( humidityCount )
+    {
+        average->humidity = (uint8_t)(humidity / humidityCount);
+        average->flags |= kDataFlag_humidity;
+    }
+    if( windCount )
+    {
+        average->windSpeedMs   /= windCount;
+        average->windDirection /= windCount;
+        average->flags |= kDataFlag_wind;
+    }
+    return found;
+}
+
+
+
+#pragma mark -
+
+static const char* station_role( const station_info* info )
+{
+    if( info->primary )
+        return "ours";
+    return info->discovered ? "discovered" : "allowed";
+}
+
+
+void stations_command( FILE* out, const char* args, void* context )
+{
+    static station_info info[kStationsMax];     // only the control thread gets here
+    int    count = stations_list( info, kStationsMax );
+    time_t now   = wx_clock_now();
+
+    fprintf( out, "id    role        callsign    frames   rejected  history  last seen  temp °F  humidity  wind mph\n" );
+    for( int i = 0; i < count; i++ )
+    {
+        const station_info* st = &info[i];
+        if( st->primary )
+        {
+            // ours goes through the main pipeline, none of the per station numbers apply
+            fprintf( out, "0x%02x  %-10s  %-10s  (see the wxlog)\n", st->id, station_role( st ), "-" );
+            continue;
+        }
+
+        char seen[16] = "never";
+        if( st->last_seen )
+            snprintf( seen, sizeof( seen ), "%lds ago", (long)(now - st->last_seen) );
+        fprintf( out, "0x%02x  %-10s  %-10s  %7llu  %9llu  %7zu  %9s  %7.1f  %8u  %8.1f\n", st->id, station_role( st ), *st->callsign ? st->callsign : "-",
+                 (unsigned long long)st->frames, (unsigned long long)st->rejected, st->history, seen, c2f( st->ave.tempC ), st->ave.humidity,
+                 ms2mph( st->ave.windSpeedMs ) );
+    }
+    fprintf( out, "sharded: %llu, dropped: %llu, workers: %d\n", (unsigned long long)atomic_load( &s_sharded ), (unsigned long long)atomic_load( &s_dropped ), s_workerCount );
+}
+
+
+void stations_log_stats( void )
+{
+    if( atomic_load( &s_known ) <= 1 && !atomic_load( &s_dropped ) )
+        return;
+
+    log_error( "stations: known: %d, sharded frames: %llu, dropped: %llu, workers: %d\n", atomic_load( &s_known ), (unsigned long long)atomic_load( &s_sharded ),
+               (unsigned long long)atomic_load( &s_dropped ), s_workerCount );
+}
+
+
+static double known_value( void* context )
+{
+    return atomic_load( &s_known );
+}
+
+
+static double sharded_value( void* context )
+{
+    return atomic_load_explicit( &s_sharded, memory_order_relaxed );
+}
+
+
+static double dropped_value( void* context )
+{
+    return atomic_load_explicit( &s_dropped, memory_order_relaxed );
+}
+
+
+void stations_add_metrics( void )
+{
+    metrics_add_value( "wxrelay_stations",                      "gauge",   "Stations on the allowlist or discovered", known_value, NULL );
+    metrics_add_value( "wxrelay_station_frames_sharded_total",  "counter", "Frames from other stations handed to a worker", sharded_value, NULL );
+    metrics_add_value( "wxrelay_station_frames_dropped_total",  "counter", "Frames from stations we don't take, or whose worker was too far behind", dropped_value, NULL );
+}
@@ -0,0 +1,71 @@
+//
+//  stations.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_stations
+#define _H_stations
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "TXDecoderFrame.h"
+
+#define kStationsMax            256         // station_id is a byte
+#define kStationHistory         720         // an hour of frames at one every 5 seconds
+#define kStationsMaxWorkers     8
+#define kStationCallsignMax     16
+
+// what the TX31U sends itself, the receiver board fills in the rest (pressure, inside temp and air quality) from its own sensors
+#define kRadioFlags             (kDataFlag_temp | kDataFlag_humidity | kDataFlag_wind | kDataFlag_gust | kDataFlag_rain)
+
+// what stations_route() did with a frame
+typedef enum
+{
+    kRoute_primary = 0,         // it's ours, the caller carries on with it
+    kRoute_sharded,             // queued for the worker that owns its station
+    kRoute_dropped              // not on the allowlist, or its worker is a whole queue behind
+} station_route;
+
+typedef struct
+{
+    uint8_t  id;
+    bool     primary;
+    bool     discovered;                        // showed up on its own instead of coming from --station
+    char     callsign[kStationCallsignMax];     // empty means we keep its history but don't send it anywhere
+    uint64_t frames;
+    uint64_t rejected;                          // frames that had a field thrown out by validation
+    time_t   first_seen;
+    time_t   last_seen;
+    size_t   history;                           // frames in its history
+    Frame    ave;                               // updateStats' running averages
+} station_info;
+
+// "id[:CALL-SSID]", decimal or 0x hex, the first one is our own station.  says what was wrong if it returns false
+bool          stations_parse_option( const char* arg );
+void          stations_set_discovery( bool discover );
+int           stations_default_workers( void );
+bool          stations_start( int workers );
+void          stations_shutdown( void );
+
+// station_id of ours or -1 if we haven't heard it yet, restoring it before the receivers start keeps a neighbor from taking over
+int           stations_primary( void );
+void          stations_restore_primary( uint8_t id );
+
+// only call this with frames that passed their CRC, the station_id is the only thing that says whose it is
+station_route stations_route( const Frame* frame, time_t when );
+
+int           stations_list( station_info* info, int max );
+bool          stations_get_averages( uint8_t id, time_t since, Frame* average );
+
+void          stations_command( FILE* out, const char* args, void* context );
+void          stations_log_stats( void );
+void          stations_add_metrics( void );
+
+#endif // !_H_stations
@@ -0,0 +1,21 @@
+//
+//  wiringPiI2C.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Stands in for wiringPi's header so the relay core can be built on machines without it (see bench.c).  There's never a CO2
+//  sensor attached so setup always fails, which co2_sensor.c already handles.
+//
+
+#ifndef _H_wiringPiI2C
+#define _H_wiringPiI2C
+
+static inline int wiringPiI2CSetup( int devId )
+{
+    (void)devId;
+    return -1;
+}
+
+#endif // !_H_wiringPiI2C
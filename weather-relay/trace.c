@@ -0,0 +1,151 @@
+//
+//  trace.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Follows a frame from the serial port to the packet going out on the wire.  The main thread stamps the newest frame as it goes
+//  through CRC, updateStats and the wxlog, the wx job copies that into the packet it builds, the send queue carries it along and the
+//  sender stamps connect and send.  Finished traces go into the per-stage histograms and a ring of recent ones for "trace N".
+//
+//  Packets are built on a schedule, so the aggregate stage is mostly the frame waiting for the next wx job, not work.
+//
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "metrics.h"
+
+
+#define kRecentTraces   128
+
+
+static const char* s_stage_names[kStage_count] = { "read", "crc", "stats", "insert", "aggregate", "format", "queue", "connect", "send" };
+
+static wx_trace        s_recent[kRecentTraces];
+static int             s_recent_next  = 0;
+static int             s_recent_count = 0;
+static pthread_mutex_t s_mutex        = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint     s_next_id      = 1;
+static __thread wx_trace* s_current   = NULL;
+
+
+
+void trace_begin( wx_trace* trace )
+{
+    if( !trace )
+        return;
+
+    memset( trace, 0, sizeof( wx_trace ) );
+    trace->id = atomic_fetch_add( &s_next_id, 1 );
+    trace->stamps[kStage_read] = metrics_now_us();
+}
+
+
+void trace_stamp( wx_trace* trace, trace_stage stage )
+{
+    trace_stamp_at( trace, stage, metrics_now_us() );
+}
+
+
+void trace_stamp_at( wx_trace* trace, trace_stage stage, uint64_t micros )
+{
+    if( trace && trace->id && stage < kStage_count )
+        trace->stamps[stage] = micros;
+}
+
+
+wx_trace* trace_current( void )
+{
+    return s_current;
+}
+
+
+void trace_set_current( wx_trace* trace )
+{
+    s_current = trace;
+}
+
+
+// each stage's histogram gets the time since the stage before it that actually happened
+void trace_finish( const wx_trace* trace )
+{
+    if( !trace || !trace->id || !trace->stamps[kStage_send] )
+        return;
+
+    uint64_t last = trace->stamps[kStage_read];
+    for( int s = kStage_crc; s < kStage_count; s++ )
+    {
+        if( !trace->stamps[s] )
+            continue;
+        metrics_observe( kHistogram_stage_crc + s - kStage_crc, trace->stamps[s] - last );
+        last = trace->stamps[s];
+    }
+    metrics_observe( kHistogram_trace_total, trace->stamps[kStage_send] - trace->stamps[kStage_read] );
+
+    pthread_mutex_lock( &s_mutex );
+    s_recent[s_recent_next] = *trace;
+    s_recent_next = (s_recent_next + 1) % kRecentTraces;
+    if( s_recent_count < kRecentTraces )
+        ++s_recent_count;
+    pthread_mutex_unlock( &s_mutex );
+}
+
+
+
+#pragma mark -
+
+static uint64_t total_us( const wx_trace* trace )
+{
+    return trace->stamps[kStage_send] - trace->stamps[kStage_read];
+}
+
+
+static int slowest_first( const void* a, const void* b )
+{
+    uint64_t ta = total_us( (const wx_trace*)a );
+    uint64_t tb = total_us( (const wx_trace*)b );
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+
+// the slowest count of the recent packets with their whole timeline
+void trace_dump( FILE* out, int count )
+{
+    if( !out )
+        return;
+
+    wx_trace* traces = (wx_trace*)malloc( sizeof( s_recent ) );
+    if( !traces )
+        return;
+
+    pthread_mutex_lock( &s_mutex );
+    int available = s_recent_count;
+    memcpy( traces, s_recent, available * sizeof( wx_trace ) );
+    pthread_mutex_unlock( &s_mutex );
+
+    qsort( traces, available, sizeof( wx_trace ), slowest_first );
+    if( count <= 0 || count > available )
+        count = available;
+
+    fprintf( out, "%d of %d recent packets, slowest first\n", count, available );
+    for( int i = 0; i < count; i++ )
+    {
+        const wx_trace* trace = &traces[i];
+        fprintf( out, "\n#%u to %s, %.3f ms: %s\n", trace->id, trace->dest, total_us( trace ) / 1e3, trace->packet );
+
+        uint64_t last = trace->stamps[kStage_read];
+        for( int s = kStage_read; s < kStage_count; s++ )
+        {
+            if( !trace->stamps[s] )
+                continue;
+            fprintf( out, "  %-10s %+12.3f ms %12.3f ms\n", s_stage_names[s], (trace->stamps[s] - trace->stamps[kStage_read]) / 1e3, (trace->stamps[s] - last) / 1e3 );
+            last = trace->stamps[s];
+        }
+    }
+    free( traces );
+}
@@ -0,0 +1,49 @@
+//
+//  trace.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_trace
+#define _H_trace
+
+#include <stdint.h>
+#include <stdio.h>
+
+// in the order a frame goes through them, each stamp is when that stage finished
+typedef enum
+{
+    kStage_read = 0,        // frame came off the serial port
+    kStage_crc,
+    kStage_stats,           // updateStats
+    kStage_insert,          // wxlog
+    kStage_aggregate,       // the wx job averaged the log
+    kStage_format,
+    kStage_queue,           // the send queue let it go
+    kStage_connect,
+    kStage_send,
+    kStage_count
+} trace_stage;
+
+typedef struct
+{
+    uint32_t id;                        // zero means nothing is being traced
+    uint64_t stamps[kStage_count];      // µs on the metrics clock, zero for stages it didn't go through
+    char     dest[12];
+    char     packet[48];                // enough of it to tell which one it was
+} wx_trace;
+
+void      trace_begin( wx_trace* trace );
+void      trace_stamp( wx_trace* trace, trace_stage stage );
+void      trace_stamp_at( wx_trace* trace, trace_stage stage, uint64_t micros );
+void      trace_finish( const wx_trace* trace );
+
+// the trace for the packet this thread is sending right now, NULL if it isn't traced
+wx_trace* trace_current( void );
+void      trace_set_current( wx_trace* trace );
+
+void      trace_dump( FILE* out, int count );
+
+#endif // !_H_trace
@@ -0,0 +1,745 @@
+//
+//  wx_archive.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Long term wx history, compressed the way Facebook's Gorilla paper does it: timestamps are stored as the delta of the delta
+//  (nearly always a single 0 bit since the sensor sends on a fixed period) and every field is XOR'd with its previous value so
+//  anything that didn't change is one bit and small changes only store the bits in the middle that moved.  Samples go into fixed
+//  size blocks, each with a header carrying its time range and per-field min/max so readers can skip around without decoding.
+//
+//  The file is just blocks back to back.  The block being filled is kept in memory and rewritten in place every so often, a block
+//  that got torn by a crash fails its checksum and readers skip it.  Next to it is a .idx file with the time range of every block
+//  so a reader can binary search its way to the first block it needs instead of reading the whole archive.
+//
+
+#define _GNU_SOURCE     // strptime
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wx_archive.h"
+
+
+#define kArchiveMagic       0x42415857      // "WXAB"
+#define kFlushSamples       12              // rewrite the block in progress every this many samples (a minute or so)
+#define kMaxSampleBits      (36 + kArchiveFields * (2 + 5 + 5 + 32))    // worst case for one sample
+#define kDataBits           (kArchiveDataSize * 8)
+
+
+static const char* s_field_names[kArchiveFields] =
+{
+    "temp_c", "humidity", "wind_ms", "wind_dir", "gust_ms", "rain_in", "int_temp_c", "pressure_mb",
+    "pm10", "pm25", "pm100", "pm10_env", "pm25_env", "pm100_env",
+    "p03um", "p05um", "p10um", "p25um", "p50um", "p100um", "flags"
+};
+
+
+typedef struct
+{
+    uint32_t value;
+    uint8_t  leading;
+    uint8_t  trailing;
+} field_state;
+
+
+static int           s_fd           = -1;
+static int           s_index_fd     = -1;
+static off_t         s_block_offset = 0;
+static uint32_t      s_sequence     = 0;
+static uint8_t       s_block[kArchiveBlockSize];
+static int64_t       s_prev_time    = 0;
+static int64_t       s_prev_delta   = 0;
+static field_state   s_fields[kArchiveFields];
+static int           s_dirty        = 0;
+static archive_stats s_stats;
+
+
+
+#pragma mark -
+
+static inline uint32_t float_bits( float f )
+{
+    uint32_t bits;
+    memcpy( &bits, &f, sizeof( bits ) );
+    return bits;
+}
+
+
+static inline float bits_float( uint32_t bits )
+{
+    float f;
+    memcpy( &f, &bits, sizeof( f ) );
+    return f;
+}
+
+
+static uint32_t checksum( const uint8_t* data, size_t len )
+{
+    uint32_t hash = 2166136261u;
+    for( size_t i = 0; i < len; i++ )
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+
+static inline archive_block_header* block_header( void )
+{
+    return (archive_block_header*)s_block;
+}
+
+
+// MSB first, count is 1-32
+static void put_bits( uint32_t value, int count )
+{
+    archive_block_header* header = block_header();
+    uint8_t*              data   = s_block + sizeof( archive_block_header );
+
+    for( int i = count - 1; i >= 0; i-- )
+    {
+        uint32_t bit = header->bits++;
+        if( (value >> i) & 1 )
+            data[bit >> 3] |= 0x80 >> (bit & 7);
+    }
+}
+
+
+typedef struct
+{
+    const uint8_t* data;
+    uint32_t       bits;        // total bits available
+    uint32_t       position;
+    uint64_t       buffer;      // next bits, left aligned
+    int            buffered;
+} bit_reader;
+
+
+static inline void reader_fill( bit_reader* r )
+{
+    while( r->buffered <= 56 && r->position < r->bits )
+    {
+        r->buffer |= (uint64_t)r->data[r->position >> 3] << (56 - r->buffered);
+        r->buffered += 8;
+        r->position += 8;
+    }
+}
+
+
+static inline uint32_t get_bits( bit_reader* r, int count )
+{
+    if( r->buffered < count )
+        reader_fill( r );
+
+    uint32_t value = (uint32_t)(r->buffer >> (64 - count));
+    r->buffer <<= count;
+    r->buffered -= count;
+    return value;
+}
+
+
+static inline int sign_extend( uint32_t value, int bits )
+{
+    // buckets are [-(2^(n-1) - 1), 2^(n-1)], stored offset so all n bits are used
+    return (int)value - ((1 << (bits - 1)) - 1);
+}
+
+
+#pragma mark -
+
+static void encode_time( int64_t dod )
+{
+    if( dod == 0 )
+        put_bits( 0, 1 );
+    else if( dod >= -63 && dod <= 64 )
+    {
+        put_bits( 0x2, 2 );
+        put_bits( (uint32_t)(dod + 63), 7 );
+    }
+    else if( dod >= -255 && dod <= 256 )
+    {
+        put_bits( 0x6, 3 );
+        put_bits( (uint32_t)(dod + 255), 9 );
+    }
+    else if( dod >= -2047 && dod <= 2048 )
+    {
+        put_bits( 0xE, 4 );
+        put_bits( (uint32_t)(dod + 2047), 12 );
+    }
+    else
+    {
+        put_bits( 0xF, 4 );
+        put_bits( (uint32_t)(int32_t)dod, 32 );
+    }
+}
+
+
+static void encode_value( field_state* field, uint32_t value )
+{
+    uint32_t xor = value ^ field->value;
+    field->value = value;
+
+    if( !xor )
+    {
+        put_bits( 0, 1 );
+        return;
+    }
+
+    int leading  = __builtin_clz( xor );
+    int trailing = __builtin_ctz( xor );
+
+    // same window as last time, just the meaningful bits
+    if( field->leading != 0xFF && leading >= field->leading && trailing >= field->trailing )
+    {
+        int length = 32 - field->leading - field->trailing;
+        put_bits( 0x2, 2 );
+        put_bits( xor >> field->trailing, length );
+        return;
+    }
+
+    int length = 32 - leading - trailing;
+    put_bits( 0x3, 2 );
+    put_bits( leading, 5 );
+    put_bits( length - 1, 5 );
+    put_bits( xor >> trailing, length );
+
+    field->leading  = leading;
+    field->trailing = trailing;
+}
+
+
+static void start_block( int64_t when, const float* values )
+{
+    memset( s_block, 0, sizeof( s_block ) );
+
+    archive_block_header* header = block_header();
+    header->magic       = kArchiveMagic;
+    header->version     = kArchiveVersion;
+    header->field_count = kArchiveFields;
+    header->first_time  = when;
+    header->last_time   = when;
+    header->sequence    = s_sequence;
+
+    // first sample goes in raw
+    for( int i = 0; i < kArchiveFields; i++ )
+    {
+        uint32_t bits = float_bits( values[i] );
+        put_bits( bits, 32 );
+        s_fields[i].value    = bits;
+        s_fields[i].leading  = 0xFF;
+        s_fields[i].trailing = 0;
+        header->min[i] = values[i];
+        header->max[i] = values[i];
+    }
+    header->count = 1;
+
+    s_prev_time  = when;
+    s_prev_delta = 0;
+    ++s_stats.blocks;
+}
+
+
+static void index_entry( const archive_block_header* header, uint32_t block, archive_index_entry* entry )
+{
+    entry->first_time = header->first_time;
+    entry->last_time  = header->last_time;
+    entry->block      = block;
+    entry->count      = header->count;
+}
+
+
+static bool write_index_entry( const archive_index_entry* entry )
+{
+    if( s_index_fd < 0 )
+        return false;
+
+    off_t offset = (off_t)entry->block * sizeof( archive_index_entry );
+    return pwrite( s_index_fd, entry, sizeof( archive_index_entry ), offset ) == sizeof( archive_index_entry );
+}
+
+
+static bool write_block( void )
+{
+    archive_block_header* header = block_header();
+    if( s_fd < 0 || !header->count )
+        return false;
+
+    header->checksum = checksum( s_block + sizeof( archive_block_header ), (header->bits + 7) / 8 );
+
+    if( pwrite( s_fd, s_block, sizeof( s_block ), s_block_offset ) != sizeof( s_block ) )
+        return false;
+
+    archive_index_entry entry;
+    index_entry( header, header->sequence, &entry );
+    write_index_entry( &entry );
+
+    s_dirty = 0;
+    ++s_stats.flushes;
+    return true;
+}
+
+
+#pragma mark -
+
+const char* wx_archive_field_name( int field )
+{
+    if( field < 0 || field >= kArchiveFields )
+        return "unknown";
+    return s_field_names[field];
+}
+
+
+int wx_archive_field_from_name( const char* name )
+{
+    for( int i = 0; name && i < kArchiveFields; i++ )
+        if( strcmp( name, s_field_names[i] ) == 0 )
+            return i;
+    return -1;
+}
+
+
+void wx_archive_frame_values( const Frame* frame, float* values )
+{
+    values[kField_temp]      = frame->tempC;
+    values[kField_humidity]  = frame->humidity;
+    values[kField_wind]      = frame->windSpeedMs;
+    values[kField_direction] = frame->windDirection;
+    values[kField_gust]      = frame->windGustMs;
+    values[kField_rain]      = frame->rain;
+    values[kField_intTemp]   = frame->intTempC;
+    values[kField_pressure]  = frame->pressure;
+    values[kField_pm10]      = frame->pm10_standard;
+    values[kField_pm25]      = frame->pm25_standard;
+    values[kField_pm100]     = frame->pm100_standard;
+    values[kField_pm10_env]  = frame->pm10_env;
+    values[kField_pm25_env]  = frame->pm25_env;
+    values[kField_pm100_env] = frame->pm100_env;
+    values[kField_03um]      = frame->particles_03um;
+    values[kField_05um]      = frame->particles_05um;
+    values[kField_10um]      = frame->particles_10um;
+    values[kField_25um]      = frame->particles_25um;
+    values[kField_50um]      = frame->particles_50um;
+    values[kField_100um]     = frame->particles_100um;
+    values[kField_flags]     = frame->flags;
+}
+
+
+// appends to an existing archive, we always start a fresh block so we never have to rebuild the encoder state
+bool wx_archive_open( const char* path )
+{
+    if( !path || s_fd >= 0 )
+        return false;
+
+    s_fd = open( path, O_RDWR | O_CREAT, 0644 );
+    if( s_fd < 0 )
+        return false;
+
+    struct stat info;
+    if( fstat( s_fd, &info ) != 0 )
+    {
+        close( s_fd );
+        s_fd = -1;
+        return false;
+    }
+
+    off_t blocks   = (info.st_size + kArchiveBlockSize - 1) / kArchiveBlockSize;
+    s_block_offset = blocks * kArchiveBlockSize;
+    s_sequence     = (uint32_t)blocks;
+
+    // bring the index up to date in case it's missing or we died before it got written
+    char indexPath[PATH_MAX];
+    wx_archive_index_path( path, indexPath, sizeof( indexPath ) );
+    archive_index_entry* entries = NULL;
+    int                  count   = wx_archive_load_index( s_fd, indexPath, &entries );
+
+    s_index_fd = open( indexPath, O_RDWR | O_CREAT, 0644 );
+    if( s_index_fd >= 0 && count >= 0 )
+    {
+        if( ftruncate( s_index_fd, (off_t)count * sizeof( archive_index_entry ) ) == 0 )
+            for( int i = 0; i < count; i++ )
+                write_index_entry( &entries[i] );
+    }
+    free( entries );
+
+    memset( &s_stats, 0, sizeof( s_stats ) );
+    memset( s_block, 0, sizeof( s_block ) );
+    s_dirty = 0;
+    return true;
+}
+
+
+bool wx_archive_append( time_t when, const Frame* frame )
+{
+    if( s_fd < 0 || !frame )
+        return false;
+
+    float values[kArchiveFields];
+    wx_archive_frame_values( frame, values );
+
+    archive_block_header* header = block_header();
+    int64_t               delta  = (int64_t)when - s_prev_time;
+    int64_t               dod    = delta - s_prev_delta;
+
+    // new block when this one is full (or the clock jumped further than we can encode)
+    if( header->count && (header->bits + kMaxSampleBits > kDataBits || dod > INT32_MAX || dod < INT32_MIN) )
+    {
+        write_block();
+        s_stats.data_bytes += (header->bits + 7) / 8;
+        s_block_offset += kArchiveBlockSize;
+        ++s_sequence;
+        header->count = 0;
+    }
+
+    if( !header->count )
+        start_block( when, values );
+    else
+    {
+        encode_time( dod );
+        for( int i = 0; i < kArchiveFields; i++ )
+        {
+            encode_value( &s_fields[i], float_bits( values[i] ) );
+            if( values[i] < header->min[i] )
+                header->min[i] = values[i];
+            if( values[i] > header->max[i] )
+                header->max[i] = values[i];
+        }
+
+        s_prev_delta = delta;
+        s_prev_time  = when;
+        header->last_time = when;
+        ++header->count;
+    }
+
+    ++s_stats.samples;
+    if( ++s_dirty >= kFlushSamples )
+        return write_block();
+    return true;
+}
+
+
+bool wx_archive_flush( void )
+{
+    return s_dirty ? write_block() : true;
+}
+
+
+void wx_archive_close( void )
+{
+    if( s_fd < 0 )
+        return;
+
+    wx_archive_flush();
+    fsync( s_fd );
+    close( s_fd );
+    s_fd = -1;
+
+    if( s_index_fd >= 0 )
+        close( s_index_fd );
+    s_index_fd = -1;
+}
+
+
+void wx_archive_get_stats( archive_stats* stats )
+{
+    if( !stats )
+        return;
+
+    *stats = s_stats;
+    stats->data_bytes += (block_header()->bits + 7) / 8;   // plus the block in progress
+}
+
+
+#pragma mark -
+
+bool wx_archive_block_valid( const void* block )
+{
+    const archive_block_header* header = (const archive_block_header*)block;
+    if( header->magic != kArchiveMagic || header->version != kArchiveVersion || header->field_count != kArchiveFields )
+        return false;
+    if( !header->count || header->bits > kDataBits )
+        return false;
+
+    return header->checksum == checksum( (const uint8_t*)block + sizeof( archive_block_header ), (header->bits + 7) / 8 );
+}
+
+
+// decodes every sample in a block, returns how many went to the callback or -1 if the block is no good
+int wx_archive_decode_block( const void* block, archive_sample_fn callback, void* context )
+{
+    if( !block || !callback || !wx_archive_block_valid( block ) )
+        return -1;
+
+    const archive_block_header* header = (const archive_block_header*)block;
+
+    bit_reader reader = { (const uint8_t*)block + sizeof( archive_block_header ), header->bits, 0, 0, 0 };
+    uint32_t   values[kArchiveFields];
+    uint8_t    leading[kArchiveFields];
+    uint8_t    trailing[kArchiveFields];
+
+    archive_sample sample;
+    sample.time = header->first_time;
+    for( int i = 0; i < kArchiveFields; i++ )
+    {
+        values[i]        = get_bits( &reader, 32 );
+        leading[i]       = 0;
+        trailing[i]      = 0;
+        sample.values[i] = bits_float( values[i] );
+    }
+
+    if( !callback( &sample, context ) )
+        return 1;
+
+    int64_t delta = 0;
+    for( uint32_t n = 1; n < header->count; n++ )
+    {
+        int64_t dod = 0;
+        if( get_bits( &reader, 1 ) )
+        {
+            if( !get_bits( &reader, 1 ) )
+                dod = sign_extend( get_bits( &reader, 7 ), 7 );
+            else if( !get_bits( &reader, 1 ) )
+                dod = sign_extend( get_bits( &reader, 9 ), 9 );
+            else if( !get_bits( &reader, 1 ) )
+                dod = sign_extend( get_bits( &reader, 12 ), 12 );
+            else
+                dod = (int32_t)get_bits( &reader, 32 );
+        }
+        delta       += dod;
+        sample.time += delta;
+
+        for( int i = 0; i < kArchiveFields; i++ )
+        {
+            if( !get_bits( &reader, 1 ) )
+                continue;
+
+            if( get_bits( &reader, 1 ) )
+            {
+                leading[i] = get_bits( &reader, 5 );
+                int length = get_bits( &reader, 5 ) + 1;
+                trailing[i] = 32 - leading[i] - length;
+            }
+
+            int length = 32 - leading[i] - trailing[i];
+            values[i] ^= get_bits( &reader, length ) << trailing[i];
+            sample.values[i] = bits_float( values[i] );
+        }
+
+        if( !callback( &sample, context ) )
+            return n + 1;
+    }
+
+    return header->count;
+}
+
+
+void wx_archive_index_path( const char* path, char* indexPath, size_t size )
+{
+    snprintf( indexPath, size, "%s.idx", path );
+}
+
+
+// reads the .idx file and fills in anything it's missing (or that looks stale) from the block headers in the archive.
+// returns the number of entries (one per block) or -1, free the entries when done.
+int wx_archive_load_index( int fd, const char* indexPath, archive_index_entry** entries )
+{
+    struct stat info;
+    if( fd < 0 || !entries || fstat( fd, &info ) != 0 )
+        return -1;
+
+    int blocks = (int)(info.st_size / kArchiveBlockSize);
+    *entries = (archive_index_entry*)calloc( blocks ? blocks : 1, sizeof( archive_index_entry ) );
+    if( !*entries )
+        return -1;
+
+    int indexed = 0;
+    int index   = indexPath ? open( indexPath, O_RDONLY ) : -1;
+    if( index >= 0 )
+    {
+        ssize_t got = pread( index, *entries, blocks * sizeof( archive_index_entry ), 0 );
+        if( got > 0 )
+            indexed = (int)(got / sizeof( archive_index_entry ));
+        close( index );
+    }
+
+    // the last entry can lag behind the block that's still being filled, so always redo that one
+    if( indexed > 0 )
+        --indexed;
+
+    for( int i = indexed; i < blocks; i++ )
+    {
+        archive_block_header header;
+        archive_index_entry* entry = &(*entries)[i];
+        if( pread( fd, &header, sizeof( header ), (off_t)i * kArchiveBlockSize ) == sizeof( header ) && header.magic == kArchiveMagic && header.count )
+            index_entry( &header, i, entry );
+        else
+        {
+            // bad block, give it the previous block's end time so the entries stay in order for the search
+            int64_t last = i ? (*entries)[i - 1].last_time : 0;
+            entry->first_time = last;
+            entry->last_time  = last;
+            entry->block      = i;
+            entry->count      = 0;
+        }
+    }
+
+    return blocks;
+}
+
+
+// first block that could have anything at or after when (count if there isn't one)
+int wx_archive_find_block( const archive_index_entry* entries, int count, int64_t when )
+{
+    int low  = 0;
+    int high = count;
+    while( low < high )
+    {
+        int mid = low + (high - low) / 2;
+        if( entries[mid].last_time < when )
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+
+typedef struct
+{
+    int64_t           from;
+    int64_t           to;
+    archive_sample_fn callback;
+    void*             context;
+    bool              stopped;
+} range_reader;
+
+
+static bool range_sample( const archive_sample* sample, void* context )
+{
+    range_reader* reader = (range_reader*)context;
+    if( sample->time < reader->from )
+        return true;
+    if( sample->time > reader->to || !reader->callback( sample, reader->context ) )
+    {
+        reader->stopped = true;
+        return false;
+    }
+    return true;
+}
+
+
+// everything from..to (inclusive) in time order, read only so it's fine to do while the relay is appending
+bool wx_archive_read_range( const char* path, int64_t from, int64_t to, archive_sample_fn callback, void* context, archive_read_stats* stats )
+{
+    static __thread uint8_t block[kArchiveBlockSize];
+
+    archive_read_stats unused;
+    if( !stats )
+        stats = &unused;
+    memset( stats, 0, sizeof( archive_read_stats ) );
+
+    int fd = path ? open( path, O_RDONLY ) : -1;
+    if( fd < 0 )
+        return false;
+    posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+    char indexPath[PATH_MAX];
+    wx_archive_index_path( path, indexPath, sizeof( indexPath ) );
+    archive_index_entry* entries = NULL;
+    int                  count   = wx_archive_load_index( fd, indexPath, &entries );
+
+    range_reader reader = { from, to, callback, context, false };
+    bool         ok     = count >= 0;
+    for( int i = ok ? wx_archive_find_block( entries, count, from ) : 0; ok && i < count && !reader.stopped; i++ )
+    {
+        if( !entries[i].count )
+            continue;
+        if( entries[i].first_time > to )
+            break;
+
+        if( pread( fd, block, sizeof( block ), (off_t)entries[i].block * kArchiveBlockSize ) != sizeof( block ) )
+        {
+            ok = false;
+            break;
+        }
+        stats->blocks_read++;
+
+        if( wx_archive_decode_block( block, range_sample, &reader ) < 0 )
+            stats->blocks_bad++;
+    }
+
+    free( entries );
+    close( fd );
+    return ok;
+}
+
+
+// accepts seconds since the epoch, "now", "-30d" style offsets from now (s, m, h, d, w) or a local "YYYY-MM-DD[ HH:MM[:SS]]"
+bool wx_archive_parse_time( const char* arg, int64_t* when )
+{
+    char*  end = NULL;
+    time_t now = time( NULL );
+
+    if( !arg || !*arg )
+        return false;
+
+    if( strcmp( arg, "now" ) == 0 )
+    {
+        *when = now;
+        return true;
+    }
+
+    if( arg[0] == '-' )
+    {
+        double amount = strtod( arg + 1, &end );
+        if( end == arg + 1 || amount < 0 )
+            return false;
+
+        double scale = 1;
+        switch( *end )
+        {
+            case '\0':
+            case 's': scale = 1;          break;
+            case 'm': scale = 60;         break;
+            case 'h': scale = 3600;       break;
+            case 'd': scale = 86400;      break;
+            case 'w': scale = 7 * 86400;  break;
+            default:  return false;
+        }
+        *when = now - (int64_t)(amount * scale);
+        return true;
+    }
+
+    long long seconds = strtoll( arg, &end, 10 );
+    if( end != arg && *end == '\0' )
+    {
+        *when = seconds;
+        return true;
+    }
+
+    struct tm tm;
+    memset( &tm, 0, sizeof( tm ) );
+    end = strptime( arg, "%Y-%m-%d", &tm );
+    if( !end )
+        return false;
+    if( *end == ' ' || *end == 'T' )
+    {
+        char* rest = strptime( end + 1, "%H:%M:%S", &tm );
+        if( !rest )
+            rest = strptime( end + 1, "%H:%M", &tm );
+        end = rest;
+    }
+    if( !end || *end != '\0' )
+        return false;
+
+    tm.tm_isdst = -1;
+    *when = mktime( &tm );
+    return true;
+}
@@ -0,0 +1,119 @@
+//
+//  wx_archive.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_wx_archive
+#define _H_wx_archive
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "TXDecoderFrame.h"
+
+#define kArchiveBlockSize   4096
+#define kArchiveVersion     1
+
+// every field we keep long term, in the units the Frame has them in
+typedef enum
+{
+    kField_temp = 0,        // °C
+    kField_humidity,        // %
+    kField_wind,            // m/s
+    kField_direction,       // degrees
+    kField_gust,            // m/s
+    kField_rain,            // inches, running total from the sensor
+    kField_intTemp,         // °C
+    kField_pressure,        // millibars
+    kField_pm10,
+    kField_pm25,
+    kField_pm100,
+    kField_pm10_env,
+    kField_pm25_env,
+    kField_pm100_env,
+    kField_03um,
+    kField_05um,
+    kField_10um,
+    kField_25um,
+    kField_50um,
+    kField_100um,
+    kField_flags,
+    kArchiveFields
+} archive_field;
+
+// sits at the front of every block, the time range and min/max let readers skip blocks without decoding them
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t field_count;
+    uint32_t count;             // samples in this block
+    uint32_t bits;              // bits used in the data that follows the header
+    int64_t  first_time;
+    int64_t  last_time;
+    uint32_t sequence;          // block number, in order
+    uint32_t checksum;          // over the data bytes
+    float    min[kArchiveFields];
+    float    max[kArchiveFields];
+} __attribute__ ((__packed__)) archive_block_header;
+
+#define kArchiveDataSize    (kArchiveBlockSize - sizeof( archive_block_header ))
+
+// the sidecar .idx file is one of these per block so readers can find a time without touching the archive
+typedef struct
+{
+    int64_t  first_time;
+    int64_t  last_time;
+    uint32_t block;
+    uint32_t count;             // zero for a block that's no good
+} __attribute__ ((__packed__)) archive_index_entry;
+
+typedef struct
+{
+    int64_t time;
+    float   values[kArchiveFields];
+} archive_sample;
+
+typedef struct
+{
+    uint64_t samples;
+    uint32_t blocks;            // blocks finished or in progress since we opened
+    uint64_t data_bytes;        // compressed bytes used in those blocks
+    uint32_t flushes;
+} archive_stats;
+
+typedef struct
+{
+    uint32_t blocks_read;
+    uint32_t blocks_bad;        // failed the checksum, most likely the one being written
+} archive_read_stats;
+
+// return false to stop decoding
+typedef bool (*archive_sample_fn)( const archive_sample* sample, void* context );
+
+// writing, this is what the relay does
+bool        wx_archive_open( const char* path );
+bool        wx_archive_append( time_t when, const Frame* frame );
+bool        wx_archive_flush( void );
+void        wx_archive_close( void );
+void        wx_archive_get_stats( archive_stats* stats );
+
+// reading
+bool        wx_archive_block_valid( const void* block );
+int         wx_archive_decode_block( const void* block, archive_sample_fn callback, void* context );
+int         wx_archive_load_index( int fd, const char* indexPath, archive_index_entry** entries );
+int         wx_archive_find_block( const archive_index_entry* entries, int count, int64_t when );
+void        wx_archive_index_path( const char* path, char* indexPath, size_t size );
+bool        wx_archive_read_range( const char* path, int64_t from, int64_t to, archive_sample_fn callback, void* context, archive_read_stats* stats );
+
+const char* wx_archive_field_name( int field );
+int         wx_archive_field_from_name( const char* name );
+void        wx_archive_frame_values( const Frame* frame, float* values );
+bool        wx_archive_parse_time( const char* arg, int64_t* when );
+
+#endif // !_H_wx_archive
@@ -0,0 +1,38 @@
+//
+//  wx_clock.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Wall clock seconds for the relay's periods and windows (averages, rain since midnight, the scheduler, packet timestamps).
+//  Replay sets it so a day of captured data can go through the real processing path in a couple of minutes.  Things that
+//  are about actual elapsed time (latencies, logging, socket timeouts, the send queue's pacing) keep using the real clocks.
+//
+
+#include <stdatomic.h>
+
+#include "wx_clock.h"
+
+
+static atomic_llong s_virtual = 0;      // zero means use the real clock
+
+
+
+time_t wx_clock_now( void )
+{
+    long long now = atomic_load_explicit( &s_virtual, memory_order_relaxed );
+    return now ? (time_t)now : time( NULL );
+}
+
+
+void wx_clock_set( time_t now )
+{
+    atomic_store_explicit( &s_virtual, (long long)now, memory_order_relaxed );
+}
+
+
+bool wx_clock_is_virtual( void )
+{
+    return atomic_load_explicit( &s_virtual, memory_order_relaxed ) != 0;
+}
@@ -0,0 +1,21 @@
+//
+//  wx_clock.h
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+
+#ifndef _H_wx_clock
+#define _H_wx_clock
+
+#include <stdbool.h>
+#include <time.h>
+
+// the relay's idea of now, everything with a period or a window asks this instead of time( NULL ).  It's the real clock
+// unless a replay has taken it over, then it only moves when the replay moves it.
+time_t wx_clock_now( void );
+void   wx_clock_set( time_t now );
+bool   wx_clock_is_virtual( void );
+
+#endif // !_H_wx_clock
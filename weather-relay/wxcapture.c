@@ -0,0 +1,122 @@
+//
+//  wxcapture.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Prints a raw receiver capture (wxrelay --capture) one read per line: wall clock time, which receiver (wx1 is the second
+//  --device), the gap since the last read from that receiver, the bytes in hex and, when a read holds a whole frame, what the
+//  relay would have made of it.
+//
+//  usage: wxcapture [-s wx|rain] capture-file...
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "TXDecoderFrame.h"
+
+
+static int s_source = -1;      // all of them
+
+
+
+static void print_frame( const uint8_t* data, size_t length, capture_source source )
+{
+    if( source == kCapture_wx && length == sizeof( Frame ) )
+    {
+        Frame frame;
+        memcpy( &frame, data, sizeof( Frame ) );
+        printf( "  station %u flags 0x%02x temp %.1fC humidity %u%% wind %.1fm/s @ %.0f gust %.1fm/s rain %.2fmm\n", frame.station_id, frame.flags, frame.tempC,
+                frame.humidity, frame.windSpeedMs, frame.windDirection, frame.windGustMs, frame.rain );
+    }
+    else if( source == kCapture_rain && length == sizeof( RainFrame ) )
+    {
+        RainFrame frame;
+        memcpy( &frame, data, sizeof( RainFrame ) );
+        printf( "  raw rain count %u\n", frame.raw_rain_count );
+    }
+}
+
+
+static int dump( const char* path )
+{
+    capture_reader* reader = capture_open( path );
+    if( !reader )
+    {
+        fprintf( stderr, "%s: not a capture file\n", path );
+        return -1;
+    }
+
+    static uint64_t last[kCapture_count][256];      // by channel
+    capture_record record;
+    uint8_t        data[kCaptureChunkMax];
+    int            length;
+    while( (length = capture_next( reader, &record, data, sizeof( data ) )) > 0 )
+    {
+        if( s_source >= 0 && record.source != s_source )
+            continue;
+
+        time_t    secs = (time_t)(record.wall_us / 1000000);
+        struct tm tm;
+        localtime_r( &secs, &tm );
+
+        double gap = 0;
+        if( record.source < kCapture_count )
+        {
+            if( last[record.source][record.channel] )
+                gap = (record.monotonic_ns - last[record.source][record.channel]) / 1e6;
+            last[record.source][record.channel] = record.monotonic_ns;
+        }
+
+        char receiver[16];
+        snprintf( receiver, sizeof( receiver ), "%s%u", capture_source_name( record.source ), record.channel );
+        printf( "%d-%02d-%02d %02d:%02d:%02d.%06lld %-6s %+10.3f ms %3d:", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                (long long)(record.wall_us % 1000000), receiver, gap, length );
+        for( int i = 0; i < length; i++ )
+            printf( " %02x", data[i] );
+        putchar( '\n' );
+
+        print_frame( data, length, record.source );
+    }
+
+    if( length < 0 )
+        fprintf( stderr, "%s: truncated or corrupt record\n", path );
+    capture_close( reader );
+    return length;
+}
+
+
+int main( int argc, char* argv[] )
+{
+    int opt;
+    while( (opt = getopt( argc, argv, "s:" )) != -1 )
+    {
+        switch( opt )
+        {
+            case 's':
+                s_source = strcmp( optarg, "rain" ) == 0 ? kCapture_rain : kCapture_wx;
+                break;
+            default:
+                fprintf( stderr, "usage: %s [-s wx|rain] capture-file...\n", argv[0] );
+                return EXIT_FAILURE;
+        }
+    }
+
+    if( optind >= argc )
+    {
+        fprintf( stderr, "usage: %s [-s wx|rain] capture-file...\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    int result = EXIT_SUCCESS;
+    for( int i = optind; i < argc; i++ )
+        if( dump( argv[i] ) < 0 )
+            result = EXIT_FAILURE;
+    return result;
+}
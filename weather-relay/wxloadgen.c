@@ -0,0 +1,305 @@
+//
+//  wxloadgen.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Feeds the relay made up receiver traffic (see loadgen.c) through a pty or a FIFO it opens like the serial port, so we can find
+//  where ingest, stats and formatting fall over before we buy more sensors.  -x is the multiple of the production rate, one frame
+//  per station every 5 seconds, and the simulated clock runs that much faster too so a day of weather goes by in 86 seconds at
+//  1000x.  Writes block when the relay falls behind, so the achieved rate in the once a second report is what it kept up with.
+//
+//  usage: wxloadgen [-n stations] [-x speedup] [-t seconds] [-c crc%] [-d drop%] [-g gusts/hour] [-s seed] [-r pty|rain-fifo] pty|wx-fifo
+//
+//  wxloadgen -n 8 -x 100 -r pty pty
+//  wxrelay --device /dev/pts/3 --rain /dev/pts/4 ...
+//
+
+#define _GNU_SOURCE     // posix_openpt, ptsname
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "loadgen.h"
+
+
+#define kReportPeriodNs     1000000000ull
+#define kStallNs            1000000ull      // a write that blocks this long means the relay isn't keeping up
+
+
+typedef struct
+{
+    int  fd;
+    int  slave;         // we keep the pty's other end open so the writes don't fail between relay runs
+    char name[64];
+} output;
+
+
+static volatile sig_atomic_t s_quit = 0;
+
+
+
+static uint64_t monotonic_ns( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+static void sleep_until( uint64_t due )
+{
+    struct timespec ts = { .tv_sec = (time_t)(due / 1000000000ull), .tv_nsec = (long)(due % 1000000000ull) };
+    while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR && !s_quit )
+        ;
+}
+
+
+static void handle_signal( int sig )
+{
+    s_quit = 1;
+}
+
+
+static void usage( const char* name )
+{
+    fprintf( stderr, "usage: %s [-n stations] [-x speedup] [-t seconds] [-c crc%%] [-d drop%%] [-g gusts/hour] [-s seed] [-r pty|rain-fifo] pty|wx-fifo\n", name );
+}
+
+
+
+#pragma mark -
+
+static bool open_pty( output* out )
+{
+    out->fd = posix_openpt( O_RDWR | O_NOCTTY );
+    if( out->fd < 0 || grantpt( out->fd ) != 0 || unlockpt( out->fd ) != 0 )
+        return false;
+
+    const char* name = ptsname( out->fd );
+    if( !name )
+        return false;
+    snprintf( out->name, sizeof( out->name ), "%s", name );
+
+    // raw, so the line discipline doesn't eat our CRs and ^Cs before the relay sets it up
+    out->slave = open( out->name, O_RDWR | O_NOCTTY );
+    if( out->slave < 0 )
+        return false;
+
+    struct termios tio;
+    if( tcgetattr( out->slave, &tio ) == 0 )
+    {
+        cfmakeraw( &tio );
+        tcsetattr( out->slave, TCSANOW, &tio );
+    }
+    return true;
+}
+
+
+static bool open_fifo( output* out, const char* path )
+{
+    if( mkfifo( path, 0666 ) != 0 && errno != EEXIST )
+        return false;
+
+    snprintf( out->name, sizeof( out->name ), "%s", path );
+    fprintf( stderr, "wxloadgen: waiting for a reader on %s...\n", path );
+    out->fd = open( path, O_WRONLY );
+    return out->fd >= 0;
+}
+
+
+static bool open_output( output* out, const char* spec )
+{
+    out->fd    = -1;
+    out->slave = -1;
+    bool ok    = strcmp( spec, "pty" ) == 0 ? open_pty( out ) : open_fifo( out, spec );
+    if( !ok )
+        fprintf( stderr, "wxloadgen: can't open %s: %s\n", spec, strerror( errno ) );
+    return ok;
+}
+
+
+static void close_output( output* out )
+{
+    if( out->fd >= 0 )
+        close( out->fd );
+    if( out->slave >= 0 )
+        close( out->slave );
+    out->fd = out->slave = -1;
+}
+
+
+// false when the reader went away
+static bool write_all( int fd, const uint8_t* data, size_t length, uint64_t* stalledNs )
+{
+    uint64_t start = monotonic_ns();
+    while( length )
+    {
+        ssize_t result = write( fd, data, length );
+        if( result < 0 )
+        {
+            if( errno == EINTR && !s_quit )
+                continue;
+            return false;
+        }
+        data   += result;
+        length -= result;
+    }
+
+    uint64_t elapsed = monotonic_ns() - start;
+    if( elapsed >= kStallNs )
+        *stalledNs += elapsed;
+    return true;
+}
+
+
+
+#pragma mark -
+
+int main( int argc, char* argv[] )
+{
+    loadgen_config config;
+    loadgen_default_config( &config );
+
+    double      speedup  = 1;
+    double      duration = 0;
+    const char* rainSpec = NULL;
+
+    int opt;
+    while( (opt = getopt( argc, argv, "n:x:t:c:d:g:s:r:" )) != -1 )
+    {
+        switch( opt )
+        {
+            case 'n':
+                config.stations = atoi( optarg );
+                break;
+            case 'x':
+                speedup = atof( optarg );
+                break;
+            case 't':
+                duration = atof( optarg );
+                break;
+            case 'c':
+                config.crcErrorRate = atof( optarg ) / 100.0;
+                break;
+            case 'd':
+                config.dropRate = atof( optarg ) / 100.0;
+                break;
+            case 'g':
+                config.gustsPerHour = atof( optarg );
+                break;
+            case 's':
+                config.seed = (uint32_t)strtoul( optarg, NULL, 0 );
+                break;
+            case 'r':
+                rainSpec = optarg;
+                break;
+            default:
+                usage( argv[0] );
+                return EXIT_FAILURE;
+        }
+    }
+
+    if( optind != argc - 1 || speedup <= 0 )
+    {
+        usage( argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    loadgen* gen = loadgen_create( &config );
+    if( !gen )
+    {
+        fprintf( stderr, "wxloadgen: stations must be 1 to %d\n", kLoadgenMaxStations );
+        return EXIT_FAILURE;
+    }
+
+    signal( SIGINT, handle_signal );
+    signal( SIGTERM, handle_signal );
+    signal( SIGPIPE, SIG_IGN );
+
+    output wx   = { .fd = -1, .slave = -1 };
+    output rain = { .fd = -1, .slave = -1 };
+    if( !open_output( &wx, argv[optind] ) || (rainSpec && !open_output( &rain, rainSpec )) )
+        return EXIT_FAILURE;
+
+    // this is the line to cut and paste into wxrelay's arguments
+    printf( "--device %s", wx.name );
+    if( rainSpec )
+        printf( " --rain %s", rain.name );
+    printf( "\n" );
+    fflush( stdout );
+
+    // every station sends once a period, spread evenly over it, and the rain gauge once a period too
+    double   wxRate  = config.stations * speedup / kLoadgenFramePeriod;
+    uint64_t spacing = (uint64_t)(1e9 / wxRate);
+    time_t   simStart = time( NULL );
+    fprintf( stderr, "wxloadgen: %d stations at %gx, %.1f frames/sec\n", config.stations, speedup, wxRate );
+
+    uint64_t start      = monotonic_ns();
+    uint64_t nextReport = start + kReportPeriodNs;
+    uint64_t lastReport = start;
+    uint64_t lastFrames = 0;
+    uint64_t stalledNs  = 0;
+    uint8_t  buffer[sizeof( Frame )];
+
+    for( uint64_t count = 0; !s_quit; count++ )
+    {
+        uint64_t due = start + count * spacing;
+        if( duration > 0 && due - start >= (uint64_t)(duration * 1e9) )
+            break;
+        sleep_until( due );
+
+        time_t when   = simStart + (time_t)(count * kLoadgenFramePeriod / config.stations);
+        size_t length = loadgen_wx_bytes( gen, when, buffer, sizeof( buffer ) );
+        if( !write_all( wx.fd, buffer, length, &stalledNs ) )
+        {
+            fprintf( stderr, "wxloadgen: %s went away\n", wx.name );
+            break;
+        }
+
+        if( rain.fd >= 0 && count % config.stations == 0 )
+        {
+            length = loadgen_rain_bytes( gen, when, buffer, sizeof( buffer ) );
+            if( !write_all( rain.fd, buffer, length, &stalledNs ) )
+            {
+                fprintf( stderr, "wxloadgen: %s went away\n", rain.name );
+                break;
+            }
+        }
+
+        uint64_t now = monotonic_ns();
+        if( now >= nextReport )
+        {
+            loadgen_stats stats;
+            loadgen_get_stats( gen, &stats );
+            double elapsed = (now - start) / 1e9;
+            fprintf( stderr, "wxloadgen: %.0fs wx: %llu (%.1f/sec, want %.1f), rain: %llu, bytes: %llu, bad crc: %llu, short: %llu, stalled: %.0fms\n",
+                     elapsed, (unsigned long long)stats.wx_frames, (stats.wx_frames - lastFrames) / ((now - lastReport) / 1e9), wxRate,
+                     (unsigned long long)stats.rain_frames, (unsigned long long)stats.bytes, (unsigned long long)stats.corrupted,
+                     (unsigned long long)stats.short_frames, stalledNs / 1e6 );
+            lastFrames = stats.wx_frames;
+            lastReport = now;
+            nextReport = now + kReportPeriodNs;
+        }
+    }
+
+    loadgen_stats stats;
+    loadgen_get_stats( gen, &stats );
+    double elapsed = (monotonic_ns() - start) / 1e9;
+    fprintf( stderr, "wxloadgen: sent %llu wx and %llu rain frames in %.1fs, %.1f frames/sec, stalled %.0fms\n", (unsigned long long)stats.wx_frames,
+             (unsigned long long)stats.rain_frames, elapsed, elapsed > 0 ? stats.wx_frames / elapsed : 0, stalledNs / 1e6 );
+
+    close_output( &wx );
+    close_output( &rain );
+    loadgen_destroy( gen );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,400 @@
+//
+//  wxquery.c
+//  weather-relay
+//
+//  Created by Alex Lelievre on 10/18/26.
+//  Copyright © 2026 Far Out Labs. All rights reserved.
+//
+//  Pulls a time range out of the long term archive as CSV or JSON, e.g. "temp_c,pressure_mb for the last 30 days at 1 hour".
+//  It binary searches the .idx file for the first block, preads just the blocks in the range and stops at the first one that
+//  starts past the end.  Everything is opened read only so it's fine to run while the relay is writing, the block still being
+//  filled might be mid-write and fail its checksum, we just skip it.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wx_archive.h"
+
+
+#define kQueryDefaultArchive   "/var/log/wx_archive.bin"
+
+
+typedef enum
+{
+    kFormat_csv,
+    kFormat_json
+} query_format;
+
+typedef struct
+{
+    int          fields[kArchiveFields];
+    int          field_count;
+    int64_t      start;
+    int64_t      end;
+    int64_t      resolution;            // seconds per row, 0 for every sample
+    query_format format;
+    FILE*        out;
+
+    // running bucket when we're averaging
+    int64_t      bucket;
+    uint32_t     bucket_count;
+    double       sums[kArchiveFields];
+
+    uint64_t           rows;
+    uint64_t           samples;
+    archive_read_stats read_stats;
+} query;
+
+
+static const char* s_archive_path = kQueryDefaultArchive;
+
+
+
+#pragma mark -
+
+// most fields are whole numbers (humidity, counts, flags...) and printf is most of the cost of a raw export, so do those by hand
+static char* format_value( char* p, float value )
+{
+    if( value == (float)(int32_t)value )
+    {
+        char     digits[12];
+        int      len       = 0;
+        int32_t  whole     = (int32_t)value;
+        uint32_t magnitude = whole < 0 ? -(uint32_t)whole : (uint32_t)whole;
+        do
+        {
+            digits[len++] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while( magnitude );
+
+        if( whole < 0 )
+            *p++ = '-';
+        while( len )
+            *p++ = digits[--len];
+        return p;
+    }
+    return p + sprintf( p, "%.7g", value );
+}
+
+
+static void write_row( query* q, int64_t when, const float* values )
+{
+    char  row[kArchiveFields * 48 + 64];
+    char* p = row;
+
+    if( q->format == kFormat_json )
+        p += sprintf( p, "%s\n  {\"time\":%lld", q->rows ? "," : "", (long long)when );
+    else
+        p += sprintf( p, "%lld", (long long)when );
+
+    for( int i = 0; i < q->field_count; i++ )
+    {
+        int field = q->fields[i];
+        if( q->format == kFormat_json )
+            p += sprintf( p, ",\"%s\":", wx_archive_field_name( field ) );
+        else
+            *p++ = ',';
+        if( isfinite( values[field] ) )
+            p = format_value( p, values[field] );
+        else if( q->format == kFormat_json )
+            p = stpcpy( p, "null" );
+    }
+
+    *p++ = q->format == kFormat_json ? '}' : '\n';
+    fwrite( row, 1, p - row, q->out );
+    q->rows++;
+}
+
+
+static void flush_bucket( query* q )
+{
+    if( !q->bucket_count )
+        return;
+
+    float values[kArchiveFields];
+    for( int i = 0; i < q->field_count; i++ )
+    {
+        int field = q->fields[i];
+        values[field] = (float)(q->sums[field] / q->bucket_count);
+    }
+    write_row( q, q->bucket, values );
+
+    q->bucket_count = 0;
+    memset( q->sums, 0, sizeof( q->sums ) );
+}
+
+
+static bool query_sample( const archive_sample* sample, void* context )
+{
+    query* q = (query*)context;
+
+    q->samples++;
+    if( !q->resolution )
+    {
+        write_row( q, sample->time, sample->values );
+        return true;
+    }
+
+    int64_t bucket = sample->time - (sample->time % q->resolution);
+    if( bucket != q->bucket )
+    {
+        flush_bucket( q );
+        q->bucket = bucket;
+    }
+
+    for( int i = 0; i < q->field_count; i++ )
+    {
+        int field = q->fields[i];
+        q->sums[field] += sample->values[field];
+    }
+    q->bucket_count++;
+    return true;
+}
+
+
+static bool run_query( const char* path, query* q )
+{
+    q->rows = q->samples = 0;
+    q->bucket_count = 0;
+    q->bucket = 0;
+    memset( q->sums, 0, sizeof( q->sums ) );
+    memset( &q->read_stats, 0, sizeof( q->read_stats ) );
+
+    if( q->format == kFormat_json )
+        fputs( "[", q->out );
+    else
+    {
+        fputs( "time", q->out );
+        for( int i = 0; i < q->field_count; i++ )
+            fprintf( q->out, ",%s", wx_archive_field_name( q->fields[i] ) );
+        fputs( "\n", q->out );
+    }
+
+    bool ok = wx_archive_read_range( path, q->start, q->end, query_sample, q, &q->read_stats );
+    flush_bucket( q );
+
+    fputs( q->format == kFormat_json ? "\n]\n" : "", q->out );
+    return ok;
+}
+
+
+
+#pragma mark -
+
+static bool parse_fields( const char* arg, query* q )
+{
+    q->field_count = 0;
+    if( strcmp( arg, "all" ) == 0 )
+    {
+        for( int i = 0; i < kArchiveFields; i++ )
+            q->fields[q->field_count++] = i;
+        return true;
+    }
+
+    char  list[256];
+    char* save = NULL;
+    strncpy( list, arg, sizeof( list ) - 1 );
+    list[sizeof( list ) - 1] = '\0';
+
+    for( char* name = strtok_r( list, ",", &save ); name; name = strtok_r( NULL, ",", &save ) )
+    {
+        int field = wx_archive_field_from_name( name );
+        if( field < 0 )
+        {
+            fprintf( stderr, "wxquery: unknown field: %s\n", name );
+            return false;
+        }
+        if( q->field_count < kArchiveFields )
+            q->fields[q->field_count++] = field;
+    }
+    return q->field_count > 0;
+}
+
+
+static double elapsed_ms( const struct timespec* start )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+
+static int64_t newest_time( const char* path )
+{
+    int fd = open( path, O_RDONLY );
+    if( fd < 0 )
+        return 0;
+
+    char indexPath[PATH_MAX];
+    wx_archive_index_path( path, indexPath, sizeof( indexPath ) );
+    archive_index_entry* entries = NULL;
+    int                  count   = wx_archive_load_index( fd, indexPath, &entries );
+
+    int64_t newest = 0;
+    for( int i = count - 1; i >= 0 && !newest; i-- )
+        if( entries[i].count )
+            newest = entries[i].last_time;
+
+    free( entries );
+    close( fd );
+    return newest;
+}
+
+
+// times a day, a month and a year back from the newest sample, output goes to /dev/null so this is just seek + decode
+static void bench( const char* path, query* q )
+{
+    static const struct { const char* name; int64_t span; } ranges[] = {
+        { "1 day",   86400 },
+        { "1 month", 30 * 86400 },
+        { "1 year",  365 * 86400 },
+    };
+
+    q->out = fopen( "/dev/null", "w" );
+    if( !q->out )
+        return;
+
+    int64_t newest = newest_time( path );
+    for( int r = 0; r < sizeof( ranges ) / sizeof( ranges[0] ) && newest; r++ )
+    {
+        q->end   = newest;
+        q->start = newest - ranges[r].span;
+
+        // the index gets loaded again every time, that's part of what a real query pays
+        struct timespec start;
+        clock_gettime( CLOCK_MONOTONIC, &start );
+        run_query( path, q );
+        double ms = elapsed_ms( &start );
+
+        printf( "%-8s %9llu samples %7llu rows %6u blocks %9.2f ms\n", ranges[r].name, (unsigned long long)q->samples, (unsigned long long)q->rows, q->read_stats.blocks_read, ms );
+    }
+    fclose( q->out );
+}
+
+
+
+#pragma mark -
+
+void usage( int argc, const char* argv[] )
+{
+    printf( "Usage: %s [OPTION...]\n\n", argv[0] );
+    printf( "Try `%s --help' for more information.\n", argv[0] );
+}
+
+
+void help( int argc, const char* argv[] )
+{
+    printf( "Usage: %s [OPTION...]\n\n", argv[0] );
+    printf( "Options:\n\
+            -H, --help                 Show this help and exit.\n\
+            -a, --archive=path         Archive to read (default: %s).\n\
+            -f, --fields=list          Comma separated field names or all (default: all).\n\
+            -s, --start=time           Start of the range (default: -1d).\n\
+            -e, --end=time             End of the range (default: now).\n\
+            -r, --resolution=secs      Average samples into rows this many seconds apart (default: 0, every sample).\n\
+            -j, --json                 Write JSON instead of CSV.\n\
+            -B, --bench                Time 1 day, 1 month and 1 year queries ending at the newest sample.\n\
+\n\
+            Times are seconds since the epoch, now, an offset like -30d (s, m, h, d, w) or YYYY-MM-DD[ HH:MM[:SS]] local time.\n\
+            Fields:", kQueryDefaultArchive );
+    for( int i = 0; i < kArchiveFields; i++ )
+        printf( " %s", wx_archive_field_name( i ) );
+    printf( "\n\n" );
+}
+
+
+int main( int argc, const char* argv[] )
+{
+    int  c            = '\0';   /* for getopt_long() */
+    int  option_index = 0;      /* for getopt_long() */
+    bool benchmark    = false;
+
+    query q;
+    memset( &q, 0, sizeof( q ) );
+    q.format = kFormat_csv;
+    q.out    = stdout;
+    parse_fields( "all", &q );
+    wx_archive_parse_time( "-1d", &q.start );
+    wx_archive_parse_time( "now", &q.end );
+
+    const static struct option long_options[] = {
+        {"help",        no_argument,       0, 'H'},
+        {"archive",     required_argument, 0, 'a'},
+        {"fields",      required_argument, 0, 'f'},
+        {"start",       required_argument, 0, 's'},
+        {"end",         required_argument, 0, 'e'},
+        {"resolution",  required_argument, 0, 'r'},
+        {"json",        no_argument,       0, 'j'},
+        {"bench",       no_argument,       0, 'B'},
+        {0, 0, 0, 0}
+    };
+
+    while( (c = getopt_long( argc, (char* const*)argv, "Ha:f:s:e:r:jB", long_options, &option_index )) != -1 )
+    {
+        switch( c )
+        {
+            case 'H':
+                help( argc, argv );
+                exit( EXIT_SUCCESS );
+
+            case 'a':
+                s_archive_path = optarg;
+                break;
+
+            case 'f':
+                if( !parse_fields( optarg, &q ) )
+                    exit( EXIT_FAILURE );
+                break;
+
+            case 's':
+            case 'e':
+                if( !wx_archive_parse_time( optarg, c == 's' ? &q.start : &q.end ) )
+                {
+                    fprintf( stderr, "wxquery: can't make sense of time: %s\n", optarg );
+                    exit( EXIT_FAILURE );
+                }
+                break;
+
+            case 'r':
+                q.resolution = strtoll( optarg, NULL, 10 );
+                if( q.resolution < 0 )
+                    q.resolution = 0;
+                break;
+
+            case 'j':
+                q.format = kFormat_json;
+                break;
+
+            case 'B':
+                benchmark = true;
+                break;
+
+            case '?':
+                usage( argc, argv );
+                exit( EXIT_FAILURE );
+        }
+    }
+
+    if( benchmark )
+    {
+        bench( s_archive_path, &q );
+        return EXIT_SUCCESS;
+    }
+
+    bool ok = run_query( s_archive_path, &q );
+    if( !ok )
+        fprintf( stderr, "wxquery: failed to read archive: %s (%d)\n", s_archive_path, errno );
+    if( q.read_stats.blocks_bad )
+        fprintf( stderr, "wxquery: skipped %u bad blocks\n", q.read_stats.blocks_bad );
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}